@@ -0,0 +1,88 @@
+/*!
+ * @file
+ * @brief The BufferedSerial of the M66 driver, received by DMA (ModemSerial).
+ *
+ * The M66 AT parser (mbed-os-quectelM66-driver at the revision of its .lib)
+ * talks to the modem through a BufferedSerial, which receives with an
+ * interrupt per byte. .mbedignore leaves the driver's copy out of the build
+ * and the parser finds this header instead, so M66Interface runs on
+ * ModemSerial without changes to the driver. The interface is the one of the
+ * BufferedSerial the driver comes with, the buffer sizes are replaced by
+ * MODEM_RX_RING_SIZE and sending is not buffered.
+ *
+ * @date 2017-04-30
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _BUFFERED_SERIAL_H_
+#define _BUFFERED_SERIAL_H_
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modem_serial.h"
+
+class BufferedSerial : public ModemSerial {
+public:
+    BufferedSerial(PinName tx, PinName rx, uint32_t buf_size = 256, uint32_t tx_multiple = 4, const char *name = NULL)
+            : ModemSerial(tx, rx) {
+        (void) buf_size;
+        (void) tx_multiple;
+        (void) name;
+        start();
+    }
+
+    virtual ~BufferedSerial() {}
+
+    virtual int readable() { return ModemSerial::readable(); }
+
+    virtual int writeable() { return RawSerial::writeable(); }
+
+    virtual int getc() { return ModemSerial::getc(); }
+
+    virtual int putc(int c) { return ModemSerial::putc(c); }
+
+    virtual int puts(const char *s) { return ModemSerial::write((const uint8_t *) s, (int) strlen(s)); }
+
+    virtual ssize_t write(const void *s, std::size_t length) {
+        return ModemSerial::write((const uint8_t *) s, (int) length);
+    }
+
+    virtual int printf(const char *format, ...) {
+        char line[128];
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (len < 0) return len;
+        if (len < (int) sizeof(line)) return ModemSerial::write((const uint8_t *) line, len);
+
+        // longer than an AT command line
+        char *formatted = (char *) malloc((size_t) len + 1);
+        if (!formatted) return -1;
+        va_start(args, format);
+        vsnprintf(formatted, (size_t) len + 1, format, args);
+        va_end(args);
+        const int written = ModemSerial::write((const uint8_t *) formatted, len);
+        free(formatted);
+        return written;
+    }
+};
+
+#endif // _BUFFERED_SERIAL_H_
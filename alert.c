@@ -0,0 +1,61 @@
+/*!
+ * @file
+ * @brief Threshold alert detection with hysteresis and rate limiting.
+ *
+ * @date 2017-03-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "alert.h"
+
+void alert_init(alert_state_t *state) {
+    memset(state, 0, sizeof(alert_state_t));
+}
+
+alert_event_t alert_check(alert_state_t *state, int value, int threshold, int hysteresis,
+                          uint32_t min_interval_ms, uint32_t now_ms) {
+    if (state->active) {
+        if (value < threshold - hysteresis) {
+            state->active = false;
+            // an excursion that was suppressed by the rate limit is not cleared either
+            if (state->reported) {
+                state->reported = false;
+                // the rate limit applies within an excursion, the next one is raised right away
+                state->last_alert_ms = 0;
+                return ALERT_CLEARED;
+            }
+        }
+    } else if (value > threshold) {
+        state->active = true;
+        state->reported = false;
+    }
+
+    if (!state->active) return ALERT_NONE;
+
+    // the first alert of an excursion is never rate limited
+    const bool allowed = state->last_alert_ms == 0 || now_ms - state->last_alert_ms >= min_interval_ms;
+    if (!allowed) return ALERT_NONE;
+
+    state->last_alert_ms = now_ms ? now_ms : 1;
+    if (state->reported) return ALERT_REPEAT;
+
+    state->reported = true;
+    return ALERT_RAISED;
+}
@@ -0,0 +1,73 @@
+/*!
+ * @file
+ * @brief Threshold alert detection with hysteresis and rate limiting.
+ *
+ * The detector is fed every sensor sample and reports threshold crossings.
+ * An alert is raised when the value exceeds the threshold and cleared only
+ * after it dropped below threshold - hysteresis. While the condition persists
+ * the alert is repeated at most once per minimum re-alert interval.
+ *
+ * @date 2017-03-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _ALERT_H_
+#define _ALERT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! alert events reported by the detector (also sent as "ev" in the alert message)
+typedef enum {
+    ALERT_NONE = 0,     //!< nothing to report
+    ALERT_RAISED = 1,   //!< value crossed the threshold
+    ALERT_REPEAT = 2,   //!< condition persists, re-alert interval expired
+    ALERT_CLEARED = 3   //!< value dropped below threshold - hysteresis
+} alert_event_t;
+
+//! alert detector state
+typedef struct {
+    uint8_t active;             //!< value is currently above the threshold
+    uint8_t reported;           //!< the current excursion has been reported
+    uint32_t last_alert_ms;     //!< time of the last raise/repeat event, 0 after a clear
+} alert_state_t;
+
+//! @brief Reset the detector state
+void alert_init(alert_state_t *state);
+
+/*!
+ * @brief Feed a new sample into the detector.
+ * @param state the detector state
+ * @param value the sampled value
+ * @param threshold the alert threshold (same unit as value)
+ * @param hysteresis the distance below threshold required to clear the alert
+ * @param min_interval_ms the minimum time between two raise/repeat events of one excursion
+ * @param now_ms the current time in milliseconds
+ * @return the event to report or ALERT_NONE
+ */
+alert_event_t alert_check(alert_state_t *state, int value, int threshold, int hysteresis,
+                          uint32_t min_interval_ms, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ALERT_H_
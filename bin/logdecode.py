@@ -0,0 +1,122 @@
+#! /usr/bin/env python3
+"""
+Decode binary log frames (firmware built with LOG_BINARY).
+
+The firmware writes the address of the format string and the raw arguments,
+the format strings are looked up in the ELF file of the same build.
+
+usage: logdecode.py <firmware.elf> [<capture file>]   (reads stdin if no capture is given)
+"""
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+TYPE_TEXT, TYPE_DUMP = 1, 2
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?([lhjzt]*)([a-zA-Z%])")
+
+
+class Elf(object):
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("not a 32 bit ELF file")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            if sh_type == 1 and addr:  # SHT_PROGBITS, loaded
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for start, offset, size in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                return self.data[pos:self.data.index(b"\0", pos)].decode("latin-1")
+        return "<unknown format 0x%08x>" % addr
+
+
+def format_args(fmt, args):
+    out, pos, last = [], 0, 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, precision, _, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+
+        def word():
+            nonlocal pos
+            value, = struct.unpack_from("<I", args, pos)
+            pos += 4
+            return value
+
+        if width == "*":
+            width = str(word())
+        if precision == "*":
+            precision = str(word())
+        spec = "%" + flags + (width or "") + ("." + precision if precision else "")
+        if conv == "s":
+            n = args[pos]
+            out.append((spec + "s") % args[pos + 1:pos + 1 + n].decode("latin-1"))
+            pos += 1 + n
+        elif conv in "fge":
+            out.append((spec + conv) % struct.unpack("<f", struct.pack("<I", word()))[0])
+        elif conv in "di":
+            out.append((spec + "d") % struct.unpack("<i", struct.pack("<I", word()))[0])
+        elif conv == "c":
+            out.append(chr(word() & 0xff))
+        elif conv == "p":
+            out.append("0x%08x" % word())
+        else:
+            out.append((spec + conv) % word())
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def dump(prefix, b):
+    lines = []
+    for i in range(0, len(b), 16):
+        chunk = b[i:i + 16]
+        hexpart = "".join("%02x%s" % (c, " " if j % 2 else "") for j, c in enumerate(chunk))
+        text = "".join(chr(c) if 0x20 <= c <= 0x7E else "." for c in chunk)
+        lines.append("%s %06x: %-40s %s" % (prefix, i, hexpart, text))
+    return "\r\n".join(lines) + "\r\n"
+
+
+def decode(elf, data):
+    pos = 0
+    while pos + 9 <= len(data):
+        if data[pos] != SYNC:
+            pos += 1
+            continue
+        level, rtype, length = data[pos + 1], data[pos + 2], struct.unpack_from("<H", data, pos + 3)[0]
+        timestamp, = struct.unpack_from("<I", data, pos + 5)
+        body = data[pos + 9:pos + 9 + length]
+        pos += 9 + length
+        if len(body) < 4:
+            break
+        addr, = struct.unpack_from("<I", body, 0)
+        if rtype == TYPE_TEXT:
+            text = format_args(elf.string(addr), body[4:])
+        elif rtype == TYPE_DUMP:
+            text = dump(elf.string(addr), body[4:])
+        else:
+            continue
+        sys.stdout.write("%10d %s %s" % (timestamp, LEVELS.get(level, "?"), text))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write(__doc__)
+        sys.exit(1)
+    elf = Elf(sys.argv[1])
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], "rb") as f:
+            decode(elf, f.read())
+    else:
+        decode(elf, sys.stdin.buffer.read())
@@ -0,0 +1,138 @@
+/*!
+ * @file
+ * @brief BME280 register map and compensation.
+ *
+ * @date 2017-04-10
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "bme280.h"
+
+// typical supply currents (datasheet table 1) in uA, the sleep current in nA
+#define BME280_CURRENT_T 350
+#define BME280_CURRENT_P 714
+#define BME280_CURRENT_H 340
+#define BME280_CURRENT_SLEEP 100
+
+#define BME280_PROFILE_ENTRY(id, name, osrs_t, osrs_p, osrs_h, filter) {name, osrs_t, osrs_p, osrs_h, filter},
+static const bme280_profile_t profiles[BME280_PROFILE_COUNT] = {
+    BME280_PROFILES(BME280_PROFILE_ENTRY)
+};
+#undef BME280_PROFILE_ENTRY
+
+#define U16(b, i) ((uint16_t) ((b)[(i) + 1] << 8 | (b)[i]))
+#define S16(b, i) ((int16_t) U16(b, i))
+
+void bme280_parse_calib(bme280_calib_t *calib, const uint8_t *tp, const uint8_t *h) {
+    calib->T1 = U16(tp, 0);
+    calib->T2 = S16(tp, 2);
+    calib->T3 = S16(tp, 4);
+    calib->P1 = U16(tp, 6);
+    calib->P2 = S16(tp, 8);
+    calib->P3 = S16(tp, 10);
+    calib->P4 = S16(tp, 12);
+    calib->P5 = S16(tp, 14);
+    calib->P6 = S16(tp, 16);
+    calib->P7 = S16(tp, 18);
+    calib->P8 = S16(tp, 20);
+    calib->P9 = S16(tp, 22);
+    calib->H1 = tp[25];     // 0xA1
+    calib->H2 = S16(h, 0);
+    calib->H3 = h[2];
+    // H4 and H5 are 12 bit values sharing the nibbles of 0xE5
+    calib->H4 = (int16_t) ((int8_t) h[3] * 16 | (h[4] & 0x0F));
+    calib->H5 = (int16_t) ((int8_t) h[5] * 16 | (h[4] >> 4));
+    calib->H6 = (int8_t) h[6];
+}
+
+const bme280_profile_t *bme280_profile(bme280_profile_id_t id) {
+    return &profiles[id < BME280_PROFILE_COUNT ? id : BME280_DEFAULT_PROFILE];
+}
+
+// register encoding of 1, 2, 4, 8, 16 (oversampling) and 0, 2, 4, 8, 16 (filter)
+static uint8_t encode(uint8_t factor) {
+    uint8_t code = 0;
+    while (factor) {
+        code++;
+        factor >>= 1;
+    }
+    return code;
+}
+
+void bme280_profile_registers(bme280_profile_id_t id, uint8_t *ctrl_hum, uint8_t *ctrl_meas, uint8_t *config) {
+    const bme280_profile_t *p = bme280_profile(id);
+    *ctrl_hum = encode(p->osrs_h);
+    *ctrl_meas = (uint8_t) (encode(p->osrs_t) << 5 | encode(p->osrs_p) << 2 | BME280_MODE_FORCED);
+    *config = (uint8_t) (p->filter ? (encode(p->filter) - 1) << 2 : 0);
+}
+
+uint32_t bme280_conversion_time(bme280_profile_id_t id, int max) {
+    const bme280_profile_t *p = bme280_profile(id);
+    if (max) return 1250 + 2300 * p->osrs_t + (2300 * p->osrs_p + 575) + (2300 * p->osrs_h + 575);
+    return 1000 + 2000 * p->osrs_t + (2000 * p->osrs_p + 500) + (2000 * p->osrs_h + 500);
+}
+
+uint32_t bme280_current_estimate(bme280_profile_id_t id, uint32_t period_ms) {
+    const bme280_profile_t *p = bme280_profile(id);
+    // charge per measurement in uA*us, the start-up time counted with the temperature current
+    const uint64_t charge = (uint64_t) BME280_CURRENT_T * (1000 + 2000 * p->osrs_t) +
+                            (uint64_t) BME280_CURRENT_P * (2000 * p->osrs_p + 500) +
+                            (uint64_t) BME280_CURRENT_H * (2000 * p->osrs_h + 500);
+    return period_ms ? (uint32_t) (charge / period_ms) + BME280_CURRENT_SLEEP : 0;
+}
+
+void bme280_compensate(const bme280_calib_t *c, const uint8_t *data, bme280_sample_t *sample) {
+    const int32_t adc_P = (int32_t) ((uint32_t) data[0] << 12 | (uint32_t) data[1] << 4 | data[2] >> 4);
+    const int32_t adc_T = (int32_t) ((uint32_t) data[3] << 12 | (uint32_t) data[4] << 4 | data[5] >> 4);
+    const int32_t adc_H = (int32_t) ((uint32_t) data[6] << 8 | data[7]);
+
+    // temperature, t_fine is shared by the pressure and humidity compensation
+    int32_t var1 = ((((adc_T >> 3) - ((int32_t) c->T1 << 1))) * (int32_t) c->T2) >> 11;
+    int32_t var2 = (((((adc_T >> 4) - (int32_t) c->T1) * ((adc_T >> 4) - (int32_t) c->T1)) >> 12) *
+                    (int32_t) c->T3) >> 14;
+    const int32_t t_fine = var1 + var2;
+    sample->temperature = (t_fine * 5 + 128) >> 8;
+
+    // pressure, 64 bit
+    int64_t p1 = (int64_t) t_fine - 128000;
+    int64_t p2 = p1 * p1 * (int64_t) c->P6;
+    p2 = p2 + ((p1 * (int64_t) c->P5) << 17);
+    p2 = p2 + ((int64_t) c->P4 << 35);
+    p1 = ((p1 * p1 * (int64_t) c->P3) >> 8) + ((p1 * (int64_t) c->P2) << 12);
+    p1 = ((((int64_t) 1) << 47) + p1) * (int64_t) c->P1 >> 33;
+    if (p1 == 0) {
+        sample->pressure = 0;
+    } else {
+        int64_t p = 1048576 - adc_P;
+        p = (((p << 31) - p2) * 3125) / p1;
+        p1 = ((int64_t) c->P9 * (p >> 13) * (p >> 13)) >> 25;
+        p2 = ((int64_t) c->P8 * p) >> 19;
+        p = ((p + p1 + p2) >> 8) + ((int64_t) c->P7 << 4);
+        sample->pressure = (uint32_t) (p >> 8);     // Q24.8 to Pa
+    }
+
+    // humidity
+    int32_t h = t_fine - 76800;
+    h = (((((adc_H << 14) - ((int32_t) c->H4 << 20) - ((int32_t) c->H5 * h)) + 16384) >> 15) *
+         (((((((h * (int32_t) c->H6) >> 10) * (((h * (int32_t) c->H3) >> 11) + 32768)) >> 10) + 2097152) *
+           (int32_t) c->H2 + 8192) >> 14));
+    h = h - (((((h >> 15) * (h >> 15)) >> 7) * (int32_t) c->H1) >> 4);
+    h = h < 0 ? 0 : h;
+    h = h > 419430400 ? 419430400 : h;
+    sample->humidity = (uint32_t) (h >> 12);
+}
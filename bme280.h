@@ -0,0 +1,160 @@
+/*!
+ * @file
+ * @brief BME280 register map and compensation.
+ *
+ * The compensation works on a raw data frame (registers 0xF7 to 0xFE), read
+ * in a single burst, so all three values come from the same measurement and
+ * the temperature fine value is computed only once per sample. Integer
+ * formulas from the Bosch BME280 datasheet (rev. 1.1, section 4.2.3).
+ *
+ * The sensor runs in forced mode: a measurement is triggered per sample and
+ * the sensor sleeps in between. The oversampling and IIR filter settings are
+ * selected by a profile.
+ *
+ * @date 2017-04-10
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _BME280_H_
+#define _BME280_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BME280_ADDRESS      (0x76 << 1)     //!< 8 bit I2C address (SDO to GND)
+#define BME280_CHIP_ID      0x60
+
+#define BME280_REG_CALIB_TP 0x88            //!< temperature and pressure calibration (0x88 - 0xA1)
+#define BME280_REG_CHIP_ID  0xD0
+#define BME280_REG_RESET    0xE0
+#define BME280_REG_CALIB_H  0xE1            //!< humidity calibration (0xE1 - 0xE7)
+#define BME280_REG_CTRL_HUM 0xF2
+#define BME280_REG_STATUS   0xF3
+#define BME280_REG_CTRL_MEAS 0xF4
+#define BME280_REG_CONFIG   0xF5
+#define BME280_REG_DATA     0xF7            //!< press_msb ... hum_lsb (0xF7 - 0xFE)
+
+#define BME280_STATUS_MEASURING 0x08
+#define BME280_MODE_FORCED  0x01
+
+#define BME280_CALIB_TP_SIZE 26
+#define BME280_CALIB_H_SIZE  7
+#define BME280_DATA_SIZE     8
+
+/*!
+ * The measurement profiles: X(id, name, temperature, pressure and humidity oversampling, IIR filter coefficient)
+ */
+#define BME280_PROFILES(X) \
+    X(BME280_ULTRA_LOW_POWER, "ultra-low-power", 1, 1,  1, 0) \
+    X(BME280_STANDARD,        "standard",        2, 4,  1, 2) \
+    X(BME280_HIGH_RESOLUTION, "high-resolution", 2, 16, 2, 4)
+
+#define BME280_PROFILE_ID(id, name, osrs_t, osrs_p, osrs_h, filter) id,
+typedef enum {
+    BME280_PROFILES(BME280_PROFILE_ID)
+    BME280_PROFILE_COUNT
+} bme280_profile_id_t;
+#undef BME280_PROFILE_ID
+
+#define BME280_DEFAULT_PROFILE BME280_ULTRA_LOW_POWER
+
+//! a measurement profile
+typedef struct {
+    const char *name;
+    uint8_t osrs_t;         //!< temperature oversampling (1, 2, 4, 8, 16)
+    uint8_t osrs_p;         //!< pressure oversampling
+    uint8_t osrs_h;         //!< humidity oversampling
+    uint8_t filter;         //!< IIR filter coefficient (0 = off, 2, 4, 8, 16)
+} bme280_profile_t;
+
+//! the factory calibration of a sensor
+typedef struct {
+    uint16_t T1;
+    int16_t T2, T3;
+    uint16_t P1;
+    int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t H1;
+    int16_t H2;
+    uint8_t H3;
+    int16_t H4, H5;
+    int8_t H6;
+} bme280_calib_t;
+
+//! a compensated sample
+typedef struct {
+    int32_t temperature;    //!< temperature in 0.01 degree Celsius
+    uint32_t pressure;      //!< pressure in Pa
+    uint32_t humidity;      //!< relative humidity in 1/1024 %
+} bme280_sample_t;
+
+/*!
+ * @brief Parse the calibration registers.
+ * @param calib where to store the calibration
+ * @param tp the registers 0x88 - 0xA1
+ * @param h the registers 0xE1 - 0xE7
+ */
+void bme280_parse_calib(bme280_calib_t *calib, const uint8_t *tp, const uint8_t *h);
+
+/*!
+ * @brief Get a measurement profile.
+ * @param id the profile id
+ * @return the profile
+ */
+const bme280_profile_t *bme280_profile(bme280_profile_id_t id);
+
+/*!
+ * @brief Get the register values of a profile, ctrl_meas triggers a forced measurement.
+ * @param id the profile id
+ * @param ctrl_hum the value of the ctrl_hum register
+ * @param ctrl_meas the value of the ctrl_meas register
+ * @param config the value of the config register
+ */
+void bme280_profile_registers(bme280_profile_id_t id, uint8_t *ctrl_hum, uint8_t *ctrl_meas, uint8_t *config);
+
+/*!
+ * @brief Get the conversion time of a forced measurement (datasheet section 9.1).
+ * @param id the profile id
+ * @param max true for the maximum, false for the typical conversion time
+ * @return the conversion time in us
+ */
+uint32_t bme280_conversion_time(bme280_profile_id_t id, int max);
+
+/*!
+ * @brief Estimate the average supply current of a profile.
+ * @param id the profile id
+ * @param period_ms the sampling period
+ * @return the average current in nA
+ */
+uint32_t bme280_current_estimate(bme280_profile_id_t id, uint32_t period_ms);
+
+/*!
+ * @brief Compensate a raw data frame.
+ * @param calib the sensor calibration
+ * @param data the registers 0xF7 - 0xFE
+ * @param sample where to store the compensated values
+ */
+void bme280_compensate(const bme280_calib_t *calib, const uint8_t *data, bme280_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BME280_H_
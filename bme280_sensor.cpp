@@ -0,0 +1,136 @@
+/*!
+ * @file
+ * @brief BME280 driver for the sensor registry.
+ *
+ * Each sample triggers a forced measurement with the selected profile, waits
+ * for the conversion, then reads the whole data block (0xF7 - 0xFE) in one
+ * I2C transaction and compensates all channels from that frame.
+ *
+ * @date 2017-04-07
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <math.h>
+#include "rtos.h"
+#include "us_ticker_api.h"
+#include "bme280_sensor.h"
+#include "log.h"
+#include "power.h"
+#include "stats.h"
+
+// status polls after the typical conversion time, 1ms apart
+#define BME280_POLL_MAX 20
+
+// payload keys and scaling, the values are sent as integers
+static const sensor_channel_t bme280_channels[BME280_CHANNELS] = {
+    {"t", 100.0f},
+    {"p", 1.0f},
+    {"h", 100.0f},
+    {"a", 100.0f}
+};
+
+static bool bme280_read(bme280_t *sensor, uint8_t reg, uint8_t *buffer, int len) {
+    return sensor->i2c->write(sensor->address, (const char *) &reg, 1, true) == 0 &&
+           sensor->i2c->read(sensor->address, (char *) buffer, len) == 0;
+}
+
+static bool bme280_write(bme280_t *sensor, uint8_t reg, uint8_t value) {
+    const uint8_t cmd[2] = {reg, value};
+    return sensor->i2c->write(sensor->address, (const char *) cmd, 2) == 0;
+}
+
+static int bme280_init(void *ctx) {
+    bme280_t *sensor = (bme280_t *) ctx;
+
+    uint8_t id, tp[BME280_CALIB_TP_SIZE], h[BME280_CALIB_H_SIZE];
+    if (!bme280_read(sensor, BME280_REG_CHIP_ID, &id, 1) || id != BME280_CHIP_ID) return false;
+    if (!bme280_read(sensor, BME280_REG_CALIB_TP, tp, sizeof(tp)) ||
+        !bme280_read(sensor, BME280_REG_CALIB_H, h, sizeof(h)))
+        return false;
+    bme280_parse_calib(&sensor->calib, tp, h);
+
+    // sleep mode, the profile is configured with the first sample
+    sensor->active = BME280_PROFILE_COUNT;
+    return bme280_write(sensor, BME280_REG_CTRL_MEAS, 0x00);
+}
+
+// trigger a forced measurement and wait until it is done
+static bool bme280_measure(bme280_t *sensor) {
+    const bme280_profile_id_t id = (bme280_profile_id_t) sensor->profile;
+    uint8_t ctrl_hum, ctrl_meas, config;
+    bme280_profile_registers(id, &ctrl_hum, &ctrl_meas, &config);
+
+    // config is only writable in sleep mode, which the sensor is in between forced measurements
+    const bool changed = sensor->active != id;
+    if (changed && !bme280_write(sensor, BME280_REG_CONFIG, config)) return false;
+    // ctrl_hum takes effect with the following ctrl_meas write
+    if (!bme280_write(sensor, BME280_REG_CTRL_HUM, ctrl_hum)) return false;
+
+    // the conversion is timed with the us ticker, which stops in deep sleep
+    power_lock_deepsleep();
+    const uint32_t start = us_ticker_read();
+    bool done = bme280_write(sensor, BME280_REG_CTRL_MEAS, ctrl_meas);
+    if (done) Thread::wait(bme280_conversion_time(id, false) / 1000);
+
+    uint8_t status = BME280_STATUS_MEASURING;
+    for (int i = 0; done && i < BME280_POLL_MAX && (status & BME280_STATUS_MEASURING); i++) {
+        if (i) Thread::wait(1);
+        done = bme280_read(sensor, BME280_REG_STATUS, &status, 1);
+    }
+    const uint32_t conversion_us = us_ticker_read() - start;
+    power_unlock_deepsleep();
+    if (!done || (status & BME280_STATUS_MEASURING)) return false;
+    sensor->conversion_us = conversion_us;
+    stats_set(STAT_BME_CONV_US, sensor->conversion_us);
+
+    if (changed) {
+        sensor->active = id;
+        stats_set(STAT_BME_PROFILE, id);
+        stats_set(STAT_BME_MAX_US, bme280_conversion_time(id, true));
+        stats_set(STAT_BME_CURRENT, bme280_current_estimate(id, sensor->period_ms));
+        LOG_I("bme280 profile %s: conversion %lu us (typ %lu us, max %lu us), ~%lu nA at %lu ms\r\n",
+              bme280_profile(id)->name, (unsigned long) sensor->conversion_us,
+              (unsigned long) bme280_conversion_time(id, false), (unsigned long) bme280_conversion_time(id, true),
+              (unsigned long) bme280_current_estimate(id, sensor->period_ms), (unsigned long) sensor->period_ms);
+    }
+    return true;
+}
+
+static int bme280_sample(void *ctx, float *values) {
+    bme280_t *sensor = (bme280_t *) ctx;
+
+    uint8_t data[BME280_DATA_SIZE];
+    if (!bme280_measure(sensor) || !bme280_read(sensor, BME280_REG_DATA, data, sizeof(data))) return false;
+
+    bme280_sample_t sample;
+    bme280_compensate(&sensor->calib, data, &sample);
+
+    values[BME280_TEMPERATURE] = sample.temperature / 100.0f;
+    values[BME280_PRESSURE] = sample.pressure / 100.0f;
+    values[BME280_HUMIDITY] = sample.humidity / 1024.0f;
+    values[BME280_ALTITUDE] =
+            44330.0f * (1.0f - (float) pow(sample.pressure / (float) PRESSURE_SEA_LEVEL, 1 / 5.255));
+    return true;
+}
+
+sensor_driver_t bme280_sensor(bme280_t *sensor, uint32_t period_ms) {
+    sensor->period_ms = period_ms;
+    sensor_driver_t driver = {"bme280", bme280_channels, BME280_CHANNELS, period_ms, bme280_init, bme280_sample,
+                              sensor};
+    return driver;
+}
@@ -0,0 +1,61 @@
+/*!
+ * @file
+ * @brief BME280 driver for the sensor registry.
+ *
+ * @date 2017-04-07
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _BME280_SENSOR_H_
+#define _BME280_SENSOR_H_
+
+#include "mbed.h"
+#include "bme280.h"
+#include "sensors.h"
+
+#define PRESSURE_SEA_LEVEL 101325
+
+//! the BME280 channels: degree Celsius, hPa, % and m (derived from the pressure)
+enum {
+    BME280_TEMPERATURE = 0,
+    BME280_PRESSURE,
+    BME280_HUMIDITY,
+    BME280_ALTITUDE,
+    BME280_CHANNELS
+};
+
+//! a BME280 on an I2C bus
+typedef struct {
+    I2C *i2c;
+    uint8_t address;            //!< 8 bit I2C address
+    bme280_calib_t calib;       //!< read from the sensor on init
+    volatile uint8_t profile;   //!< the requested profile, applied on the next sample
+    uint8_t active;             //!< the profile the sensor is configured for
+    uint32_t conversion_us;     //!< the measured conversion time of the last sample
+    uint32_t period_ms;         //!< the sampling period, for the current estimate
+} bme280_t;
+
+/*!
+ * @brief Create the registry driver for a BME280.
+ * @param sensor the sensor, must stay valid
+ * @param period_ms the sampling period
+ * @return the driver
+ */
+sensor_driver_t bme280_sensor(bme280_t *sensor, uint32_t period_ms);
+
+#endif // _BME280_SENSOR_H_
@@ -0,0 +1,59 @@
+/*!
+ * @file
+ * @brief Boot timeline trace.
+ *
+ * @date 2017-04-06
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "boot.h"
+#include "log.h"
+
+#define BOOT_STAGE_NAME(id, name) name,
+static const char *const boot_names[BOOT_STAGE_COUNT] = {
+    BOOT_STAGES(BOOT_STAGE_NAME)
+};
+#undef BOOT_STAGE_NAME
+
+// each stage is marked by a single thread, 0 means not finished yet
+static volatile uint32_t boot_times[BOOT_STAGE_COUNT];
+
+void boot_mark(boot_stage_t stage, uint32_t now_ms) {
+    if (!boot_times[stage]) boot_times[stage] = now_ms ? now_ms : 1;
+}
+
+uint32_t boot_time(boot_stage_t stage) {
+    return boot_times[stage];
+}
+
+void boot_report(void) {
+    // the stages finish in a different order on every boot, sort them by time
+    uint32_t times[BOOT_STAGE_COUNT];
+    int order[BOOT_STAGE_COUNT];
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        const uint32_t t = boot_times[i];
+        int j = i;
+        for (; j > 0 && times[order[j - 1]] > t; j--) order[j] = order[j - 1];
+        order[j] = i;
+        times[i] = t;
+    }
+
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (times[order[i]]) LOG_I("boot %6lu ms %s\r\n", (unsigned long) times[order[i]], boot_names[order[i]]);
+    }
+}
@@ -0,0 +1,81 @@
+/*!
+ * @file
+ * @brief Boot timeline trace.
+ *
+ * Startup runs in concurrent stages (modem bring-up in the MQTT thread,
+ * crypto and sensor warm-up in the main thread). Each stage records the
+ * uptime at which it finished, the timeline is logged after the first
+ * message has been published.
+ *
+ * @date 2017-04-06
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _BOOT_H_
+#define _BOOT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The boot stages: X(id, name)
+ */
+#define BOOT_STAGES(X) \
+    X(BOOT_STATE,         "state")     /* settings and persisted state restored */ \
+    X(BOOT_THREADS,       "threads")   /* worker threads started */ \
+    X(BOOT_CRYPTO,        "crypto")    /* RNG seeded, device key imported */ \
+    X(BOOT_IDENTITY,      "identity")  /* public key encoded for the identity cache */ \
+    X(BOOT_SENSOR,        "sensor")    /* first sensor sample */ \
+    X(BOOT_SIGNED,        "signed")    /* first payload signed and queued */ \
+    X(BOOT_MODEM,         "modem")     /* modem powered and attached to GPRS */ \
+    X(BOOT_MQTT,          "mqtt")      /* MQTT connected and subscribed */ \
+    X(BOOT_LOCATION,      "location")  /* location lookup finished */ \
+    X(BOOT_PUBLISHED,     "published") /* first message published */
+
+#define BOOT_STAGE_ID(id, name) id,
+typedef enum {
+    BOOT_STAGES(BOOT_STAGE_ID)
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+#undef BOOT_STAGE_ID
+
+/*!
+ * @brief Record the time a boot stage finished, only the first mark of a stage counts.
+ * @param stage the stage
+ * @param now_ms the current uptime
+ */
+void boot_mark(boot_stage_t stage, uint32_t now_ms);
+
+/*!
+ * @brief Get the time a boot stage finished.
+ * @param stage the stage
+ * @return the uptime in ms, or 0 if the stage has not finished yet
+ */
+uint32_t boot_time(boot_stage_t stage);
+
+//! @brief Log the boot timeline, ordered by time (stages that did not finish are left out)
+void boot_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _BOOT_H_
@@ -26,36 +26,18 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include "wolfssl/wolfcrypt/sha512.h"
 #include "wolfssl/wolfcrypt/coding.h"
 #include "wolfssl/wolfcrypt/random.h"
 #include "wolfssl/wolfcrypt/ed25519.h"
 #include "wolfssl/wolfcrypt/error-crypt.h"
 #include "crypto.h"
+#include "log.h"
 
-#ifdef NDEBUG
-#  define UCERROR(p, e)   printf("E: %s: %d\r\n", (p), (e))
-#  define UCDUMP(p, b, s) dbg_dump((p), (b), (s))
-#else
-#  define UCERROR(...)
-#  define UCDUMP(...)
-#endif
-
-
-void dbg_dump(const char *prefix, const uint8_t *b, size_t size) {
-  for (int i = 0; i < size; i += 16) {
-    if (prefix && strlen(prefix) > 0) printf("%s %06x: ", prefix, i);
-    for (int j = 0; j < 16; j++) {
-      if ((i + j) < size) printf("%02x", b[i + j]); else printf("  ");
-      if ((j+1) % 2 == 0) putchar(' ');
-    }
-    putchar(' ');
-    for (int j = 0; j < 16 && (i + j) < size; j++) {
-      putchar(b[i + j] >= 0x20 && b[i + j] <= 0x7E ? b[i + j] : '.');
-    }
-    printf("\r\n");
-  }
-}
+// errors and dumps go through the buffered log, dumps only at debug level
+#define UCERROR(p, e)   LOG_E("E: %s: %d\r\n", (p), (e))
+#define UCDUMP(p, b, s) LOG_DUMP((p), (b), (s))
 
 
 WC_RNG uc_random;
@@ -71,7 +53,7 @@ int uc_init() {
   if (wc_InitRng(&uc_random)) return false;
 
 #if !FSL_FEATURE_SOC_LTC_COUNT
-  PRINTF("- no LTC available\r\n");
+  LOG_I("- no LTC available\r\n");
 #else
   LTC_Init(LTC0);
 #endif
@@ -81,35 +63,408 @@ int uc_init() {
 }
 
 // === BASE64 ===
+//
+// The codec processes the bulk of the data in blocks with the selected implementation,
+// the tail (padding, line breaks) always goes through the scalar code. The results are
+// the same as with Base64_Encode_NoNl() and Base64_Decode() of wolfcrypt.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define UC_BASE64_X86 1
+#  include <immintrin.h>
+#endif
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#  include "cmsis.h"
+#endif
 
-char *uc_base64_encode(const unsigned char *in, size_t inlen) {
-  // estimate the length of the encoded digest
-  word32 base64_len;
-  if (Base64_Encode_NoNl(in, inlen, NULL, &base64_len) != LENGTH_ONLY_E) return NULL;
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6 bit value of a character, 0xff if it is not part of the alphabet (the upper half is never)
+static const uint8_t base64_values[128] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+#define BASE64_VALUE(c) ((c) & 0x80 ? 0xff : base64_values[(c)])
+
+static size_t base64_encode_scalar(const uint8_t *in, size_t len, char *out) {
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3, out += 4) {
+    const uint32_t v = (uint32_t) in[i] << 16 | (uint32_t) in[i + 1] << 8 | in[i + 2];
+    out[0] = base64_alphabet[v >> 18];
+    out[1] = base64_alphabet[v >> 12 & 0x3f];
+    out[2] = base64_alphabet[v >> 6 & 0x3f];
+    out[3] = base64_alphabet[v & 0x3f];
+  }
+  return i;
+}
 
-  // allocate memory for the encoded string + 1
-  char *encoded_digest = malloc(base64_len * sizeof(char) + 1);
-  const int r = Base64_Encode_NoNl(in, inlen, (byte *) encoded_digest, &base64_len);
+// decode blocks of 4 characters, stops at the first block that is not plain alphabet
+static size_t base64_decode_scalar(const char *in, size_t len, uint8_t *out, size_t max, size_t *written) {
+  size_t i = 0, o = *written;
+  for (; i + 4 <= len && o + 3 <= max; i += 4, o += 3) {
+    const uint8_t *c = (const uint8_t *) in + i;
+    const uint32_t a = BASE64_VALUE(c[0]), b = BASE64_VALUE(c[1]), d = BASE64_VALUE(c[2]), e = BASE64_VALUE(c[3]);
+    if ((a | b | d | e) & 0x80) break;
+    const uint32_t v = a << 18 | b << 12 | d << 6 | e;
+    out[o] = (uint8_t) (v >> 16);
+    out[o + 1] = (uint8_t) (v >> 8);
+    out[o + 2] = (uint8_t) v;
+  }
+  *written = o;
+  return i;
+}
 
-  if (r) {
-    UCERROR("base64 encode", r);
-    return NULL;
+/*
+ * SIMD within a register: four 6 bit values in a 32 bit word are mapped to their characters
+ * at once by adding a per-byte offset (A-Z +65, a-z +71, 0-9 -4, '+' -19, '/' -16). The
+ * offset is picked with byte-wise compares, on Cortex-M4 with USUB8 and SEL (DSP extension).
+ */
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+static inline uint32_t swar_pick(uint32_t x, uint32_t k, uint32_t a, uint32_t b) {
+  (void) __USUB8(x, k);     // sets the GE flag of each byte where x >= k
+  return __SEL(a, b);
+}
+#  define swar_add(x, y) __UADD8((x), (y))
+#else
+static inline uint32_t swar_pick(uint32_t x, uint32_t k, uint32_t a, uint32_t b) {
+  // the values are 6 bit, so the subtraction never borrows from the next byte
+  const uint32_t mask = (((x | 0x80808080u) - k) & 0x80808080u) >> 7;
+  return (a & mask * 0xff) | (b & ~(mask * 0xff));
+}
+
+static inline uint32_t swar_add(uint32_t x, uint32_t y) {
+  return ((x & 0x7f7f7f7fu) + (y & 0x7f7f7f7fu)) ^ ((x ^ y) & 0x80808080u);
+}
+#endif
+
+static size_t base64_encode_swar(const uint8_t *in, size_t len, char *out) {
+  size_t i = 0;
+  for (; i + 3 <= len; i += 3, out += 4) {
+    const uint32_t v = (uint32_t) in[i] << 16 | (uint32_t) in[i + 1] << 8 | in[i + 2];
+    // the first character in the lowest byte (little endian store)
+    const uint32_t x = (v >> 18) | (v >> 4 & 0x3f00u) | (v << 10 & 0x3f0000u) | (v << 24 & 0x3f000000u);
+    uint32_t offset = swar_pick(x, 0x1a1a1a1au, 0x47474747u, 0x41414141u);
+    offset = swar_pick(x, 0x34343434u, 0xfcfcfcfcu, offset);
+    offset = swar_pick(x, 0x3e3e3e3eu, 0xededededu, offset);
+    offset = swar_pick(x, 0x3f3f3f3fu, 0xf0f0f0f0u, offset);
+    const uint32_t chars = swar_add(x, offset);
+    memcpy(out, &chars, 4);
   }
-  encoded_digest[base64_len] = '\0';
+  return i;
+}
 
-  return encoded_digest;
+#ifdef UC_BASE64_X86
+/*
+ * SSSE3 and AVX2, after Wojciech Mula and Daniel Lemire, "Faster Base64 Encoding and Decoding
+ * using AVX2 Instructions": 12 bytes per 128 bit lane are split into 16 6 bit values with
+ * multiplies, mapped with a 16 entry lookup (pshufb) and the reverse, with a lookup based
+ * validation of every character.
+ */
+#define BASE64_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define BASE64_TARGET_AVX2 __attribute__((target("avx2")))
+// the SSSE3 loops also finish the AVX2 ones, inlined they are VEX encoded there (no SSE/AVX transitions)
+#define BASE64_INLINE inline __attribute__((always_inline))
+
+BASE64_TARGET_SSSE3 static inline __m128i base64_encode_lane(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  const __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+  const __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+  const __m128i values = _mm_or_si128(t0, t1);
+
+  // 0: A-Z, 1: a-z, 2-11: 0-9, 12: '+', 13: '/' (the offsets are ordered by range)
+  __m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+  range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), values), _mm_set1_epi8(13)));
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), values);
 }
 
-int uc_base64_decode(const char *in, size_t inlen, unsigned char *out, size_t *outlen) {
-  // TODO: check updated version of wolfSSL, which expects outlen+1 bytes, but only decodes outlen
-  (*outlen) += 1;
+BASE64_TARGET_SSSE3 static BASE64_INLINE size_t base64_encode_ssse3(const uint8_t *in, size_t len, char *out) {
+  size_t i = 0;
+  // a lane reads 16 bytes but uses 12
+  for (; i + 16 <= len; i += 12, out += 16) {
+    _mm_storeu_si128((__m128i *) out, base64_encode_lane(_mm_loadu_si128((const __m128i *) (in + i))));
+  }
+  return i + base64_encode_scalar(in + i, len - i, out);
+}
 
-  const int r = Base64_Decode((const byte *) in, inlen, out, outlen);
-  if (r) {
-    UCERROR("base64 decode", r);
+// the 6 bit values of 16 characters, false if one is not plain alphabet
+BASE64_TARGET_SSSE3 static inline int base64_decode_lane(__m128i in, __m128i *values) {
+  const __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+  const __m128i low = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+  // the high nibbles that are valid with each low nibble, as a bit mask
+  const __m128i valid = _mm_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                      (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                      (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+  const __m128i bit = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i match = _mm_and_si128(_mm_shuffle_epi8(valid, low), _mm_shuffle_epi8(bit, high));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(match, _mm_setzero_si128()))) return 0;
+
+  // the offset by high nibble, '/' shares it with '+'
+  const __m128i offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m128i offset = _mm_shuffle_epi8(offsets, high);
+  offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), _mm_set1_epi8(-3)));
+  *values = _mm_add_epi8(in, offset);
+  return 1;
+}
+
+// pack 16 6 bit values into 12 bytes, at the start of the lane
+BASE64_TARGET_SSSE3 static inline __m128i base64_pack_lane(__m128i values) {
+  const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+  return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+BASE64_TARGET_SSSE3 static BASE64_INLINE size_t base64_decode_ssse3(const char *in, size_t len, uint8_t *out, size_t max,
+                                                      size_t *written) {
+  size_t i = 0, o = *written;
+  __m128i values;
+  for (; i + 16 <= len && o + 12 <= max; i += 16, o += 12) {
+    if (!base64_decode_lane(_mm_loadu_si128((const __m128i *) (in + i)), &values)) break;
+    uint8_t packed[16];
+    _mm_storeu_si128((__m128i *) packed, base64_pack_lane(values));
+    memcpy(out + o, packed, 12);
+  }
+  *written = o;
+  return i + base64_decode_scalar(in + i, len - i, out, max, written);
+}
+
+BASE64_TARGET_AVX2 static size_t base64_encode_avx2(const uint8_t *in, size_t len, char *out) {
+  const __m256i split = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                         1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  // 12 bytes per lane, the upper lane reads 16 bytes from +12
+  for (; i + 28 <= len; i += 24, out += 32) {
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (in + i))),
+                                        _mm_loadu_si128((const __m128i *) (in + i + 12)), 1);
+    v = _mm256_shuffle_epi8(v, split);
+    const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                                          _mm256_set1_epi32(0x04000040));
+    const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                                          _mm256_set1_epi32(0x01000010));
+    const __m256i values = _mm256_or_si256(t0, t1);
+    __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+    range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), values),
+                                                    _mm256_set1_epi8(13)));
+    _mm256_storeu_si256((__m256i *) out, _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), values));
+  }
+  return i + base64_encode_ssse3(in + i, len - i, out);
+}
+
+BASE64_TARGET_AVX2 static size_t base64_decode_avx2(const char *in, size_t len, uint8_t *out, size_t max,
+                                                    size_t *written) {
+  const __m256i valid = _mm256_setr_epi8((char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                         (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                         (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54,
+                                         (char) 0xa8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                         (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8, (char) 0xf8,
+                                         (char) 0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+  const __m256i bit = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+                                       0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i offsets = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t i = 0, o = *written;
+  for (; i + 32 <= len && o + 24 <= max; i += 32, o += 24) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+    const __m256i high = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+    const __m256i low = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+    const __m256i match = _mm256_and_si256(_mm256_shuffle_epi8(valid, low), _mm256_shuffle_epi8(bit, high));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(match, _mm256_setzero_si256()))) break;
+
+    __m256i offset = _mm256_shuffle_epi8(offsets, high);
+    offset = _mm256_add_epi8(offset, _mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')),
+                                                      _mm256_set1_epi8(-3)));
+    const __m256i values = _mm256_add_epi8(v, offset);
+    const __m256i pairs = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    __m256i packed = _mm256_shuffle_epi8(_mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000)), pack);
+    // move the 12 bytes of the upper lane next to the lower ones
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    uint8_t bytes[32];
+    _mm256_storeu_si256((__m256i *) bytes, packed);
+    memcpy(out + o, bytes, 24);
+  }
+  *written = o;
+  return i + base64_decode_ssse3(in + i, len - i, out, max, written);
+}
+#endif
+
+typedef size_t (*base64_encoder_t)(const uint8_t *in, size_t len, char *out);
+typedef size_t (*base64_decoder_t)(const char *in, size_t len, uint8_t *out, size_t max, size_t *written);
+
+// the data of uc_base64_self_test()
+#define BASE64_TEST_SIZE 192
+
+static int base64_impl = -1;
+static base64_encoder_t base64_encoder = base64_encode_scalar;
+static base64_decoder_t base64_decoder = base64_decode_scalar;
+
+static int base64_available(uc_base64_impl_t impl) {
+  switch (impl) {
+    case UC_BASE64_SCALAR:
+      return true;
+    case UC_BASE64_SWAR:
+      // the characters are stored as a little endian word
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      return true;
+#else
+      return false;
+#endif
+#ifdef UC_BASE64_X86
+    case UC_BASE64_SSSE3:
+      return __builtin_cpu_supports("ssse3");
+    case UC_BASE64_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+// the block encoder and decoder of an implementation
+static int base64_codec(uc_base64_impl_t impl, base64_encoder_t *encoder, base64_decoder_t *decoder) {
+  if (!base64_available(impl)) return false;
+  switch (impl) {
+    case UC_BASE64_SWAR:
+      *encoder = base64_encode_swar;
+      *decoder = base64_decode_scalar;
+      break;
+#ifdef UC_BASE64_X86
+    case UC_BASE64_SSSE3:
+      *encoder = base64_encode_ssse3;
+      *decoder = base64_decode_ssse3;
+      break;
+    case UC_BASE64_AVX2:
+      *encoder = base64_encode_avx2;
+      *decoder = base64_decode_avx2;
+      break;
+#endif
+    default:
+      *encoder = base64_encode_scalar;
+      *decoder = base64_decode_scalar;
+      break;
+  }
+  return true;
+}
+
+int uc_base64_select(uc_base64_impl_t impl) {
+  if (!base64_codec(impl, &base64_encoder, &base64_decoder)) return false;
+  base64_impl = impl;
+  return true;
+}
+
+uc_base64_impl_t uc_base64_selected(void) {
+  // the scalar codec unless another one was selected
+  if (base64_impl < 0) uc_base64_select(UC_BASE64_SCALAR);
+  return (uc_base64_impl_t) base64_impl;
+}
+
+// encode the blocks with the given encoder, the tail here
+static size_t base64_encode_with(base64_encoder_t encoder, const unsigned char *in, size_t inlen, char *out) {
+  const size_t done = encoder(in, inlen, out);
+  char *o = out + done / 3 * 4;
+
+  const size_t n = inlen - done;
+  if (n) {
+    const uint32_t v = (uint32_t) in[done] << 16 | (n > 1 ? (uint32_t) in[done + 1] << 8 : 0);
+    *o++ = base64_alphabet[v >> 18];
+    *o++ = base64_alphabet[v >> 12 & 0x3f];
+    *o++ = n > 1 ? base64_alphabet[v >> 6 & 0x3f] : '=';
+    *o++ = '=';
+  }
+  return (size_t) (o - out);
+}
+
+size_t uc_base64_encode_to(const unsigned char *in, size_t inlen, char *out) {
+  uc_base64_selected();
+  return base64_encode_with(base64_encoder, in, inlen, out);
+}
+
+char *uc_base64_encode(const unsigned char *in, size_t inlen) {
+  char *encoded = malloc((inlen + 2) / 3 * 4 + 1);
+  if (!encoded) {
+    UCERROR("base64 encode", MEMORY_E);
+    return NULL;
+  }
+  encoded[uc_base64_encode_to(in, inlen, encoded)] = '\0';
+  return encoded;
+}
+
+// decode the blocks with the given decoder, the rest here
+static int base64_decode_with(base64_decoder_t decoder, const char *in, size_t inlen, unsigned char *out,
+                              size_t *outlen) {
+  size_t o = 0;
+  const size_t max = *outlen;
+  size_t i = decoder(in, inlen, out, max, &o);
+
+  // the rest like wolfcrypt: line breaks are skipped, padding only at the end
+  uint32_t bits = 0, count = 0, padding = 0;
+  for (; i < inlen; i++) {
+    const uint8_t c = (uint8_t) in[i];
+    if (c == '\r' || c == '\n') continue;
+    if (c == '=') {
+      padding++;
+      continue;
+    }
+    const uint8_t v = BASE64_VALUE(c);
+    if (v == 0xff || padding) break;
+    bits = bits << 6 | v;
+    if (++count == 4) {
+      if (o + 3 > max) break;
+      out[o++] = (uint8_t) (bits >> 16);
+      out[o++] = (uint8_t) (bits >> 8);
+      out[o++] = (uint8_t) bits;
+      bits = count = 0;
+    }
+  }
+  if (i < inlen || count == 1 || count + padding > 4 || (count && count + padding != 4) ||
+      (count && o + count - 1 > max)) {
+    UCERROR("base64 decode", ASN_INPUT_E);
     return false;
   }
+  if (count == 2) out[o++] = (uint8_t) (bits >> 4);
+  if (count == 3) {
+    out[o++] = (uint8_t) (bits >> 10);
+    out[o++] = (uint8_t) (bits >> 2);
+  }
+  *outlen = o;
+
+  return true;
+}
 
+int uc_base64_decode(const char *in, size_t inlen, unsigned char *out, size_t *outlen) {
+  uc_base64_selected();
+  return base64_decode_with(base64_decoder, in, inlen, out, outlen);
+}
+
+int uc_base64_self_test(uc_base64_impl_t impl) {
+  base64_encoder_t encoder;
+  base64_decoder_t decoder;
+  if (!base64_codec(impl, &encoder, &decoder)) return false;
+
+  // every length up to 64 sextets, so every character is encoded at every position of a block
+  unsigned char data[BASE64_TEST_SIZE], decoded[BASE64_TEST_SIZE];
+  char expected[BASE64_TEST_SIZE / 3 * 4], encoded[BASE64_TEST_SIZE / 3 * 4];
+  for (size_t i = 0; i < BASE64_TEST_SIZE; i++) data[i] = (unsigned char) (i * 167 + 13);
+  for (size_t len = 0; len <= BASE64_TEST_SIZE; len++) {
+    const size_t n = base64_encode_with(base64_encode_scalar, data, len, expected);
+    if (base64_encode_with(encoder, data, len, encoded) != n || memcmp(encoded, expected, n)) return false;
+    size_t decoded_len = sizeof(decoded);
+    if (!base64_decode_with(decoder, expected, n, decoded, &decoded_len) || decoded_len != len ||
+        memcmp(decoded, data, len))
+      return false;
+  }
   return true;
 }
 
@@ -54,6 +54,41 @@ extern WC_RNG uc_random;
  */
 int uc_init();
 
+//! Base64 codec implementations
+typedef enum {
+    UC_BASE64_SCALAR = 0,   //!< portable, table driven
+    UC_BASE64_SWAR,         //!< four characters per 32 bit word, with the DSP extension on Cortex-M4
+    UC_BASE64_SSSE3,        //!< x86 SSSE3, 16 characters per step
+    UC_BASE64_AVX2,         //!< x86 AVX2, 32 characters per step
+    UC_BASE64_IMPLS
+} uc_base64_impl_t;
+
+/*!
+ * @brief Select the Base64 implementation, by default the scalar one is used.
+ * @param impl the implementation
+ * @return true if the implementation is available on this CPU
+ */
+int uc_base64_select(uc_base64_impl_t impl);
+
+//! @brief Get the selected Base64 implementation
+uc_base64_impl_t uc_base64_selected(void);
+
+/*!
+ * @brief Check a Base64 implementation against the scalar one, on this CPU.
+ * @param impl the implementation
+ * @return true if it is available and encodes and decodes like the scalar one
+ */
+int uc_base64_self_test(uc_base64_impl_t impl);
+
+/*!
+ * @brief Encode a byte array in Base64 encoding into a buffer.
+ * @param in the byte array input
+ * @param inlen the length of the input array
+ * @param out the buffer, (inlen + 2) / 3 * 4 bytes (not 0 terminated)
+ * @return the length of the encoded string
+ */
+size_t uc_base64_encode_to(const unsigned char *in, size_t inlen, char *out);
+
 /*!
  * @brief Encode a byte array in Base64 encoding.
  * @param in the byte array input
@@ -67,8 +102,8 @@ char *uc_base64_encode(const unsigned char *in, size_t inlen);
  * @param in the encoded character string
  * @param inlen the length of the input string
  * @param out the decoded byte array (must be preallocated)
- * @param outlen the length of the decoded byte array
- * @return true if the operation was successful, false if not
+ * @param outlen the size of out, set to the length of the decoded byte array
+ * @return true if the operation was successful, false if the input is invalid or does not fit
  */
 int uc_base64_decode(const char *in, size_t inlen, unsigned char *out, size_t *outlen);
 
@@ -0,0 +1,72 @@
+/*!
+ * @file
+ * @brief Compact latency histogram with percentile estimates.
+ *
+ * @date 2017-04-24
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <string.h>
+#include "latency.h"
+
+//! bucket index: exact below 4, then the octave and the next two bits
+static unsigned int bucket(uint32_t ms) {
+    if (ms < 4) return ms;
+    unsigned int octave = 2;
+    while (ms >> (octave + 1)) octave++;
+    unsigned int index = 4 + (octave - 2) * 4 + ((ms >> (octave - 2)) & 3);
+    return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+//! largest value that falls into a bucket
+static uint32_t upper(unsigned int index) {
+    if (index < 4) return index;
+    unsigned int octave = (index - 4) / 4 + 2;
+    return ((5 + (index - 4) % 4) << (octave - 2)) - 1;
+}
+
+void latency_reset(latency_t *latency) {
+    memset(latency, 0, sizeof(latency_t));
+}
+
+void latency_add(latency_t *latency, uint32_t ms) {
+    uint16_t *b = &latency->buckets[bucket(ms)];
+    // saturate rather than wrap, the percentiles stay meaningful
+    if (*b == UINT16_MAX) return;
+    (*b)++;
+    latency->count++;
+    if (ms > latency->max_ms) latency->max_ms = ms;
+}
+
+uint32_t latency_percentile(const latency_t *latency, unsigned int percent) {
+    if (!latency->count) return 0;
+    if (percent > 100) percent = 100;
+    // rank of the sample, rounded up so that p100 is the last one
+    uint32_t rank = (uint32_t) (((uint64_t) latency->count * percent + 99) / 100);
+    if (!rank) rank = 1;
+    uint32_t seen = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += latency->buckets[i];
+        if (seen >= rank) {
+            // the last bucket is open ended
+            const uint32_t bound = i + 1 < LATENCY_BUCKETS ? upper(i) : latency->max_ms;
+            return bound < latency->max_ms ? bound : latency->max_ms;
+        }
+    }
+    return latency->max_ms;
+}
@@ -0,0 +1,73 @@
+/*!
+ * @file
+ * @brief Compact latency histogram with percentile estimates.
+ *
+ * Samples are counted in log-linear buckets: exact below 4 ms, then four
+ * buckets per power of two. A percentile is reported as the upper bound
+ * of the bucket it falls into, so the estimate is at most 25% high. The
+ * whole histogram is a fixed 128 bytes and adding a sample is O(1).
+ *
+ * @date 2017-04-24
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! number of buckets, covers up to ~2^16 ms, larger samples land in the last one
+#define LATENCY_BUCKETS 60
+
+typedef struct {
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max_ms;
+} latency_t;
+
+/*!
+ * Clear all samples.
+ * @param latency the histogram
+ */
+void latency_reset(latency_t *latency);
+
+/*!
+ * Add a sample.
+ * @param latency the histogram
+ * @param ms the latency in milliseconds
+ */
+void latency_add(latency_t *latency, uint32_t ms);
+
+/*!
+ * Estimate a percentile.
+ * @param latency the histogram
+ * @param percent the percentile (1-100)
+ * @return the upper bound of the bucket the percentile falls into (capped at
+ *         the maximum sample), or 0 if there are no samples
+ */
+uint32_t latency_percentile(const latency_t *latency, unsigned int percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LATENCY_H_
@@ -0,0 +1,234 @@
+/*!
+ * @file
+ * @brief Buffered, levelled logging.
+ *
+ * The ring buffer is a multi producer, single consumer queue. Producers
+ * reserve space by advancing the head with compare-and-swap, write their
+ * record and then mark it committed. The log thread consumes committed
+ * records from the tail. A record that would wrap around the end of the
+ * buffer is preceded by a padding record.
+ *
+ * @date 2017-03-29
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "uptime.h"
+#include "log.h"
+
+#define LOG_FREE      0
+#define LOG_COMMITTED 1
+#define LOG_PADDING   2
+
+//! record header, the data starts with the 4 byte timestamp
+typedef struct {
+    volatile uint8_t state;
+    uint8_t level;
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t size;      //!< size of the whole record, multiple of 8
+    uint16_t len;       //!< size of the data (without timestamp)
+} log_record_t;
+
+#define LOG_ALIGN(n) (((n) + 7u) & ~7u)
+
+static uint8_t log_buffer[LOG_BUFFER_SIZE] __attribute__((aligned(8)));
+static volatile uint32_t log_head = 0;    // bytes reserved by producers (free running)
+static volatile uint32_t log_tail = 0;    // bytes consumed by the log thread (free running)
+static volatile uint32_t log_drops = 0;
+
+static log_record_t *log_reserve(uint32_t size) {
+    uint32_t head, offset, need;
+    do {
+        head = log_head;
+        offset = head & (LOG_BUFFER_SIZE - 1);
+        // records do not wrap, pad the rest of the buffer instead
+        need = LOG_BUFFER_SIZE - offset < size ? LOG_BUFFER_SIZE - offset + size : size;
+        if (head + need - log_tail > LOG_BUFFER_SIZE) {
+            __sync_fetch_and_add(&log_drops, 1);
+            return NULL;
+        }
+    } while (!__sync_bool_compare_and_swap(&log_head, head, head + need));
+
+    if (need != size) {
+        log_record_t *padding = (log_record_t *) (log_buffer + offset);
+        padding->size = (uint16_t) (LOG_BUFFER_SIZE - offset);
+        __sync_synchronize();
+        padding->state = LOG_PADDING;
+        offset = 0;
+    }
+
+    return (log_record_t *) (log_buffer + offset);
+}
+
+static void log_commit(uint8_t level, uint8_t type, const uint8_t *data, size_t len) {
+    if (len > LOG_MAX_RECORD) len = LOG_MAX_RECORD;
+
+    const uint32_t size = LOG_ALIGN(sizeof(log_record_t) + sizeof(uint32_t) + len);
+    log_record_t *record = log_reserve(size);
+    if (!record) return;
+
+    const uint32_t timestamp = uptime_ms();
+    uint8_t *body = (uint8_t *) (record + 1);
+    memcpy(body, &timestamp, sizeof(timestamp));
+    memcpy(body + sizeof(timestamp), data, len);
+    record->level = level;
+    record->type = type;
+    record->size = (uint16_t) size;
+    record->len = (uint16_t) len;
+
+    // the record must be complete before the log thread can see it
+    __sync_synchronize();
+    record->state = LOG_COMMITTED;
+}
+
+#ifdef LOG_BINARY
+
+// append the raw arguments of a printf format to the buffer
+static size_t log_pack_args(uint8_t *out, size_t max, const char *format, va_list ap) {
+    size_t len = 0;
+    for (const char *f = format; *f; f++) {
+        if (*f != '%') continue;
+        if (*++f == '%') continue;
+
+        char length = 0;
+        while (*f && strchr("-+ #0123456789.*lhjzt", *f)) {
+            if (*f == '*') {
+                const uint32_t width = (uint32_t) va_arg(ap, int);
+                if (len + 4 <= max) memcpy(out + len, &width, 4), len += 4;
+            } else if (strchr("lhjzt", *f)) length = *f;
+            f++;
+        }
+        if (!*f) break;
+
+        if (*f == 's') {
+            // strings are copied, the host has no access to the device memory
+            const char *str = va_arg(ap, const char *);
+            size_t n = str ? strlen(str) : 0;
+            if (n > 255) n = 255;
+            if (len + 1 + n > max) break;
+            out[len++] = (uint8_t) n;
+            memcpy(out + len, str, n);
+            len += n;
+        } else {
+            uint32_t value;
+            if (*f == 'f' || *f == 'g' || *f == 'e') {
+                const float fvalue = (float) va_arg(ap, double);
+                memcpy(&value, &fvalue, 4);
+            } else if (*f == 'p') value = (uint32_t) (uintptr_t) va_arg(ap, void *);
+            else if (length == 'l') value = (uint32_t) va_arg(ap, long);
+            else if (length == 'z') value = (uint32_t) va_arg(ap, size_t);
+            else value = (uint32_t) va_arg(ap, int);
+            if (len + 4 > max) break;
+            memcpy(out + len, &value, 4);
+            len += 4;
+        }
+    }
+    return len;
+}
+
+#endif
+
+void log_printf(uint8_t level, const char *format, ...) {
+    uint8_t data[LOG_MAX_RECORD];
+    size_t len;
+
+    va_list ap;
+    va_start(ap, format);
+#ifdef LOG_BINARY
+    memcpy(data, &format, sizeof(format));
+    len = sizeof(format) + log_pack_args(data + sizeof(format), sizeof(data) - sizeof(format), format, ap);
+#else
+    const int n = vsnprintf((char *) data, sizeof(data), format, ap);
+    len = n < 0 ? 0 : ((size_t) n < sizeof(data) ? (size_t) n : sizeof(data) - 1);
+#endif
+    va_end(ap);
+
+    log_commit(level, LOG_TYPE_TEXT, data, len);
+}
+
+void log_dump(uint8_t level, const char *prefix, const uint8_t *b, size_t size) {
+    uint8_t data[LOG_MAX_RECORD];
+    if (size > sizeof(data) - sizeof(prefix)) size = sizeof(data) - sizeof(prefix);
+
+    memcpy(data, &prefix, sizeof(prefix));
+    memcpy(data + sizeof(prefix), b, size);
+    log_commit(level, LOG_TYPE_DUMP, data, sizeof(prefix) + size);
+}
+
+#ifndef LOG_BINARY
+
+static void log_write_dump(const uint8_t *data, size_t len) {
+    const char *prefix;
+    memcpy(&prefix, data, sizeof(prefix));
+    const uint8_t *b = data + sizeof(prefix);
+    const size_t size = len - sizeof(prefix);
+
+    for (size_t i = 0; i < size; i += 16) {
+        if (prefix && strlen(prefix) > 0) printf("%s %06x: ", prefix, (unsigned int) i);
+        for (size_t j = 0; j < 16; j++) {
+            if ((i + j) < size) printf("%02x", b[i + j]); else printf("  ");
+            if ((j + 1) % 2 == 0) putchar(' ');
+        }
+        putchar(' ');
+        for (size_t j = 0; j < 16 && (i + j) < size; j++) {
+            putchar(b[i + j] >= 0x20 && b[i + j] <= 0x7E ? b[i + j] : '.');
+        }
+        printf("\r\n");
+    }
+}
+
+#endif
+
+void log_flush(void) {
+    while (log_tail != log_head) {
+        log_record_t *record = (log_record_t *) (log_buffer + (log_tail & (LOG_BUFFER_SIZE - 1)));
+        if (record->state == LOG_FREE) break;   // reserved, but not yet committed
+        __sync_synchronize();
+
+        const uint16_t size = record->size;
+        if (record->state == LOG_COMMITTED) {
+            const uint8_t *body = (const uint8_t *) (record + 1);
+#ifdef LOG_BINARY
+            const uint8_t header[5] = {LOG_FRAME_SYNC, record->level, record->type,
+                                       (uint8_t) (record->len & 0xff), (uint8_t) (record->len >> 8)};
+            fwrite(header, 1, sizeof(header), stdout);
+            fwrite(body, 1, sizeof(uint32_t) + record->len, stdout);
+#else
+            if (record->type == LOG_TYPE_DUMP) log_write_dump(body + sizeof(uint32_t), record->len);
+            else fwrite(body + sizeof(uint32_t), 1, record->len, stdout);
+#endif
+        }
+
+        // a later record header may start anywhere in this one, so none of its bytes may look committed
+        memset(record, 0, size);
+        __sync_synchronize();
+        log_tail += size;
+    }
+    fflush(stdout);
+}
+
+int log_pending(void) {
+    return log_head != log_tail;
+}
+
+uint32_t log_dropped(void) {
+    return log_drops;
+}
@@ -0,0 +1,115 @@
+/*!
+ * @file
+ * @brief Buffered, levelled logging.
+ *
+ * Log calls do not write to the UART. They only put a record into a
+ * lock-free ring buffer, which a low priority thread drains by calling
+ * log_flush(). Records are dropped (and counted) if the buffer is full.
+ *
+ * The log level is selected at compile time (LOG_LEVEL), calls above it
+ * compile to nothing. With LOG_BINARY defined, records are not formatted on
+ * the device: the format string address and the raw arguments are written
+ * as binary frames, to be formatted on the host with bin/logdecode.py.
+ *
+ * @date 2017-03-29
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_BUFFER_SIZE 2048    //!< ring buffer size, must be a power of 2
+#define LOG_MAX_RECORD  160     //!< maximum data per record, longer records are truncated
+
+//! start of a binary log frame
+#define LOG_FRAME_SYNC  0xA5
+
+//! record types
+#define LOG_TYPE_TEXT   1       //!< formatted text (or format address + arguments in binary mode)
+#define LOG_TYPE_DUMP   2       //!< hex dump: prefix address + raw bytes
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#  define LOG_E(...) log_printf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#  define LOG_E(...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#  define LOG_W(...) log_printf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#  define LOG_W(...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#  define LOG_I(...) log_printf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#  define LOG_I(...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#  define LOG_D(...) log_printf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#  define LOG_DUMP(p, b, s) log_dump(LOG_LEVEL_DEBUG, (p), (b), (s))
+#else
+#  define LOG_D(...)
+#  define LOG_DUMP(p, b, s)
+#endif
+
+/*!
+ * @brief Queue a log record, use the LOG_* macros instead.
+ * @param level the log level
+ * @param format the printf format, must be a string literal in binary mode
+ */
+void log_printf(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/*!
+ * @brief Queue a hex dump record, use LOG_DUMP instead.
+ * @param level the log level
+ * @param prefix the prefix printed before each line, must be a string literal
+ * @param b the bytes to dump
+ * @param size the number of bytes
+ */
+void log_dump(uint8_t level, const char *prefix, const uint8_t *b, size_t size);
+
+//! @brief Write all queued records to stdout, called from the log thread only
+void log_flush(void);
+
+//! @brief Whether records are waiting to be written
+int log_pending(void);
+
+//! @brief Number of records dropped because the buffer was full
+uint32_t log_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _LOG_H_
@@ -26,7 +26,6 @@
  */
 
 
-#include <BME280.h>
 
 #include "mbed-os-quectelM66-driver/M66Interface.h"
 #include "mbed-os-quectelM66-driver/M66MQTT.h"
@@ -36,154 +35,413 @@
 #include "MQTT/MQTTPacket/MQTTConnect.h"
 
 #include "crypto/crypto.h"
+#include "alert.h"
+#include "bme280_sensor.h"
+#include "boot.h"
+#include "latency.h"
+#include "merkle.h"
+#include "log.h"
+#include "outbox.h"
+#include "power.h"
+#include "protocol.h"
+#include "report.h"
+#include "uptime.h"
 #include "response.h"
+#include "schedule.h"
+#include "sensors.h"
+#include "settings.h"
+#include "state.h"
+#include "stats.h"
+#include "telemetry.h"
 #include "sensor.h"
 #include "config.h"
 #include "jsmn/jsmn.h"
-
-#ifndef MAINDEBUG
-#define PRINTF printf
-#else
-#define PRINTF(...)
+#ifdef MQTT_TLS
+#include "tls_network.h"
 #endif
 
-#define MQTT_PAYLOAD_LENGTH 512
-#define PRESSURE_SEA_LEVEL 101325
-#define TEMPERATURE_THRESHOLD 4000
+// debug output is buffered and written by the log thread, see LOG_LEVEL in log.h
+#define PRINTF(...) LOG_D(__VA_ARGS__)
 
-static int temp_threshold = TEMPERATURE_THRESHOLD;
-// internal sensor state
-static unsigned int interval = DEFAULT_INTERVAL;
+// MQTT frame size (send and receive buffer), can be overridden in mbed_app.json
+#ifndef MQTT_FRAME_SIZE
+#define MQTT_FRAME_SIZE 512
+#endif
+// PUBLISH header: fixed header (1), remaining length (max 4) and topic length (2)
+#define MQTT_FRAME_HEADER 7
+
+// signals to the main thread
+#define SIG_ALERT 0x01
+#define SIG_CONFIG 0x02
+#define SIG_SAMPLE 0x04
+// signals to the MQTT thread
+#define SIG_OUTBOX 0x01
+#define SIG_RING 0x02
+
+#ifdef MQTT_TLS
+// the handshake runs in the MQTT thread
+#define MQTT_STACK_SIZE 8192
+#else
+#define MQTT_STACK_SIZE 4096
+#endif
+#define DOWNLINK_STACK_SIZE 4096
+// how long the first payload waits for the first sensor sample during boot
+#define SENSOR_WARMUP_TIMEOUT 2000
+// the heartbeat LED keeps the MCU from sleeping long, set to 0 for battery powered units
+#ifndef HEARTBEAT_LED
+#define HEARTBEAT_LED 1
+#endif
+// received messages waiting for verification, and verified config changes waiting to be applied
+#define DOWNLINK_QUEUE_SIZE 2
+#define CONFIG_QUEUE_SIZE 2
+// detected alert events waiting to be published, a raise and its clear can both arrive before the main thread runs
+#define ALERT_QUEUE_SIZE 4
+
+// location lookups on connect, a warm boot already has a location and tries only once
+#define LOCATION_ATTEMPTS 3
+
+// PROTOCOL_SESSION sends the identity once per MQTT session instead of in every message
+#ifndef PROTOCOL_MODE
+#define PROTOCOL_MODE PROTOCOL_FULL
+#endif
+// telemetry is sent in windows of BATCH_WINDOW messages, signed once over their Merkle root (1 signs each message)
+#ifndef BATCH_WINDOW
+#define BATCH_WINDOW 1
+#endif
+#if BATCH_WINDOW > MERKLE_MAX_LEAVES
+#error "BATCH_WINDOW exceeds MERKLE_MAX_LEAVES"
+#endif
+// the inclusion proofs (up to three Base64 encoded SHA512 hashes) do not fit into the default frame
+#if BATCH_WINDOW > 1 && MQTT_FRAME_SIZE < 1024
+#error "BATCH_WINDOW needs an MQTT_FRAME_SIZE of at least 1024"
+#endif
 
 static bool mqttConnected = false;
-static bool unsuccessfulSend = false;
 
-static char lat[32], lon[32];
+static char lat[STATE_LOCATION_LENGTH], lon[STATE_LOCATION_LENGTH];
 static char deviceUUID[37];
 
 static int loop_counter = 0;
 
+// set when the persisted state (settings, location) needs to be saved
+static volatile bool stateChanged = false;
+static bool haveLocation = false;
+
+// alert detection runs in the sensor thread, publishing in the main thread
+static alert_state_t alert_state;
+static report_state_t lastReport;
+static osThreadId mainThread;
+static osThreadId mqttThread;
+
+static char *topic_send;
+static char *topic_receive;
+
+// a raw downlink message, as received by the MQTT thread
+typedef struct {
+    char message[MQTT_FRAME_SIZE + 1];
+    uint32_t received_ms;
+    uint32_t rtt_ms;        // time since the publish it answers, 0 if it answers none
+} downlink_t;
+
+// a verified config change, with the request ID to acknowledge (0 if none)
+typedef struct {
+    settings_update_t update;
+    uint32_t request;
+    uint32_t received_ms;
+    uint8_t status;         // 0 if the change is applied, the E_* flags it was rejected with otherwise
+} config_change_t;
+
+static Mail<downlink_t, DOWNLINK_QUEUE_SIZE> downlinkMail;
+static Mail<config_change_t, CONFIG_QUEUE_SIZE> configMail;
+
+// a detected alert event, with the temperature (*100) that caused it
+typedef struct {
+    alert_event_t event;
+    int temperature;
+} alert_t;
+
+static Mail<alert_t, ALERT_QUEUE_SIZE> alertMail;
+// downlinks, config changes and alerts dropped because their queue was full
+static volatile uint32_t mailDropped = 0;
+// the outbox is filled by the main thread and drained by the MQTT thread
+static Mutex outboxMutex;
+static outbox_t outbox;
+// held by the MQTT thread while it talks to the modem, a state sector erase masks interrupts and waits for it
+static Mutex modemMutex;
+
 int arrivedcount = 0;
 int level = 0;
 int voltage = 0;
 uint8_t error_flag = 0x00;
 
-//actual payload template
-static const char *const message_template = "{\"v\":\"0.0.2\",\"a\":\"%s\",\"k\":\"%s\",\"s\":\"%s\",\"p\":%s}";
-static const char *const payload_template = "{\"t\":%d,\"p\":%d,\"h\":%d,\"a\":%d,\"la\":\"%s\",\"lo\":\"%s\",\"ba\":%d,\"lp\":%d,\"e\":%d}";
-
-static const char *topicTemplate = "mwc/ubirch/devices/%s/%s";
+// the telemetry payload is declared in TELEMETRY_SCHEMA (telemetry.h), topics, heartbeats, alerts and acks in protocol.h
 
 // crypto key of the board
 static uc_ed25519_key uc_key;
-
-float temperature, pressure, humidity, altitude;
+static bool keyLoaded = false;
+// the key and the identity are set up by the main thread during boot, and on first use by the MQTT thread.
+// Signing (main and MQTT thread) and verifying (downlink thread) share the RNG and the LTC0 unit of the
+// crypto module, every key import, signature, verification and session ID is made under this mutex
+static Mutex cryptoMutex;
+
+// device identity (auth hash and public key), computed once
+static protocol_identity_t identity;
+static protocol_mode_t protocol_mode = PROTOCOL_MODE;
+static bool sessionAnnounced = false;
+
+// downlink round trip times (last publish to downlink arrival) of the current session
+static Mutex rttMutex;
+static latency_t downlinkRtt;
+static uint32_t lastPublishMs = 0;
+
+// message bytes that fit into a frame on the send topic, and the last chunked transfer ID
+static size_t frameCapacity = 0;
+static uint16_t transferId = 0;
+
+#if BATCH_WINDOW > 1
+// the window being signed, only used while draining the outbox
+static merkle_tree_t batchTree;
+#endif
 
 DigitalOut led1(LED1);
-BME280 bmeSensor(I2C_SDA, I2C_SCL);
+#ifdef GSM_RI
+// the modem pulls RI low on incoming data, the pin interrupt also wakes from deep sleep
+InterruptIn modemRing(GSM_RI);
+#endif
+// all sensors share one I2C bus, sampled by the sensor thread
+I2C i2c(I2C_SDA, I2C_SCL);
+static bme280_t bmeSensor = {&i2c, BME280_ADDRESS, {0}, BME280_DEFAULT_PROFILE};
+static sensor_driver_t bmeDriver = bme280_sensor(&bmeSensor, BME280_PERIOD);
+static int bmeId = -1;
+// the driver's BufferedSerial is a ModemSerial (BufferedSerial.h): the modem UART is received by DMA
 M66Interface network(GSM_UART_TX, GSM_UART_RX, GSM_PWRKEY, GSM_POWER, true);
-MQTTNetwork mqttNetwork(&network);
-MQTT::Client<MQTTNetwork, Countdown, MQTT_PAYLOAD_LENGTH> client = MQTT::Client<MQTTNetwork, Countdown, MQTT_PAYLOAD_LENGTH>(
-mqttNetwork);
-
-void dbg_dump(const char *prefix, const uint8_t *b, size_t size) {
-    for (int i = 0; i < size; i += 16) {
-        if (prefix && strlen(prefix) > 0) printf("%s %06x: ", prefix, i);
-        for (int j = 0; j < 16; j++) {
-            if ((i + j) < size) printf("%02x", b[i + j]); else printf("  ");
-            if ((j + 1) % 2 == 0) putchar(' ');
-        }
-        putchar(' ');
-        for (int j = 0; j < 16 && (i + j) < size; j++) {
-            putchar(b[i + j] >= 0x20 && b[i + j] <= 0x7E ? b[i + j] : '.');
-        }
-        printf("\r\n");
+#ifdef MQTT_TLS
+typedef MQTTNetworkTLS MQTTTransport;
+#else
+typedef MQTTNetwork MQTTTransport;
+#endif
+MQTTTransport mqttNetwork(&network);
+
+/*!
+ * The timer of the MQTT client. The Countdown of MQTTmbed.h runs on the us
+ * ticker, which stops in deep sleep, so the keep alive would expire late.
+ * This one runs on uptime_ms(), which includes the time spent in deep sleep.
+ * The client sets its keep alive timer in seconds, all others in ms, the
+ * MQTT thread wakes for the deadline of the last one set in seconds.
+ */
+class UptimeCountdown {
+public:
+    UptimeCountdown() : end_ms(uptime_ms()) {}
+
+    UptimeCountdown(int ms) { countdown_ms((unsigned long) ms); }
+
+    bool expired() { return left_ms() == 0; }
+
+    void countdown_ms(unsigned long ms) { end_ms = uptime_ms() + (uint32_t) ms; }
+
+    void countdown(int seconds) {
+        countdown_ms((unsigned long) seconds * 1000);
+        keepalive_end_ms = end_ms;
     }
-}
 
-// convert a number of characters into an unsigned integer value
-static unsigned int to_uint(const char *ptr, size_t len) {
-    unsigned int ret = 0;
-    for (uint8_t i = 0; i < len; i++) {
-        ret = (ret * 10) + (ptr[i] - '0');
+    int left_ms() {
+        const int32_t left = (int32_t) (end_ms - uptime_ms());
+        return left > 0 ? left : 0;
     }
-    return ret;
-}
 
-/*!
- * Process payload and set configuration parameters from it.
- * @param payload the payload to use, should be checked
- */
-void process_payload(char *payload) {
-    jsmntok_t *token;
-    jsmn_parser parser;
-    jsmn_init(&parser);
-
-    // identify the number of tokens in our response, we expect 13
-    const uint8_t token_count = (const uint8_t) jsmn_parse(&parser, payload, strlen(payload), NULL, 0);
-    token = (jsmntok_t *) malloc(sizeof(*token) * token_count);
-
-    // reset parser, parse and store tokens
-    jsmn_init(&parser);
-    if (jsmn_parse(&parser, payload, strlen(payload), token, token_count) == token_count &&
-        token[0].type == JSMN_OBJECT) {
-        uint8_t index = 0;
-        while (++index < token_count) {
-            if (jsoneq(payload, &token[index], P_INTERVAL) == 0 && token[index + 1].type == JSMN_PRIMITIVE) {
-                index++;
-                interval = to_uint(payload + token[index].start, (size_t) token[index].end - token[index].start);
-                PRINTF("Interval: %ds\r\n", interval);
-            } else if (jsoneq(payload, &token[index], P_THRESHOLD) == 0 && token[index + 1].type == JSMN_PRIMITIVE) {
-                index++;
-                temp_threshold = to_uint(payload + token[index].start, (size_t) token[index].end - token[index].start);
-                PRINTF("Threshold: %d\r\n", temp_threshold);
-            } else {
-                print_token("unknown key:", payload, &token[index]);
-                index++;
-            }
-        }
-    } else {
-        error_flag |= E_JSON_FAILED;
+    //! time left until the keep alive ping is due
+    static uint32_t keepalive_left_ms() {
+        const int32_t left = (int32_t) (keepalive_end_ms - uptime_ms());
+        return left > 0 ? (uint32_t) left : 0;
     }
 
-    free(token);
-}
+private:
+    uint32_t end_ms;
+    static volatile uint32_t keepalive_end_ms;
+};
+
+volatile uint32_t UptimeCountdown::keepalive_end_ms = 0;
 
+MQTT::Client<MQTTTransport, UptimeCountdown, MQTT_FRAME_SIZE> client =
+        MQTT::Client<MQTTTransport, UptimeCountdown, MQTT_FRAME_SIZE>(mqttNetwork);
+
+/*!
+ * Called from within client.yield() in the MQTT thread. The message is only
+ * copied into the downlink queue, verification happens in the downlink thread.
+ */
 void messageArrived(MQTT::MessageData &md) {
     MQTT::Message &message = md.message;
     PRINTF("Message arrived: qos %d, retained %d, dup %d, packetid %d\r\n", message.qos, message.retained, message.dup,
            message.id);
-    PRINTF("Payload %.*s\r\n", message.payloadlen, (char *) message.payload);
     ++arrivedcount;
 
+    downlink_t *downlink = downlinkMail.alloc();
+    if (!downlink || message.payloadlen > MQTT_FRAME_SIZE) {
+        LOG_W("downlink queue full, message dropped\r\n");
+        if (downlink) downlinkMail.free(downlink);
+        __sync_fetch_and_add(&mailDropped, 1);
+        ERROR_SET(E_NO_MEMORY);
+        return;
+    }
+
+    memcpy(downlink->message, message.payload, message.payloadlen);
+    downlink->message[message.payloadlen] = '\0';
+    downlink->received_ms = uptime_ms();
+    // the backend answers uplink messages, the first downlink after a publish is the candidate answer
+    downlink->rtt_ms = lastPublishMs ? downlink->received_ms - lastPublishMs : 0;
+    lastPublishMs = 0;
+    downlinkMail.put(downlink);
+}
+
+/*!
+ * Verify a downlink message and hand the validated config changes to the main thread.
+ */
+void processDownlink(downlink_t *downlink) {
+    // the last request ID seen, only used by the downlink thread
+    static uint32_t lastRequest = 0;
+    PRINTF("Payload %s\r\n", downlink->message);
+
     uc_ed25519_pub_pkcs8 response_key;
     unsigned char response_signature[SHA512_HASH_SIZE];
     memset(&response_key, 0xff, sizeof(uc_ed25519_pub_pkcs8));
     memset(response_signature, 0xf7, SHA512_HASH_SIZE);
 
 
-    char *response_payload = process_response((char *) message.payload, &response_key, response_signature);
+    char *response_payload = process_response(downlink->message, &response_key, response_signature);
+    if (!response_payload) {
+        PRINTF("no payload in response\r\n");
+        return;
+    }
 
-    dbg_dump("Received KEY    : ", (unsigned char *) &response_key, sizeof(uc_ed25519_pub_pkcs8));
-    dbg_dump("Received SIG    : ", response_signature, sizeof(response_signature));
+    LOG_DUMP("Received KEY    : ", (unsigned char *) &response_key, sizeof(uc_ed25519_pub_pkcs8));
+    LOG_DUMP("Received SIG    : ", response_signature, sizeof(response_signature));
     PRINTF("Received PAYLOAD: %s\r\n", response_payload);
 
     uc_ed25519_key remote_pub;
-    if (uc_import_ecc_pub_key_encoded(&remote_pub, &response_key)) {
-        if (uc_ecc_verify(&remote_pub, (const unsigned char *) response_payload, strlen(response_payload),
-                          response_signature, sizeof(response_signature))) {
-            process_payload(response_payload);
-            unsuccessfulSend = false;
+    cryptoMutex.lock();
+    const bool imported = uc_import_ecc_pub_key_encoded(&remote_pub, &response_key);
+    const bool verified = imported && uc_ecc_verify(&remote_pub, (const unsigned char *) response_payload,
+                                                    strlen(response_payload), response_signature,
+                                                    sizeof(response_signature));
+    cryptoMutex.unlock();
+    if (imported) {
+        if (verified) {
+            // a config message is applied as a whole or not at all
+            config_change_t change;
+            memset(&change, 0, sizeof(change));
+            change.received_ms = downlink->received_ms;
+            if (!process_payload(response_payload, &change.update, &change.request)) {
+                memset(&change.update, 0, sizeof(change.update));
+                change.status = E_JSON_FAILED;
+            }
+
+            // a round trip is counted once per request, repeated and unsolicited messages carry no new request ID
+            if (change.request && change.request != lastRequest && downlink->rtt_ms) {
+                rttMutex.lock();
+                latency_add(&downlinkRtt, downlink->rtt_ms);
+                rttMutex.unlock();
+            }
+            if (change.request) lastRequest = change.request;
+
+            // rejected changes are passed on too, to be acknowledged with their status
+            if (change.update.mask || change.request) {
+                config_change_t *queued = configMail.alloc();
+                if (queued) {
+                    *queued = change;
+                    configMail.put(queued);
+                    osSignalSet(mainThread, SIG_CONFIG);
+                } else {
+                    LOG_W("config queue full, change dropped\r\n");
+                    __sync_fetch_and_add(&mailDropped, 1);
+                }
+            }
         } else {
-            PRINTF("payload verification failed\r\n");
+            LOG_W("payload verification failed\r\n");
+            ERROR_SET(E_SIG_VRFY_FAIL);
         }
     } else {
-        PRINTF("import public key failed\r\n");
+        LOG_W("import public key failed\r\n");
     }
 
     free(response_payload);
 }
 
+int queueSigned(outbox_class_t cls, char *payload);
+
+/*!
+ * Queue the signed ack for a config change, with the applied values (or the
+ * status of a rejected change) and the time from receiving the downlink to
+ * applying it.
+ * @param change the applied or rejected change
+ * @param applied_ms when the change was applied
+ * @return 0 if the ack was queued, -1 if it was dropped
+ */
+int queueAck(const config_change_t *change, uint32_t applied_ms) {
+    char fields[SETTINGS_COUNT * 20];
+    if (change->status) snprintf(fields, sizeof(fields), PROTOCOL_ACK_STATUS, change->status);
+    else if (settings_format(&change->update, fields, sizeof(fields)) >= sizeof(fields)) fields[0] = '\0';
+
+    const unsigned long latency = applied_ms - change->received_ms;
+    const int payload_size = snprintf(NULL, 0, PROTOCOL_ACK, (unsigned long) change->request, fields, latency);
+    char *payload = (char *) malloc((size_t) payload_size + 1);
+    if (!payload) {
+        ERROR_SET(E_NO_MEMORY);
+        return -1;
+    }
+    sprintf(payload, PROTOCOL_ACK, (unsigned long) change->request, fields, latency);
+
+    return queueSigned(OUTBOX_CONFIG_ACK, payload);
+}
+
+/*!
+ * Apply all pending config changes. Each change is committed as a whole, so the
+ * sensor thread never sees a partially applied configuration. Changes with a
+ * request ID are acknowledged right away, rejected ones with their status.
+ */
+void applyConfig() {
+    osEvent evt;
+    bool acked = false;
+    while ((evt = configMail.get(0)).status == osEventMail) {
+        config_change_t *change = (config_change_t *) evt.value.p;
+        if (change->update.mask) {
+            settings_commit(&change->update);
+            stateChanged = true;
+        }
+        if (change->request && queueAck(change, uptime_ms()) == 0) acked = true;
+        configMail.free(change);
+    }
+    if (acked) osSignalSet(mqttThread, SIG_OUTBOX);
+}
+
+/*!
+ * Restore settings, loop counter and location of the last run.
+ * @return true if the state was restored (warm boot)
+ */
+bool restoreState() {
+    state_t state;
+    if (!state_load(&state)) return false;
+
+    settings_deserialize(state.settings, state.settings_len);
+    loop_counter = state.loop_counter;
+    if (*state.lat && *state.lon) {
+        strcpy(lat, state.lat);
+        strcpy(lon, state.lon);
+        haveLocation = true;
+    }
+    return true;
+}
+
+//! Save the current state, the state module skips writes if nothing changed.
+void saveState() {
+    state_t state;
+    memset(&state, 0, sizeof(state));
+    state.loop_counter = (uint32_t) loop_counter;
+    strcpy(state.lat, lat);
+    strcpy(state.lon, lon);
+    state.settings_len = (uint16_t) settings_serialize(state.settings, STATE_SETTINGS_SIZE);
+    if (!state_save(&state)) LOG_W("saving state failed\r\n");
+}
+
 int getDeviceUUID(char *deviceID) {
     uint32_t uuid[4];
 
@@ -202,48 +460,117 @@ int getDeviceUUID(char *deviceID) {
     return true;
 }
 
-int pubMqttPayload(char *topic) {
+// import the device key once, signing needs it
+static bool loadKey() {
+    cryptoMutex.lock();
+    if (!keyLoaded) {
+        uc_init();
+        keyLoaded = uc_import_ecc_key(&uc_key, device_ecc_key, device_ecc_key_len);
+    }
+    const bool loaded = keyLoaded;
+    cryptoMutex.unlock();
+    return loaded;
+}
 
-    uc_init();
-    uc_import_ecc_key(&uc_key, device_ecc_key, device_ecc_key_len);
+/*!
+ * Cache the identity. The public key is encoded during boot, while the modem
+ * comes up, the auth hash needs the IMEI and is computed once the modem is attached.
+ */
+static void cacheIdentityKey() {
+    // the mutex is recursive, loadKey() locks it again
+    cryptoMutex.lock();
+    if (!identity.key && loadKey()) {
+        identity.key = uc_base64_encode(uc_key.p, 32);
+        PRINTF("PUBKEY   : %s\r\n", identity.key);
+    }
+    cryptoMutex.unlock();
+}
 
-    //++++++++++++++++++++++++++++++++++++++++++
-    //++++++++++++++++++++++++++++++++++++++++
-    // payload structure to be signed
-    // Example: '{"t":22.0,"p":1019.5,"h":40.2,"lat":"12.475886","lon":"51.505264","bat":100,"lps":99999}'
-    int payload_size = snprintf(NULL, 0, payload_template,
-                                (int) (temperature * 100.0f), (int) pressure, (int) ((humidity) * 100.0f),
-                                (int) (altitude * 100.0f),
-                                lat, lon, level, loop_counter, error_flag);
-    char *payload = (char *)malloc((size_t) payload_size);
-    sprintf(payload, payload_template,
-            (int) (temperature * 100.0f), (int) (pressure), (int) ((humidity) * 100.0f), (int) (altitude * 100.0f),
-            lat, lon, level, loop_counter, error_flag);
-
-    error_flag = 0x00;
-
-    const char *imei = network.get_imei();
-
-    // be aware that you need to free these strings after use
-    char *auth_hash = uc_sha512_encoded((const unsigned char *) imei, strnlen(imei, 15));
-    char *pub_key_hash = uc_base64_encode(uc_key.p, 32);
-    char *payload_hash = uc_ecc_sign_encoded(&uc_key, (const unsigned char *) payload, strlen(payload));
-
-    PRINTF("PUBKEY   : %s\r\n", pub_key_hash);
-    PRINTF("AUTH     : %s\r\n", auth_hash);
-    PRINTF("SIGNATURE: %s\r\n", payload_hash);
-
-    int message_size = snprintf(NULL, 0, message_template, auth_hash, pub_key_hash, payload_hash, payload);
-    char *message = (char *) malloc((size_t) (message_size + 1));
-    sprintf(message, message_template, auth_hash, pub_key_hash, payload_hash, payload);
-
-    // free hashes
-    delete (auth_hash);
-    delete (pub_key_hash);
-    delete (payload_hash);
+static void cacheIdentityAuth() {
+    cryptoMutex.lock();
+    if (!identity.auth) {
+        const char *imei = network.get_imei();
+        identity.auth = uc_sha512_encoded((const unsigned char *) imei, strnlen(imei, 15));
+        PRINTF("AUTH     : %s\r\n", identity.auth);
+    }
+    cryptoMutex.unlock();
+}
+
+//! Sign with the device key, the signature is Base64 encoded and must be freed after use.
+static char *signEncoded(const unsigned char *data, size_t len) {
+    cryptoMutex.lock();
+    char *signature = uc_ecc_sign_encoded(&uc_key, data, len);
+    cryptoMutex.unlock();
+    return signature;
+}
+
+/*!
+ * Sign the payload and queue it for publishing. Batch signed telemetry is
+ * queued unsigned, the window is signed when the outbox is drained.
+ * @param cls the message class, decides the send priority
+ * @param payload the payload to sign, the queue takes ownership
+ * @return 0 if the message was queued, -1 if it was dropped
+ */
+int queueSigned(outbox_class_t cls, char *payload) {
+    if (!loadKey()) {
+        LOG_W("device key not loaded, dropped message (class %d)\r\n", cls);
+        free(payload);
+        return -1;
+    }
+
+    outbox_entry_t entry = {payload, NULL, NULL, NULL, 0, uptime_ms()};
+    const bool batched = BATCH_WINDOW > 1 && cls == OUTBOX_TELEMETRY;
+
+    // check capacity before signing, payloads that exceed a frame are sent chunked with a signed manifest
+    char *manifest = NULL;
+    size_t overhead = protocol_overhead(protocol_mode);
+    if (batched) overhead += protocol_proof_overhead(MERKLE_MAX_LEAVES);
+    if (strlen(payload) + overhead > frameCapacity) {
+        entry.transfer = ++transferId;
+        manifest = protocol_manifest(entry.transfer, payload, protocol_chunk_size(frameCapacity));
+        if (!manifest) {
+            free(payload);
+            ERROR_SET(E_NO_MEMORY);
+            return -1;
+        }
+        PRINTF("MANIFEST : %s\r\n", manifest);
+    }
+    const char *signed_data = manifest ? manifest : payload;
+
+    // be aware that the signature needs to be freed after use (done by the outbox)
+    char *payload_hash = NULL;
+    if (!batched) {
+        payload_hash = signEncoded((const unsigned char *) signed_data, strlen(signed_data));
+        if (!payload_hash) {
+            free(payload);
+            free(manifest);
+            ERROR_SET(E_NO_MEMORY);
+            return -1;
+        }
+        PRINTF("SIGNATURE: %s\r\n", payload_hash);
+    }
 
+    entry.manifest = manifest;
+    entry.signature = payload_hash;
+    outboxMutex.lock();
+    const int queued = outbox_push(&outbox, cls, &entry);
+    outboxMutex.unlock();
+    if (!queued) {
+        LOG_W("outbox full, dropped message (class %d)\r\n", cls);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * Publish a single message frame.
+ * @param topic the topic to publish to
+ * @param message the message, must fit into the frame
+ * @return 0 on success, -1 if publishing failed
+ */
+int pubMqttFrame(char *topic, char *message) {
     PRINTF("--MESSAGE (%d)\r\n", strlen(message));
-    PRINTF(message);
+    PRINTF("%s", message);
     PRINTF("\r\n--MESSAGE\r\n");
 
     MQTT::Message mqmessage;
@@ -253,29 +580,332 @@ int pubMqttPayload(char *topic) {
     mqmessage.retained = false;
     mqmessage.dup = false;
     mqmessage.payload = (void *) message;
-    mqmessage.payloadlen = strlen(message) + 1;
+    mqmessage.payloadlen = strlen(message);
 
-    printf("OUT: %s\r\n", topic);
+    PRINTF("OUT: %s\r\n", topic);
     rc = client.publish(topic, mqmessage);
 
+    if (rc != 0) {
+        mqttConnected = false;
+
+        LOG_E("Failed to publish: %d\r\n", rc);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*!
+ * Publish a signed payload wrapped into the message envelope.
+ * @param topic the topic to publish to
+ * @param mode the envelope mode
+ * @param payload the signed payload
+ * @param payload_hash the Base64 encoded payload signature (of the Merkle root if batch signed)
+ * @param proof the inclusion proof of a batch signed payload, or NULL
+ * @return 0 on success, -1 if publishing failed
+ */
+int pubMqttMessage(char *topic, protocol_mode_t mode, const char *payload, const char *payload_hash,
+                   const char *proof) {
+    // normally cached during boot and connect already
+    cacheIdentityKey();
+    cacheIdentityAuth();
+
+    char *message = protocol_batch_message(mode, &identity, payload_hash, proof, payload);
+    if (!message) {
+        ERROR_SET(E_NO_MEMORY);
+        return -1;
+    }
+
+    const int rc = pubMqttFrame(topic, message);
+
     // the message is also dynamically allocated, free it after use
     free(message);
 
-    if (rc != 0) {
-        unsuccessfulSend = true;
-        mqttConnected = false;
+    if (rc == 0) lastPublishMs = uptime_ms();
+    return rc;
+}
+
+/*!
+ * Start a new session and publish the signed identity message binding the
+ * session ID to the device key. Must be sent before any session mode message.
+ * @param topic the topic to publish to
+ * @return 0 on success, -1 if publishing failed
+ */
+int pubMqttIdentity(char *topic) {
+    if (!loadKey()) return -1;
+    cryptoMutex.lock();
+    const bool started = protocol_new_session(&identity);
+    cryptoMutex.unlock();
+    if (!started) return -1;
+    PRINTF("SESSION  : %s\r\n", identity.sid);
+
+    char *payload = protocol_identity_payload(&identity);
+    char *payload_hash = payload ? signEncoded((const unsigned char *) payload, strlen(payload)) : NULL;
+
+    const int rc = payload_hash ? pubMqttMessage(topic, PROTOCOL_FULL, payload, payload_hash, NULL) : -1;
+    free(payload);
+    free(payload_hash);
+
+    if (rc == 0) sessionAnnounced = true;
+    return rc;
+}
+
+/*!
+ * Publish a queued message, either as a single frame or as a chunked transfer
+ * followed by the signed manifest.
+ * @param topic the topic to publish to
+ * @param entry the queued message
+ * @return 0 on success, -1 if publishing failed (the whole transfer will be repeated)
+ */
+int pubMqttEntry(char *topic, outbox_entry_t *entry) {
+    if (!entry->manifest) return pubMqttMessage(topic, protocol_mode, entry->payload, entry->signature, entry->proof);
+
+    // the chunk size is the same the manifest was created with
+    const size_t chunk_size = protocol_chunk_size(frameCapacity);
+    const size_t len = strlen(entry->payload);
+
+    uint16_t seq = 0;
+    for (size_t offset = 0; offset < len; offset += chunk_size, seq++) {
+        const size_t n = len - offset < chunk_size ? len - offset : chunk_size;
+        char *chunk = protocol_chunk(entry->transfer, seq, entry->payload + offset, n);
+        if (!chunk) {
+            ERROR_SET(E_NO_MEMORY);
+            return -1;
+        }
+        const int rc = pubMqttFrame(topic, chunk);
+        free(chunk);
+        if (rc != 0) return -1;
+    }
+
+    return pubMqttMessage(topic, protocol_mode, entry->manifest, entry->signature, entry->proof);
+}
+
+#if BATCH_WINDOW > 1
+/*!
+ * Sign the telemetry queued since the last window with one signature over
+ * the Merkle root of the messages, each message gets its inclusion proof.
+ * The outbox must be locked.
+ * @return true if the window was signed or there was nothing to sign
+ */
+bool signWindow() {
+    // the unsigned messages are the newest ones, older windows may wait for a retry
+    const uint8_t queued = outbox_count(&outbox, OUTBOX_TELEMETRY);
+    uint8_t first = queued;
+    while (first > 0 && !outbox_at(&outbox, OUTBOX_TELEMETRY, (uint8_t) (first - 1))->signature) first--;
+    if (first == queued) return true;
+    if (!loadKey()) return false;
+
+    merkle_init(&batchTree);
+    for (uint8_t i = first; i < queued; i++) {
+        const outbox_entry_t *entry = outbox_at(&outbox, OUTBOX_TELEMETRY, i);
+        const char *signed_data = entry->manifest ? entry->manifest : entry->payload;
+        if (!merkle_add(&batchTree, (const unsigned char *) signed_data, strlen(signed_data))) return false;
+    }
+    const unsigned char *root = merkle_build(&batchTree);
+    char *signature = root ? signEncoded(root, MERKLE_HASH_SIZE) : NULL;
+    if (!signature) {
+        ERROR_SET(E_NO_MEMORY);
+        return false;
+    }
+    PRINTF("SIGNATURE: %s (%d messages)\r\n", signature, batchTree.count);
+
+    // all messages of the window are signed, or none
+    bool signedAll = true;
+    for (uint8_t i = first; i < queued && signedAll; i++) {
+        outbox_entry_t *entry = outbox_at(&outbox, OUTBOX_TELEMETRY, i);
+        unsigned char siblings[MERKLE_MAX_DEPTH][MERKLE_HASH_SIZE];
+        const uint8_t index = (uint8_t) (i - first);
+        const size_t len = merkle_proof(&batchTree, index, siblings);
+        entry->proof = protocol_proof(index, batchTree.count, siblings, len);
+        entry->signature = strdup(signature);
+        signedAll = entry->proof && entry->signature;
+    }
+    if (!signedAll) {
+        for (uint8_t i = first; i < queued; i++) {
+            outbox_entry_t *entry = outbox_at(&outbox, OUTBOX_TELEMETRY, i);
+            free(entry->proof);
+            free(entry->signature);
+            entry->proof = NULL;
+            entry->signature = NULL;
+        }
+        ERROR_SET(E_NO_MEMORY);
+    }
+    free(signature);
+    return signedAll;
+}
+#endif
 
-        printf("Failed to publish: %d\r\n", rc);
+/*!
+ * Publish queued messages in priority order. A message stays queued
+ * until it was published successfully.
+ * @param topic the topic to publish to
+ * @return 0 if the queue was drained, -1 if publishing failed
+ */
+int drainOutbox(char *topic) {
+    if (protocol_mode == PROTOCOL_SESSION && !sessionAnnounced && pubMqttIdentity(topic) != 0) return -1;
+
+    // a message is taken off the queue while it is published, so queueing does not wait for the network
+    // and the drop policy cannot free it meanwhile; it goes back to the front if publishing failed
+    outbox_class_t cls;
+    outbox_entry_t entry;
+    int rc = 0;
+    outboxMutex.lock();
+#if BATCH_WINDOW > 1
+    if (!signWindow()) {
+        outboxMutex.unlock();
         return -1;
     }
+#endif
+    while (rc == 0 && outbox_take(&outbox, &cls, &entry)) {
+        outboxMutex.unlock();
+        rc = pubMqttEntry(topic, &entry);
+        if (rc == 0 && !boot_time(BOOT_PUBLISHED)) {
+            boot_mark(BOOT_PUBLISHED, uptime_ms());
+            boot_report();
+        }
+        outboxMutex.lock();
+        if (rc == 0) outbox_release(&entry);
+        else outbox_requeue(&outbox, cls, &entry);
+    }
+    outboxMutex.unlock();
+    return rc;
+}
 
+int queueTelemetry() {
+    // payload structure to be signed
+    // Example: '{"t":2200,"p":1019,"h":4020,"a":3410,"la":"12.475886","lo":"51.505264","ba":100,"lp":99999,"e":0}'
+    telemetry_t telemetry;
+    memset(&telemetry, 0, sizeof(telemetry));
+
+    // the values of all registered sensors, a channel must be declared in the schema to be sent
+    const char *keys[REPORT_MAX_CHANNELS];
+    int32_t values[REPORT_MAX_CHANNELS];
+    const size_t count = sensors_values(keys, values, REPORT_MAX_CHANNELS);
+    if (telemetry_set_sensors(&telemetry, keys, values, count)) LOG_W("sensor channel not in the telemetry schema\r\n");
+
+    telemetry_set_string(&telemetry, TELEMETRY_LATITUDE, lat);
+    telemetry_set_string(&telemetry, TELEMETRY_LONGITUDE, lon);
+    telemetry.battery = level;
+    telemetry.loop = (int32_t) loop_counter;
+    // flags set by other threads from here on go with the next telemetry
+    const uint8_t errors = ERROR_TAKE();
+    telemetry.error = errors;
+    telemetry.present |= 1u << TELEMETRY_BATTERY | 1u << TELEMETRY_LOOP | 1u << TELEMETRY_ERROR;
+
+    char json[TELEMETRY_JSON_SIZE];
+    const size_t len = telemetry_json(&telemetry, json);
+    char *payload = (char *) malloc(len + 1);
+    if (!payload) {
+        ERROR_SET(errors | E_NO_MEMORY);
+        return -1;
+    }
+    memcpy(payload, json, len + 1);
 
-    unsuccessfulSend = false;
+    return queueSigned(OUTBOX_TELEMETRY, payload);
+}
 
-//    while (arrivedcount < 1)
-//        client.yield(100);
+/*!
+ * Queue a heartbeat, the minimal message sent when nothing changed for the heartbeat interval.
+ */
+int queueHeartbeat() {
+    int payload_size = snprintf(NULL, 0, PROTOCOL_HEARTBEAT, loop_counter);
+    char *payload = (char *) malloc((size_t) payload_size + 1);
+    if (!payload) {
+        ERROR_SET(E_NO_MEMORY);
+        return -1;
+    }
+    sprintf(payload, PROTOCOL_HEARTBEAT, loop_counter);
 
-    return 0;
+    return queueSigned(OUTBOX_TELEMETRY, payload);
+}
+
+/*!
+ * Queue the scheduled report: telemetry, a heartbeat or nothing, depending on the
+ * report mode and the changes since the last sent telemetry.
+ * @return 0 if a message was queued, 1 if there was nothing to send, -1 on error
+ */
+int queueReport() {
+    const char *keys[REPORT_MAX_CHANNELS];
+    int32_t values[REPORT_MAX_CHANNELS];
+    const size_t count = sensors_values(keys, values, REPORT_MAX_CHANNELS);
+    const uint32_t now = uptime_ms();
+
+    // errors are always reported with the full payload
+    const report_action_t action = error_flag ? REPORT_TELEMETRY
+                                              : report_check(&lastReport, keys, values, count, now);
+    if (action == REPORT_SKIP) return 1;
+
+    const int rc = action == REPORT_TELEMETRY ? queueTelemetry() : queueHeartbeat();
+    if (rc == 0) report_sent(&lastReport, action, keys, values, count, now);
+    return rc;
+}
+
+/*!
+ * Queue a threshold alert. Alerts are sent ahead of any other queued
+ * message, independent of the reporting interval.
+ * @param event the alert event (raised, repeated, cleared)
+ * @param temp the temperature (*100) that caused the event
+ */
+int queueAlert(alert_event_t event, int temp) {
+    const int threshold = (int) settings_get(SETTING_THRESHOLD);
+    int payload_size = snprintf(NULL, 0, PROTOCOL_ALERT, event, temp, threshold, lat, lon, loop_counter);
+    char *payload = (char *) malloc((size_t) payload_size + 1);
+    if (!payload) {
+        ERROR_SET(E_NO_MEMORY);
+        return -1;
+    }
+    sprintf(payload, PROTOCOL_ALERT, event, temp, threshold, lat, lon, loop_counter);
+
+    return queueSigned(OUTBOX_ALERT, payload);
+}
+
+/*!
+ * Queue the stats message: time spent in each power state, wake-ups and drops.
+ */
+int queueStats() {
+    power_update_stats(uptime_ms());
+
+    uint32_t dropped = mailDropped;
+    outboxMutex.lock();
+    for (int cls = 0; cls < OUTBOX_CLASSES; cls++) dropped += outbox_dropped(&outbox, (outbox_class_t) cls);
+    outboxMutex.unlock();
+    stats_set(STAT_DROPPED, dropped);
+    stats_set(STAT_LOG_DROPPED, log_dropped());
+
+    rttMutex.lock();
+    stats_set(STAT_RTT_COUNT, downlinkRtt.count);
+    stats_set(STAT_RTT_P50, latency_percentile(&downlinkRtt, 50));
+    stats_set(STAT_RTT_P90, latency_percentile(&downlinkRtt, 90));
+    stats_set(STAT_RTT_P99, latency_percentile(&downlinkRtt, 99));
+    stats_set(STAT_RTT_MAX, downlinkRtt.max_ms);
+    rttMutex.unlock();
+
+    char *payload = stats_payload();
+    if (!payload) {
+        ERROR_SET(E_NO_MEMORY);
+        return -1;
+    }
+    return queueSigned(OUTBOX_STATS, payload);
+}
+
+int mqttConnect(char *topic, char *deviceUUID);
+
+/*!
+ * Connect if necessary and publish everything that is queued.
+ */
+void flushOutbox(char *topic_send, char *topic_receive) {
+    outboxMutex.lock();
+    const uint8_t pending = outbox_pending(&outbox);
+    // batch signed telemetry waits for a complete window, unless other messages go out anyway
+    const bool windowOpen = BATCH_WINDOW > 1 && pending == outbox_count(&outbox, OUTBOX_TELEMETRY) &&
+                            pending < BATCH_WINDOW;
+    outboxMutex.unlock();
+
+    if (!pending || windowOpen) return;
+    if (!mqttConnected)
+        mqttConnect(topic_receive, deviceUUID);
+    if (mqttConnected)
+        drainOutbox(topic_send);
 }
 
 
@@ -292,14 +922,16 @@ int mqttConnect(char *topic, char *deviceUUID) {
 
         if (network.connect(CELL_APN, CELL_USER, CELL_PWD) != 0)
             return false;
+        boot_mark(BOOT_MODEM, uptime_ms());
+        cacheIdentityAuth();
 
         network.getModemBattery(&status, &level, &voltage);
-        printf("the battery status %d, level %d, voltage %d\r\n", status, level, voltage);
+        LOG_I("the battery status %d, level %d, voltage %d\r\n", status, level, voltage);
 
         PRINTF("Connecting to %s:%d\r\n", UMQTT_HOST, UMQTT_HOST_PORT);
         rc = mqttNetwork.connect(UMQTT_HOST, UMQTT_HOST_PORT);
         if (rc != 0) {
-            PRINTF("rc from TCP connect is %d\r\n", rc);
+            LOG_E("rc from connect is %d\r\n", rc);
             mqttConnected = false;
             return false;
         }
@@ -315,27 +947,44 @@ int mqttConnect(char *topic, char *deviceUUID) {
 
         if ((rc = client.connect(data)) == 0) {
             if ((rc = client.subscribe(topic, MQTT::QOS1, messageArrived)) == 0) {
-                PRINTF("Connected and subscribed\r\n");
+                LOG_I("Connected and subscribed\r\n");
                 mqttConnected = true;
+                sessionAnnounced = false;
+                // round trip times are per session
+                rttMutex.lock();
+                latency_reset(&downlinkRtt);
+                rttMutex.unlock();
+                lastPublishMs = 0;
+                boot_mark(BOOT_MQTT, uptime_ms());
             } else {
-                PRINTF("rc from MQTT subscribe is %d\r\n", rc);
+                LOG_E("rc from MQTT subscribe is %d\r\n", rc);
                 mqttConnected = false;
                 return false;
             }
         } else {
-            PRINTF("rc from MQTT connect is %d\r\n", rc);
+            LOG_E("rc from MQTT connect is %d\r\n", rc);
             mqttConnected = false;
             return false;
         }
     }
 
-    for (int lc = 0; lc < 3 && !gotLocation; lc++) {
-        gotLocation = network.get_location_date(lat, lon, &date_time);
+    // keep the last known (or restored) location if the lookup fails
+    char newLat[STATE_LOCATION_LENGTH], newLon[STATE_LOCATION_LENGTH];
+    const int attempts = haveLocation ? 1 : LOCATION_ATTEMPTS;
+    for (int lc = 0; lc < attempts && !gotLocation; lc++) {
+        gotLocation = network.get_location_date(newLat, newLon, &date_time);
         PRINTF("setting current time from GSM\r\n");
         PRINTF("%04hd-%02hd-%02hd %02hd:%02hd:%02hd\r\n",
                date_time.year, date_time.month, date_time.day, date_time.hour, date_time.minute, date_time.second);
+    }
+    if (gotLocation) {
+        if (strcmp(lat, newLat) || strcmp(lon, newLon)) stateChanged = true;
+        strcpy(lat, newLat);
+        strcpy(lon, newLon);
+        haveLocation = true;
         PRINTF("lat is %s lon %s\r\n", lat, lon);
     }
+    boot_mark(BOOT_LOCATION, uptime_ms());
     return true;
 }
 
@@ -346,51 +995,236 @@ void led_thread(void const *args) {
     }
 }
 
-void bme_thread(void const *args) {
+void lockBus() {
+    i2c.lock();
+}
+
+void unlockBus() {
+    i2c.unlock();
+}
+
+void lockModem() {
+    modemMutex.lock();
+}
+
+void unlockModem() {
+    modemMutex.unlock();
+}
+
+/*!
+ * Called by the sensor scheduler after each sample, runs the alert detection.
+ */
+void sensorSampled(int id, const float *values, uint32_t now_ms) {
+    if (!values) {
+        ERROR_SET(E_SENSOR_FAILED);
+        return;
+    }
+    if (id != bmeId) return;
+
+    // take a consistent snapshot of the alert config
+    static const setting_id_t alert_settings[] = {SETTING_THRESHOLD, SETTING_HYSTERESIS, SETTING_ALERT_INTERVAL};
+    int32_t alert_config[3];
+    settings_read(alert_settings, alert_config, 3);
+
+    const int temp = (int) (values[BME280_TEMPERATURE] * 100);
+    const alert_event_t event = alert_check(&alert_state, temp, alert_config[0], alert_config[1],
+                                            (uint32_t) alert_config[2] * 1000, now_ms);
+    if (event != ALERT_NONE) {
+        alert_t *alert = alertMail.alloc();
+        if (alert) {
+            alert->event = event;
+            alert->temperature = temp;
+            alertMail.put(alert);
+        } else {
+            LOG_W("alert queue full, dropped event %d\r\n", event);
+            __sync_fetch_and_add(&mailDropped, 1);
+            ERROR_SET(E_NO_MEMORY);
+        }
+        osSignalSet(mainThread, SIG_ALERT);
+    }
+    if (!boot_time(BOOT_SENSOR)) {
+        boot_mark(BOOT_SENSOR, now_ms);
+        osSignalSet(mainThread, SIG_SAMPLE);
+    }
+}
+
+/*!
+ * The sensor thread runs the scheduler for all registered sensors.
+ */
+void sensor_thread(void const *args) {
+    while (true) {
+        // the BME280 applies a new profile with the next sample
+        bmeSensor.profile = (uint8_t) settings_get(SETTING_BME_PROFILE);
+        const uint32_t wait = sensors_run(uptime_ms());
+        Thread::wait(wait < SENSOR_MAX_WAIT ? wait : SENSOR_MAX_WAIT);
+    }
+}
+
+/*!
+ * The log thread writes buffered log records to the UART at low priority.
+ */
+void log_thread(void const *args) {
+    while (true) {
+        // the UART must not stop in the middle of a record
+        power_lock_deepsleep();
+        log_flush();
+        power_unlock_deepsleep();
+        Thread::wait(log_pending() ? LOG_FLUSH_PERIOD : LOG_IDLE_PERIOD);
+    }
+}
+
+/*!
+ * The MQTT thread owns the client: it connects, yields to receive downlink
+ * messages and publishes queued messages.
+ */
+void mqtt_thread(void const *args) {
+    // the modem UART must be clocked while talking to the modem, deep sleep only while waiting
+    power_lock_deepsleep();
+    modemMutex.lock();
+    mqttConnect(topic_receive, deviceUUID);
 
     while (true) {
-        temperature = bmeSensor.getTemperature();
-        pressure = bmeSensor.getPressure();
-        humidity = bmeSensor.getHumidity();
-        altitude = 44330.0f * (1.0f - (float) pow(pressure / (float) PRESSURE_SEA_LEVEL, 1 / 5.255));
+        // also retries messages that failed to publish before
+        flushOutbox(topic_send, topic_receive);
+
+        if (mqttConnected) {
+            // sleep until something is queued, the modem rings or the next poll or ping is due; the UART does not
+            // receive in deep sleep, without the RI line incoming data is buffered by the modem until the poll
+            modemMutex.unlock();
+            power_unlock_deepsleep();
+#ifdef GSM_RI
+            osSignalWait(0, schedule_mqtt_wait(RING_WAIT, UptimeCountdown::keepalive_left_ms()));
+#else
+            osSignalWait(0, schedule_mqtt_wait(POLL_WAIT, UptimeCountdown::keepalive_left_ms()));
+#endif
+            power_lock_deepsleep();
+            modemMutex.lock();
+            client.yield(YIELD_SLICE);
+        } else {
+            // wait for something new to send, or retry after a loop period
+            modemMutex.unlock();
+            power_unlock_deepsleep();
+            osSignalWait(SIG_OUTBOX, LOOP_PERIOD);
+            power_lock_deepsleep();
+            modemMutex.lock();
+        }
+    }
+}
 
-        Thread::wait(10000);
+#ifdef GSM_RI
+void modemRang() {
+    osSignalSet(mqttThread, SIG_RING);
+}
+#endif
+
+/*!
+ * The downlink thread verifies received messages, decoupled from the MQTT I/O.
+ */
+void downlink_thread(void const *args) {
+    while (true) {
+        osEvent evt = downlinkMail.get();
+        if (evt.status != osEventMail) continue;
+
+        downlink_t *downlink = (downlink_t *) evt.value.p;
+        processDownlink(downlink);
+        downlinkMail.free(downlink);
     }
 }
 
 osThreadDef(led_thread, osPriorityNormal, DEFAULT_STACK_SIZE);
-osThreadDef(bme_thread, osPriorityNormal, DEFAULT_STACK_SIZE);
+osThreadDef(sensor_thread, osPriorityNormal, DEFAULT_STACK_SIZE);
+osThreadDef(mqtt_thread, osPriorityNormal, MQTT_STACK_SIZE);
+osThreadDef(downlink_thread, osPriorityBelowNormal, DOWNLINK_STACK_SIZE);
+osThreadDef(log_thread, osPriorityLow, DEFAULT_STACK_SIZE);
 
 int main(int argc, char *argv[]) {
-    osThreadCreate(osThread(led_thread), NULL);
-    osThreadCreate(osThread(bme_thread), NULL);
+    mainThread = osThreadGetId();
+    power_init();
+    settings_init();
+    state_init(lockModem, unlockModem);
+    const bool warmBoot = restoreState();
+    alert_init(&alert_state);
+    report_init(&lastReport);
+    boot_mark(BOOT_STATE, uptime_ms());
+
+    // the SWAR Base64 encoder (DSP instructions) only replaces the scalar one if it gives the same results on this MCU,
+    // selected before any other thread encodes
+    if (!uc_base64_self_test(UC_BASE64_SWAR) || !uc_base64_select(UC_BASE64_SWAR))
+        LOG_W("base64 SWAR self test failed, using the scalar codec\r\n");
+
+    osThreadCreate(osThread(log_thread), NULL);
 
     getDeviceUUID(deviceUUID);
-    int len = snprintf(NULL, 0, topicTemplate, deviceUUID, "out");
-    char *topic_receive = (char *)malloc((size_t) len);
-    sprintf(topic_receive, topicTemplate, deviceUUID, "out");
-    printf("RECEIVE: \"%s\"\r\n", topic_receive);
+    int len = snprintf(NULL, 0, PROTOCOL_TOPIC, deviceUUID, "out");
+    topic_receive = (char *)malloc((size_t) len + 1);
+    sprintf(topic_receive, PROTOCOL_TOPIC, deviceUUID, "out");
+    LOG_I("RECEIVE: \"%s\"\r\n", topic_receive);
+
+    len = snprintf(NULL, 0, PROTOCOL_TOPIC, deviceUUID, "");
+    topic_send = (char *)malloc((size_t) len + 1);
+    sprintf(topic_send, PROTOCOL_TOPIC, deviceUUID, "");
+    LOG_I("SEND: \"%s\"\r\n", topic_send);
+    if (warmBoot) LOG_I("warm boot: loop %d, location %s,%s\r\n", loop_counter, lat, lon);
+    frameCapacity = MQTT_FRAME_SIZE - MQTT_FRAME_HEADER - strlen(topic_send);
+
+    // modem power-up and network attach take longest, start them first in the MQTT thread
+    mqttThread = osThreadCreate(osThread(mqtt_thread), NULL);
+    osThreadCreate(osThread(downlink_thread), NULL);
+#ifdef GSM_RI
+    modemRing.fall(modemRang);
+#endif
+#if HEARTBEAT_LED
+    osThreadCreate(osThread(led_thread), NULL);
+#endif
+    sensors_init(lockBus, unlockBus, sensorSampled);
+    bmeId = sensors_register(&bmeDriver);
+    if (bmeId < 0) LOG_E("BME280 init failed\r\n");
+    osThreadCreate(osThread(sensor_thread), NULL);
+    boot_mark(BOOT_THREADS, uptime_ms());
 
-    len = snprintf(NULL, 0, topicTemplate, deviceUUID, "");
-    char *topic_send = (char *)malloc((size_t) len);
-    sprintf(topic_send, topicTemplate, deviceUUID, "");
-    printf("SEND: \"%s\"\r\n", topic_send);
+    // meanwhile seed the RNG, import the key and cache the identity
+    if (loadKey()) boot_mark(BOOT_CRYPTO, uptime_ms());
+    else LOG_E("loading the device key failed\r\n");
+    cacheIdentityKey();
+    if (identity.key) boot_mark(BOOT_IDENTITY, uptime_ms());
 
-    mqttConnect(topic_receive, deviceUUID);
+    // the first payload carries a real sample, it is signed and queued before the link is up
+    osSignalWait(SIG_SAMPLE, SENSOR_WARMUP_TIMEOUT);
 
     while (1) {
-//        printf("send? %d %% ((%d / %d) == %d\r\n", loop_counter, MAX_INTERVAL, interval,
-//               loop_counter % (MAX_INTERVAL / interval));
-//        printf("temp (%d) > threshold (%d)?\r\n", ((int) (temperature * 100)), temp_threshold);
-//        printf("unsuccessful? == %d\r\n", unsuccessfulSend);
-        if (((int) (temperature * 100)) > temp_threshold || (loop_counter % (MAX_INTERVAL / interval) == 0) || unsuccessfulSend) {
-            if (!mqttConnected)
-                mqttConnect(topic_receive, deviceUUID);
-
-            pubMqttPayload(topic_send);
+        const uint32_t due = schedule_loop((uint32_t) loop_counter, settings_get(SETTING_INTERVAL));
+        if ((due & SCHEDULE_REPORT) || !boot_time(BOOT_SIGNED)) {
+            if (queueReport() == 0) boot_mark(BOOT_SIGNED, uptime_ms());
+            osSignalSet(mqttThread, SIG_OUTBOX);
+        }
+        if (due & SCHEDULE_STATS) {
+            queueStats();
+            osSignalSet(mqttThread, SIG_OUTBOX);
+        }
+
+        // wait for the next loop, alerts and config changes are handled right away
+        const uint32_t loop_start = uptime_ms();
+        uint32_t elapsed;
+        while ((elapsed = uptime_ms() - loop_start) < LOOP_PERIOD) {
+            osEvent evt = osSignalWait(0, LOOP_PERIOD - elapsed);
+            if (evt.status != osEventSignal) continue;
+
+            if (evt.value.signals & SIG_ALERT) {
+                osEvent alertEvt;
+                while ((alertEvt = alertMail.get(0)).status == osEventMail) {
+                    alert_t *alert = (alert_t *) alertEvt.value.p;
+                    queueAlert(alert->event, alert->temperature);
+                    alertMail.free(alert);
+                }
+                osSignalSet(mqttThread, SIG_OUTBOX);
+            }
+            if (evt.value.signals & SIG_CONFIG) applyConfig();
         }
-        client.yield(10000);
         loop_counter++;
-        printf(".");
+        if (stateChanged || (due & SCHEDULE_SAVE_STATE)) {
+            stateChanged = false;
+            saveState();
+        }
+        LOG_D(".");
     }
-}
\ No newline at end of file
+}
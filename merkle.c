@@ -0,0 +1,122 @@
+/*!
+ * @file
+ * @brief Merkle tree of message hashes, for signing a window of messages once.
+ *
+ * @date 2017-04-27
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "crypto/crypto.h"
+#include "merkle.h"
+
+#define MERKLE_LEAF_PREFIX 0x00
+#define MERKLE_NODE_PREFIX 0x01
+
+// the tree layout depends on the hash size
+typedef char merkle_hash_is_sha512[MERKLE_HASH_SIZE == SHA512_HASH_SIZE ? 1 : -1];
+
+// hash of the prefix, left and right
+static int merkle_node(const unsigned char *left, const unsigned char *right, unsigned char *node) {
+    unsigned char data[1 + 2 * MERKLE_HASH_SIZE];
+    data[0] = MERKLE_NODE_PREFIX;
+    memcpy(data + 1, left, MERKLE_HASH_SIZE);
+    memcpy(data + 1 + MERKLE_HASH_SIZE, right, MERKLE_HASH_SIZE);
+    return uc_sha512(data, sizeof(data), node);
+}
+
+int merkle_leaf(const unsigned char *data, size_t len, unsigned char *leaf) {
+    static const unsigned char prefix = MERKLE_LEAF_PREFIX;
+    Sha512 sha512;
+    if (wc_InitSha512(&sha512) != 0) return false;
+    // the signed data can be a whole frame, it is hashed behind the prefix without a copy
+    const int ok = wc_Sha512Update(&sha512, &prefix, 1) == 0 && wc_Sha512Update(&sha512, data, (word32) len) == 0;
+    return wc_Sha512Final(&sha512, leaf) == 0 && ok;
+}
+
+void merkle_init(merkle_tree_t *tree) {
+    tree->count = 0;
+    tree->size = 0;
+}
+
+int merkle_add(merkle_tree_t *tree, const unsigned char *data, size_t len) {
+    if (tree->size || tree->count == MERKLE_MAX_LEAVES) return false;
+    if (!merkle_leaf(data, len, tree->nodes[tree->count])) return false;
+    tree->count++;
+    return true;
+}
+
+const unsigned char *merkle_build(merkle_tree_t *tree) {
+    if (!tree->count) return NULL;
+
+    // level by level, a node without a sibling is copied up
+    size_t level = 0, width = tree->count, next = tree->count;
+    while (width > 1) {
+        for (size_t i = 0; i < width; i += 2) {
+            unsigned char *parent = tree->nodes[next + i / 2];
+            if (i + 1 < width) {
+                if (!merkle_node(tree->nodes[level + i], tree->nodes[level + i + 1], parent)) return NULL;
+            } else {
+                memcpy(parent, tree->nodes[level + i], MERKLE_HASH_SIZE);
+            }
+        }
+        level = next;
+        width = (width + 1) / 2;
+        next = level + width;
+    }
+    tree->size = (uint8_t) next;
+    return tree->nodes[level];
+}
+
+size_t merkle_proof(const merkle_tree_t *tree, uint8_t index, unsigned char proof[][MERKLE_HASH_SIZE]) {
+    size_t len = 0, level = 0, width = tree->count, i = index;
+    while (width > 1) {
+        const size_t sibling = i ^ 1;
+        if (sibling < width) memcpy(proof[len++], tree->nodes[level + sibling], MERKLE_HASH_SIZE);
+        level += width;
+        width = (width + 1) / 2;
+        i /= 2;
+    }
+    return len;
+}
+
+size_t merkle_proof_length(uint32_t index, uint32_t count) {
+    size_t len = 0;
+    for (uint64_t width = count, i = index; width > 1; width = (width + 1) / 2, i /= 2) {
+        if ((i ^ 1) < width) len++;
+    }
+    return len;
+}
+
+int merkle_root_from_proof(const unsigned char *leaf, uint32_t index, uint32_t count,
+                           const unsigned char proof[][MERKLE_HASH_SIZE], size_t len, unsigned char *root) {
+    if (index >= count || len != merkle_proof_length(index, count)) return false;
+
+    unsigned char node[MERKLE_HASH_SIZE];
+    memcpy(node, leaf, MERKLE_HASH_SIZE);
+    size_t p = 0;
+    for (uint64_t width = count, i = index; width > 1; width = (width + 1) / 2, i /= 2) {
+        if ((i ^ 1) >= width) continue;
+        const int ok = i & 1 ? merkle_node(proof[p], node, node) : merkle_node(node, proof[p], node);
+        if (!ok) return false;
+        p++;
+    }
+    memcpy(root, node, MERKLE_HASH_SIZE);
+    return true;
+}
@@ -0,0 +1,118 @@
+/*!
+ * @file
+ * @brief Merkle tree of message hashes, for signing a window of messages once.
+ *
+ * A leaf is the SHA512 hash of 0x00 and the signed data, an inner node the
+ * SHA512 hash of 0x01, the left and the right child (RFC 6962), so a leaf can
+ * never be taken for an inner node, whatever the signed data is.
+ * A node without a sibling (the last one of a level with an odd count) moves
+ * up a level unchanged, nothing is duplicated.
+ *
+ * The signature covers the root only. The inclusion proof of a leaf is the
+ * list of siblings from the leaf up to the root, which together with the leaf
+ * index and the number of leaves gives back the root.
+ *
+ * @date 2017-04-27
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _MERKLE_H_
+#define _MERKLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MERKLE_HASH_SIZE  64    //!< SHA512
+#define MERKLE_MAX_LEAVES 8     //!< messages per window (the telemetry outbox capacity)
+#define MERKLE_MAX_DEPTH  3     //!< levels above the leaves, the max proof length
+#define MERKLE_MAX_PROOF  32    //!< max proof length accepted when verifying (2^32 leaves)
+
+//! the tree of a window, the leaves first, then each level up to the root
+typedef struct {
+    unsigned char nodes[2 * MERKLE_MAX_LEAVES + MERKLE_MAX_DEPTH][MERKLE_HASH_SIZE];
+    uint8_t count;      //!< number of leaves
+    uint8_t size;       //!< number of nodes, 0 until the tree is built
+} merkle_tree_t;
+
+//! @brief Start an empty tree.
+void merkle_init(merkle_tree_t *tree);
+
+/*!
+ * @brief Compute the leaf hash of signed data.
+ * @param data the signed data
+ * @param len the size of the data
+ * @param leaf where to store the hash (MERKLE_HASH_SIZE bytes)
+ * @return true if the hash was computed
+ */
+int merkle_leaf(const unsigned char *data, size_t len, unsigned char *leaf);
+
+/*!
+ * @brief Add a leaf, the leaf hash of the signed data.
+ * @param tree the tree, not built yet
+ * @param data the signed data
+ * @param len the size of the data
+ * @return true if the leaf was added, false if the tree is full or hashing failed
+ */
+int merkle_add(merkle_tree_t *tree, const unsigned char *data, size_t len);
+
+/*!
+ * @brief Compute the levels above the leaves.
+ * @param tree the tree with at least one leaf
+ * @return the root (MERKLE_HASH_SIZE bytes), or NULL if hashing failed
+ */
+const unsigned char *merkle_build(merkle_tree_t *tree);
+
+/*!
+ * @brief Get the inclusion proof of a leaf.
+ * @param tree the built tree
+ * @param index the leaf index
+ * @param proof where to store the siblings, MERKLE_MAX_DEPTH hashes
+ * @return the number of hashes in the proof
+ */
+size_t merkle_proof(const merkle_tree_t *tree, uint8_t index, unsigned char proof[][MERKLE_HASH_SIZE]);
+
+/*!
+ * @brief Number of hashes in the inclusion proof of a leaf.
+ * @param index the leaf index
+ * @param count the number of leaves
+ * @return the proof length
+ */
+size_t merkle_proof_length(uint32_t index, uint32_t count);
+
+/*!
+ * @brief Compute the root from a leaf and its inclusion proof.
+ * @param leaf the leaf hash (merkle_leaf())
+ * @param index the leaf index
+ * @param count the number of leaves
+ * @param proof the siblings from the leaf up
+ * @param len the number of hashes in the proof
+ * @param root where to store the root (MERKLE_HASH_SIZE bytes)
+ * @return true if the proof has the length index and count require, and the root was computed
+ */
+int merkle_root_from_proof(const unsigned char *leaf, uint32_t index, uint32_t count,
+                           const unsigned char proof[][MERKLE_HASH_SIZE], size_t len, unsigned char *root);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _MERKLE_H_
@@ -0,0 +1,198 @@
+/*!
+ * @file
+ * @brief Modem UART with a DMA receive ring and idle line detection.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "mbed.h"
+#include "pinmap.h"
+#include "PeripheralPins.h"
+#include "fsl_dmamux.h"
+#include "fsl_lpuart.h"
+#include "modem_serial.h"
+#include "power.h"
+
+typedef char modem_rx_ring_is_power_of_2[(MODEM_RX_RING_SIZE & (MODEM_RX_RING_SIZE - 1)) == 0 ? 1 : -1];
+
+static LPUART_Type *const lpuartBases[] = LPUART_BASE_PTRS;
+static const IRQn_Type lpuartIrqs[] = LPUART_RX_TX_IRQS;
+static const dma_request_source_t lpuartRxRequests[] = {
+        kDmaRequestMux0LPUART0Rx, kDmaRequestMux0LPUART1Rx, kDmaRequestMux0LPUART2Rx, kDmaRequestMux0LPUART3Rx
+};
+
+ModemSerial *ModemSerial::instance = NULL;
+
+ModemSerial::ModemSerial(PinName tx, PinName rx) : RawSerial(tx, rx), received(0), running(false), awake(false) {
+    setup(rx);
+}
+
+ModemSerial::ModemSerial(PinName tx, PinName rx, int baud)
+        : RawSerial(tx, rx, baud), received(0), running(false), awake(false) {
+    setup(rx);
+}
+
+void ModemSerial::setup(PinName rx) {
+    const uint32_t index = pinmap_peripheral(rx, PinMap_UART_RX);
+    MBED_ASSERT(index < sizeof(lpuartRxRequests) / sizeof(lpuartRxRequests[0]));
+    base = lpuartBases[index];
+    irq = lpuartIrqs[index];
+    instance = this;
+
+    // the line is idle after MODEM_RX_IDLE_CHARS characters without a start bit, counted after the stop bit
+    uint32_t idleCfg = 0;
+    while ((2u << idleCfg) <= MODEM_RX_IDLE_CHARS && idleCfg < 7) idleCfg++;
+    // CTRL is written with the transmitter and receiver disabled (as LPUART_Init() does), RawSerial enabled them
+    const uint32_t enabled = base->CTRL & (LPUART_CTRL_TE_MASK | LPUART_CTRL_RE_MASK);
+    while (!(base->STAT & LPUART_STAT_TC_MASK)) {}
+    base->CTRL &= ~enabled;
+    while (base->CTRL & enabled) {}
+    base->CTRL = (base->CTRL & ~LPUART_CTRL_IDLECFG_MASK) | LPUART_CTRL_IDLECFG(idleCfg) | LPUART_CTRL_ILT_MASK;
+    base->CTRL |= enabled;
+
+    DMAMUX_Init(DMAMUX);
+    DMAMUX_SetSource(DMAMUX, MODEM_RX_DMA_CHANNEL, lpuartRxRequests[index]);
+    DMAMUX_EnableChannel(DMAMUX, MODEM_RX_DMA_CHANNEL);
+    edma_config_t config;
+    EDMA_GetDefaultConfig(&config);
+    EDMA_Init(DMA0, &config);
+    EDMA_CreateHandle(&dma, DMA0, MODEM_RX_DMA_CHANNEL);
+    EDMA_SetCallback(&dma, dmaCallback, this);
+
+    // both interrupts keep the default priority, so they don't preempt each other (see rxring_dma_update())
+    NVIC_SetVector(irq, (uint32_t) &ModemSerial::uartIrq);
+    NVIC_EnableIRQ(irq);
+}
+
+ModemSerial::~ModemSerial() {
+    stop();
+    NVIC_DisableIRQ(irq);
+    instance = NULL;
+}
+
+void ModemSerial::start() {
+    if (running) return;
+    rxring_init(&ring, buffer, sizeof(buffer));
+
+    edma_transfer_config_t transfer;
+    EDMA_PrepareTransfer(&transfer, (void *) LPUART_GetDataRegisterAddress(base), 1, buffer, 1, 1, sizeof(buffer),
+                         kEDMA_PeripheralToMemory);
+    EDMA_SetTransferConfig(DMA0, MODEM_RX_DMA_CHANNEL, &transfer, NULL);
+    // circular: back to the start of the buffer after the major loop, the request stays enabled,
+    // interrupts at half and full, so the ring is updated before the DMA can lap it
+    DMA0->TCD[MODEM_RX_DMA_CHANNEL].DLAST_SGA = -(int32_t) sizeof(buffer);
+    DMA0->TCD[MODEM_RX_DMA_CHANNEL].CSR = (DMA0->TCD[MODEM_RX_DMA_CHANNEL].CSR & ~DMA_CSR_DREQ_MASK) |
+                                          DMA_CSR_INTHALF_MASK | DMA_CSR_INTMAJOR_MASK;
+    EDMA_StartTransfer(&dma);
+
+    LPUART_ClearStatusFlags(base, kLPUART_IdleLineFlag | kLPUART_RxOverrunFlag | kLPUART_RxActiveEdgeFlag);
+    LPUART_EnableInterrupts(base, kLPUART_IdleLineInterruptEnable | kLPUART_RxOverrunInterruptEnable |
+                                  kLPUART_RxActiveEdgeInterruptEnable);
+    LPUART_EnableRxDMA(base, true);
+    running = true;
+}
+
+void ModemSerial::stop() {
+    if (!running) return;
+    LPUART_EnableRxDMA(base, false);
+    LPUART_DisableInterrupts(base, kLPUART_IdleLineInterruptEnable | kLPUART_RxOverrunInterruptEnable |
+                                   kLPUART_RxActiveEdgeInterruptEnable);
+    EDMA_AbortTransfer(&dma);
+    replyTimeout.detach();
+    if (awake) power_unlock_deepsleep();
+    awake = false;
+    running = false;
+}
+
+int ModemSerial::read(uint8_t *out, int len, uint32_t timeout) {
+    size_t n;
+    // a wake-up may be left over from bytes that were already read
+    while (!(n = rxring_read(&ring, out, (size_t) len))) {
+        if (received.wait(timeout) <= 0) return 0;
+    }
+    return (int) n;
+}
+
+int ModemSerial::getc(uint32_t timeout) {
+    uint8_t c;
+    return read(&c, 1, timeout) ? c : -1;
+}
+
+int ModemSerial::putc(int c) {
+    const uint8_t byte = (uint8_t) c;
+    return write(&byte, 1) ? c : -1;
+}
+
+int ModemSerial::write(const uint8_t *data, int len) {
+    wake();
+    for (int i = 0; i < len; i++) RawSerial::putc(data[i]);
+    // the reply timeout counts from the last byte
+    wake();
+    return len;
+}
+
+void ModemSerial::wake() {
+    if (!running) return;
+    core_util_critical_section_enter();
+    if (!awake) {
+        awake = true;
+        LPUART_DisableInterrupts(base, kLPUART_RxActiveEdgeInterruptEnable);
+        power_lock_deepsleep();
+    }
+    replyTimeout.attach_us(callback(this, &ModemSerial::quiet), MODEM_RX_REPLY_TIMEOUT * 1000u);
+    core_util_critical_section_exit();
+}
+
+void ModemSerial::quiet() {
+    core_util_critical_section_enter();
+    // the edges of the burst that just ended are stale, an edge from here on is new data
+    LPUART_ClearStatusFlags(base, kLPUART_RxActiveEdgeFlag);
+    if (awake && !(LPUART_GetStatusFlags(base) & kLPUART_RxActiveFlag)) {
+        replyTimeout.detach();
+        awake = false;
+        LPUART_EnableInterrupts(base, kLPUART_RxActiveEdgeInterruptEnable);
+        power_unlock_deepsleep();
+    }
+    core_util_critical_section_exit();
+}
+
+void ModemSerial::update() {
+    // the remaining count of the major loop, one byte per minor loop
+    const uint32_t remaining = DMA0->TCD[MODEM_RX_DMA_CHANNEL].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK;
+    if (rxring_dma_update(&ring, remaining)) received.release();
+}
+
+void ModemSerial::uartIrq() {
+    ModemSerial *self = instance;
+    // an overrun stops the receiver until it is cleared
+    const uint32_t flags = LPUART_GetStatusFlags(self->base) &
+                           (kLPUART_IdleLineFlag | kLPUART_RxOverrunFlag | kLPUART_RxActiveEdgeFlag);
+    if (flags) LPUART_ClearStatusFlags(self->base, flags);
+    // the edge interrupt is only enabled while the line sleeps
+    if ((flags & kLPUART_RxActiveEdgeFlag) && !self->awake) self->wake();
+    self->update();
+    if (flags & kLPUART_IdleLineFlag) self->quiet();
+}
+
+void ModemSerial::dmaCallback(edma_handle_t *handle, void *param, bool transferDone, uint32_t tcds) {
+    (void) handle;
+    (void) transferDone;
+    (void) tcds;
+    static_cast<ModemSerial *>(param)->update();
+}
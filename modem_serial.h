@@ -0,0 +1,128 @@
+/*!
+ * @file
+ * @brief Modem UART with a DMA receive ring and idle line detection.
+ *
+ * A replacement for the interrupt driven receive side of BufferedSerial
+ * under the M66 AT parser: the LPUART requests a DMA transfer per received
+ * byte, the eDMA channel writes them into a circular ring (rxring.h), and
+ * the CPU is only interrupted when the line goes idle after a burst or the
+ * ring is half or completely filled. Readers wait on a semaphore and take
+ * whole chunks. Sending stays with RawSerial.
+ *
+ * The LPUART and the DMA stop in deep sleep, so the line keeps the MCU out of
+ * it only while it is awake: from sending (the reply is coming) or an active
+ * edge on RX (the edge interrupt also wakes from VLPS) until the line goes
+ * idle, or MODEM_RX_REPLY_TIMEOUT passes without a byte. The first character
+ * of data that arrives in deep sleep can be lost while the clocks come back,
+ * incoming data is announced by the ring indicator (GSM_RI) for that.
+ *
+ * The M66 driver receives through a BufferedSerial, BufferedSerial.h puts
+ * this class in its place.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _MODEM_SERIAL_H_
+#define _MODEM_SERIAL_H_
+
+#include "mbed.h"
+#include "fsl_edma.h"
+#include "rxring.h"
+
+//! size of the receive ring, a power of 2 (a downlink frame and the AT responses around it)
+#ifndef MODEM_RX_RING_SIZE
+#define MODEM_RX_RING_SIZE 2048
+#endif
+
+//! eDMA channel of the receive ring
+#ifndef MODEM_RX_DMA_CHANNEL
+#define MODEM_RX_DMA_CHANNEL 0
+#endif
+
+//! idle characters before the idle line interrupt (1, 2, 4 .. 128)
+#ifndef MODEM_RX_IDLE_CHARS
+#define MODEM_RX_IDLE_CHARS 4
+#endif
+
+//! ms the line stays awake after sending or an edge, if nothing is received
+#ifndef MODEM_RX_REPLY_TIMEOUT
+#define MODEM_RX_REPLY_TIMEOUT 300
+#endif
+
+class ModemSerial : public RawSerial {
+public:
+    ModemSerial(PinName tx, PinName rx);
+    ModemSerial(PinName tx, PinName rx, int baud);
+    ~ModemSerial();
+
+    //! @brief Start receiving, the line sleeps until something is sent or received
+    void start();
+
+    //! @brief Stop receiving, what is left in the ring is discarded
+    void stop();
+
+    //! @brief Bytes waiting to be read
+    int readable() const { return (int) rxring_available(&ring); }
+
+    /*!
+     * @brief Read what has been received, at least one byte.
+     * @param buffer where to store the bytes
+     * @param len the size of the buffer
+     * @param timeout how long to wait for the first byte, in ms
+     * @return the number of bytes read, 0 on timeout
+     */
+    int read(uint8_t *buffer, int len, uint32_t timeout);
+
+    //! @brief Read a single byte, waits for it, -1 on timeout
+    int getc(uint32_t timeout = osWaitForever);
+
+    //! @brief Send a byte, the line is awake for the reply
+    int putc(int c);
+
+    //! @brief Send bytes, the line is awake for the reply
+    int write(const uint8_t *data, int len);
+
+    //! @brief Wake-ups of the readers (idle line, half and full ring) since the start
+    uint32_t chunks() const { return ring.updates; }
+
+    //! @brief Bytes lost because the readers fell behind
+    uint32_t overruns() const { return ring.overruns; }
+
+private:
+    static void uartIrq();
+    static void dmaCallback(edma_handle_t *handle, void *param, bool transferDone, uint32_t tcds);
+    void setup(PinName rx);
+    void update();
+    void wake();
+    void quiet();
+
+    static ModemSerial *instance;   //!< the interrupts find the UART here, there is one modem
+
+    LPUART_Type *base;
+    IRQn_Type irq;
+    edma_handle_t dma;
+    uint8_t buffer[MODEM_RX_RING_SIZE];
+    rxring_t ring;
+    Semaphore received;
+    Timeout replyTimeout;
+    bool running;
+    volatile bool awake;            //!< deep sleep is locked
+};
+
+#endif // _MODEM_SERIAL_H_
@@ -0,0 +1,159 @@
+/*!
+ * @file
+ * @brief Prioritized outbound message queue.
+ *
+ * @date 2017-03-22
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "outbox.h"
+
+//! per class capacity and drop policy
+static const struct {
+    uint8_t capacity;
+    outbox_policy_t policy;
+} outbox_config[OUTBOX_CLASSES] = {
+        {4, OUTBOX_DROP_OLDEST},    // alert: the latest alert state matters most
+        {2, OUTBOX_DROP_OLDEST},    // config ack
+        {8, OUTBOX_DROP_OLDEST},    // telemetry: keep the freshest readings
+        {1, OUTBOX_DROP_OLDEST},    // stats: only the last snapshot is of interest
+};
+
+static void outbox_free(outbox_entry_t *entry) {
+    free(entry->payload);
+    free(entry->manifest);
+    free(entry->signature);
+    free(entry->proof);
+    entry->payload = NULL;
+    entry->manifest = NULL;
+    entry->signature = NULL;
+    entry->proof = NULL;
+}
+
+void outbox_init(outbox_t *outbox) {
+    memset(outbox, 0, sizeof(*outbox));
+}
+
+void outbox_clear(outbox_t *outbox) {
+    for (int c = 0; c < OUTBOX_CLASSES; c++) {
+        while (outbox->rings[c].count) outbox_pop(outbox, (outbox_class_t) c);
+    }
+}
+
+int outbox_push(outbox_t *outbox, outbox_class_t cls, const outbox_entry_t *entry) {
+    outbox_ring_t *ring = &outbox->rings[cls];
+    const uint8_t capacity = outbox_config[cls].capacity;
+
+    if (ring->count == capacity) {
+        ring->dropped++;
+        if (outbox_config[cls].policy == OUTBOX_DROP_NEWEST) {
+            outbox_entry_t dropped = *entry;
+            outbox_free(&dropped);
+            return false;
+        }
+        outbox_pop(outbox, cls);
+    }
+
+    ring->entries[(ring->head + ring->count) % capacity] = *entry;
+    ring->count++;
+
+    return true;
+}
+
+outbox_entry_t *outbox_peek(outbox_t *outbox, outbox_class_t *cls) {
+    for (int c = 0; c < OUTBOX_CLASSES; c++) {
+        if (outbox->rings[c].count) {
+            *cls = (outbox_class_t) c;
+            return &outbox->rings[c].entries[outbox->rings[c].head];
+        }
+    }
+    return NULL;
+}
+
+outbox_entry_t *outbox_at(outbox_t *outbox, outbox_class_t cls, uint8_t index) {
+    outbox_ring_t *ring = &outbox->rings[cls];
+    if (index >= ring->count) return NULL;
+    return &ring->entries[(ring->head + index) % outbox_config[cls].capacity];
+}
+
+void outbox_pop(outbox_t *outbox, outbox_class_t cls) {
+    outbox_ring_t *ring = &outbox->rings[cls];
+    if (!ring->count) return;
+
+    outbox_free(&ring->entries[ring->head]);
+    ring->head = (uint8_t) ((ring->head + 1) % outbox_config[cls].capacity);
+    ring->count--;
+}
+
+int outbox_take(outbox_t *outbox, outbox_class_t *cls, outbox_entry_t *entry) {
+    const outbox_entry_t *head = outbox_peek(outbox, cls);
+    if (!head) return false;
+
+    outbox_ring_t *ring = &outbox->rings[*cls];
+    *entry = *head;
+    ring->head = (uint8_t) ((ring->head + 1) % outbox_config[*cls].capacity);
+    ring->count--;
+    return true;
+}
+
+int outbox_requeue(outbox_t *outbox, outbox_class_t cls, const outbox_entry_t *entry) {
+    outbox_ring_t *ring = &outbox->rings[cls];
+    const uint8_t capacity = outbox_config[cls].capacity;
+
+    if (ring->count == capacity) {
+        // the taken message is older than everything queued since it was taken
+        ring->dropped++;
+        if (outbox_config[cls].policy == OUTBOX_DROP_OLDEST) {
+            outbox_entry_t dropped = *entry;
+            outbox_free(&dropped);
+            return false;
+        }
+        outbox_free(&ring->entries[(ring->head + ring->count - 1) % capacity]);
+        ring->count--;
+    }
+
+    ring->head = (uint8_t) ((ring->head + capacity - 1) % capacity);
+    ring->entries[ring->head] = *entry;
+    ring->count++;
+    return true;
+}
+
+void outbox_release(outbox_entry_t *entry) {
+    outbox_free(entry);
+}
+
+uint8_t outbox_capacity(outbox_class_t cls) {
+    return outbox_config[cls].capacity;
+}
+
+uint8_t outbox_count(const outbox_t *outbox, outbox_class_t cls) {
+    return outbox->rings[cls].count;
+}
+
+uint8_t outbox_pending(const outbox_t *outbox) {
+    uint8_t pending = 0;
+    for (int c = 0; c < OUTBOX_CLASSES; c++) pending += outbox->rings[c].count;
+    return pending;
+}
+
+uint32_t outbox_dropped(const outbox_t *outbox, outbox_class_t cls) {
+    return outbox->rings[cls].dropped;
+}
@@ -0,0 +1,154 @@
+/*!
+ * @file
+ * @brief Prioritized outbound message queue.
+ *
+ * Signed messages are queued per message class and drained in priority
+ * order (alert > config ack > telemetry > stats), so an alert never waits
+ * behind buffered periodic readings. Each class has a fixed capacity and
+ * a drop policy that decides which message is discarded when it is full.
+ *
+ * @date 2017-03-22
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _OUTBOX_H_
+#define _OUTBOX_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUTBOX_MAX_CAPACITY 8
+
+//! message classes, in priority order
+typedef enum {
+    OUTBOX_ALERT = 0,
+    OUTBOX_CONFIG_ACK,
+    OUTBOX_TELEMETRY,
+    OUTBOX_STATS,
+    OUTBOX_CLASSES
+} outbox_class_t;
+
+//! what to do when a message is queued into a full class
+typedef enum {
+    OUTBOX_DROP_OLDEST,   //!< discard the oldest queued message
+    OUTBOX_DROP_NEWEST    //!< discard the message that is being queued
+} outbox_policy_t;
+
+//! a signed message waiting to be sent
+typedef struct {
+    char *payload;          //!< the payload (malloc(), 0 terminated)
+    char *manifest;         //!< the chunked transfer manifest if the payload exceeds a frame, or NULL
+    char *signature;        //!< the Base64 encoded signature of manifest or payload (malloc(), 0 terminated)
+    char *proof;            //!< the inclusion proof of a batch signed message (malloc(), 0 terminated), or NULL
+    uint16_t transfer;      //!< the chunked transfer ID (if there is a manifest)
+    uint32_t queued_ms;     //!< uptime when the message was queued
+} outbox_entry_t;
+
+//! the messages queued in one class
+typedef struct {
+    outbox_entry_t entries[OUTBOX_MAX_CAPACITY];
+    uint8_t head;
+    uint8_t count;
+    uint32_t dropped;
+} outbox_ring_t;
+
+//! an outbound message queue, zero initialized or set up with outbox_init()
+typedef struct {
+    outbox_ring_t rings[OUTBOX_CLASSES];
+} outbox_t;
+
+//! @brief Set up an empty queue
+void outbox_init(outbox_t *outbox);
+
+//! @brief Free all queued messages, the drop counters are kept
+void outbox_clear(outbox_t *outbox);
+
+/*!
+ * @brief Queue a signed message, the queue takes ownership of payload, manifest, signature and proof.
+ * A batch signed message is queued without signature, it is signed before it is sent.
+ * @param outbox the queue
+ * @param cls the message class
+ * @param entry the message to queue (copied)
+ * @return true if the message was queued, false if it was dropped (and freed)
+ */
+int outbox_push(outbox_t *outbox, outbox_class_t cls, const outbox_entry_t *entry);
+
+/*!
+ * @brief Get the next message to send without removing it.
+ * @param outbox the queue
+ * @param cls where to store the class of the message
+ * @return the highest priority message or NULL if the queue is empty
+ */
+outbox_entry_t *outbox_peek(outbox_t *outbox, outbox_class_t *cls);
+
+/*!
+ * @brief Get a queued message of a class.
+ * @param outbox the queue
+ * @param cls the message class
+ * @param index the position in the queue, 0 is the oldest message
+ * @return the message or NULL if there are fewer messages queued
+ */
+outbox_entry_t *outbox_at(outbox_t *outbox, outbox_class_t cls, uint8_t index);
+
+//! @brief Remove and free the head message of a class (after it has been sent)
+void outbox_pop(outbox_t *outbox, outbox_class_t cls);
+
+/*!
+ * @brief Remove the highest priority message to send it without holding the queue.
+ * @param outbox the queue
+ * @param cls where to store the class of the message
+ * @param entry where to move the message, the caller owns it afterwards
+ * @return true if there was a message
+ */
+int outbox_take(outbox_t *outbox, outbox_class_t *cls, outbox_entry_t *entry);
+
+/*!
+ * @brief Put a taken message back at the front of its class, if sending it failed.
+ * If the class filled up meanwhile, the drop policy applies: with DROP_OLDEST
+ * the returned message is the oldest and is dropped, with DROP_NEWEST the
+ * newest queued message makes room for it.
+ * @param outbox the queue
+ * @param cls the class the message was taken from
+ * @param entry the message (the queue takes ownership)
+ * @return true if the message was requeued, false if it was dropped (and freed)
+ */
+int outbox_requeue(outbox_t *outbox, outbox_class_t cls, const outbox_entry_t *entry);
+
+//! @brief Free a taken message (after it has been sent)
+void outbox_release(outbox_entry_t *entry);
+
+//! @brief Number of messages a class holds before its drop policy applies
+uint8_t outbox_capacity(outbox_class_t cls);
+
+//! @brief Number of messages queued in a class
+uint8_t outbox_count(const outbox_t *outbox, outbox_class_t cls);
+
+//! @brief Total number of messages queued
+uint8_t outbox_pending(const outbox_t *outbox);
+
+//! @brief Number of messages of a class dropped since boot
+uint32_t outbox_dropped(const outbox_t *outbox, outbox_class_t cls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OUTBOX_H_
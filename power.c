@@ -0,0 +1,139 @@
+/*!
+ * @file
+ * @brief Low-power idle: tickless deep sleep and residency accounting.
+ *
+ * @date 2017-04-13
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "power.h"
+#include "stats.h"
+
+static volatile uint32_t deepsleep_locks = 0;
+
+// idle time and wake-ups since the last stats update, 32 bit ms cover the 6 hours between two stats messages
+static volatile uint32_t power_idle_ms[POWER_STATES];
+static volatile uint32_t wakeups = 0;
+// the uptime is 32 bit and wraps after ~49 days, the stats keep counting
+static uint32_t last_update_ms = 0;
+static uint64_t uptime_total_ms = 0;
+
+void power_lock_deepsleep(void) {
+    __sync_fetch_and_add(&deepsleep_locks, 1);
+}
+
+void power_unlock_deepsleep(void) {
+    __sync_fetch_and_sub(&deepsleep_locks, 1);
+}
+
+power_state_t power_select(uint32_t idle_ms) {
+    return !deepsleep_locks && idle_ms >= POWER_DEEPSLEEP_MIN_MS ? POWER_DEEPSLEEP : POWER_SLEEP;
+}
+
+void power_account(power_state_t state, uint32_t ms) {
+    if (state == POWER_RUN) return;
+    __sync_fetch_and_add(&power_idle_ms[state], ms);
+    if (state == POWER_DEEPSLEEP) __sync_fetch_and_add(&wakeups, 1);
+}
+
+void power_update_stats(uint32_t now_ms) {
+    // the difference is right across a wrap of the uptime, the updates are hours apart
+    const uint32_t interval = now_ms - last_update_ms;
+    last_update_ms = now_ms;
+    uptime_total_ms += interval;
+
+    // take the counters, the idle hook keeps adding to them
+    const uint32_t sleep = __sync_fetch_and_and(&power_idle_ms[POWER_SLEEP], 0);
+    const uint32_t deepsleep = __sync_fetch_and_and(&power_idle_ms[POWER_DEEPSLEEP], 0);
+    stats_set(STAT_SLEEP_MS, sleep);
+    stats_set(STAT_DEEPSLEEP_MS, deepsleep);
+    stats_set(STAT_WAKEUPS, __sync_fetch_and_and(&wakeups, 0));
+    stats_set(STAT_RUN_MS, interval > sleep + deepsleep ? interval - (sleep + deepsleep) : 0);
+    stats_set(STAT_UPTIME, (uint32_t) (uptime_total_ms / 1000));
+}
+
+#ifdef __MBED__
+
+#include "fsl_lptmr.h"
+#include "fsl_smc.h"
+#include "platform/critical.h"
+#include "rtos/rtos_idle.h"
+#include "us_ticker_api.h"
+#include "uptime.h"
+
+// RTX kernel suspend/resume for tickless idle, in ticks (1 ms)
+extern uint32_t os_suspend(void);
+extern void os_resume(uint32_t sleep_time);
+
+static void power_lptmr_irq(void) {
+    LPTMR_ClearStatusFlags(LPTMR0, kLPTMR_TimerCompareFlag);
+}
+
+static void power_idle_hook(void) {
+    // os_suspend() and os_resume() are SVC calls, they fault with interrupts masked (as in the RTX tickless example)
+    const uint32_t idle_ms = os_suspend();
+
+    if (power_select(idle_ms) != POWER_DEEPSLEEP) {
+        // short idle: resume the tick and wait for the next interrupt
+        os_resume(0);
+
+        const uint32_t start = us_ticker_read();
+        __WFI();
+        power_account(POWER_SLEEP, (us_ticker_read() - start) / 1000);
+        return;
+    }
+
+    // the LPTMR keeps counting in VLPS, any enabled interrupt (LPTMR, RI pin) wakes up, also while masked
+    core_util_critical_section_enter();
+    LPTMR_SetTimerPeriod(LPTMR0, idle_ms);
+    LPTMR_StartTimer(LPTMR0);
+    SMC_SetPowerModeVlps(SMC);
+
+    uint32_t slept = LPTMR_GetCurrentTimerCount(LPTMR0);
+    if (LPTMR_GetStatusFlags(LPTMR0) & kLPTMR_TimerCompareFlag) slept = idle_ms;
+    LPTMR_StopTimer(LPTMR0);
+    LPTMR_ClearStatusFlags(LPTMR0, kLPTMR_TimerCompareFlag);
+    core_util_critical_section_exit();
+
+    // the us ticker stopped as well
+    uptime_add_ms(slept);
+    os_resume(slept);
+
+    power_account(POWER_DEEPSLEEP, slept);
+}
+
+void power_init(void) {
+    SMC_SetPowerModeProtection(SMC, kSMC_AllowPowerModeAll);
+
+    lptmr_config_t config;
+    LPTMR_GetDefaultConfig(&config);    // 1 kHz LPO, prescaler bypassed: 1 count per ms
+    LPTMR_Init(LPTMR0, &config);
+    LPTMR_EnableInterrupts(LPTMR0, kLPTMR_TimerInterruptEnable);
+    NVIC_SetVector(LPTMR0_IRQn, (uint32_t) power_lptmr_irq);
+    NVIC_EnableIRQ(LPTMR0_IRQn);
+
+    rtos_attach_idle_hook(power_idle_hook);
+}
+
+#else
+
+// the host build has no idle hook, the simulator calls power_select() and power_account()
+void power_init(void) {
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*!
+ * @file
+ * @brief Low-power idle: tickless deep sleep and residency accounting.
+ *
+ * When no thread is ready the RTOS idle hook suspends the kernel tick and,
+ * if the next timeout is far enough away and no driver holds a deep sleep
+ * lock, enters VLPS until the low-power timer (LPTMR, 1 kHz LPO clock) or a
+ * wake-up pin interrupt (modem RI) fires. Shorter idle periods use WFI with
+ * the tick running. The time spent in each state is counted in the stats.
+ *
+ * The decision and accounting are plain C and also used by the simulator.
+ *
+ * @date 2017-04-13
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! idle periods shorter than this are not worth the VLPS entry and exit
+#define POWER_DEEPSLEEP_MIN_MS 4
+
+//! power states
+typedef enum {
+    POWER_RUN = 0,
+    POWER_SLEEP,        //!< WFI, clocks and tick running
+    POWER_DEEPSLEEP,    //!< VLPS, woken by LPTMR or wake-up pins
+    POWER_STATES
+} power_state_t;
+
+//! @brief Install the idle hook and set up the wake-up timer (target only)
+void power_init(void);
+
+//! @brief Prevent deep sleep, e.g. while a UART must receive (nests)
+void power_lock_deepsleep(void);
+
+//! @brief Allow deep sleep again
+void power_unlock_deepsleep(void);
+
+/*!
+ * @brief Select the state to idle in.
+ * @param idle_ms the time until the next timeout
+ * @return POWER_DEEPSLEEP or POWER_SLEEP
+ */
+power_state_t power_select(uint32_t idle_ms);
+
+/*!
+ * @brief Account time spent idle (updates the stats).
+ * @param state the idle state
+ * @param ms the time spent
+ */
+void power_account(power_state_t state, uint32_t ms);
+
+/*!
+ * @brief Update the power stats for the stats message: run, sleep and deep sleep time and wake-ups since the last
+ * update (run time is what was not spent idle), and the uptime.
+ * @param now_ms the current uptime_ms()
+ */
+void power_update_stats(uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _POWER_H_
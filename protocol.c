@@ -0,0 +1,181 @@
+/*!
+ * @file
+ * @brief Message envelope of the ubirch protocol.
+ *
+ * @date 2017-03-24
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crypto/crypto.h"
+#include "protocol.h"
+
+static const char *const full_template =
+        "{\"v\":\"" PROTOCOL_VERSION_FULL "\",\"a\":\"%s\",\"k\":\"%s\",\"s\":\"%s\"%s,\"p\":%s}";
+static const char *const session_template =
+        "{\"v\":\"" PROTOCOL_VERSION_SESSION "\",\"sid\":\"%s\",\"s\":\"%s\"%s,\"p\":%s}";
+static const char *const identity_template = "{\"y\":\"i\",\"sid\":\"%s\"}";
+static const char *const manifest_template = "{\"y\":\"m\",\"x\":%u,\"c\":%u,\"l\":%u,\"h\":\"%s\"}";
+static const char *const chunk_template = "{\"x\":%u,\"n\":%u,\"d\":\"%s\"}";
+static const char *const proof_template = ",\"i\":%u,\"n\":%u,\"m\":[";
+
+int protocol_new_session(protocol_identity_t *identity) {
+    unsigned char sid[PROTOCOL_SID_LENGTH / 2];
+
+    if (!uc_init()) return false;
+    if (wc_RNG_GenerateBlock(&uc_random, sid, sizeof(sid))) return false;
+
+    for (int i = 0; i < (int) sizeof(sid); i++) sprintf(identity->sid + 2 * i, "%02x", sid[i]);
+    return true;
+}
+
+char *protocol_identity_payload(const protocol_identity_t *identity) {
+    const int size = snprintf(NULL, 0, identity_template, identity->sid);
+    char *payload = (char *) malloc((size_t) size + 1);
+    if (payload) sprintf(payload, identity_template, identity->sid);
+    return payload;
+}
+
+char *protocol_message(protocol_mode_t mode, const protocol_identity_t *identity,
+                       const char *signature, const char *payload) {
+    return protocol_batch_message(mode, identity, signature, NULL, payload);
+}
+
+char *protocol_batch_message(protocol_mode_t mode, const protocol_identity_t *identity,
+                             const char *signature, const char *proof, const char *payload) {
+    char *message;
+    int size;
+
+    if (!proof) proof = "";
+    if (mode == PROTOCOL_SESSION) {
+        size = snprintf(NULL, 0, session_template, identity->sid, signature, proof, payload);
+        message = (char *) malloc((size_t) size + 1);
+        if (message) sprintf(message, session_template, identity->sid, signature, proof, payload);
+    } else {
+        size = snprintf(NULL, 0, full_template, identity->auth, identity->key, signature, proof, payload);
+        message = (char *) malloc((size_t) size + 1);
+        if (message) sprintf(message, full_template, identity->auth, identity->key, signature, proof, payload);
+    }
+
+    return message;
+}
+
+size_t protocol_overhead(protocol_mode_t mode) {
+    // the strings only need the correct length, their contents are irrelevant here
+    char auth[PROTOCOL_AUTH_LENGTH + 1], key[PROTOCOL_KEY_LENGTH + 1], sig[PROTOCOL_SIGNATURE_LENGTH + 1];
+    memset(auth, 'a', PROTOCOL_AUTH_LENGTH);
+    memset(key, 'k', PROTOCOL_KEY_LENGTH);
+    memset(sig, 's', PROTOCOL_SIGNATURE_LENGTH);
+    auth[PROTOCOL_AUTH_LENGTH] = key[PROTOCOL_KEY_LENGTH] = sig[PROTOCOL_SIGNATURE_LENGTH] = '\0';
+
+    if (mode == PROTOCOL_SESSION)
+        return (size_t) snprintf(NULL, 0, session_template, "00000000", sig, "", "");
+    return (size_t) snprintf(NULL, 0, full_template, auth, key, sig, "", "");
+}
+
+size_t protocol_chunk_size(size_t capacity) {
+    const size_t overhead = (size_t) snprintf(NULL, 0, chunk_template, 0xffff, 0xffff, "");
+    if (capacity <= overhead) return 0;
+
+    // 4 Base64 characters per 3 bytes of data
+    return ((capacity - overhead) / 4) * 3;
+}
+
+char *protocol_manifest(uint16_t transfer, const char *payload, size_t chunk_size) {
+    const size_t len = strlen(payload);
+    if (!chunk_size) return NULL;
+
+    char *hash = uc_sha512_encoded((const unsigned char *) payload, len);
+    if (!hash) return NULL;
+
+    const unsigned int count = (unsigned int) ((len + chunk_size - 1) / chunk_size);
+    const int size = snprintf(NULL, 0, manifest_template, transfer, count, (unsigned int) len, hash);
+    char *manifest = (char *) malloc((size_t) size + 1);
+    if (manifest) sprintf(manifest, manifest_template, transfer, count, (unsigned int) len, hash);
+    free(hash);
+
+    return manifest;
+}
+
+char *protocol_chunk(uint16_t transfer, uint16_t seq, const char *data, size_t len) {
+    char *encoded = uc_base64_encode((const unsigned char *) data, len);
+    if (!encoded) return NULL;
+
+    const int size = snprintf(NULL, 0, chunk_template, transfer, seq, encoded);
+    char *chunk = (char *) malloc((size_t) size + 1);
+    if (chunk) sprintf(chunk, chunk_template, transfer, seq, encoded);
+    free(encoded);
+
+    return chunk;
+}
+
+char *protocol_proof(uint8_t index, uint8_t count, const unsigned char proof[][MERKLE_HASH_SIZE], size_t len) {
+    const int prefix = snprintf(NULL, 0, proof_template, index, count);
+    // each hash quoted and followed by a comma or the closing bracket
+    char *members = (char *) malloc((size_t) prefix + len * (PROTOCOL_HASH_LENGTH + 3) + 2);
+    if (!members) return NULL;
+
+    char *p = members + sprintf(members, proof_template, index, count);
+    for (size_t i = 0; i < len; i++) {
+        if (i) *p++ = ',';
+        *p++ = '"';
+        p += uc_base64_encode_to(proof[i], MERKLE_HASH_SIZE, p);
+        *p++ = '"';
+    }
+    *p++ = ']';
+    *p = '\0';
+    return members;
+}
+
+size_t protocol_proof_overhead(uint8_t count) {
+    size_t len = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const size_t n = merkle_proof_length(i, count);
+        if (n > len) len = n;
+    }
+    const size_t hashes = len * (PROTOCOL_HASH_LENGTH + 2) + (len ? len - 1 : 0);
+    return (size_t) snprintf(NULL, 0, proof_template, count, count) + hashes + 1;
+}
+
+int protocol_batch_root(const char *data, size_t len, uint32_t index, uint32_t count,
+                        const char *proof, size_t proof_len, unsigned char *root) {
+    unsigned char hashes[MERKLE_MAX_PROOF][MERKLE_HASH_SIZE], leaf[MERKLE_HASH_SIZE];
+    const char *p = proof, *end = proof + proof_len;
+    size_t n = 0;
+
+    // ["<hash>","<hash>",..]
+    if (p == end || *p++ != '[') return false;
+    while (p < end && *p != ']') {
+        if (n && *p++ != ',') return false;
+        if (p == end || *p++ != '"' || n == MERKLE_MAX_PROOF) return false;
+        const char *quote = (const char *) memchr(p, '"', (size_t) (end - p));
+        size_t hash_len = MERKLE_HASH_SIZE;
+        if (!quote || !uc_base64_decode(p, (size_t) (quote - p), hashes[n], &hash_len) ||
+            hash_len != MERKLE_HASH_SIZE)
+            return false;
+        n++;
+        p = quote + 1;
+    }
+    if (p == end || p + 1 != end) return false;
+
+    return merkle_leaf((const unsigned char *) data, len, leaf) &&
+           merkle_root_from_proof(leaf, index, count, (const unsigned char (*)[MERKLE_HASH_SIZE]) hashes, n, root);
+}
@@ -0,0 +1,192 @@
+/*!
+ * @file
+ * @brief Message envelope of the ubirch protocol.
+ *
+ * In full mode every message carries the device identity (auth hash and
+ * public key). In session mode the identity is sent once per MQTT session
+ * in a signed identity message that announces a short session ID. All
+ * following messages only carry the session ID, signature and payload.
+ *
+ * Payloads that do not fit into a single MQTT frame are sent as a chunked
+ * transfer: unsigned chunk messages carrying the Base64 encoded payload
+ * parts, followed by a signed manifest with the SHA512 hash of the complete
+ * payload, which the backend checks after reassembling the chunks.
+ *
+ * Batch signed messages share one signature over the Merkle root of a window
+ * of messages (merkle.h). Their envelope also carries the inclusion proof:
+ * the leaf index "i", the number of messages in the window "n" and the
+ * Base64 encoded sibling hashes "m", from which the backend computes the
+ * root of any single message and checks the signature against it.
+ *
+ * @date 2017-03-24
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "merkle.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROTOCOL_VERSION_FULL    "0.0.2"
+#define PROTOCOL_VERSION_SESSION "0.0.3"
+
+#define PROTOCOL_SID_LENGTH 8   //!< hex characters of the session ID
+
+#define PROTOCOL_AUTH_LENGTH      88    //!< Base64 encoded SHA512 auth hash
+#define PROTOCOL_KEY_LENGTH       44    //!< Base64 encoded public key
+#define PROTOCOL_SIGNATURE_LENGTH 88    //!< Base64 encoded signature
+#define PROTOCOL_HASH_LENGTH      88    //!< Base64 encoded SHA512 hash of an inclusion proof
+
+//! heartbeat payload: loop counter
+#define PROTOCOL_HEARTBEAT "{\"y\":\"h\",\"lp\":%d}"
+//! alert payload: event, temperature, threshold, latitude, longitude, loop counter
+#define PROTOCOL_ALERT "{\"y\":\"a\",\"ev\":%d,\"t\":%d,\"th\":%d,\"la\":\"%s\",\"lo\":\"%s\",\"lp\":%d}"
+//! config ack payload: request, the applied fields (each followed by a comma), downlink latency in ms
+#define PROTOCOL_ACK "{\"y\":\"k\",\"r\":%lu,%s\"ms\":%lu}"
+//! the fields of the ack of a rejected config change: error status (E_* flags)
+#define PROTOCOL_ACK_STATUS "\"e\":%d,"
+//! MQTT topic prefix of all devices
+#define PROTOCOL_TOPIC_PREFIX "mwc/ubirch/devices/"
+//! MQTT topic: device UUID, subtopic ("" for the uplink, "out" for the downlink)
+#define PROTOCOL_TOPIC PROTOCOL_TOPIC_PREFIX "%s/%s"
+
+//! envelope modes
+typedef enum {
+    PROTOCOL_FULL = 0,      //!< identity in every message
+    PROTOCOL_SESSION = 1    //!< identity once per session, session ID in every message
+} protocol_mode_t;
+
+//! device identity, Base64 encoded (malloc(), 0 terminated)
+typedef struct {
+    char *auth;                             //!< SHA512 hash of the IMEI
+    char *key;                              //!< the public key
+    char sid[PROTOCOL_SID_LENGTH + 1];      //!< the current session ID
+} protocol_identity_t;
+
+/*!
+ * @brief Start a new session by creating a random session ID.
+ * @param identity the identity to store the session ID in
+ * @return true if the session ID was created
+ */
+int protocol_new_session(protocol_identity_t *identity);
+
+/*!
+ * @brief Create the payload of the identity message that binds the session ID to the key.
+ * @param identity the identity with the current session ID
+ * @return the payload to sign (malloc(), 0 terminated)
+ */
+char *protocol_identity_payload(const protocol_identity_t *identity);
+
+/*!
+ * @brief Wrap a signed payload into the message envelope.
+ * @param mode the envelope mode
+ * @param identity the device identity (and session ID in session mode)
+ * @param signature the Base64 encoded payload signature
+ * @param payload the signed payload
+ * @return the message (malloc(), 0 terminated)
+ */
+char *protocol_message(protocol_mode_t mode, const protocol_identity_t *identity,
+                       const char *signature, const char *payload);
+
+/*!
+ * @brief Wrap a batch signed payload into the message envelope.
+ * @param mode the envelope mode
+ * @param identity the device identity (and session ID in session mode)
+ * @param signature the Base64 encoded signature of the Merkle root
+ * @param proof the inclusion proof members (see protocol_proof()), NULL for a singly signed payload
+ * @param payload the signed payload
+ * @return the message (malloc(), 0 terminated)
+ */
+char *protocol_batch_message(protocol_mode_t mode, const protocol_identity_t *identity,
+                             const char *signature, const char *proof, const char *payload);
+
+/*!
+ * @brief Size of the message envelope without the payload.
+ * @param mode the envelope mode
+ * @return the number of characters the envelope adds to the payload
+ */
+size_t protocol_overhead(protocol_mode_t mode);
+
+/*!
+ * @brief Number of payload bytes a single chunk message can carry.
+ * @param capacity the number of bytes available for a message in one frame
+ * @return the chunk size, 0 if the capacity is too small for any data
+ */
+size_t protocol_chunk_size(size_t capacity);
+
+/*!
+ * @brief Create the manifest of a chunked transfer, which is signed instead of the payload.
+ * @param transfer the transfer ID
+ * @param payload the complete payload
+ * @param chunk_size the payload bytes per chunk
+ * @return the manifest (malloc(), 0 terminated)
+ */
+char *protocol_manifest(uint16_t transfer, const char *payload, size_t chunk_size);
+
+/*!
+ * @brief Create a chunk message of a chunked transfer.
+ * @param transfer the transfer ID
+ * @param seq the sequence number of the chunk, starting at 0
+ * @param data the payload part
+ * @param len the size of the payload part
+ * @return the chunk message (malloc(), 0 terminated)
+ */
+char *protocol_chunk(uint16_t transfer, uint16_t seq, const char *data, size_t len);
+
+/*!
+ * @brief Create the inclusion proof members of a batch signed message.
+ * @param index the index of the message in the window
+ * @param count the number of messages in the window
+ * @param proof the sibling hashes (see merkle_proof())
+ * @param len the number of hashes in the proof
+ * @return the envelope members, with a leading comma (malloc(), 0 terminated)
+ */
+char *protocol_proof(uint8_t index, uint8_t count, const unsigned char proof[][MERKLE_HASH_SIZE], size_t len);
+
+/*!
+ * @brief Size of the inclusion proof members, added to protocol_overhead() for batch signed messages.
+ * @param count the number of messages in the window
+ * @return the max number of characters the proof adds to the envelope
+ */
+size_t protocol_proof_overhead(uint8_t count);
+
+/*!
+ * @brief Compute the Merkle root a batch signed message was signed with.
+ * @param data the signed data (the payload or the manifest, as in the message)
+ * @param len the size of the signed data
+ * @param index the leaf index ("i")
+ * @param count the number of messages in the window ("n")
+ * @param proof the JSON array of sibling hashes ("m")
+ * @param proof_len the size of the JSON array
+ * @param root where to store the root (MERKLE_HASH_SIZE bytes)
+ * @return true if the proof is well formed and the root was computed
+ */
+int protocol_batch_root(const char *data, size_t len, uint32_t index, uint32_t count,
+                        const char *proof, size_t proof_len, unsigned char *root);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _PROTOCOL_H_
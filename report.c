@@ -0,0 +1,72 @@
+/*!
+ * @file
+ * @brief Send-on-delta reporting decision.
+ *
+ * @date 2017-04-14
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "report.h"
+
+//! the deadband of a channel, or -1 if it has none
+static int32_t deadband(const char *key) {
+#define REPORT_DEADBAND(k, setting) if (strcmp(key, k) == 0) return settings_get(setting);
+    REPORT_DEADBANDS(REPORT_DEADBAND)
+#undef REPORT_DEADBAND
+    return -1;
+}
+
+void report_init(report_state_t *state) {
+    memset(state, 0, sizeof(report_state_t));
+}
+
+report_action_t report_check(const report_state_t *state, const char *const *keys, const int32_t *values,
+                             size_t count, uint32_t now_ms) {
+    if (settings_get(SETTING_REPORT_MODE) != REPORT_ON_DELTA || !state->sent) return REPORT_TELEMETRY;
+
+    for (size_t i = 0; i < count; i++) {
+        const int32_t band = deadband(keys[i]);
+        if (band < 0) continue;
+
+        // a channel that was not sent last time (new or recovered sensor) is a change
+        size_t j = 0;
+        while (j < state->count && strcmp(state->keys[j], keys[i]) != 0) j++;
+        if (j == state->count) return REPORT_TELEMETRY;
+
+        const int32_t delta = values[i] - state->values[j];
+        if (delta > band || delta < -band) return REPORT_TELEMETRY;
+    }
+
+    if (now_ms - state->last_ms >= (uint32_t) settings_get(SETTING_HEARTBEAT) * 1000) return REPORT_HEARTBEAT;
+    return REPORT_SKIP;
+}
+
+void report_sent(report_state_t *state, report_action_t action, const char *const *keys, const int32_t *values,
+                 size_t count, uint32_t now_ms) {
+    if (action == REPORT_SKIP) return;
+    state->last_ms = now_ms;
+    if (action != REPORT_TELEMETRY) return;
+
+    if (count > REPORT_MAX_CHANNELS) count = REPORT_MAX_CHANNELS;
+    memcpy(state->keys, keys, count * sizeof(const char *));
+    memcpy(state->values, values, count * sizeof(int32_t));
+    state->count = count;
+    state->sent = true;
+}
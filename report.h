@@ -0,0 +1,100 @@
+/*!
+ * @file
+ * @brief Send-on-delta reporting decision.
+ *
+ * In the periodic mode every report is a full telemetry message. In the
+ * send-on-delta mode a report is only sent if a channel moved beyond its
+ * deadband since the last sent telemetry. If nothing was sent for the
+ * heartbeat interval a minimal heartbeat message is sent instead. Channels
+ * without a deadband (e.g. the altitude, which follows the pressure) do not
+ * trigger a report but are sent with the others.
+ *
+ * @date 2017-04-14
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+#include "settings.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPORT_MAX_CHANNELS (SENSORS_MAX * SENSOR_MAX_CHANNELS)
+
+/*!
+ * The deadband table: X(channel key, deadband setting)
+ */
+#define REPORT_DEADBANDS(X) \
+    X("t", SETTING_DEADBAND_T) \
+    X("p", SETTING_DEADBAND_P) \
+    X("h", SETTING_DEADBAND_H)
+
+//! what to send for a report
+typedef enum {
+    REPORT_SKIP = 0,        //!< nothing changed, stay silent
+    REPORT_TELEMETRY,       //!< a full telemetry message
+    REPORT_HEARTBEAT        //!< a heartbeat message ("y":"h")
+} report_action_t;
+
+//! the last sent report
+typedef struct {
+    uint8_t sent;                               //!< telemetry has been sent
+    uint32_t last_ms;                           //!< time of the last telemetry or heartbeat
+    size_t count;
+    const char *keys[REPORT_MAX_CHANNELS];
+    int32_t values[REPORT_MAX_CHANNELS];
+} report_state_t;
+
+//! @brief Reset the state, the next report is a full telemetry message
+void report_init(report_state_t *state);
+
+/*!
+ * @brief Decide what to send for a report, according to the report mode setting.
+ * @param state the last sent report
+ * @param keys the channel keys
+ * @param values the current channel values (see sensors_values())
+ * @param count the number of channels
+ * @param now_ms the current uptime
+ * @return the action
+ */
+report_action_t report_check(const report_state_t *state, const char *const *keys, const int32_t *values,
+                             size_t count, uint32_t now_ms);
+
+/*!
+ * @brief Record a sent report.
+ * @param state the last sent report
+ * @param action what was sent
+ * @param keys the channel keys
+ * @param values the sent channel values
+ * @param count the number of channels
+ * @param now_ms the current uptime
+ */
+void report_sent(report_state_t *state, report_action_t action, const char *const *keys, const int32_t *values,
+                 size_t count, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _REPORT_H_
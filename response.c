@@ -26,18 +26,18 @@
 #include "crypto/crypto.h"
 #include "jsmn/jsmn.h"
 #include "sensor.h"
+#include "settings.h"
+#include "log.h"
 
-#define PRINTF printf
-#define PUTCHAR putchar
-
-extern int error_flag;
+#define PRINTF(...) LOG_D(__VA_ARGS__)
 
 //! @brief JSMN helper function to print the current token for debugging
 void print_token(const char *prefix, const char *response, jsmntok_t *token) {
-  const size_t token_size = (const size_t) (token->end - token->start);
-  PRINTF("%s ", prefix);
-  for (int i = 0; i < token_size; i++) putchar(*(response + token->start + i));
-  PRINTF("\r\n");
+  const int token_size = token->end - token->start;
+  PRINTF("%s %.*s\r\n", prefix, token_size, response + token->start);
+  (void) prefix;
+  (void) response;
+  (void) token_size;
 }
 
 //! @brief JSMN helper function to compare token values
@@ -69,6 +69,11 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
 
   // identify the number of tokens in our response, we expect 13
   const int token_count = jsmn_parse(&parser, response, strlen(response), NULL, 0);
+  // a truncated or broken message has no token count (jsmn returns an error)
+  if (token_count <= 0) {
+    ERROR_SET(E_JSON_FAILED);
+    return NULL;
+  }
   // TODO check token count and return if too many
   token = (jsmntok_t *) malloc(sizeof(*token) * token_count);
 
@@ -84,7 +89,7 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
           print_token("protocol version mismatch:", response, &token[index]);
 
           // do not continue if the version does not match, free already copied payload or sig
-          error_flag |= E_PROTOCOL_FAIL;
+          ERROR_SET(E_PROTOCOL_FAIL);
           break;
         }
       } else if (jsoneq(response, &token[index], P_KEY) == 0 && token[index + 1].type == JSMN_STRING) {
@@ -97,7 +102,7 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
         memset(key, 0, key_length);
         if (!uc_base64_decode(response + token[index].start, (size_t)(token[index].end - token[index].start),
                               (unsigned char *) key, &key_length)) {
-          PRINTF("ERROR decoding key.\r\n");
+          LOG_E("ERROR decoding key.\r\n");
         }
       } else if (jsoneq(response, &token[index], P_SIGNATURE) == 0 && token[index + 1].type == JSMN_STRING) {
         index++;
@@ -109,7 +114,7 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
         if (!uc_base64_decode(response + token[index].start,
                               (size_t)(token[index].end - token[index].start),
                               signature, &hash_length)) {
-          PRINTF("ERROR decoding hash digest.\r\n");
+          LOG_E("ERROR decoding hash digest.\r\n");
         }
       } else if (jsoneq(response, &token[index], P_PAYLOAD) == 0 && token[index + 1].type == JSMN_OBJECT) {
         index++;
@@ -128,7 +133,7 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
       }
     }
   } else {
-    error_flag |= E_JSON_FAILED;
+    ERROR_SET(E_JSON_FAILED);
   }
 
   // free used heap (token)
@@ -136,3 +141,80 @@ char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char
 
   return payload;
 }
+
+/*!
+ * Parse a request ID, a positive integer that fits 32 bit.
+ * @return true if the request ID is valid
+ */
+static int parse_request(const char *value, int len, jsmntype_t type, uint32_t *request) {
+  if (type != JSMN_PRIMITIVE || len <= 0 || len > 10) return false;
+  uint64_t id = 0;
+  for (int i = 0; i < len; i++) {
+    if (value[i] < '0' || value[i] > '9') return false;
+    id = id * 10 + (uint64_t) (value[i] - '0');
+  }
+  if (id == 0 || id > UINT32_MAX) return false;
+  if (request) *request = (uint32_t) id;
+  return true;
+}
+
+/*!
+ * Process payload and stage the configuration changes from it.
+ * @param payload the payload to use, should be checked
+ * @param update where to stage the validated configuration changes
+ * @param request where to store the request ID the backend expects an ack for (0 if none), may be NULL
+ * @return true if all settings in the payload are valid
+ */
+int process_payload(char *payload, settings_update_t *update, uint32_t *request) {
+  jsmntok_t *token;
+  jsmn_parser parser;
+  jsmn_init(&parser);
+  int valid = true;
+  if (request) *request = 0;
+
+  // identify the number of tokens in our payload
+  const int token_count = jsmn_parse(&parser, payload, strlen(payload), NULL, 0);
+  if (token_count <= 0) {
+    ERROR_SET(E_JSON_FAILED);
+    return false;
+  }
+  token = (jsmntok_t *) malloc(sizeof(*token) * token_count);
+
+  // reset parser, parse and store tokens
+  jsmn_init(&parser);
+  if (jsmn_parse(&parser, payload, strlen(payload), token, (unsigned int) token_count) == token_count &&
+      token[0].type == JSMN_OBJECT) {
+    int index = 0;
+    while (++index < token_count) {
+      if (index + 1 < token_count && jsoneq(payload, &token[index], P_REQUEST) == 0) {
+        // the request ID is not a setting, it is echoed in the ack
+        if (!parse_request(payload + token[index + 1].start, token[index + 1].end - token[index + 1].start,
+                           token[index + 1].type, request)) {
+          print_token("invalid value:", payload, &token[index + 1]);
+          valid = false;
+        }
+      } else if (index + 1 < token_count && token[index].type == JSMN_STRING && token[index + 1].type == JSMN_PRIMITIVE) {
+        const setting_result_t result = settings_stage(
+            update, payload + token[index].start, (size_t) (token[index].end - token[index].start),
+            payload + token[index + 1].start, (size_t) (token[index + 1].end - token[index + 1].start));
+        if (result == SETTING_UNKNOWN) {
+          print_token("unknown key:", payload, &token[index]);
+        } else if (result == SETTING_INVALID) {
+          print_token("invalid value:", payload, &token[index + 1]);
+          valid = false;
+        } else {
+          print_token("setting:", payload, &token[index]);
+        }
+      } else {
+        print_token("unknown key:", payload, &token[index]);
+      }
+      index++;
+    }
+  } else {
+    ERROR_SET(E_JSON_FAILED);
+    valid = false;
+  }
+
+  free(token);
+  return valid;
+}
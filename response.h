@@ -23,7 +23,8 @@
 #ifndef _RESPONSE_H_
 #define _RESPONSE_H_
 
-#include "jsmn.h"
+#include "jsmn/jsmn.h"
+#include "settings.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,6 +33,15 @@ extern "C" {
 //! @brief Process response and return key and signature
 char *process_response(char *response, uc_ed25519_pub_pkcs8 *key, unsigned char *signature);
 
+/*!
+ * @brief Process a verified config payload and stage the settings from it.
+ * @param payload the verified payload
+ * @param update where to stage the validated configuration changes
+ * @param request where to store the request ID ("r") to acknowledge, 0 if there is none (may be NULL)
+ * @return true if all settings in the payload are valid
+ */
+int process_payload(char *payload, settings_update_t *update, uint32_t *request);
+
 //! @brief JSMN helper function to print the current token for debugging
 void print_token(const char *prefix, const char *response, jsmntok_t *token);
 
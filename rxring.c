@@ -0,0 +1,111 @@
+/*!
+ * @file
+ * @brief Receive ring of a UART that is written by DMA.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "rxring.h"
+
+void rxring_init(rxring_t *ring, uint8_t *buffer, uint32_t size) {
+    ring->buffer = buffer;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dma_offset = 0;
+    ring->updates = 0;
+    ring->overruns = 0;
+}
+
+uint32_t rxring_dma_update(rxring_t *ring, uint32_t remaining) {
+    // the remaining count is reloaded to the size at the end of the major loop
+    const uint32_t offset = (ring->size - remaining) & (ring->size - 1);
+    const uint32_t n = (offset - ring->dma_offset) & (ring->size - 1);
+    if (!n) return 0;
+    ring->dma_offset = offset;
+
+    // the bytes are in memory before the consumer can see them
+    __sync_synchronize();
+    ring->head += n;
+    ring->updates++;
+    return n;
+}
+
+// the DMA may be ahead of the last update up to the next half of the buffer, where it raises an interrupt,
+// so the bytes more than the size of the buffer behind that may be overwritten
+static uint32_t rxring_oldest(const rxring_t *ring, uint32_t head) {
+    const uint32_t reach = (head | (ring->size / 2 - 1)) + 1;
+    return reach - ring->size;
+}
+
+// skip what the DMA may have overwritten
+static int rxring_skip_overrun(rxring_t *ring, uint32_t head) {
+    const uint32_t oldest = rxring_oldest(ring, head), tail = ring->tail;
+    if ((int32_t) (oldest - tail) <= 0) return false;
+    ring->overruns += oldest - tail;
+    ring->tail = oldest;
+    return true;
+}
+
+uint32_t rxring_available(const rxring_t *ring) {
+    const uint32_t head = ring->head, oldest = rxring_oldest(ring, head);
+    return head - ((int32_t) (oldest - ring->tail) > 0 ? oldest : ring->tail);
+}
+
+size_t rxring_peek(rxring_t *ring, const uint8_t **chunk) {
+    const uint32_t head = ring->head;
+    __sync_synchronize();
+    rxring_skip_overrun(ring, head);
+
+    const uint32_t offset = ring->tail & (ring->size - 1);
+    const uint32_t available = head - ring->tail;
+    *chunk = ring->buffer + offset;
+    return available < ring->size - offset ? available : ring->size - offset;
+}
+
+int rxring_consume(rxring_t *ring, size_t len) {
+    // the DMA may have reached the chunk while it was used
+    __sync_synchronize();
+    if (rxring_skip_overrun(ring, ring->head)) return false;
+    ring->tail += (uint32_t) len;
+    return true;
+}
+
+size_t rxring_read(rxring_t *ring, uint8_t *out, size_t max) {
+    size_t len = 0;
+    while (len < max) {
+        const uint8_t *chunk;
+        size_t n = rxring_peek(ring, &chunk);
+        if (!n) break;
+        if (n > max - len) n = max - len;
+        memcpy(out + len, chunk, n);
+        if (!rxring_consume(ring, n)) break;
+        len += n;
+    }
+    return len;
+}
+
+int rxring_getc(rxring_t *ring) {
+    const uint8_t *chunk;
+    if (!rxring_peek(ring, &chunk)) return -1;
+    const uint8_t c = *chunk;
+    return rxring_consume(ring, 1) ? c : -1;
+}
@@ -0,0 +1,113 @@
+/*!
+ * @file
+ * @brief Receive ring of a UART that is written by DMA.
+ *
+ * The DMA engine writes the received bytes into the ring buffer in a
+ * circular major loop, without an interrupt per byte. Its write position
+ * is only visible in the remaining count of the major loop, so the ring is
+ * updated from the interrupts that mark the end of a burst: the idle line
+ * interrupt of the UART and the half and full transfer interrupts of the
+ * DMA channel. The consumer then takes whole chunks, contiguous parts of
+ * the buffer, instead of single bytes.
+ *
+ * The DMA does not stop when the consumer falls behind, it overwrites the
+ * oldest bytes. As it may be up to half the buffer ahead of the last
+ * update, the consumer should stay within half the buffer of it. Bytes
+ * that may have been overwritten are skipped and counted as overruns.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _RXRING_H_
+#define _RXRING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! a DMA receive ring, one producer (the DMA interrupts) and one consumer
+typedef struct {
+    uint8_t *buffer;            //!< the DMA destination
+    uint32_t size;              //!< size of the buffer, a power of 2
+    volatile uint32_t head;     //!< bytes written by the DMA (free running)
+    volatile uint32_t tail;     //!< bytes consumed (free running)
+    uint32_t dma_offset;        //!< the DMA write offset at the last update
+    volatile uint32_t updates;  //!< updates that found new bytes, the consumer wake-ups
+    volatile uint32_t overruns; //!< bytes overwritten before they were consumed
+} rxring_t;
+
+/*!
+ * @brief Set up an empty ring, before the DMA is started at the start of the buffer.
+ * @param ring the ring
+ * @param buffer the DMA destination
+ * @param size the size of the buffer, a power of 2
+ */
+void rxring_init(rxring_t *ring, uint8_t *buffer, uint32_t size);
+
+/*!
+ * @brief Take over the bytes the DMA wrote since the last update.
+ * Called from the idle line and the DMA half and full transfer interrupts,
+ * which must not preempt each other. The DMA must not write more than the
+ * size of the buffer between two updates, the half transfer interrupt
+ * guarantees that.
+ * @param ring the ring
+ * @param remaining the remaining count of the DMA major loop
+ * @return the number of new bytes
+ */
+uint32_t rxring_dma_update(rxring_t *ring, uint32_t remaining);
+
+//! @brief Bytes waiting to be consumed
+uint32_t rxring_available(const rxring_t *ring);
+
+/*!
+ * @brief Get the next contiguous chunk of received bytes without consuming it.
+ * @param ring the ring
+ * @param chunk where to store the start of the chunk
+ * @return the size of the chunk, 0 if the ring is empty
+ */
+size_t rxring_peek(rxring_t *ring, const uint8_t **chunk);
+
+/*!
+ * @brief Consume bytes after they were used.
+ * @param ring the ring
+ * @param len the number of bytes, at most the size of the last peeked chunk
+ * @return false if the DMA may have overwritten them in the meantime (counted as an overrun)
+ */
+int rxring_consume(rxring_t *ring, size_t len);
+
+/*!
+ * @brief Copy and consume received bytes.
+ * @param ring the ring
+ * @param out where to copy the bytes
+ * @param max the size of out
+ * @return the number of bytes copied
+ */
+size_t rxring_read(rxring_t *ring, uint8_t *out, size_t max);
+
+//! @brief Consume a single byte, -1 if the ring is empty
+int rxring_getc(rxring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RXRING_H_
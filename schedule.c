@@ -0,0 +1,39 @@
+/*!
+ * @file
+ * @brief The schedule of the main loop.
+ *
+ * @date 2017-04-29
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "schedule.h"
+
+uint32_t schedule_loop(uint32_t loop_counter, int32_t interval_s) {
+    uint32_t due = 0;
+    if (loop_counter % (MAX_INTERVAL / interval_s) == 0) due |= SCHEDULE_REPORT;
+    if (loop_counter && loop_counter % STATS_LOOPS == 0) due |= SCHEDULE_STATS;
+    // the counter is saved after it was incremented at the end of the loop
+    if ((loop_counter + 1) % STATE_SAVE_LOOPS == 0) due |= SCHEDULE_SAVE_STATE;
+    return due;
+}
+
+uint32_t schedule_mqtt_wait(uint32_t wait_ms, uint32_t keepalive_ms) {
+    // a ping that failed to send leaves the keep alive expired, don't spin on it
+    if (keepalive_ms < YIELD_SLICE) keepalive_ms = YIELD_SLICE;
+    return keepalive_ms < wait_ms ? keepalive_ms : wait_ms;
+}
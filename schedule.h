@@ -0,0 +1,85 @@
+/*!
+ * @file
+ * @brief The schedule of the main loop and the timing of the firmware threads.
+ *
+ * The main thread runs a loop every LOOP_PERIOD and decides which messages
+ * are due from the loop counter. The decision and the periods live here,
+ * so the simulator (tools/sim) runs the same schedule as the firmware.
+ *
+ * @date 2017-04-29
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+#include <stdint.h>
+#include "sensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOOP_PERIOD 10000
+// the MQTT thread yields in short slices to pick up queued messages quickly
+#define YIELD_SLICE 100
+// the BME280 sampling period, the sensor thread sleeps at most SENSOR_MAX_WAIT between runs
+#define BME280_PERIOD 10000
+#define SENSOR_MAX_WAIT 60000
+// how often the log thread writes buffered log records, less often if there was nothing to write
+#define LOG_FLUSH_PERIOD 50
+#define LOG_IDLE_PERIOD 1000
+// stats are published every 6 hours
+#define STATS_LOOPS (6 * 3600 * 1000 / LOOP_PERIOD)
+// with the modem RI line, the connected MQTT thread sleeps until data arrives (at most half a keep alive)
+#define RING_WAIT (MAX_INTERVAL * 1000 / 2)
+// without it, the connected MQTT thread polls the modem for a YIELD_SLICE every POLL_WAIT, deep sleep in between
+#define POLL_WAIT 1000
+// the loop counter is persisted every 30 minutes, settings and location when they change
+#define STATE_SAVE_LOOPS (MAX_INTERVAL * 1000 / LOOP_PERIOD)
+
+//! what a loop of the main thread does, besides handling alerts and config changes
+typedef enum {
+    SCHEDULE_REPORT = 1u << 0,      //!< queue the scheduled report (telemetry or heartbeat)
+    SCHEDULE_STATS = 1u << 1,       //!< queue the stats message
+    SCHEDULE_SAVE_STATE = 1u << 2   //!< save the state at the end of the loop
+} schedule_task_t;
+
+/*!
+ * @brief The tasks due in a loop.
+ * @param loop_counter the loop counter, incremented at the end of each loop
+ * @param interval_s the reporting interval (SETTING_INTERVAL)
+ * @return a mask of schedule_task_t
+ */
+uint32_t schedule_loop(uint32_t loop_counter, int32_t interval_s);
+
+/*!
+ * @brief How long the connected MQTT thread sleeps before it yields again.
+ * The client sends its ping from within the yield, so the thread wakes when
+ * the keep alive is due, even if the modem does not ring.
+ * @param wait_ms the wait until the next poll (POLL_WAIT, or RING_WAIT with the RI line)
+ * @param keepalive_ms the time left until the client has to ping
+ * @return the time to sleep in milliseconds
+ */
+uint32_t schedule_mqtt_wait(uint32_t wait_ms, uint32_t keepalive_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SCHEDULE_H_
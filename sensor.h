@@ -1,6 +1,8 @@
 #ifndef _ENV_SENSOR_H_
 #define _ENV_SENSOR_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -9,7 +11,22 @@ extern "C" {
 
 // default wakup interval in seconds
 #define DEFAULT_INTERVAL 10
-#define MAX_INTERVAL 30*60
+#define MAX_INTERVAL (30*60)
+
+// default alert threshold and hysteresis (temperature * 100)
+#define TEMPERATURE_THRESHOLD 4000
+#define TEMPERATURE_HYSTERESIS 50
+// minimum time between two alerts while the condition persists, in seconds
+#define ALERT_MIN_INTERVAL 300
+
+// reporting modes: every interval, or only on a change beyond the deadbands (and a heartbeat)
+#define REPORT_PERIODIC 0
+#define REPORT_ON_DELTA 1
+// send-on-delta reporting: deadbands in payload units and the max silence in seconds
+#define DEADBAND_TEMPERATURE 50
+#define DEADBAND_PRESSURE 1
+#define DEADBAND_HUMIDITY 200
+#define HEARTBEAT_INTERVAL (6*60*60)
 
 // protocol version check
 #define PROTOCOL_VERSION_MIN "0.0"
@@ -20,6 +37,15 @@ extern "C" {
 #define P_PAYLOAD "p"
 #define P_INTERVAL "i"
 #define P_THRESHOLD "th"
+#define P_HYSTERESIS "hy"
+#define P_ALERT_INTERVAL "ai"
+#define P_BME_PROFILE "bp"
+#define P_REPORT_MODE "rm"
+#define P_DEADBAND_T "dt"
+#define P_DEADBAND_P "dp"
+#define P_DEADBAND_H "dh"
+#define P_HEARTBEAT "hb"
+#define P_REQUEST "r"
 
 // error flags
 #define E_SENSOR_FAILED 0b00000001
@@ -29,6 +55,13 @@ extern "C" {
 #define E_NO_MEMORY     0b10000000
 #define E_NO_CONNECTION 0b01000000
 
+// the error flags are set by the main, MQTT and downlink threads and taken by the main thread
+extern uint8_t error_flag;
+//! set error flags
+#define ERROR_SET(flags) ((void) __sync_fetch_and_or(&error_flag, (uint8_t) (flags)))
+//! read and clear the error flags
+#define ERROR_TAKE() __sync_fetch_and_and(&error_flag, (uint8_t) 0)
+
 #ifdef __cplusplus
 }
 #endif
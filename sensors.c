@@ -0,0 +1,184 @@
+/*!
+ * @file
+ * @brief Sensor driver registry and scheduler.
+ *
+ * @date 2017-04-07
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "sensors.h"
+
+#ifdef __MBED__
+#include "cmsis_os.h"
+
+// wait for a sample being written: a yield only runs threads of the same priority, the sampling thread may be lower
+static void sensors_wait(uint32_t retries) {
+    if (retries < 2) osThreadYield();
+    else osDelay(1);
+}
+
+#else
+#include <sched.h>
+
+static void sensors_wait(uint32_t retries) {
+    (void) retries;
+    sched_yield();
+}
+
+#endif
+
+typedef struct {
+    const sensor_driver_t *driver;
+    uint32_t next_ms;
+    volatile uint32_t seq;      //!< odd while the values are written
+    float values[SENSOR_MAX_CHANNELS];
+    uint8_t valid;
+} sensor_slot_t;
+
+static sensor_slot_t sensors[SENSORS_MAX];
+static int sensors_count = 0;
+static bool sensors_started = false;
+static void (*bus_lock)(void) = NULL;
+static void (*bus_unlock)(void) = NULL;
+static sensor_listener_t sensors_listener = NULL;
+
+void sensors_init(void (*lock)(void), void (*unlock)(void), sensor_listener_t listener) {
+    memset(sensors, 0, sizeof(sensors));
+    sensors_count = 0;
+    sensors_started = false;
+    bus_lock = lock;
+    bus_unlock = unlock;
+    sensors_listener = listener;
+}
+
+int sensors_register(const sensor_driver_t *driver) {
+    if (sensors_count >= SENSORS_MAX || driver->channel_count > SENSOR_MAX_CHANNELS) return -1;
+
+    if (driver->init) {
+        if (bus_lock) bus_lock();
+        const int ok = driver->init(driver->ctx);
+        if (bus_unlock) bus_unlock();
+        if (!ok) return -1;
+    }
+
+    sensors[sensors_count].driver = driver;
+    sensors_started = false;
+    return sensors_count++;
+}
+
+uint32_t sensors_run(uint32_t now_ms) {
+    // newly registered sensors are due right away
+    if (!sensors_started) {
+        for (int id = 0; id < sensors_count; id++) if (!sensors[id].valid) sensors[id].next_ms = now_ms;
+        sensors_started = true;
+    }
+
+    // sample everything that is due (or almost), holding the bus once
+    bool due[SENSORS_MAX];
+    bool ok[SENSORS_MAX];
+    bool any = false;
+    for (int id = 0; id < sensors_count; id++) {
+        due[id] = (int32_t) (sensors[id].next_ms - now_ms) <= SENSORS_COALESCE_MS;
+        any |= due[id];
+    }
+
+    if (any) {
+        if (bus_lock) bus_lock();
+        for (int id = 0; id < sensors_count; id++) {
+            if (!due[id]) continue;
+            sensor_slot_t *slot = &sensors[id];
+
+            float values[SENSOR_MAX_CHANNELS];
+            ok[id] = slot->driver->sample(slot->driver->ctx, values) != 0;
+
+            slot->seq++;
+            __sync_synchronize();
+            if (ok[id]) memcpy(slot->values, values, sizeof(values));
+            slot->valid = ok[id];
+            __sync_synchronize();
+            slot->seq++;
+
+            // keep the schedule, unless we fell behind by more than a period
+            slot->next_ms += slot->driver->period_ms;
+            if ((int32_t) (slot->next_ms - now_ms) <= 0) slot->next_ms = now_ms + slot->driver->period_ms;
+        }
+        if (bus_unlock) bus_unlock();
+
+        // notify outside of the bus lock
+        for (int id = 0; id < sensors_count; id++) {
+            if (due[id] && sensors_listener) sensors_listener(id, ok[id] ? sensors[id].values : NULL, now_ms);
+        }
+    }
+
+    uint32_t wait = UINT32_MAX;
+    for (int id = 0; id < sensors_count; id++) {
+        const int32_t remaining = (int32_t) (sensors[id].next_ms - now_ms);
+        if (remaining <= 0) return 0;
+        if ((uint32_t) remaining < wait) wait = (uint32_t) remaining;
+    }
+    return wait;
+}
+
+int sensors_read(int id, float *values) {
+    if (id < 0 || id >= sensors_count) return false;
+    sensor_slot_t *slot = &sensors[id];
+
+    for (uint32_t retries = 0;; sensors_wait(retries++)) {
+        const uint32_t seq = slot->seq;
+        if (seq & 1) continue;
+        __sync_synchronize();
+        memcpy(values, slot->values, slot->driver->channel_count * sizeof(float));
+        const int valid = slot->valid;
+        __sync_synchronize();
+        if (seq == slot->seq) return valid;
+    }
+}
+
+size_t sensors_values(const char **keys, int32_t *values, size_t max) {
+    size_t count = 0;
+    for (int id = 0; id < sensors_count; id++) {
+        float sampled[SENSOR_MAX_CHANNELS];
+        if (!sensors_read(id, sampled)) continue;
+
+        const sensor_driver_t *driver = sensors[id].driver;
+        for (int c = 0; c < driver->channel_count && count < max; c++, count++) {
+            keys[count] = driver->channels[c].key;
+            values[count] = (int32_t) (sampled[c] * driver->channels[c].scale);
+        }
+    }
+    return count;
+}
+
+size_t sensors_format(char *out, size_t max) {
+    size_t len = 0;
+    for (int id = 0; id < sensors_count; id++) {
+        float values[SENSOR_MAX_CHANNELS];
+        if (!sensors_read(id, values)) continue;
+
+        const sensor_driver_t *driver = sensors[id].driver;
+        for (int c = 0; c < driver->channel_count; c++) {
+            const int n = snprintf(len < max ? out + len : NULL, len < max ? max - len : 0, "\"%s\":%ld,",
+                                   driver->channels[c].key, (long) (values[c] * driver->channels[c].scale));
+            if (n > 0) len += (size_t) n;
+        }
+    }
+    return len;
+}
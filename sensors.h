@@ -0,0 +1,120 @@
+/*!
+ * @file
+ * @brief Sensor driver registry and scheduler.
+ *
+ * Each sensor driver declares its channels (payload key and scaling) and its
+ * sampling period. A single scheduler, run by the sensor thread, samples all
+ * registered sensors on the shared I2C bus. Sensors that fall due within
+ * SENSORS_COALESCE_MS of each other are sampled together while holding the bus
+ * once, so adding a sensor does not cost another thread and stack.
+ *
+ * @date 2017-04-07
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _SENSORS_H_
+#define _SENSORS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SENSORS_MAX 4               //!< max number of registered sensors
+#define SENSOR_MAX_CHANNELS 4       //!< max channels per sensor
+#define SENSORS_COALESCE_MS 100     //!< sensors due within this window are sampled together
+
+//! a sensor channel, sent as the integer value * scale
+typedef struct {
+    const char *key;        //!< the payload key
+    float scale;            //!< the scaling applied before sending
+} sensor_channel_t;
+
+//! a sensor driver
+typedef struct {
+    const char *name;
+    const sensor_channel_t *channels;
+    uint8_t channel_count;
+    uint32_t period_ms;                         //!< the sampling period
+    int (*init)(void *ctx);                     //!< initialize the sensor (optional), return true on success
+    int (*sample)(void *ctx, float *values);    //!< read all channels, return true on success
+    void *ctx;                                  //!< driver context passed to init and sample
+} sensor_driver_t;
+
+/*!
+ * Called by the scheduler after a sensor was sampled.
+ * @param id the sensor id
+ * @param values the sampled channel values, or NULL if sampling failed
+ * @param now_ms the time of the sample
+ */
+typedef void (*sensor_listener_t)(int id, const float *values, uint32_t now_ms);
+
+/*!
+ * @brief Initialize the registry.
+ * @param lock acquires the shared bus (may be NULL)
+ * @param unlock releases the shared bus (may be NULL)
+ * @param listener called after each sample (may be NULL)
+ */
+void sensors_init(void (*lock)(void), void (*unlock)(void), sensor_listener_t listener);
+
+/*!
+ * @brief Register and initialize a sensor, it is sampled right away on the next run.
+ * @param driver the driver (not copied, must stay valid)
+ * @return the sensor id, or -1 if the registry is full or the sensor failed to initialize
+ */
+int sensors_register(const sensor_driver_t *driver);
+
+/*!
+ * @brief Sample all sensors that are due.
+ * @param now_ms the current uptime
+ * @return the time in ms until the next sensor is due
+ */
+uint32_t sensors_run(uint32_t now_ms);
+
+/*!
+ * @brief Read the last sampled values of a sensor consistently.
+ * @param id the sensor id
+ * @param values where to store the channel values
+ * @return true if the sensor has a valid sample
+ */
+int sensors_read(int id, float *values);
+
+/*!
+ * @brief Format the last samples of all sensors as JSON members ("key":value,...), followed by a comma.
+ * @param out the buffer to write to (may be NULL if max is 0)
+ * @param max the size of the buffer
+ * @return the length of the formatted members (like snprintf(), may be larger than max)
+ */
+size_t sensors_format(char *out, size_t max);
+
+/*!
+ * @brief Get the last samples of all sensors as the scaled integers that are sent, in payload order.
+ * @param keys where to store the channel keys
+ * @param values where to store the channel values
+ * @param max the max number of channels to store
+ * @return the number of channels stored
+ */
+size_t sensors_values(const char **keys, int32_t *values, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SENSORS_H_
@@ -0,0 +1,211 @@
+/*!
+ * @file
+ * @brief Remote configuration registry.
+ *
+ * Keys are dispatched by their FNV-1a hash, computed once at init, and
+ * confirmed by a single compare. Commits are protected by a sequence
+ * counter, readers retry if a commit happened while they were reading.
+ *
+ * @date 2017-04-03
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "settings.h"
+
+#ifdef __MBED__
+#include "cmsis_os.h"
+
+// wait for a commit in progress: the committing thread may have a lower priority, which a yield does not run
+static void settings_wait(uint32_t retries) {
+    if (retries < 2) osThreadYield();
+    else osDelay(1);
+}
+
+#else
+#include <sched.h>
+
+static void settings_wait(uint32_t retries) {
+    (void) retries;
+    sched_yield();
+}
+
+#endif
+
+typedef struct {
+    const char *key;
+    setting_type_t type;
+    int32_t min;
+    int32_t max;
+    int32_t def;
+    setting_apply_t apply;
+} setting_t;
+
+#define SETTING_ENTRY(id, key, type, min, max, def, apply) {key, type, min, max, def, apply},
+static const setting_t settings[SETTINGS_COUNT] = {
+    SETTINGS_TABLE(SETTING_ENTRY)
+};
+#undef SETTING_ENTRY
+
+static uint32_t settings_hash[SETTINGS_COUNT];
+static volatile int32_t settings_values[SETTINGS_COUNT];
+static volatile uint32_t settings_seq = 0;
+
+// FNV-1a, 32 bit
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int find(uint32_t h, const char *key, size_t keylen) {
+    for (int id = 0; id < SETTINGS_COUNT; id++) {
+        if (settings_hash[id] == h && (!key || (strlen(settings[id].key) == keylen &&
+                                                 memcmp(settings[id].key, key, keylen) == 0)))
+            return id;
+    }
+    return -1;
+}
+
+// parse a decimal integer, rejecting anything but an optional sign and digits
+static int parse_int(const char *s, size_t len, int32_t *out) {
+    size_t i = 0;
+    int negative = 0;
+    if (len && (s[0] == '-' || s[0] == '+')) negative = s[i++] == '-';
+    if (i == len) return 0;
+
+    int64_t value = 0;
+    for (; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+        value = value * 10 + (s[i] - '0');
+        if (value > (int64_t) INT32_MAX + 1) return 0;
+    }
+    if (negative) value = -value;
+    if (value > INT32_MAX) return 0;
+
+    *out = (int32_t) value;
+    return 1;
+}
+
+static int valid(int id, int32_t value) {
+    if (settings[id].type == SETTING_UINT && value < 0) return 0;
+    return value >= settings[id].min && value <= settings[id].max;
+}
+
+void settings_init(void) {
+    for (int id = 0; id < SETTINGS_COUNT; id++) {
+        settings_hash[id] = hash(settings[id].key, strlen(settings[id].key));
+        settings_values[id] = settings[id].def;
+    }
+}
+
+int32_t settings_get(setting_id_t id) {
+    return settings_values[id];
+}
+
+void settings_read(const setting_id_t *ids, int32_t *values, size_t count) {
+    for (uint32_t retries = 0;; settings_wait(retries++)) {
+        const uint32_t seq = settings_seq;
+        if (seq & 1) continue;
+        __sync_synchronize();
+        for (size_t i = 0; i < count; i++) values[i] = settings_values[ids[i]];
+        __sync_synchronize();
+        if (seq == settings_seq) return;
+    }
+}
+
+const char *settings_key(setting_id_t id) {
+    return settings[id].key;
+}
+
+setting_result_t settings_stage(settings_update_t *update, const char *key, size_t keylen,
+                                const char *value, size_t valuelen) {
+    const int id = find(hash(key, keylen), key, keylen);
+    if (id < 0) return SETTING_UNKNOWN;
+
+    int32_t parsed;
+    if (!parse_int(value, valuelen, &parsed) || !valid(id, parsed)) return SETTING_INVALID;
+
+    update->values[id] = parsed;
+    update->mask |= 1u << id;
+    return SETTING_STAGED;
+}
+
+void settings_commit(const settings_update_t *update) {
+    // commits only happen from one thread, the sequence counter protects the readers
+    settings_seq++;
+    __sync_synchronize();
+    for (int id = 0; id < SETTINGS_COUNT; id++) {
+        if (update->mask & (1u << id)) settings_values[id] = update->values[id];
+    }
+    __sync_synchronize();
+    settings_seq++;
+
+    for (int id = 0; id < SETTINGS_COUNT; id++) {
+        if ((update->mask & (1u << id)) && settings[id].apply) settings[id].apply(update->values[id]);
+    }
+}
+
+size_t settings_format(const settings_update_t *update, char *out, size_t max) {
+    size_t len = 0;
+    for (int id = 0; id < SETTINGS_COUNT; id++) {
+        if (!(update->mask & (1u << id))) continue;
+        const int n = snprintf(len < max ? out + len : NULL, len < max ? max - len : 0, "\"%s\":%ld,",
+                               settings[id].key, (long) update->values[id]);
+        if (n > 0) len += (size_t) n;
+    }
+    return len;
+}
+
+size_t settings_serialize(uint8_t *out, size_t max) {
+    size_t len = 0;
+    for (int id = 0; id < SETTINGS_COUNT && len + 8 <= max; id++) {
+        const int32_t value = settings_values[id];
+        memcpy(out + len, &settings_hash[id], 4);
+        memcpy(out + len + 4, &value, 4);
+        len += 8;
+    }
+    return len;
+}
+
+int settings_deserialize(const uint8_t *in, size_t len) {
+    settings_update_t update;
+    memset(&update, 0, sizeof(update));
+
+    int loaded = 0;
+    for (size_t i = 0; i + 8 <= len; i += 8) {
+        uint32_t h;
+        int32_t value;
+        memcpy(&h, in + i, 4);
+        memcpy(&value, in + i + 4, 4);
+
+        const int id = find(h, NULL, 0);
+        if (id < 0 || !valid(id, value)) continue;
+        update.values[id] = value;
+        update.mask |= 1u << id;
+        loaded++;
+    }
+
+    settings_commit(&update);
+    return loaded;
+}
@@ -0,0 +1,150 @@
+/*!
+ * @file
+ * @brief Remote configuration registry.
+ *
+ * All tunables are declared in SETTINGS_TABLE with their JSON key, type,
+ * range and default. A new tunable only needs a new line in the table.
+ * Config messages are staged key by key and committed as a whole, so a
+ * reader never sees a partially applied configuration and a message with
+ * a single invalid value changes nothing.
+ *
+ * @date 2017-04-03
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bme280.h"
+#include "sensor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! setting value types
+typedef enum {
+    SETTING_UINT,   //!< unsigned integer
+    SETTING_INT     //!< signed integer
+} setting_type_t;
+
+//! called after a committed change of the setting
+typedef void (*setting_apply_t)(int32_t value);
+
+/*!
+ * The settings table: X(id, key, type, min, max, default, apply callback)
+ */
+#define SETTINGS_TABLE(X) \
+    X(SETTING_INTERVAL,       P_INTERVAL,       SETTING_UINT, 1,     MAX_INTERVAL, DEFAULT_INTERVAL,       NULL) \
+    X(SETTING_THRESHOLD,      P_THRESHOLD,      SETTING_INT,  -4000, 8500,         TEMPERATURE_THRESHOLD,  NULL) \
+    X(SETTING_HYSTERESIS,     P_HYSTERESIS,     SETTING_UINT, 0,     2000,         TEMPERATURE_HYSTERESIS, NULL) \
+    X(SETTING_ALERT_INTERVAL, P_ALERT_INTERVAL, SETTING_UINT, 0,     86400,        ALERT_MIN_INTERVAL,     NULL) \
+    X(SETTING_BME_PROFILE,    P_BME_PROFILE,    SETTING_UINT, 0,     BME280_PROFILE_COUNT - 1, BME280_DEFAULT_PROFILE, NULL) \
+    X(SETTING_REPORT_MODE,    P_REPORT_MODE,    SETTING_UINT, 0,     REPORT_ON_DELTA, REPORT_PERIODIC,      NULL) \
+    X(SETTING_DEADBAND_T,     P_DEADBAND_T,     SETTING_UINT, 0,     10000,        DEADBAND_TEMPERATURE,   NULL) \
+    X(SETTING_DEADBAND_P,     P_DEADBAND_P,     SETTING_UINT, 0,     1000,         DEADBAND_PRESSURE,      NULL) \
+    X(SETTING_DEADBAND_H,     P_DEADBAND_H,     SETTING_UINT, 0,     10000,        DEADBAND_HUMIDITY,      NULL) \
+    X(SETTING_HEARTBEAT,      P_HEARTBEAT,      SETTING_UINT, 60,    7*24*60*60,   HEARTBEAT_INTERVAL,     NULL)
+
+#define SETTING_ID(id, key, type, min, max, def, apply) id,
+typedef enum {
+    SETTINGS_TABLE(SETTING_ID)
+    SETTINGS_COUNT
+} setting_id_t;
+#undef SETTING_ID
+
+//! result of staging a key/value pair
+typedef enum {
+    SETTING_STAGED = 0,     //!< the value was staged
+    SETTING_UNKNOWN,        //!< the key is not a setting
+    SETTING_INVALID         //!< the value is malformed or out of range
+} setting_result_t;
+
+//! a set of staged changes
+typedef struct {
+    uint32_t mask;                      //!< bit per setting id that has been staged
+    int32_t values[SETTINGS_COUNT];
+} settings_update_t;
+
+//! @brief Initialize the registry with the default values and precompute the key hashes
+void settings_init(void);
+
+//! @brief Get the current value of a setting
+int32_t settings_get(setting_id_t id);
+
+/*!
+ * @brief Read several settings consistently (not torn by a concurrent commit).
+ * @param ids the settings to read
+ * @param values where to store the values
+ * @param count the number of settings
+ */
+void settings_read(const setting_id_t *ids, int32_t *values, size_t count);
+
+//! @brief Get the JSON key of a setting
+const char *settings_key(setting_id_t id);
+
+/*!
+ * @brief Parse, validate and stage a key/value pair.
+ * @param update the update to stage the value in
+ * @param key the key (not 0 terminated)
+ * @param keylen the length of the key
+ * @param value the value (not 0 terminated)
+ * @param valuelen the length of the value
+ * @return the result of staging
+ */
+setting_result_t settings_stage(settings_update_t *update, const char *key, size_t keylen,
+                                const char *value, size_t valuelen);
+
+/*!
+ * @brief Apply all staged changes at once and call the apply callbacks.
+ * @param update the staged changes
+ */
+void settings_commit(const settings_update_t *update);
+
+/*!
+ * @brief Format the staged values as JSON members ("key":value,...), followed by a comma.
+ * @param update the staged changes
+ * @param out the buffer to write to (may be NULL if max is 0)
+ * @param max the size of the buffer
+ * @return the length of the formatted members (like snprintf(), may be larger than max)
+ */
+size_t settings_format(const settings_update_t *update, char *out, size_t max);
+
+/*!
+ * @brief Serialize the current settings (key hash and value pairs) for persistent storage.
+ * @param out the buffer to write to
+ * @param max the size of the buffer
+ * @return the number of bytes written
+ */
+size_t settings_serialize(uint8_t *out, size_t max);
+
+/*!
+ * @brief Load serialized settings, unknown keys and invalid values are skipped.
+ * @param in the serialized settings
+ * @param len the length of the serialized settings
+ * @return the number of settings loaded
+ */
+int settings_deserialize(const uint8_t *in, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _SETTINGS_H_
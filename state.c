@@ -0,0 +1,226 @@
+/*!
+ * @file
+ * @brief Persisted runtime state for a fast warm boot.
+ *
+ * @date 2017-04-05
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "state.h"
+
+#define STATE_MAGIC   0x54534255    // "UBST"
+#define STATE_VERSION 3
+
+//! the stored record, a multiple of the 8 byte flash programming unit
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t sequence;
+    state_t state;
+    uint32_t crc;
+} state_record_t;
+
+#define STATE_RECORD_SIZE ((sizeof(state_record_t) + 7u) & ~7u)
+
+static uint32_t sequence = 0;
+static int32_t next_slot = -1;
+static state_record_t last;
+static state_quiet_t quiet_begin = NULL;
+static state_quiet_t quiet_end = NULL;
+
+// === STORAGE BACKEND ===
+
+#ifdef __MBED__
+
+#include "fsl_flash.h"
+#include "platform/critical.h"
+
+#define STATE_SECTOR_SIZE FSL_FEATURE_FLASH_PFLASH_BLOCK_SECTOR_SIZE
+#define STATE_ADDRESS (FSL_FEATURE_FLASH_PFLASH_BLOCK_SIZE * FSL_FEATURE_FLASH_PFLASH_BLOCK_COUNT - STATE_SECTOR_SIZE)
+
+#ifdef TOOLCHAIN_GCC_ARM
+// the end of the image in flash: code, followed by the initial values of the data, from the symbols
+// the startup code copies the data with (a linker script without them does not link)
+extern const uint32_t __etext[], __data_start__[], __data_end__[];
+#define STATE_IMAGE_END ((uint32_t) __etext + ((uint32_t) __data_end__ - (uint32_t) __data_start__))
+#endif
+
+static flash_config_t flash_config;
+static bool flash_initialized = false;
+
+static int storage_init(void) {
+#ifdef STATE_IMAGE_END
+    // the linker script does not reserve the sector, an image that grew into it must not be erased
+    if (STATE_IMAGE_END > STATE_ADDRESS) return false;
+#endif
+    if (!flash_initialized) flash_initialized = FLASH_Init(&flash_config) == kStatus_FLASH_Success;
+    return flash_initialized;
+}
+
+static void storage_read(uint32_t offset, void *buffer, uint32_t len) {
+    memcpy(buffer, (const void *) (STATE_ADDRESS + offset), len);
+}
+
+static int storage_erase(void) {
+    core_util_critical_section_enter();
+    const status_t status = FLASH_Erase(&flash_config, STATE_ADDRESS, STATE_SECTOR_SIZE, kFLASH_apiEraseKey);
+    core_util_critical_section_exit();
+    return status == kStatus_FLASH_Success;
+}
+
+static int storage_program(uint32_t offset, const void *buffer, uint32_t len) {
+    core_util_critical_section_enter();
+    const status_t status = FLASH_Program(&flash_config, STATE_ADDRESS + offset, (uint32_t *) buffer, len);
+    core_util_critical_section_exit();
+    return status == kStatus_FLASH_Success;
+}
+
+#else
+
+#define STATE_SECTOR_SIZE 4096
+
+// the host build emulates the flash sector with a file (erased bytes are 0xff)
+static uint8_t sector[STATE_SECTOR_SIZE];
+
+static int storage_init(void) {
+    memset(sector, 0xff, sizeof(sector));
+    FILE *f = fopen(STATE_FILE, "rb");
+    if (f) {
+        if (fread(sector, 1, sizeof(sector), f) != sizeof(sector)) memset(sector, 0xff, sizeof(sector));
+        fclose(f);
+    }
+    return true;
+}
+
+static int storage_flush(void) {
+    FILE *f = fopen(STATE_FILE, "wb");
+    if (!f) return false;
+    const int ok = fwrite(sector, 1, sizeof(sector), f) == sizeof(sector);
+    fclose(f);
+    return ok;
+}
+
+static void storage_read(uint32_t offset, void *buffer, uint32_t len) {
+    memcpy(buffer, sector + offset, len);
+}
+
+static int storage_erase(void) {
+    memset(sector, 0xff, sizeof(sector));
+    return storage_flush();
+}
+
+static int storage_program(uint32_t offset, const void *buffer, uint32_t len) {
+    memcpy(sector + offset, buffer, len);
+    return storage_flush();
+}
+
+#endif
+
+#define STATE_SLOTS (STATE_SECTOR_SIZE / STATE_RECORD_SIZE)
+
+// === RECORDS ===
+
+// CRC-32 (IEEE 802.3), bitwise, the record is small
+static uint32_t crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static int record_valid(const state_record_t *record) {
+    return record->magic == STATE_MAGIC && record->version == STATE_VERSION &&
+           record->crc == crc32((const uint8_t *) record, offsetof(state_record_t, crc));
+}
+
+void state_init(state_quiet_t begin, state_quiet_t end) {
+    quiet_begin = begin;
+    quiet_end = end;
+}
+
+// erase the full sector and start it with the current record
+static int compact(void) {
+    // interrupts are masked during the erase
+    if (quiet_begin) quiet_begin();
+    int ok = storage_erase();
+    if (ok && sequence) ok = storage_program(0, &last, sizeof(last));
+    if (quiet_end) quiet_end();
+    if (!ok) return false;
+
+    next_slot = sequence ? 1 : 0;
+    return true;
+}
+
+int state_load(state_t *state) {
+    if (!storage_init()) return false;
+
+    // find the newest valid record and the first free slot
+    int found = false;
+    next_slot = STATE_SLOTS;
+    for (uint32_t slot = 0; slot < STATE_SLOTS; slot++) {
+        state_record_t record;
+        storage_read(slot * STATE_RECORD_SIZE, &record, sizeof(record));
+        if (record.magic == 0xffffffff) {
+            next_slot = (int32_t) slot;
+            break;
+        }
+        if (record_valid(&record) && (!found || record.sequence > sequence)) {
+            sequence = record.sequence;
+            last = record;
+            found = true;
+        }
+    }
+
+    // a full sector is erased now, at boot, rather than in the middle of a session
+    if (next_slot >= (int32_t) STATE_SLOTS) compact();
+
+    if (found) *state = last.state;
+    return found;
+}
+
+int state_save(const state_t *state) {
+    if (next_slot < 0) {
+        state_t ignored;
+        state_load(&ignored);
+        if (next_slot < 0) return false;
+    }
+    if (next_slot >= 0 && sequence && memcmp(&last.state, state, sizeof(state_t)) == 0) return true;
+
+    state_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.magic = STATE_MAGIC;
+    record.version = STATE_VERSION;
+    record.sequence = sequence + 1;
+    record.state = *state;
+    record.crc = crc32((const uint8_t *) &record, offsetof(state_record_t, crc));
+
+    if (next_slot >= (int32_t) STATE_SLOTS && !compact()) return false;
+    if (!storage_program((uint32_t) next_slot * STATE_RECORD_SIZE, &record, sizeof(record))) return false;
+
+    next_slot++;
+    sequence = record.sequence;
+    last = record;
+    return true;
+}
@@ -0,0 +1,85 @@
+/*!
+ * @file
+ * @brief Persisted runtime state for a fast warm boot.
+ *
+ * The state (settings, loop counter and last known location) is stored as
+ * a CRC protected record in the last flash sector (a file in the host build).
+ * Records are appended to the sector and the sector is only erased when it
+ * is full, the record with the highest sequence number is the current one.
+ * A full sector is erased at boot, before the modem is up. The erase masks
+ * interrupts for tens of milliseconds, an erase at runtime is bracketed by
+ * callbacks that keep the modem quiet.
+ *
+ * @date 2017-04-05
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _STATE_H_
+#define _STATE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATE_LOCATION_LENGTH 32    //!< latitude/longitude buffer (incl. 0), as filled by the modem driver
+#define STATE_SETTINGS_SIZE   128   //!< serialized settings, see settings_serialize()
+
+#ifndef STATE_FILE
+#define STATE_FILE "state.bin"      //!< backing file of the host build
+#endif
+
+//! the runtime state that survives a reset
+typedef struct {
+    uint32_t loop_counter;
+    char lat[STATE_LOCATION_LENGTH];
+    char lon[STATE_LOCATION_LENGTH];
+    uint16_t settings_len;
+    uint8_t settings[STATE_SETTINGS_SIZE];
+} state_t;
+
+//! called around a sector erase at runtime
+typedef void (*state_quiet_t)(void);
+
+/*!
+ * @brief Register the callbacks around a sector erase, before the state is loaded.
+ * @param begin called before the erase, keeps the modem quiet (may be NULL)
+ * @param end called after the erase (may be NULL)
+ */
+void state_init(state_quiet_t begin, state_quiet_t end);
+
+/*!
+ * @brief Restore the last saved state.
+ * @param state where to store the state
+ * @return true if a valid state was found
+ */
+int state_load(state_t *state);
+
+/*!
+ * @brief Save the state, unless it is the same as the last saved one.
+ * @param state the state to save
+ * @return true if the state is stored
+ */
+int state_save(const state_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _STATE_H_
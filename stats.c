@@ -0,0 +1,68 @@
+/*!
+ * @file
+ * @brief Device statistics.
+ *
+ * @date 2017-04-13
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "stats.h"
+
+#define STAT_KEY(id, key) key,
+static const char *const stats_keys[STATS_COUNT] = {
+    STATS_TABLE(STAT_KEY)
+};
+#undef STAT_KEY
+
+static volatile uint32_t stats_values[STATS_COUNT];
+
+void stats_set(stat_id_t id, uint32_t value) {
+    stats_values[id] = value;
+}
+
+void stats_add(stat_id_t id, uint32_t delta) {
+    __sync_fetch_and_add(&stats_values[id], delta);
+}
+
+uint32_t stats_get(stat_id_t id) {
+    return stats_values[id];
+}
+
+// format into out (if not NULL), returns the length
+static size_t stats_format(char *out, size_t max, const uint32_t *values) {
+    size_t len = (size_t) snprintf(out, max, "{\"y\":\"s\"");
+    for (int id = 0; id < STATS_COUNT; id++) {
+        len += (size_t) snprintf(out ? out + len : NULL, out ? max - len : 0, ",\"%s\":%lu", stats_keys[id],
+                                 (unsigned long) values[id]);
+    }
+    len += (size_t) snprintf(out ? out + len : NULL, out ? max - len : 0, "}");
+    return len;
+}
+
+char *stats_payload(void) {
+    // a snapshot, so the length does not change between measuring and formatting
+    uint32_t values[STATS_COUNT];
+    for (int id = 0; id < STATS_COUNT; id++) values[id] = stats_values[id];
+
+    const size_t len = stats_format(NULL, 0, values);
+    char *payload = (char *) malloc(len + 1);
+    if (payload) stats_format(payload, len + 1, values);
+    return payload;
+}
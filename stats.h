@@ -0,0 +1,84 @@
+/*!
+ * @file
+ * @brief Device statistics.
+ *
+ * Counters are declared in STATS_TABLE with their payload key. They are
+ * updated from any thread and published as a signed stats message
+ * (`{"y":"s",...}`).
+ *
+ * @date 2017-04-13
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The statistics table: X(id, key)
+ */
+#define STATS_TABLE(X) \
+    X(STAT_UPTIME,      "up")   /* uptime in s */ \
+    X(STAT_RUN_MS,      "run")  /* time spent running since the last stats message */ \
+    X(STAT_SLEEP_MS,    "slp")  /* time spent in sleep (WFI) since the last stats message */ \
+    X(STAT_DEEPSLEEP_MS, "dsl") /* time spent in deep sleep (VLPS) since the last stats message */ \
+    X(STAT_WAKEUPS,     "wk")   /* wake-ups from deep sleep since the last stats message */ \
+    X(STAT_DROPPED,     "dr")   /* messages dropped by the outbox and the thread queues */ \
+    X(STAT_LOG_DROPPED, "ld")   /* log records dropped */ \
+    X(STAT_RTT_COUNT,   "rn")   /* downlinks with a round trip time in this session */ \
+    X(STAT_RTT_P50,     "r50")  /* downlink round trip time percentiles in ms */ \
+    X(STAT_RTT_P90,     "r90") \
+    X(STAT_RTT_P99,     "r99") \
+    X(STAT_RTT_MAX,     "rmx") \
+    X(STAT_BME_PROFILE, "bp")   /* active BME280 profile */ \
+    X(STAT_BME_CONV_US, "bcv")  /* BME280 conversion time of the last sample in us */ \
+    X(STAT_BME_MAX_US,  "bcx")  /* BME280 datasheet maximum conversion time of the profile in us */ \
+    X(STAT_BME_CURRENT, "bna")  /* BME280 average current estimate of the profile in nA */
+
+#define STAT_ID(id, key) id,
+typedef enum {
+    STATS_TABLE(STAT_ID)
+    STATS_COUNT
+} stat_id_t;
+#undef STAT_ID
+
+//! @brief Set a counter
+void stats_set(stat_id_t id, uint32_t value);
+
+//! @brief Add to a counter (atomic, also from interrupt context)
+void stats_add(stat_id_t id, uint32_t delta);
+
+//! @brief Get a counter
+uint32_t stats_get(stat_id_t id);
+
+/*!
+ * @brief Create the stats message payload with all counters.
+ * @return the payload (malloc(), 0 terminated) or NULL if out of memory
+ */
+char *stats_payload(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _STATS_H_
@@ -0,0 +1,201 @@
+/*!
+ * @file
+ * @brief The telemetry payload schema and its JSON and binary encoders.
+ *
+ * @date 2017-04-26
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <string.h>
+#include "telemetry.h"
+
+#define TELEMETRY_KEY(id, member, key, type, scale) key,
+static const char *const telemetry_keys[TELEMETRY_FIELDS] = {
+    TELEMETRY_SCHEMA(TELEMETRY_KEY)
+};
+#undef TELEMETRY_KEY
+
+#define TELEMETRY_SCALE(id, member, key, type, scale) scale,
+static const int32_t telemetry_scales[TELEMETRY_FIELDS] = {
+    TELEMETRY_SCHEMA(TELEMETRY_SCALE)
+};
+#undef TELEMETRY_SCALE
+
+// the present mask has 16 bits
+typedef char telemetry_fields_fit[TELEMETRY_FIELDS <= 16 ? 1 : -1];
+
+// the generated code below picks the function for the type of each field
+#define SET_INT_FIELD_INT(member, value) ((member) = (value), 1)
+#define SET_INT_FIELD_STRING(member, value) 0
+#define SET_STRING_FIELD_INT(member, value) 0
+#define SET_STRING_FIELD_STRING(member, value) (copy_string((member), (value)), 1)
+#define DECODE_FIELD_INT(in, end, member) decode_int((in), (end), &(member))
+#define DECODE_FIELD_STRING(in, end, member) decode_string((in), (end), (member))
+
+const char *telemetry_key(telemetry_field_t field) {
+    return telemetry_keys[field];
+}
+
+int32_t telemetry_scale(telemetry_field_t field) {
+    return telemetry_scales[field];
+}
+
+static void copy_string(char *out, const char *value) {
+    size_t len = strlen(value);
+    if (len > TELEMETRY_STRING_MAX) len = TELEMETRY_STRING_MAX;
+    memcpy(out, value, len);
+    out[len] = '\0';
+}
+
+size_t telemetry_set_sensors(telemetry_t *telemetry, const char *const *keys, const int32_t *values, size_t count) {
+    size_t unknown = 0;
+    for (size_t i = 0; i < count; i++) {
+        int set = 0;
+#define TELEMETRY_SET(id, member, key, type, scale) \
+        if (!set && strcmp(keys[i], key) == 0 && SET_INT_##type(telemetry->member, values[i])) { \
+            telemetry->present |= 1u << id; \
+            set = 1; \
+        }
+        TELEMETRY_SCHEMA(TELEMETRY_SET)
+#undef TELEMETRY_SET
+        if (!set) unknown++;
+    }
+    return unknown;
+}
+
+void telemetry_set_string(telemetry_t *telemetry, telemetry_field_t field, const char *value) {
+    switch (field) {
+#define TELEMETRY_SET(id, member, key, type, scale) \
+        case id: \
+            if (SET_STRING_##type(telemetry->member, value)) telemetry->present |= 1u << id; \
+            break;
+        TELEMETRY_SCHEMA(TELEMETRY_SET)
+#undef TELEMETRY_SET
+        default:
+            break;
+    }
+}
+
+// === JSON ===
+
+static char *json_FIELD_INT(char *out, int32_t value) {
+    char digits[10];
+    uint32_t v = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+    int n = 0;
+    do {
+        digits[n++] = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v);
+    *out = '-';
+    out += value < 0;
+    while (n) *out++ = digits[--n];
+    return out;
+}
+
+static char *json_FIELD_STRING(char *out, const char *value) {
+    const size_t len = strlen(value);
+    *out++ = '"';
+    memcpy(out, value, len);
+    out += len;
+    *out++ = '"';
+    return out;
+}
+
+size_t telemetry_json(const telemetry_t *telemetry, char *out) {
+    char *p = out;
+    *p++ = '{';
+    // "key": is copied as one literal of known size
+#define TELEMETRY_WRITE(id, member, key, type, scale) \
+    if (telemetry->present & (1u << id)) { \
+        memcpy(p, "\"" key "\":", sizeof(key) + 2); \
+        p = json_##type(p + sizeof(key) + 2, telemetry->member); \
+        *p++ = ','; \
+    }
+    TELEMETRY_SCHEMA(TELEMETRY_WRITE)
+#undef TELEMETRY_WRITE
+    // the last comma becomes the closing brace
+    p -= p[-1] == ',';
+    *p++ = '}';
+    *p = '\0';
+    return (size_t) (p - out);
+}
+
+// === BINARY ===
+
+static uint8_t *encode_FIELD_INT(uint8_t *out, int32_t value) {
+    uint32_t v = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    while (v >= 0x80) {
+        *out++ = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t) v;
+    return out;
+}
+
+static uint8_t *encode_FIELD_STRING(uint8_t *out, const char *value) {
+    const size_t len = strlen(value);
+    *out++ = (uint8_t) len;
+    memcpy(out, value, len);
+    return out + len;
+}
+
+size_t telemetry_encode(const telemetry_t *telemetry, uint8_t *out) {
+    uint8_t *p = out;
+    *p++ = (uint8_t) telemetry->present;
+    *p++ = (uint8_t) (telemetry->present >> 8);
+#define TELEMETRY_ENCODE(id, member, key, type, scale) \
+    if (telemetry->present & (1u << id)) p = encode_##type(p, telemetry->member);
+    TELEMETRY_SCHEMA(TELEMETRY_ENCODE)
+#undef TELEMETRY_ENCODE
+    return (size_t) (p - out);
+}
+
+static const uint8_t *decode_int(const uint8_t *in, const uint8_t *end, int32_t *value) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7) {
+        const uint8_t b = *in++;
+        if (shift == 28 && b > 0x0f) return NULL;
+        v |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *value = (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *decode_string(const uint8_t *in, const uint8_t *end, char *value) {
+    if (in >= end || *in > TELEMETRY_STRING_MAX || end - in - 1 < *in) return NULL;
+    const size_t len = *in++;
+    memcpy(value, in, len);
+    value[len] = '\0';
+    return memchr(value, '\0', len) ? NULL : in + len;
+}
+
+int telemetry_decode(const uint8_t *in, size_t len, telemetry_t *telemetry) {
+    memset(telemetry, 0, sizeof(telemetry_t));
+    if (len < 2) return 0;
+    const uint8_t *p = in + 2, *end = in + len;
+    telemetry->present = (uint16_t) (in[0] | in[1] << 8);
+    if (telemetry->present >> TELEMETRY_FIELDS) return 0;
+#define TELEMETRY_DECODE(id, member, key, type, scale) \
+    if (p && (telemetry->present & (1u << id))) p = DECODE_##type(p, end, telemetry->member);
+    TELEMETRY_SCHEMA(TELEMETRY_DECODE)
+#undef TELEMETRY_DECODE
+    return p == end;
+}
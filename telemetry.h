@@ -0,0 +1,151 @@
+/*!
+ * @file
+ * @brief The telemetry payload schema and its JSON and binary encoders.
+ *
+ * The payload fields are declared once in TELEMETRY_SCHEMA, everything else
+ * is generated from it: the telemetry_t struct with a typed member per field,
+ * the JSON writer, the binary encoder and decoder and the maximum sizes, so
+ * buffers can be sized at compile time. The JSON writer is unrolled per field
+ * and does not use printf.
+ *
+ * The binary encoding is a 16 bit little endian presence mask followed by the
+ * present fields in schema order: integers as zigzag varints, strings as a
+ * length byte and the characters.
+ *
+ * @date 2017-04-26
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_STRING_MAX 31     //!< max length of a string field
+
+//! field types, the member type of a field is TELEMETRY_<type>
+typedef int32_t TELEMETRY_FIELD_INT;
+typedef char TELEMETRY_FIELD_STRING[TELEMETRY_STRING_MAX + 1];
+
+/*!
+ * The telemetry payload, in payload order: X(id, member, key, type, scale)
+ *
+ * The scale is the factor the value was multiplied with before it was sent
+ * as an integer. The sensor channels must match the channel tables of the
+ * sensor drivers (e.g. bme280_sensor.cpp).
+ */
+#define TELEMETRY_SCHEMA(X) \
+    X(TELEMETRY_TEMPERATURE, temperature, "t",  FIELD_INT,    100) \
+    X(TELEMETRY_PRESSURE,    pressure,    "p",  FIELD_INT,    1)   \
+    X(TELEMETRY_HUMIDITY,    humidity,    "h",  FIELD_INT,    100) \
+    X(TELEMETRY_ALTITUDE,    altitude,    "a",  FIELD_INT,    100) \
+    X(TELEMETRY_LATITUDE,    latitude,    "la", FIELD_STRING, 1)   \
+    X(TELEMETRY_LONGITUDE,   longitude,   "lo", FIELD_STRING, 1)   \
+    X(TELEMETRY_BATTERY,     battery,     "ba", FIELD_INT,    1)   \
+    X(TELEMETRY_LOOP,        loop,        "lp", FIELD_INT,    1)   \
+    X(TELEMETRY_ERROR,       error,       "e",  FIELD_INT,    1)
+
+#define TELEMETRY_ID(id, member, key, type, scale) id,
+typedef enum {
+    TELEMETRY_SCHEMA(TELEMETRY_ID)
+    TELEMETRY_FIELDS
+} telemetry_field_t;
+#undef TELEMETRY_ID
+
+//! a telemetry payload, only the fields in the present mask are sent
+#define TELEMETRY_MEMBER(id, member, key, type, scale) TELEMETRY_##type member;
+typedef struct {
+    uint16_t present;       //!< bit per field id
+    TELEMETRY_SCHEMA(TELEMETRY_MEMBER)
+} telemetry_t;
+#undef TELEMETRY_MEMBER
+
+// max length of a value in JSON and in the binary encoding
+#define TELEMETRY_JSON_FIELD_INT 11
+#define TELEMETRY_JSON_FIELD_STRING (TELEMETRY_STRING_MAX + 2)
+#define TELEMETRY_BINARY_FIELD_INT 5
+#define TELEMETRY_BINARY_FIELD_STRING (TELEMETRY_STRING_MAX + 1)
+
+// "key":value,
+#define TELEMETRY_JSON_MAX(id, member, key, type, scale) + (sizeof(key) - 1 + 4 + TELEMETRY_JSON_##type)
+#define TELEMETRY_BINARY_MAX(id, member, key, type, scale) + TELEMETRY_BINARY_##type
+
+//! buffer size for the JSON payload, with the braces and the terminating 0
+#define TELEMETRY_JSON_SIZE (2 TELEMETRY_SCHEMA(TELEMETRY_JSON_MAX))
+//! buffer size for the binary payload
+#define TELEMETRY_BINARY_SIZE (2 TELEMETRY_SCHEMA(TELEMETRY_BINARY_MAX))
+
+//! @brief Get the JSON key of a field
+const char *telemetry_key(telemetry_field_t field);
+
+//! @brief Get the scale of a field
+int32_t telemetry_scale(telemetry_field_t field);
+
+/*!
+ * @brief Set the sensor fields from the channel values (see sensors_values()).
+ * @param telemetry the payload
+ * @param keys the channel keys
+ * @param values the scaled channel values
+ * @param count the number of channels
+ * @return the number of channels that are not part of the schema (not set)
+ */
+size_t telemetry_set_sensors(telemetry_t *telemetry, const char *const *keys, const int32_t *values, size_t count);
+
+/*!
+ * @brief Set a string field, it is truncated to TELEMETRY_STRING_MAX.
+ * @param telemetry the payload
+ * @param field the field (of type FIELD_STRING)
+ * @param value the string
+ */
+void telemetry_set_string(telemetry_t *telemetry, telemetry_field_t field, const char *value);
+
+/*!
+ * @brief Write the payload as JSON.
+ * @param telemetry the payload
+ * @param out the buffer, TELEMETRY_JSON_SIZE bytes
+ * @return the length of the JSON (0 terminated)
+ */
+size_t telemetry_json(const telemetry_t *telemetry, char *out);
+
+/*!
+ * @brief Encode the payload in the binary format.
+ * @param telemetry the payload
+ * @param out the buffer, TELEMETRY_BINARY_SIZE bytes
+ * @return the length of the encoding
+ */
+size_t telemetry_encode(const telemetry_t *telemetry, uint8_t *out);
+
+/*!
+ * @brief Decode a binary payload.
+ * @param in the encoding
+ * @param len the length of the encoding
+ * @param telemetry the decoded payload
+ * @return true if the encoding is valid and complete
+ */
+int telemetry_decode(const uint8_t *in, size_t len, telemetry_t *telemetry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _TELEMETRY_H_
@@ -0,0 +1,195 @@
+/*!
+ * @file
+ * @brief TLS transport for the MQTT client, with session resumption.
+ *
+ * @date 2017-04-18
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+// only built with MQTT_TLS, the credentials in config.h are not needed otherwise
+#ifdef MQTT_TLS
+
+#include <string.h>
+#include "tls_network.h"
+#include "log.h"
+#include "uptime.h"
+#include "config.h"
+
+// the wolfSSL build options both profiles need, set in the wolfSSL user settings (see README)
+#if !defined(HAVE_CHACHA) || !defined(HAVE_POLY1305)
+#error "MQTT_TLS needs wolfSSL with HAVE_CHACHA and HAVE_POLY1305"
+#endif
+#ifndef HAVE_SESSION_TICKET
+#error "MQTT_TLS needs wolfSSL with HAVE_SESSION_TICKET, reconnects resume the session with a ticket"
+#endif
+#if TLS_PROFILE == TLS_PROFILE_PSK && defined(NO_PSK)
+#error "TLS_PROFILE_PSK needs wolfSSL without NO_PSK"
+#endif
+#if TLS_PROFILE == TLS_PROFILE_ECDHE && !defined(HAVE_ECC)
+#error "TLS_PROFILE_ECDHE needs wolfSSL with HAVE_ECC"
+#endif
+
+#if TLS_PROFILE == TLS_PROFILE_PSK
+
+static unsigned int psk_client(WOLFSSL *ssl, const char *hint, char *identity, unsigned int identity_max,
+                               unsigned char *key, unsigned int key_max) {
+    (void) ssl;
+    (void) hint;
+    if (strlen(TLS_PSK_IDENTITY) >= identity_max || tls_psk_key_len > key_max) return 0;
+    strcpy(identity, TLS_PSK_IDENTITY);
+    memcpy(key, tls_psk_key, tls_psk_key_len);
+    return tls_psk_key_len;
+}
+
+#endif
+
+MQTTNetworkTLS::MQTTNetworkTLS(NetworkInterface *network)
+        : network(network), socketOpen(false), ctx(NULL), ssl(NULL), session(NULL), sessionResumed(false),
+          timeout(TLS_TIMEOUT), bytes(0) {
+    wolfSSL_Init();
+    ctx = wolfSSL_CTX_new(wolfTLSv1_2_client_method());
+    if (!ctx) return;
+
+    wolfSSL_SetIORecv(ctx, receive);
+    wolfSSL_SetIOSend(ctx, send);
+#if TLS_PROFILE == TLS_PROFILE_PSK
+    wolfSSL_CTX_set_cipher_list(ctx, "PSK-CHACHA20-POLY1305");
+    wolfSSL_CTX_set_psk_client_callback(ctx, psk_client);
+#else
+    wolfSSL_CTX_set_cipher_list(ctx, "ECDHE-ECDSA-CHACHA20-POLY1305");
+    if (wolfSSL_CTX_load_verify_buffer(ctx, tls_ca_cert, tls_ca_cert_len, SSL_FILETYPE_PEM) != SSL_SUCCESS)
+        LOG_E("TLS CA certificate invalid\r\n");
+    wolfSSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+#endif
+    // the broker keeps no per-client state and resumption survives broker restarts
+    wolfSSL_CTX_UseSessionTicket(ctx);
+}
+
+MQTTNetworkTLS::~MQTTNetworkTLS() {
+    disconnect();
+    if (ctx) wolfSSL_CTX_free(ctx);
+}
+
+int MQTTNetworkTLS::connect(const char *hostname, int port) {
+    disconnect();
+    if (!ctx) return -1;
+
+    int rc = socket.open(network);
+    if (rc != 0) return rc;
+    socketOpen = true;
+    if ((rc = socket.connect(hostname, (uint16_t) port)) != 0) {
+        disconnect();
+        return rc;
+    }
+
+    ssl = wolfSSL_new(ctx);
+    if (!ssl) {
+        disconnect();
+        return -1;
+    }
+    wolfSSL_SetIOReadCtx(ssl, this);
+    wolfSSL_SetIOWriteCtx(ssl, this);
+    if (session) wolfSSL_set_session(ssl, session);
+
+    const uint32_t started = uptime_ms();
+    timeout = TLS_TIMEOUT;
+    bytes = 0;
+    if (wolfSSL_connect(ssl) != SSL_SUCCESS) {
+        rc = wolfSSL_get_error(ssl, 0);
+        LOG_E("TLS handshake failed: %d\r\n", rc);
+        // do not offer the session again, it may be the reason
+        session = NULL;
+        disconnect();
+        return rc < 0 ? rc : -1;
+    }
+
+    sessionResumed = wolfSSL_session_reused(ssl) != 0;
+    session = wolfSSL_get_session(ssl);
+    LOG_I("TLS %s handshake: %u bytes, %u ms\r\n", sessionResumed ? "resumed" : "full", bytes,
+          uptime_ms() - started);
+    return 0;
+}
+
+int MQTTNetworkTLS::read(unsigned char *buffer, int len, int timeout) {
+    if (!ssl) return -1;
+
+    const uint32_t started = uptime_ms();
+    int received = 0;
+    while (received < len) {
+        const uint32_t elapsed = uptime_ms() - started;
+        if (received && elapsed >= (uint32_t) timeout) break;
+        this->timeout = elapsed < (uint32_t) timeout ? timeout - (int) elapsed : 1;
+
+        const int n = wolfSSL_read(ssl, buffer + received, len - received);
+        if (n > 0) {
+            received += n;
+            continue;
+        }
+        if (wolfSSL_get_error(ssl, n) != SSL_ERROR_WANT_READ) return -1;
+        if (!received) return 0;
+    }
+    return received;
+}
+
+int MQTTNetworkTLS::write(unsigned char *buffer, int len, int timeout) {
+    if (!ssl) return -1;
+
+    this->timeout = timeout > 0 ? timeout : TLS_TIMEOUT;
+    const int n = wolfSSL_write(ssl, buffer, len);
+    return n > 0 ? n : -1;
+}
+
+int MQTTNetworkTLS::disconnect() {
+    if (ssl) {
+        // no close notify, the link is usually gone already; the session stays cached
+        wolfSSL_free(ssl);
+        ssl = NULL;
+    }
+    if (socketOpen) {
+        socket.close();
+        socketOpen = false;
+    }
+    return 0;
+}
+
+int MQTTNetworkTLS::receive(WOLFSSL *ssl, char *buffer, int len, void *ctx) {
+    (void) ssl;
+    MQTTNetworkTLS *self = (MQTTNetworkTLS *) ctx;
+
+    self->socket.set_timeout(self->timeout);
+    const int n = self->socket.recv(buffer, (nsapi_size_t) len);
+    if (n == NSAPI_ERROR_WOULD_BLOCK) return WOLFSSL_CBIO_ERR_WANT_READ;
+    if (n == 0) return WOLFSSL_CBIO_ERR_CONN_CLOSE;
+    if (n < 0) return WOLFSSL_CBIO_ERR_GENERAL;
+    self->bytes += n;
+    return n;
+}
+
+int MQTTNetworkTLS::send(WOLFSSL *ssl, char *buffer, int len, void *ctx) {
+    (void) ssl;
+    MQTTNetworkTLS *self = (MQTTNetworkTLS *) ctx;
+
+    self->socket.set_timeout(self->timeout);
+    const int n = self->socket.send(buffer, (nsapi_size_t) len);
+    if (n == NSAPI_ERROR_WOULD_BLOCK) return WOLFSSL_CBIO_ERR_WANT_WRITE;
+    if (n < 0) return WOLFSSL_CBIO_ERR_GENERAL;
+    self->bytes += n;
+    return n;
+}
+
+#endif // MQTT_TLS
@@ -0,0 +1,99 @@
+/*!
+ * @file
+ * @brief TLS transport for the MQTT client, with session resumption.
+ *
+ * A drop-in replacement for MQTTNetwork that runs TLS 1.2 (wolfSSL) over the
+ * modem TCP socket. The session of the last connection (including a session
+ * ticket, if the broker issues one) is kept and offered on the next connect,
+ * so reconnects after short outages skip the key exchange and certificate
+ * transfer: a resumed handshake is a single round trip of a few hundred bytes.
+ *
+ * Two cipher profiles are available (TLS_PROFILE):
+ * - TLS_PROFILE_PSK: PSK-CHACHA20-POLY1305, a pre-shared key and no public
+ *   key operations at all, the smallest and cheapest handshake
+ * - TLS_PROFILE_ECDHE: ECDHE-ECDSA-CHACHA20-POLY1305, the broker certificate
+ *   is verified against TLS_CA_CERT
+ *
+ * ChaCha20-Poly1305 is used in both profiles, it is faster than AES-GCM in
+ * software on the Cortex-M4.
+ *
+ * @date 2017-04-18
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _TLS_NETWORK_H_
+#define _TLS_NETWORK_H_
+
+#include "mbed.h"
+#include "TCPSocket.h"
+#include <wolfssl/ssl.h>
+
+#define TLS_PROFILE_PSK   0     //!< PSK-CHACHA20-POLY1305
+#define TLS_PROFILE_ECDHE 1     //!< ECDHE-ECDSA-CHACHA20-POLY1305, broker certificate verified
+
+#ifndef TLS_PROFILE
+#define TLS_PROFILE TLS_PROFILE_PSK
+#endif
+
+//! timeout of the handshake and of a single write, in ms
+#define TLS_TIMEOUT 30000
+
+class MQTTNetworkTLS {
+public:
+    MQTTNetworkTLS(NetworkInterface *network);
+    ~MQTTNetworkTLS();
+
+    /*!
+     * @brief Connect and run the TLS handshake, resuming the last session if possible.
+     * @param hostname the broker host
+     * @param port the broker port
+     * @return 0 on success, a negative socket or TLS error otherwise
+     */
+    int connect(const char *hostname, int port);
+
+    //! @brief Read exactly len bytes, returns len, 0 on timeout or -1 on error
+    int read(unsigned char *buffer, int len, int timeout);
+
+    //! @brief Write len bytes, returns the number of bytes written or -1 on error
+    int write(unsigned char *buffer, int len, int timeout);
+
+    //! @brief Close the connection, the session is kept for resumption
+    int disconnect();
+
+    //! @brief Whether the last handshake resumed a session
+    bool resumed() const { return sessionResumed; }
+
+    //! @brief Forget the session, the next connect does a full handshake
+    void forget() { session = NULL; }
+
+private:
+    static int receive(WOLFSSL *ssl, char *buffer, int len, void *ctx);
+    static int send(WOLFSSL *ssl, char *buffer, int len, void *ctx);
+
+    NetworkInterface *network;
+    TCPSocket socket;
+    bool socketOpen;
+    WOLFSSL_CTX *ctx;
+    WOLFSSL *ssl;
+    WOLFSSL_SESSION *session;
+    bool sessionResumed;
+    int timeout;            //!< the timeout of the current socket operation
+    uint32_t bytes;         //!< bytes sent and received, for the handshake log
+};
+
+#endif // _TLS_NETWORK_H_
@@ -0,0 +1,233 @@
+/*!
+ * @file
+ * @brief Base64 benchmark and equivalence check: crypto.c against wolfcrypt.
+ *
+ * Checks every available implementation of uc_base64_encode_to() and
+ * uc_base64_decode() against Base64_Encode_NoNl() and Base64_Decode(): all
+ * lengths up to 1 kB and random lengths up to 64 kB, and for decoding also
+ * corrupted input (a character replaced, line breaks, padding in the middle,
+ * truncated). The results must be byte for byte the same, including which
+ * input is rejected. Then both are timed across message sizes.
+ *
+ * Configured with WOLFSSL_DIR, the reference is wolfcrypt/src/coding.c of
+ * that wolfSSL checkout (the revision of wolfSSL.lib), built next to the
+ * stand-in with its functions renamed. Without it the reference is the
+ * stand-in of compat/wolfcrypt.c, which is written to give the wolfcrypt
+ * results but is not wolfcrypt: the check then only shows that the
+ * implementations agree with each other, and -c exits with 77 (skipped).
+ * Each implementation also runs uc_base64_self_test(), the boot-time check
+ * of the firmware.
+ *
+ * @date 2017-04-25
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "crypto/crypto.h"
+#include "wolfssl/wolfcrypt/coding.h"
+
+#define MAX_SIZE 65536
+#define DECODED_SIZE (MAX_SIZE + 64)
+
+static const char *const impl_names[UC_BASE64_IMPLS] = {"scalar", "swar", "ssse3", "avx2"};
+
+#ifdef B64BENCH_WOLFCRYPT
+static const char *const reference_name = "wolfcrypt/src/coding.c";
+#else
+static const char *const reference_name = "the compat/wolfcrypt.c stand-in";
+#endif
+
+static unsigned char data[MAX_SIZE], decoded[DECODED_SIZE], reference[DECODED_SIZE];
+static char encoded[MAX_SIZE / 3 * 4 + 8], expected[MAX_SIZE / 3 * 4 + 8];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// === CHECK ===
+
+static unsigned long mismatches = 0, checks = 0;
+
+// exit code of -c without the wolfcrypt reference, ctest reports the test as skipped
+#define B64BENCH_SKIPPED 77
+
+static void check_encode(uc_base64_impl_t impl, size_t len) {
+    word32 expected_len = sizeof(expected);
+    Base64_Encode_NoNl(data, (word32) len, (byte *) expected, &expected_len);
+    const size_t encoded_len = uc_base64_encode_to(data, len, encoded);
+    checks++;
+    if (encoded_len != expected_len || memcmp(encoded, expected, encoded_len) != 0) {
+        if (!mismatches++) fprintf(stderr, "%s: encoding %zu bytes differs\n", impl_names[impl], len);
+    }
+}
+
+static void check_decode(uc_base64_impl_t impl, const char *in, size_t len) {
+    word32 reference_len = DECODED_SIZE;
+    const int reference_ok = Base64_Decode((const byte *) in, (word32) len, reference, &reference_len) == 0;
+    size_t decoded_len = DECODED_SIZE;
+    const int ok = uc_base64_decode(in, len, decoded, &decoded_len);
+    checks++;
+    if (ok != reference_ok || (ok && (decoded_len != reference_len || memcmp(decoded, reference, decoded_len)))) {
+        if (!mismatches++) {
+            fprintf(stderr, "%s: decoding %zu characters differs (%s, wolfcrypt %s): %.*s\n", impl_names[impl], len,
+                    ok ? "ok" : "rejected", reference_ok ? "ok" : "rejected", (int) (len < 200 ? len : 200), in);
+        }
+    }
+}
+
+// decode a corrupted copy of the encoded string
+static void check_corrupted(uc_base64_impl_t impl, size_t len) {
+    static const char replacements[] = "=\r\n -_.\0\x80\xff*A/+";
+    char *copy = malloc(len + 2);
+    const size_t at = len ? (size_t) rand() % len : 0;
+
+    memcpy(copy, encoded, len);
+    copy[at] = replacements[rand() % (sizeof(replacements) - 1)];
+    check_decode(impl, copy, len);
+
+    // a line break inserted
+    memcpy(copy, encoded, at);
+    copy[at] = '\n';
+    memcpy(copy + at + 1, encoded + at, len - at);
+    check_decode(impl, copy, len + 1);
+
+    // truncated
+    check_decode(impl, encoded, at);
+    free(copy);
+}
+
+static void check(uc_base64_impl_t impl, size_t len) {
+    for (size_t i = 0; i < len; i++) data[i] = (unsigned char) rand();
+    check_encode(impl, len);
+    const size_t encoded_len = uc_base64_encode_to(data, len, encoded);
+    check_decode(impl, encoded, encoded_len);
+    check_corrupted(impl, encoded_len);
+}
+
+// === BENCHMARK ===
+
+typedef int (*codec_t)(size_t len);
+
+static int wolf_encode(size_t len) {
+    word32 out_len = sizeof(encoded);
+    return Base64_Encode_NoNl(data, (word32) len, (byte *) encoded, &out_len);
+}
+
+static int uc_encode(size_t len) {
+    return (int) uc_base64_encode_to(data, len, encoded);
+}
+
+static int wolf_decode(size_t len) {
+    word32 out_len = DECODED_SIZE;
+    return Base64_Decode((const byte *) expected, (word32) len, decoded, &out_len);
+}
+
+static int uc_decode(size_t len) {
+    size_t out_len = DECODED_SIZE;
+    return uc_base64_decode(expected, len, decoded, &out_len);
+}
+
+// MB/s of the input, repeated for at least the given time
+static double measure(codec_t codec, size_t len, double seconds) {
+    unsigned long rounds = 0, batch = 1 + 65536 / (len + 1);
+    volatile int sink = 0;
+    const double start = now_s();
+    double elapsed;
+    do {
+        for (unsigned long i = 0; i < batch; i++) sink += codec(len);
+        rounds += batch;
+    } while ((elapsed = now_s() - start) < seconds);
+    (void) sink;
+    return (double) rounds * len / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+    static const size_t sizes[] = {32, 47, 64, 128, 256, 1024, 16384, 65536};
+    double seconds = 0.2;
+    bool check_only = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:c")) != -1) {
+        switch (opt) {
+            case 't': seconds = atof(optarg) / 1000; break;
+            case 'c': check_only = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-t ms] [-c]\n"
+                                "  -t <ms>   time per measurement (default 200)\n"
+                                "  -c        only check the implementations against wolfcrypt\n", argv[0]);
+                return 1;
+        }
+    }
+    srand(1);
+
+    printf("reference: %s\n", reference_name);
+    for (int impl = 0; impl < UC_BASE64_IMPLS; impl++) {
+        if (!uc_base64_select((uc_base64_impl_t) impl)) {
+            printf("%-7s: not available\n", impl_names[impl]);
+            continue;
+        }
+        const unsigned long before = mismatches, checked = checks;
+        for (size_t len = 0; len <= 1024; len++) check((uc_base64_impl_t) impl, len);
+        for (int i = 0; i < 200; i++) check((uc_base64_impl_t) impl, (size_t) rand() % MAX_SIZE);
+        const bool self_test = uc_base64_self_test((uc_base64_impl_t) impl);
+        if (!self_test) mismatches++;
+        printf("%-7s: %lu checks, %lu differ from wolfcrypt, self test %s\n", impl_names[impl], checks - checked,
+               mismatches - before, self_test ? "ok" : "failed");
+    }
+#ifndef B64BENCH_WOLFCRYPT
+    if (check_only && !mismatches) {
+        printf("skipped: not checked against wolfcrypt, configure the tools with -DWOLFSSL_DIR=<wolfSSL checkout>\n");
+        return B64BENCH_SKIPPED;
+    }
+#endif
+    if (check_only) return mismatches ? 1 : 0;
+
+    printf("\n%-8s %-8s %10s", "size", "op", "wolfcrypt");
+    for (int impl = 0; impl < UC_BASE64_IMPLS; impl++) {
+        if (uc_base64_select((uc_base64_impl_t) impl)) printf(" %10s", impl_names[impl]);
+    }
+    printf("   (MB/s of input)\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const size_t len = sizes[s];
+        for (size_t i = 0; i < len; i++) data[i] = (unsigned char) rand();
+        word32 expected_len = sizeof(expected);
+        Base64_Encode_NoNl(data, (word32) len, (byte *) expected, &expected_len);
+
+        for (int op = 0; op < 2; op++) {
+            const size_t n = op ? expected_len : len;
+            printf("%-8zu %-8s %10.0f", len, op ? "decode" : "encode",
+                   measure(op ? wolf_decode : wolf_encode, n, seconds));
+            for (int impl = 0; impl < UC_BASE64_IMPLS; impl++) {
+                if (uc_base64_select((uc_base64_impl_t) impl)) {
+                    printf(" %10.0f", measure(op ? uc_decode : uc_encode, n, seconds));
+                }
+            }
+            printf("\n");
+        }
+    }
+    return mismatches ? 1 : 0;
+}
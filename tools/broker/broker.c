@@ -0,0 +1,432 @@
+/*!
+ * @file
+ * @brief Host tools: a local MQTT broker stand-in.
+ *
+ * One thread, one epoll set: the listening socket, a wakeup eventfd and the
+ * client connections (level triggered, one read per event so busy clients do
+ * not starve the others). Exact topic filters are kept in a hash table, the
+ * wildcard filters in a list, so the device topics scale with the number of
+ * clients. A client that stops reading is dropped once its output backlog
+ * exceeds OUTPUT_LIMIT.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "broker.h"
+#include "mqtt.h"
+
+#define EVENTS 256
+#define READ_CHUNK 16384
+#define PACKET_LIMIT (1u << 20)     //!< largest accepted packet
+#define OUTPUT_LIMIT (4u << 20)     //!< output backlog of a client before it is dropped
+#define TOPICS_SIZE 65536           //!< exact topic filter hash table (power of 2)
+
+#define COUNT(b, field, n) __atomic_fetch_add(&(b)->stats.field, (uint64_t) (n), __ATOMIC_RELAXED)
+
+struct connection;
+
+//! a topic filter of a connection, in a hash chain or the wildcard list
+typedef struct subscription {
+    struct subscription *next;
+    struct subscription **prev;
+    struct subscription *sibling;   //!< the next subscription of the same connection
+    struct connection *conn;
+    int qos;
+    char filter[];
+} subscription_t;
+
+typedef struct connection {
+    int fd;
+    bool connected;                 //!< CONNECT received
+    bool dead;                      //!< shut down, closed on the next event
+    bool writing;                   //!< waiting for EPOLLOUT
+    uint16_t next_id;
+    uint8_t *in, *out;
+    size_t in_len, in_cap, out_len, out_cap;
+    subscription_t *subscriptions;
+} connection_t;
+
+struct broker {
+    int listen_fd, epoll_fd, wake_fd;
+    uint16_t port;
+    bool verbose;
+    capture_t *capture;             //!< set by broker_capture(), read by the broker thread
+    int stop, drop;
+    pthread_t thread;
+    connection_t **conns;           //!< by file descriptor
+    size_t conns_size;
+    subscription_t *topics[TOPICS_SIZE];
+    subscription_t *wildcards;
+    broker_stats_t stats;
+};
+
+static size_t topic_hash(const char *topic, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t) topic[i]) * 16777619u;
+    return h & (TOPICS_SIZE - 1);
+}
+
+// === CONNECTIONS ===
+
+static void drop_connection(broker_t *b, connection_t *c) {
+    if (c->dead) return;
+    c->dead = true;
+    shutdown(c->fd, SHUT_RDWR);
+    COUNT(b, drops, 1);
+}
+
+static void close_connection(broker_t *b, connection_t *c) {
+    for (subscription_t *s = c->subscriptions, *sibling; s; s = sibling) {
+        sibling = s->sibling;
+        *s->prev = s->next;
+        if (s->next) s->next->prev = s->prev;
+        free(s);
+    }
+    if (c->connected) __atomic_fetch_sub(&b->stats.clients, 1, __ATOMIC_RELAXED);
+    b->conns[c->fd] = NULL;
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+static void flush(broker_t *b, connection_t *c) {
+    size_t sent = 0;
+    while (sent < c->out_len) {
+        const ssize_t n = send(c->fd, c->out + sent, c->out_len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) drop_connection(b, c);
+            break;
+        }
+        sent += (size_t) n;
+    }
+    COUNT(b, bytes_out, sent);
+    memmove(c->out, c->out + sent, c->out_len - sent);
+    c->out_len -= sent;
+
+    const bool writing = c->out_len > 0 && !c->dead;
+    if (writing != c->writing) {
+        struct epoll_event ev = {.events = EPOLLIN | (writing ? EPOLLOUT : 0), .data.fd = c->fd};
+        epoll_ctl(b->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->writing = writing;
+    }
+}
+
+// reserve space for a packet in the output buffer, NULL if the client is too far behind
+static uint8_t *reserve(broker_t *b, connection_t *c, size_t len) {
+    if (c->dead) return NULL;
+    if (c->out_len + len > OUTPUT_LIMIT) {
+        drop_connection(b, c);
+        return NULL;
+    }
+    if (c->out_len + len > c->out_cap) {
+        c->out_cap = (c->out_len + len) * 2;
+        c->out = realloc(c->out, c->out_cap);
+    }
+    return c->out + c->out_len;
+}
+
+static void send_packet(broker_t *b, connection_t *c, const uint8_t *packet, size_t len) {
+    uint8_t *out = reserve(b, c, len);
+    if (!out) return;
+    memcpy(out, packet, len);
+    c->out_len += len;
+    flush(b, c);
+}
+
+// === ROUTING ===
+
+static void subscribe(broker_t *b, connection_t *c, const char *filter, size_t len, int qos) {
+    subscription_t *s = malloc(sizeof(subscription_t) + len + 1);
+    memcpy(s->filter, filter, len);
+    s->filter[len] = '\0';
+    s->conn = c;
+    s->qos = qos;
+    s->sibling = c->subscriptions;
+    c->subscriptions = s;
+
+    subscription_t **head = strpbrk(s->filter, "+#") ? &b->wildcards : &b->topics[topic_hash(filter, len)];
+    s->next = *head;
+    if (*head) (*head)->prev = &s->next;
+    s->prev = head;
+    *head = s;
+}
+
+static void deliver(broker_t *b, subscription_t *s, const char *topic, const mqtt_publish_t *publish) {
+    connection_t *c = s->conn;
+    const int qos = publish->qos < s->qos ? publish->qos : s->qos;
+    const size_t max = MQTT_HEADER_MAX + 4 + publish->topic_len + publish->len;
+    uint8_t *out = reserve(b, c, max);
+    if (!out) return;
+
+    if (qos && ++c->next_id == 0) c->next_id = 1;
+    c->out_len += mqtt_publish(out, max, topic, publish->payload, publish->len, qos, c->next_id);
+    COUNT(b, delivered, 1);
+    flush(b, c);
+}
+
+static void route(broker_t *b, const mqtt_publish_t *publish) {
+    char *topic = malloc(publish->topic_len + 1);
+    memcpy(topic, publish->topic, publish->topic_len);
+    topic[publish->topic_len] = '\0';
+
+    for (subscription_t *s = b->topics[topic_hash(topic, publish->topic_len)]; s; s = s->next) {
+        if (strcmp(s->filter, topic) == 0) deliver(b, s, topic, publish);
+    }
+    for (subscription_t *s = b->wildcards; s; s = s->next) {
+        if (mqtt_topic_matches(s->filter, topic, publish->topic_len)) deliver(b, s, topic, publish);
+    }
+    free(topic);
+}
+
+// handle a packet, false if the connection has to be closed
+static bool handle(broker_t *b, connection_t *c, const mqtt_packet_t *packet) {
+    uint8_t reply[MQTT_HEADER_MAX + 2 + 128];
+    if (packet->type != MQTT_CONNECT && !c->connected) return false;
+
+    switch (packet->type) {
+        case MQTT_CONNECT:
+            if (c->connected) return false;
+            c->connected = true;
+            COUNT(b, connects, 1);
+            COUNT(b, clients, 1);
+            send_packet(b, c, reply, mqtt_connack(reply, sizeof(reply), 0));
+            return true;
+
+        case MQTT_PUBLISH: {
+            mqtt_publish_t publish;
+            if (!mqtt_parse_publish(packet, &publish)) return false;
+            COUNT(b, published, 1);
+            if (b->verbose) {
+                fprintf(stderr, "%.*s %.*s\n", (int) publish.topic_len, publish.topic,
+                        (int) publish.len, (const char *) publish.payload);
+            }
+            capture_t *capture = __atomic_load_n(&b->capture, __ATOMIC_ACQUIRE);
+            if (capture) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                capture_write(capture, (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000,
+                              capture_direction(publish.topic, publish.topic_len),
+                              publish.topic, publish.topic_len, publish.payload, publish.len);
+            }
+            if (publish.qos) send_packet(b, c, reply, mqtt_puback(reply, sizeof(reply), publish.id));
+            route(b, &publish);
+            return true;
+        }
+
+        case MQTT_SUBSCRIBE: {
+            // packet ID, then (filter, QoS) pairs, granted QoS 0 or 1 per filter
+            const uint8_t *p = packet->body, *end = packet->body + packet->len;
+            if (packet->len < 2) return false;
+            size_t count = 0;
+            reply[0] = MQTT_SUBACK << 4;
+            reply[2] = p[0];
+            reply[3] = p[1];
+            for (p += 2; p < end; count++) {
+                if (end - p < 3 || count >= 120) return false;
+                const size_t len = (size_t) p[0] << 8 | p[1];
+                if ((size_t) (end - p) < 3 + len) return false;
+                const int qos = p[2 + len] ? 1 : 0;
+                subscribe(b, c, (const char *) p + 2, len, qos);
+                reply[4 + count] = (uint8_t) qos;
+                p += 3 + len;
+            }
+            reply[1] = (uint8_t) (2 + count);
+            send_packet(b, c, reply, 4 + count);
+            return true;
+        }
+
+        case MQTT_PUBACK:
+            return true;
+
+        case MQTT_PINGREQ:
+            send_packet(b, c, reply, mqtt_empty(reply, sizeof(reply), MQTT_PINGRESP));
+            return true;
+
+        default:
+            // DISCONNECT, and anything the stand-in does not know
+            return false;
+    }
+}
+
+static void receive(broker_t *b, connection_t *c) {
+    if (c->in_len + READ_CHUNK > c->in_cap) {
+        c->in_cap = c->in_len + READ_CHUNK;
+        c->in = realloc(c->in, c->in_cap);
+    }
+    const ssize_t n = c->dead ? 0 : recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (n <= 0) {
+        close_connection(b, c);
+        return;
+    }
+    COUNT(b, bytes_in, n);
+    c->in_len += (size_t) n;
+
+    size_t used = 0;
+    mqtt_packet_t packet;
+    int status;
+    while ((status = mqtt_next(c->in + used, c->in_len - used, &packet)) == 1) {
+        used += packet.size;
+        if (!handle(b, c, &packet)) {
+            close_connection(b, c);
+            return;
+        }
+    }
+    if (status < 0 || c->in_len - used > PACKET_LIMIT) {
+        close_connection(b, c);
+        return;
+    }
+    memmove(c->in, c->in + used, c->in_len - used);
+    c->in_len -= used;
+}
+
+static void accept_all(broker_t *b) {
+    int fd;
+    while ((fd = accept4(b->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if ((size_t) fd >= b->conns_size) {
+            const size_t size = (size_t) fd * 2;
+            b->conns = realloc(b->conns, size * sizeof(connection_t *));
+            memset(b->conns + b->conns_size, 0, (size - b->conns_size) * sizeof(connection_t *));
+            b->conns_size = size;
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        connection_t *c = calloc(1, sizeof(connection_t));
+        c->fd = fd;
+        b->conns[fd] = c;
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+        epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void *broker_thread(void *arg) {
+    broker_t *b = arg;
+    struct epoll_event events[EVENTS];
+
+    while (!__atomic_load_n(&b->stop, __ATOMIC_ACQUIRE)) {
+        const int n = epoll_wait(b->epoll_fd, events, EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == b->listen_fd) {
+                accept_all(b);
+            } else if (fd == b->wake_fd) {
+                uint64_t value;
+                if (read(b->wake_fd, &value, sizeof(value)) < 0) continue;
+                if (__atomic_exchange_n(&b->drop, 0, __ATOMIC_ACQ_REL)) {
+                    for (size_t k = 0; k < b->conns_size; k++) if (b->conns[k]) drop_connection(b, b->conns[k]);
+                }
+            } else if ((size_t) fd < b->conns_size && b->conns[fd]) {
+                connection_t *c = b->conns[fd];
+                if (events[i].events & EPOLLOUT) flush(b, c);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive(b, c);
+            }
+        }
+    }
+    return NULL;
+}
+
+// === API ===
+
+broker_t *broker_start(const char *address, uint16_t port, bool verbose) {
+    broker_t *b = calloc(1, sizeof(broker_t));
+    b->verbose = verbose;
+
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    if (inet_pton(AF_INET, address ? address : "127.0.0.1", &addr.sin_addr) != 1) {
+        free(b);
+        return NULL;
+    }
+    const int one = 1;
+    b->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    setsockopt(b->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(b->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(b->listen_fd, SOMAXCONN)) {
+        close(b->listen_fd);
+        free(b);
+        return NULL;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(b->listen_fd, (struct sockaddr *) &addr, &len);
+    b->port = ntohs(addr.sin_port);
+
+    b->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    b->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = b->listen_fd};
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->listen_fd, &ev);
+    ev.data.fd = b->wake_fd;
+    epoll_ctl(b->epoll_fd, EPOLL_CTL_ADD, b->wake_fd, &ev);
+
+    pthread_create(&b->thread, NULL, broker_thread, b);
+    return b;
+}
+
+void broker_capture(broker_t *broker, capture_t *capture) {
+    __atomic_store_n(&broker->capture, capture, __ATOMIC_RELEASE);
+}
+
+uint16_t broker_port(const broker_t *broker) {
+    return broker->port;
+}
+
+void broker_stats(const broker_t *broker, broker_stats_t *stats) {
+    const uint64_t *from = (const uint64_t *) &broker->stats;
+    uint64_t *to = (uint64_t *) stats;
+    for (size_t i = 0; i < sizeof(broker_stats_t) / sizeof(uint64_t); i++) {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void wake(broker_t *broker) {
+    const uint64_t one = 1;
+    if (write(broker->wake_fd, &one, sizeof(one)) < 0) perror("broker");
+}
+
+void broker_drop_all(broker_t *broker) {
+    __atomic_store_n(&broker->drop, 1, __ATOMIC_RELEASE);
+    wake(broker);
+}
+
+void broker_stop(broker_t *broker) {
+    __atomic_store_n(&broker->stop, 1, __ATOMIC_RELEASE);
+    wake(broker);
+    pthread_join(broker->thread, NULL);
+
+    for (size_t i = 0; i < broker->conns_size; i++) if (broker->conns[i]) close_connection(broker, broker->conns[i]);
+    free(broker->conns);
+    close(broker->listen_fd);
+    close(broker->wake_fd);
+    close(broker->epoll_fd);
+    free(broker);
+}
@@ -0,0 +1,85 @@
+/*!
+ * @file
+ * @brief Host tools: a local MQTT broker stand-in.
+ *
+ * A single threaded MQTT 3.1.1 broker (epoll) for the host tools: it accepts
+ * any client, forwards PUBLISH to the matching subscriptions (QoS 0 and 1, no
+ * retained messages, no sessions) and counts the traffic. It runs in a thread
+ * of the tool that starts it, or standalone (broker/main.c) for a real device.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _BROKER_H_
+#define _BROKER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "capture.h"
+
+typedef struct broker broker_t;
+
+//! broker counters, since the start
+typedef struct {
+    uint64_t connects;          //!< accepted CONNECT
+    uint64_t drops;             //!< connections closed by the broker
+    uint64_t published;         //!< PUBLISH received
+    uint64_t delivered;         //!< PUBLISH forwarded to subscribers
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t clients;           //!< currently connected
+} broker_stats_t;
+
+/*!
+ * @brief Start the broker in its own thread.
+ * @param address the address to listen on (NULL for the loopback interface)
+ * @param port the port to listen on, 0 for any free port
+ * @param verbose print every PUBLISH to stderr
+ * @return the broker, NULL if the port could not be opened
+ */
+broker_t *broker_start(const char *address, uint16_t port, bool verbose);
+
+/*!
+ * @brief Record every PUBLISH the broker receives, in the order it routes them.
+ * @param broker the broker
+ * @param capture the capture to append to, NULL to stop recording (the caller closes it after broker_stop())
+ */
+void broker_capture(broker_t *broker, capture_t *capture);
+
+/*!
+ * @brief The port the broker listens on.
+ */
+uint16_t broker_port(const broker_t *broker);
+
+/*!
+ * @brief Copy the broker counters.
+ */
+void broker_stats(const broker_t *broker, broker_stats_t *stats);
+
+/*!
+ * @brief Close all client connections, as a broker restart or network outage would.
+ */
+void broker_drop_all(broker_t *broker);
+
+/*!
+ * @brief Stop the broker, close all connections and free it.
+ */
+void broker_stop(broker_t *broker);
+
+#endif // _BROKER_H_
@@ -0,0 +1,111 @@
+/*!
+ * @file
+ * @brief Standalone MQTT broker stand-in, for a device or the host tools on a local network.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "broker.h"
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+int main(int argc, char **argv) {
+    const char *address = "0.0.0.0";
+    int port = 1883, interval = 0, opt;
+    const char *capture_file = NULL;
+    bool verbose = false;
+
+    while ((opt = getopt(argc, argv, "a:p:i:C:v")) != -1) {
+        switch (opt) {
+            case 'a': address = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'i': interval = atoi(optarg); break;
+            case 'C': capture_file = optarg; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-a address] [-p port] [-i seconds] [-C file] [-v]\n"
+                                "  -a <address>   listen address (default 0.0.0.0)\n"
+                                "  -p <port>      listen port (default 1883)\n"
+                                "  -i <seconds>   print the counters periodically\n"
+                                "  -C <file>      capture every PUBLISH to a file (see replay)\n"
+                                "  -v             print every PUBLISH to stderr\n", argv[0]);
+                return 1;
+        }
+    }
+
+    broker_t *broker = broker_start(address, (uint16_t) port, verbose);
+    if (!broker) {
+        fprintf(stderr, "broker: can't listen on %s:%d\n", address, port);
+        return 1;
+    }
+    capture_t *capture = NULL;
+    if (capture_file) {
+        capture = capture_open(capture_file);
+        if (!capture) {
+            fprintf(stderr, "broker: can't create %s\n", capture_file);
+            broker_stop(broker);
+            return 1;
+        }
+        broker_capture(broker, capture);
+    }
+    printf("broker: listening on %s:%u\n", address, broker_port(broker));
+    fflush(stdout);
+
+    struct sigaction action = {.sa_handler = stop};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    broker_stats_t stats;
+    while (running) {
+        sleep(interval > 0 ? (unsigned) interval : 1);
+        if (interval > 0 && running) {
+            broker_stats(broker, &stats);
+            printf("clients %llu, published %llu, delivered %llu, in %llu B, out %llu B\n",
+                   (unsigned long long) stats.clients, (unsigned long long) stats.published,
+                   (unsigned long long) stats.delivered, (unsigned long long) stats.bytes_in,
+                   (unsigned long long) stats.bytes_out);
+            fflush(stdout);
+        }
+    }
+
+    broker_stats(broker, &stats);
+    broker_stop(broker);
+    printf("broker: %llu connects, %llu published, %llu delivered\n", (unsigned long long) stats.connects,
+           (unsigned long long) stats.published, (unsigned long long) stats.delivered);
+    if (capture) {
+        const uint64_t records = capture_records(capture);
+        if (!capture_close(capture)) {
+            fprintf(stderr, "broker: writing %s failed\n", capture_file);
+            return 1;
+        }
+        printf("broker: %llu records captured to %s\n", (unsigned long long) records, capture_file);
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*!
+ * @file
+ * @brief Host tools: the MQTT 3.1.1 packets the firmware uses.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <string.h>
+#include "mqtt.h"
+
+int mqtt_next(const uint8_t *buf, size_t len, mqtt_packet_t *packet) {
+    size_t body = 0, i = 1;
+    for (int shift = 0; ; shift += 7, i++) {
+        if (i >= len) return 0;
+        if (i > 4) return -1;
+        body |= (size_t) (buf[i] & 0x7f) << shift;
+        if (!(buf[i] & 0x80)) break;
+    }
+    if (len < i + 1 + body) return 0;
+
+    packet->type = buf[0] >> 4;
+    packet->flags = buf[0] & 0x0f;
+    packet->body = buf + i + 1;
+    packet->len = body;
+    packet->size = i + 1 + body;
+    return 1;
+}
+
+bool mqtt_parse_publish(const mqtt_packet_t *packet, mqtt_publish_t *publish) {
+    const uint8_t *p = packet->body;
+    if (packet->type != MQTT_PUBLISH || packet->len < 2) return false;
+
+    publish->qos = (packet->flags >> 1) & 3;
+    publish->topic_len = (size_t) p[0] << 8 | p[1];
+    size_t header = 2 + publish->topic_len + (publish->qos ? 2 : 0);
+    if (publish->qos > 1 || header > packet->len) return false;
+
+    publish->topic = (const char *) p + 2;
+    publish->id = publish->qos ? (uint16_t) (p[2 + publish->topic_len] << 8 | p[3 + publish->topic_len]) : 0;
+    publish->payload = p + header;
+    publish->len = packet->len - header;
+    return true;
+}
+
+bool mqtt_topic_matches(const char *filter, const char *topic, size_t topic_len) {
+    const char *end = topic + topic_len;
+    while (*filter) {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (topic < end && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if (topic == end || *filter != *topic) return false;
+        filter++;
+        topic++;
+    }
+    return topic == end;
+}
+
+// === ENCODERS ===
+
+// the fixed header, returns its size or 0 if the packet does not fit
+static size_t header(uint8_t *out, size_t max, uint8_t first, size_t body) {
+    size_t i = 0;
+    uint8_t length[4];
+    do {
+        length[i] = (uint8_t) (body & 0x7f);
+        body >>= 7;
+        if (body) length[i] |= 0x80;
+        i++;
+    } while (body && i < 4);
+    if (body) return 0;
+
+    const size_t total = 1 + i;
+    if (max < total) return 0;
+    out[0] = first;
+    memcpy(out + 1, length, i);
+    return total;
+}
+
+static uint8_t *string(uint8_t *p, const char *s) {
+    const size_t len = strlen(s);
+    *p++ = (uint8_t) (len >> 8);
+    *p++ = (uint8_t) len;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+size_t mqtt_connect(uint8_t *out, size_t max, const char *client_id, const char *user, const char *password,
+                    uint16_t keepalive) {
+    size_t body = 10 + 2 + strlen(client_id);
+    if (user) body += 2 + strlen(user);
+    if (password) body += 2 + strlen(password);
+
+    const size_t h = header(out, max, MQTT_CONNECT << 4, body);
+    if (!h || max < h + body) return 0;
+
+    uint8_t *p = string(out + h, "MQTT");
+    *p++ = 4;                                   // protocol level 3.1.1
+    *p++ = (uint8_t) (0x02 | (user ? 0x80 : 0) | (password ? 0x40 : 0));    // clean session
+    *p++ = (uint8_t) (keepalive >> 8);
+    *p++ = (uint8_t) keepalive;
+    p = string(p, client_id);
+    if (user) p = string(p, user);
+    if (password) string(p, password);
+    return h + body;
+}
+
+size_t mqtt_connack(uint8_t *out, size_t max, uint8_t rc) {
+    if (max < 4) return 0;
+    out[0] = MQTT_CONNACK << 4;
+    out[1] = 2;
+    out[2] = 0;
+    out[3] = rc;
+    return 4;
+}
+
+size_t mqtt_publish(uint8_t *out, size_t max, const char *topic, const void *payload, size_t len, int qos,
+                    uint16_t id) {
+    const size_t body = 2 + strlen(topic) + (qos ? 2 : 0) + len;
+    const size_t h = header(out, max, (uint8_t) (MQTT_PUBLISH << 4 | qos << 1), body);
+    if (!h || max < h + body) return 0;
+
+    uint8_t *p = string(out + h, topic);
+    if (qos) {
+        *p++ = (uint8_t) (id >> 8);
+        *p++ = (uint8_t) id;
+    }
+    memcpy(p, payload, len);
+    return h + body;
+}
+
+static size_t ack(uint8_t *out, size_t max, uint8_t first, uint16_t id) {
+    if (max < 4) return 0;
+    out[0] = first;
+    out[1] = 2;
+    out[2] = (uint8_t) (id >> 8);
+    out[3] = (uint8_t) id;
+    return 4;
+}
+
+size_t mqtt_puback(uint8_t *out, size_t max, uint16_t id) {
+    return ack(out, max, MQTT_PUBACK << 4, id);
+}
+
+size_t mqtt_subscribe(uint8_t *out, size_t max, uint16_t id, const char *filter, int qos) {
+    const size_t body = 2 + 2 + strlen(filter) + 1;
+    const size_t h = header(out, max, MQTT_SUBSCRIBE << 4 | 0x02, body);
+    if (!h || max < h + body) return 0;
+
+    uint8_t *p = out + h;
+    *p++ = (uint8_t) (id >> 8);
+    *p++ = (uint8_t) id;
+    p = string(p, filter);
+    *p = (uint8_t) qos;
+    return h + body;
+}
+
+size_t mqtt_suback(uint8_t *out, size_t max, uint16_t id, uint8_t granted) {
+    if (max < 5) return 0;
+    ack(out, max, MQTT_SUBACK << 4, id);
+    out[1] = 3;
+    out[4] = granted;
+    return 5;
+}
+
+size_t mqtt_empty(uint8_t *out, size_t max, uint8_t type) {
+    if (max < 2) return 0;
+    out[0] = (uint8_t) (type << 4);
+    out[1] = 0;
+    return 2;
+}
@@ -0,0 +1,102 @@
+/*!
+ * @file
+ * @brief Host tools: the MQTT 3.1.1 packets the firmware uses.
+ *
+ * Just enough of MQTT for the broker stand-in and the host clients (the
+ * firmware's MQTT library is not part of the host build): CONNECT, PUBLISH
+ * (QoS 0 and 1), SUBSCRIBE, PINGREQ and DISCONNECT, and their answers.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _MQTT_H_
+#define _MQTT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MQTT_CONNECT     1
+#define MQTT_CONNACK     2
+#define MQTT_PUBLISH     3
+#define MQTT_PUBACK      4
+#define MQTT_SUBSCRIBE   8
+#define MQTT_SUBACK      9
+#define MQTT_PINGREQ    12
+#define MQTT_PINGRESP   13
+#define MQTT_DISCONNECT 14
+
+#define MQTT_HEADER_MAX 5       //!< fixed header: type and up to 4 length bytes
+
+//! a packet in a receive buffer
+typedef struct {
+    uint8_t type;               //!< packet type (MQTT_*)
+    uint8_t flags;              //!< the low nibble of the first byte
+    const uint8_t *body;        //!< variable header and payload
+    size_t len;                 //!< size of the body
+    size_t size;                //!< size of the whole packet
+} mqtt_packet_t;
+
+//! a received PUBLISH
+typedef struct {
+    const char *topic;          //!< not 0 terminated
+    size_t topic_len;
+    const uint8_t *payload;
+    size_t len;
+    int qos;
+    uint16_t id;                //!< packet ID (QoS 1)
+} mqtt_publish_t;
+
+/*!
+ * @brief Find the next complete packet in a receive buffer.
+ * @param buf the received bytes
+ * @param len number of received bytes
+ * @param packet the packet found
+ * @return 1 if a packet is complete, 0 if more bytes are needed, -1 if the stream is malformed
+ */
+int mqtt_next(const uint8_t *buf, size_t len, mqtt_packet_t *packet);
+
+/*!
+ * @brief Decode a PUBLISH packet.
+ * @return true if the packet is well formed
+ */
+bool mqtt_parse_publish(const mqtt_packet_t *packet, mqtt_publish_t *publish);
+
+/*!
+ * @brief Check an MQTT topic filter ('+' and '#' wildcards) against a topic.
+ */
+bool mqtt_topic_matches(const char *filter, const char *topic, size_t topic_len);
+
+// the encoders write to out (at most max bytes), they return the packet size or 0 if it does not fit
+
+size_t mqtt_connect(uint8_t *out, size_t max, const char *client_id, const char *user, const char *password,
+                    uint16_t keepalive);
+size_t mqtt_connack(uint8_t *out, size_t max, uint8_t rc);
+size_t mqtt_publish(uint8_t *out, size_t max, const char *topic, const void *payload, size_t len, int qos,
+                    uint16_t id);
+size_t mqtt_puback(uint8_t *out, size_t max, uint16_t id);
+size_t mqtt_subscribe(uint8_t *out, size_t max, uint16_t id, const char *filter, int qos);
+size_t mqtt_suback(uint8_t *out, size_t max, uint16_t id, uint8_t granted);
+
+/*!
+ * @brief Encode a packet without a body (PINGREQ, PINGRESP, DISCONNECT).
+ */
+size_t mqtt_empty(uint8_t *out, size_t max, uint8_t type);
+
+#endif // _MQTT_H_
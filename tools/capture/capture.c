@@ -0,0 +1,191 @@
+/*!
+ * @file
+ * @brief Host tools: capture file of MQTT traffic.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "capture.h"
+
+#define WRITE_BUFFER (1 << 20)
+
+static const uint8_t magic[4] = {'U', 'C', 'A', 'P'};
+
+const char *const capture_direction_names[CAPTURE_DIRECTIONS] = {"uplink", "downlink"};
+
+struct capture {
+    FILE *file;
+    pthread_mutex_t lock;
+    uint64_t records;
+    bool failed;
+};
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t) v);
+    put16(p + 2, (uint16_t) (v >> 16));
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    put32(p, (uint32_t) v);
+    put32(p + 4, (uint32_t) (v >> 32));
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t) get16(p + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+capture_direction_t capture_direction(const char *topic, size_t len) {
+    return len >= 4 && memcmp(topic + len - 4, "/out", 4) == 0 ? CAPTURE_DOWNLINK : CAPTURE_UPLINK;
+}
+
+// === WRITER ===
+
+capture_t *capture_open(const char *path) {
+    capture_t *c = calloc(1, sizeof(capture_t));
+    c->file = fopen(path, "wb");
+    if (!c->file) {
+        free(c);
+        return NULL;
+    }
+    setvbuf(c->file, NULL, _IOFBF, WRITE_BUFFER);
+    pthread_mutex_init(&c->lock, NULL);
+
+    uint8_t header[CAPTURE_HEADER_SIZE] = {0};
+    memcpy(header, magic, sizeof(magic));
+    put16(header + 4, CAPTURE_VERSION);
+    c->failed = fwrite(header, sizeof(header), 1, c->file) != 1;
+    return c;
+}
+
+bool capture_write(capture_t *capture, uint64_t t_us, capture_direction_t direction, const char *topic,
+                   size_t topic_len, const void *payload, size_t len) {
+    if (topic_len > UINT16_MAX || len > UINT32_MAX - (CAPTURE_RECORD_HEADER - 4) - topic_len) return false;
+
+    uint8_t header[CAPTURE_RECORD_HEADER];
+    put32(header, (uint32_t) (CAPTURE_RECORD_HEADER - 4 + topic_len + len));
+    put64(header + 4, t_us);
+    header[12] = (uint8_t) direction;
+    header[13] = 0;
+    put16(header + 14, (uint16_t) topic_len);
+
+    // a record is written as a whole, records of several threads do not interleave
+    pthread_mutex_lock(&capture->lock);
+    const bool ok = fwrite(header, sizeof(header), 1, capture->file) == 1 &&
+                    (!topic_len || fwrite(topic, topic_len, 1, capture->file) == 1) &&
+                    (!len || fwrite(payload, len, 1, capture->file) == 1);
+    if (ok) capture->records++;
+    else capture->failed = true;
+    pthread_mutex_unlock(&capture->lock);
+    return ok;
+}
+
+uint64_t capture_records(const capture_t *capture) {
+    return capture->records;
+}
+
+bool capture_close(capture_t *capture) {
+    bool ok = !capture->failed;
+    if (fclose(capture->file)) ok = false;
+    pthread_mutex_destroy(&capture->lock);
+    free(capture);
+    return ok;
+}
+
+// === READER ===
+
+bool capture_map(const char *path, capture_reader_t *reader) {
+    memset(reader, 0, sizeof(capture_reader_t));
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || (size_t) st.st_size < CAPTURE_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    reader->data = data;
+    reader->size = (size_t) st.st_size;
+    if (memcmp(reader->data, magic, sizeof(magic)) != 0 || get16(reader->data + 4) != CAPTURE_VERSION) {
+        capture_unmap(reader);
+        return false;
+    }
+    reader->offset = CAPTURE_HEADER_SIZE;
+    return true;
+}
+
+bool capture_next(capture_reader_t *reader, capture_record_t *record) {
+    const size_t left = reader->size - reader->offset;
+    if (!left) return false;
+
+    const uint8_t *p = reader->data + reader->offset;
+    const size_t len = left >= 4 ? get32(p) : 0;
+    if (left < CAPTURE_RECORD_HEADER || len > left - 4 || len < CAPTURE_RECORD_HEADER - 4 ||
+        get16(p + 14) > len - (CAPTURE_RECORD_HEADER - 4) || p[12] >= CAPTURE_DIRECTIONS) {
+        reader->truncated = true;
+        reader->offset = reader->size;
+        return false;
+    }
+
+    record->t_us = get64(p + 4);
+    record->direction = (capture_direction_t) p[12];
+    record->topic_len = get16(p + 14);
+    record->topic = (const char *) p + CAPTURE_RECORD_HEADER;
+    record->payload = p + CAPTURE_RECORD_HEADER + record->topic_len;
+    record->len = len - (CAPTURE_RECORD_HEADER - 4) - record->topic_len;
+    reader->offset += 4 + len;
+    return true;
+}
+
+void capture_rewind(capture_reader_t *reader) {
+    reader->offset = CAPTURE_HEADER_SIZE;
+    reader->truncated = false;
+}
+
+void capture_unmap(capture_reader_t *reader) {
+    if (reader->data) munmap((void *) reader->data, reader->size);
+    memset(reader, 0, sizeof(capture_reader_t));
+}
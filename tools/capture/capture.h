@@ -0,0 +1,140 @@
+/*!
+ * @file
+ * @brief Host tools: capture file of MQTT traffic.
+ *
+ * A capture is an 8 byte file header ("UCAP", version, reserved) followed by
+ * length prefixed records, all integers little endian:
+ *
+ * ```
+ * uint32  length of the rest of the record
+ * uint64  timestamp, us since the epoch
+ * uint8   direction (capture_direction_t)
+ * uint8   reserved, 0
+ * uint16  topic length
+ * char    topic[topic length]
+ * uint8   payload[length - 12 - topic length]
+ * ```
+ *
+ * The writer appends records (thread safe), the reader maps the whole file
+ * and returns the records in place, without copying.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 8
+#define CAPTURE_RECORD_HEADER 16    //!< length, timestamp, direction, reserved and topic length
+
+//! direction of a captured message
+typedef enum {
+    CAPTURE_UPLINK = 0,     //!< device to backend (`mwc/ubirch/devices/<uuid>/`)
+    CAPTURE_DOWNLINK = 1,   //!< backend to device (`.../out`)
+    CAPTURE_DIRECTIONS
+} capture_direction_t;
+
+extern const char *const capture_direction_names[CAPTURE_DIRECTIONS];
+
+typedef struct capture capture_t;
+
+//! a record of a mapped capture, pointing into the mapping
+typedef struct {
+    uint64_t t_us;
+    capture_direction_t direction;
+    const char *topic;      //!< not 0 terminated
+    size_t topic_len;
+    const uint8_t *payload;
+    size_t len;
+} capture_record_t;
+
+//! a capture mapped for reading
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;          //!< of the next record
+    bool truncated;         //!< the last record is incomplete (a capture that was cut off)
+} capture_reader_t;
+
+/*!
+ * @brief The direction of a message on a device topic.
+ * @param topic the topic
+ * @param len the length of the topic
+ * @return CAPTURE_DOWNLINK for `.../out`, CAPTURE_UPLINK otherwise
+ */
+capture_direction_t capture_direction(const char *topic, size_t len);
+
+/*!
+ * @brief Create a capture file, an existing file is replaced.
+ * @param path the file
+ * @return the capture, NULL if the file could not be created
+ */
+capture_t *capture_open(const char *path);
+
+/*!
+ * @brief Append a record.
+ * @param capture the capture
+ * @param t_us the timestamp, us since the epoch
+ * @param direction the direction
+ * @param topic the topic (not 0 terminated)
+ * @param topic_len the length of the topic
+ * @param payload the payload
+ * @param len the size of the payload
+ * @return true if the record was written
+ */
+bool capture_write(capture_t *capture, uint64_t t_us, capture_direction_t direction, const char *topic,
+                   size_t topic_len, const void *payload, size_t len);
+
+//! @brief Number of records written.
+uint64_t capture_records(const capture_t *capture);
+
+/*!
+ * @brief Flush and close the capture.
+ * @return true if everything was written
+ */
+bool capture_close(capture_t *capture);
+
+/*!
+ * @brief Map a capture for reading.
+ * @param path the file
+ * @param reader the reader to set up
+ * @return true if the file is a capture of a known version
+ */
+bool capture_map(const char *path, capture_reader_t *reader);
+
+/*!
+ * @brief Get the next record.
+ * @param reader the reader
+ * @param record where to store the record
+ * @return true if there was a complete record
+ */
+bool capture_next(capture_reader_t *reader, capture_record_t *record);
+
+//! @brief Start again from the first record.
+void capture_rewind(capture_reader_t *reader);
+
+//! @brief Unmap the capture.
+void capture_unmap(capture_reader_t *reader);
+
+#endif // _CAPTURE_H_
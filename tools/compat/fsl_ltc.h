@@ -0,0 +1,4 @@
+/*!
+ * @file
+ * @brief Host build: there is no LTC, crypto.c runs on the software implementation.
+ */
@@ -0,0 +1,21 @@
+/*!
+ * @file
+ * @brief Host build: uptime from the monotonic clock (for log timestamps).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include "uptime.h"
+
+static uint32_t offset = 0;
+
+uint32_t uptime_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000) + offset;
+}
+
+void uptime_add_ms(uint32_t ms) {
+    offset += ms;
+}
@@ -0,0 +1,214 @@
+/*!
+ * @file
+ * @brief Host build: the wolfcrypt subset used by crypto.c, implemented with OpenSSL.
+ *
+ * The host tools link the firmware crypto unit (crypto/crypto.c) unchanged,
+ * wolfSSL is only available in the firmware build. Return values and error
+ * codes follow wolfcrypt, including the Base64 length checks crypto.c relies on.
+ *
+ * @date 2017-04-19
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "wolfssl/wolfcrypt/coding.h"
+#include "wolfssl/wolfcrypt/ed25519.h"
+#include "wolfssl/wolfcrypt/error-crypt.h"
+#include "wolfssl/wolfcrypt/random.h"
+#include "wolfssl/wolfcrypt/sha512.h"
+
+#define BASE64_LINE_SZ 64
+
+// === RNG ===
+
+int wc_InitRng(WC_RNG *rng) {
+    rng->initialized = 1;
+    return 0;
+}
+
+int wc_RNG_GenerateBlock(WC_RNG *rng, byte *out, word32 sz) {
+    (void) rng;
+    return RAND_bytes(out, (int) sz) == 1 ? 0 : BAD_FUNC_ARG;
+}
+
+// === SHA512 ===
+
+int wc_InitSha512(Sha512 *sha) {
+    sha->ctx = EVP_MD_CTX_new();
+    return sha->ctx && EVP_DigestInit_ex(sha->ctx, EVP_sha512(), NULL) == 1 ? 0 : BAD_FUNC_ARG;
+}
+
+int wc_Sha512Update(Sha512 *sha, const byte *data, word32 len) {
+    return EVP_DigestUpdate(sha->ctx, data, len) == 1 ? 0 : BAD_FUNC_ARG;
+}
+
+int wc_Sha512Final(Sha512 *sha, byte *hash) {
+    const int ok = EVP_DigestFinal_ex(sha->ctx, hash, NULL) == 1;
+    EVP_MD_CTX_free(sha->ctx);
+    sha->ctx = NULL;
+    return ok ? 0 : BAD_FUNC_ARG;
+}
+
+// === BASE64 ===
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int Base64_Encode_NoNl(const byte *in, word32 inLen, byte *out, word32 *outLen) {
+    const word32 size = (inLen + 2) / 3 * 4;
+    if (!out) {
+        *outLen = size;
+        return LENGTH_ONLY_E;
+    }
+    if (*outLen < size) return BUFFER_E;
+
+    word32 o = 0;
+    for (word32 i = 0; i < inLen; i += 3) {
+        const word32 n = inLen - i;
+        const word32 v = (word32) in[i] << 16 | (n > 1 ? (word32) in[i + 1] << 8 : 0) | (n > 2 ? in[i + 2] : 0);
+        out[o++] = (byte) base64_alphabet[v >> 18 & 0x3f];
+        out[o++] = (byte) base64_alphabet[v >> 12 & 0x3f];
+        out[o++] = n > 1 ? (byte) base64_alphabet[v >> 6 & 0x3f] : '=';
+        out[o++] = n > 2 ? (byte) base64_alphabet[v & 0x3f] : '=';
+    }
+    *outLen = size;
+    return 0;
+}
+
+static int base64_value(byte c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+int Base64_Decode(const byte *in, word32 inLen, byte *out, word32 *outLen) {
+    // the same (conservative) size check as wolfcrypt, it allows for line breaks
+    word32 plainSz = inLen - ((inLen + (BASE64_LINE_SZ - 1)) / BASE64_LINE_SZ);
+    plainSz = (plainSz * 3 + 3) / 4;
+    if (plainSz > *outLen) return BAD_FUNC_ARG;
+
+    word32 o = 0, bits = 0, count = 0, padding = 0;
+    for (word32 i = 0; i < inLen; i++) {
+        const byte c = in[i];
+        if (c == '\r' || c == '\n') continue;
+        if (c == '=') {
+            padding++;
+            continue;
+        }
+        const int v = base64_value(c);
+        if (v < 0 || padding) return ASN_INPUT_E;
+        bits = bits << 6 | (word32) v;
+        if (++count == 4) {
+            out[o++] = (byte) (bits >> 16);
+            out[o++] = (byte) (bits >> 8);
+            out[o++] = (byte) bits;
+            bits = count = 0;
+        }
+    }
+    if (count == 1 || count + padding > 4 || (count && count + padding != 4)) return ASN_INPUT_E;
+    if (count == 2) out[o++] = (byte) (bits >> 4);
+    if (count == 3) {
+        out[o++] = (byte) (bits >> 10);
+        out[o++] = (byte) (bits >> 2);
+    }
+    *outLen = o;
+    return 0;
+}
+
+// === ED25519 ===
+
+int wc_ed25519_init(ed25519_key *key) {
+    memset(key, 0, sizeof(ed25519_key));
+    return 0;
+}
+
+void wc_ed25519_free(ed25519_key *key) {
+    EVP_PKEY_free(key->pkey);
+    key->pkey = NULL;
+}
+
+static int ed25519_set_private(ed25519_key *key, const byte *priv) {
+    EVP_PKEY_free(key->pkey);
+    key->pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, NULL, priv, ED25519_KEY_SIZE);
+    if (!key->pkey) return BAD_FUNC_ARG;
+
+    size_t len = ED25519_PUB_KEY_SIZE;
+    EVP_PKEY_get_raw_public_key(key->pkey, key->p, &len);
+    memcpy(key->k, priv, ED25519_KEY_SIZE);
+    memcpy(key->k + ED25519_KEY_SIZE, key->p, ED25519_PUB_KEY_SIZE);
+    return 0;
+}
+
+int wc_ed25519_make_key(WC_RNG *rng, int keysize, ed25519_key *key) {
+    byte seed[ED25519_KEY_SIZE];
+    if (keysize != ED25519_KEY_SIZE || wc_RNG_GenerateBlock(rng, seed, sizeof(seed))) return BAD_FUNC_ARG;
+    return ed25519_set_private(key, seed);
+}
+
+int wc_ed25519_import_private_key(const byte *priv, word32 privSz, const byte *pub, word32 pubSz, ed25519_key *key) {
+    if (privSz < ED25519_KEY_SIZE || pubSz != ED25519_PUB_KEY_SIZE) return BAD_FUNC_ARG;
+    const int status = ed25519_set_private(key, priv);
+    if (status) return status;
+    return memcmp(key->p, pub, ED25519_PUB_KEY_SIZE) == 0 ? 0 : BAD_FUNC_ARG;
+}
+
+int wc_ed25519_import_public(const byte *in, word32 inLen, ed25519_key *key) {
+    if (inLen != ED25519_PUB_KEY_SIZE) return BAD_FUNC_ARG;
+    EVP_PKEY_free(key->pkey);
+    key->pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, in, inLen);
+    if (!key->pkey) return BAD_FUNC_ARG;
+    memcpy(key->p, in, ED25519_PUB_KEY_SIZE);
+    return 0;
+}
+
+int wc_ed25519_export_public(ed25519_key *key, byte *out, word32 *outLen) {
+    if (*outLen < ED25519_PUB_KEY_SIZE) return BUFFER_E;
+    memcpy(out, key->p, ED25519_PUB_KEY_SIZE);
+    *outLen = ED25519_PUB_KEY_SIZE;
+    return 0;
+}
+
+int wc_ed25519_sign_msg(const byte *in, word32 inLen, byte *out, word32 *outLen, ed25519_key *key) {
+    if (!key->pkey || *outLen < ED25519_SIG_SIZE) return BAD_FUNC_ARG;
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    size_t len = *outLen;
+    const int ok = ctx && EVP_DigestSignInit(ctx, NULL, NULL, NULL, key->pkey) == 1 &&
+                   EVP_DigestSign(ctx, out, &len, in, inLen) == 1;
+    EVP_MD_CTX_free(ctx);
+    *outLen = (word32) len;
+    return ok ? 0 : BAD_FUNC_ARG;
+}
+
+int wc_ed25519_verify_msg(const byte *sig, word32 sigLen, const byte *msg, word32 msgLen, int *stat,
+                          ed25519_key *key) {
+    *stat = 0;
+    if (!key->pkey || sigLen != ED25519_SIG_SIZE) return BAD_FUNC_ARG;
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (!ctx || EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, key->pkey) != 1) {
+        EVP_MD_CTX_free(ctx);
+        return BAD_FUNC_ARG;
+    }
+    *stat = EVP_DigestVerify(ctx, sig, sigLen, msg, msgLen) == 1;
+    EVP_MD_CTX_free(ctx);
+    return 0;
+}
@@ -0,0 +1,22 @@
+/*!
+ * @file
+ * @brief Host build: wolfcrypt Base64 (same length checks and errors as wolfSSL).
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_CODING_H_
+#define _COMPAT_WOLFCRYPT_CODING_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int Base64_Encode_NoNl(const byte *in, word32 inLen, byte *out, word32 *outLen);
+int Base64_Decode(const byte *in, word32 inLen, byte *out, word32 *outLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _COMPAT_WOLFCRYPT_CODING_H_
@@ -0,0 +1,40 @@
+/*!
+ * @file
+ * @brief Host build: wolfcrypt Ed25519.
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_ED25519_H_
+#define _COMPAT_WOLFCRYPT_ED25519_H_
+
+#include "random.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ED25519_KEY_SIZE     32
+#define ED25519_SIG_SIZE     64
+#define ED25519_PUB_KEY_SIZE 32
+#define ED25519_PRV_KEY_SIZE 64
+
+typedef struct {
+    byte p[ED25519_PUB_KEY_SIZE];   //!< public key
+    byte k[ED25519_PRV_KEY_SIZE];   //!< private key, followed by the public key
+    void *pkey;                     //!< EVP_PKEY, created on import
+} ed25519_key;
+
+int wc_ed25519_init(ed25519_key *key);
+void wc_ed25519_free(ed25519_key *key);
+int wc_ed25519_make_key(WC_RNG *rng, int keysize, ed25519_key *key);
+int wc_ed25519_import_private_key(const byte *priv, word32 privSz, const byte *pub, word32 pubSz, ed25519_key *key);
+int wc_ed25519_import_public(const byte *in, word32 inLen, ed25519_key *key);
+int wc_ed25519_export_public(ed25519_key *key, byte *out, word32 *outLen);
+int wc_ed25519_sign_msg(const byte *in, word32 inLen, byte *out, word32 *outLen, ed25519_key *key);
+int wc_ed25519_verify_msg(const byte *sig, word32 sigLen, const byte *msg, word32 msgLen, int *stat,
+                          ed25519_key *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _COMPAT_WOLFCRYPT_ED25519_H_
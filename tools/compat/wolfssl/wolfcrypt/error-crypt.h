@@ -0,0 +1,15 @@
+/*!
+ * @file
+ * @brief Host build: wolfcrypt error codes (same values as wolfSSL).
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_ERROR_CRYPT_H_
+#define _COMPAT_WOLFCRYPT_ERROR_CRYPT_H_
+
+#define MEMORY_E      -125
+#define BUFFER_E      -132
+#define ASN_INPUT_E   -154
+#define BAD_FUNC_ARG  -173
+#define LENGTH_ONLY_E -202
+
+#endif // _COMPAT_WOLFCRYPT_ERROR_CRYPT_H_
@@ -0,0 +1,26 @@
+/*!
+ * @file
+ * @brief Host build: wolfcrypt RNG, backed by the OpenSSL RNG.
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_RANDOM_H_
+#define _COMPAT_WOLFCRYPT_RANDOM_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int initialized;
+} WC_RNG;
+
+int wc_InitRng(WC_RNG *rng);
+int wc_RNG_GenerateBlock(WC_RNG *rng, byte *out, word32 sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _COMPAT_WOLFCRYPT_RANDOM_H_
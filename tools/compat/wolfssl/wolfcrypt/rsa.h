@@ -0,0 +1,13 @@
+/*!
+ * @file
+ * @brief Host build: only the RsaKey type, crypto.h declares it.
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_RSA_H_
+#define _COMPAT_WOLFCRYPT_RSA_H_
+
+typedef struct {
+    int unused;
+} RsaKey;
+
+#endif // _COMPAT_WOLFCRYPT_RSA_H_
@@ -0,0 +1,29 @@
+/*!
+ * @file
+ * @brief Host build: wolfcrypt SHA512.
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_SHA512_H_
+#define _COMPAT_WOLFCRYPT_SHA512_H_
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA512_DIGEST_SIZE 64
+
+typedef struct {
+    void *ctx;      //!< EVP_MD_CTX
+} Sha512;
+
+int wc_InitSha512(Sha512 *sha);
+int wc_Sha512Update(Sha512 *sha, const byte *data, word32 len);
+int wc_Sha512Final(Sha512 *sha, byte *hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _COMPAT_WOLFCRYPT_SHA512_H_
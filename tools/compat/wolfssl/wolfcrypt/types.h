@@ -0,0 +1,17 @@
+/*!
+ * @file
+ * @brief Host build: the wolfcrypt subset used by crypto.c, implemented with OpenSSL (wolfcrypt.c).
+ */
+
+#ifndef _COMPAT_WOLFCRYPT_TYPES_H_
+#define _COMPAT_WOLFCRYPT_TYPES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef uint32_t word32;
+
+#endif // _COMPAT_WOLFCRYPT_TYPES_H_
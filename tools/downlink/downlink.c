@@ -0,0 +1,59 @@
+/*!
+ * @file
+ * @brief Host tools: the firmware downlink path, with its outcome.
+ *
+ * @date 2017-04-21
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "crypto/crypto.h"
+#include "downlink.h"
+#include "response.h"
+
+// the firmware's error flags, set by process_response() and process_payload()
+uint8_t error_flag = 0;
+
+const char *const downlink_outcome_names[DOWNLINK_OUTCOMES] = {"applied", "no payload", "bad key", "bad signature",
+                                                               "invalid"};
+
+downlink_outcome_t downlink_process(char *message, settings_update_t *update, uint32_t *request) {
+    uc_ed25519_pub_pkcs8 key;
+    unsigned char signature[SHA512_HASH_SIZE];
+    memset(&key, 0xff, sizeof(key));
+    memset(signature, 0xf7, sizeof(signature));
+    memset(update, 0, sizeof(settings_update_t));
+    if (request) *request = 0;
+
+    char *payload = process_response(message, &key, signature);
+    if (!payload) return DOWNLINK_NO_PAYLOAD;
+
+    downlink_outcome_t outcome;
+    uc_ed25519_key pub;
+    if (!uc_import_ecc_pub_key_encoded(&pub, &key)) {
+        outcome = DOWNLINK_BAD_KEY;
+    } else {
+        if (!uc_ecc_verify(&pub, (const unsigned char *) payload, strlen(payload), signature, sizeof(signature)))
+            outcome = DOWNLINK_BAD_SIGNATURE;
+        else outcome = process_payload(payload, update, request) && update->mask ? DOWNLINK_APPLIED : DOWNLINK_INVALID;
+        wc_ed25519_free(&pub);
+    }
+    free(payload);
+    return outcome;
+}
@@ -0,0 +1,53 @@
+/*!
+ * @file
+ * @brief Host tools: the firmware downlink path, with its outcome.
+ *
+ * processDownlink() of main.cpp up to staging the settings: process_response(),
+ * importing the key and checking the signature, process_payload().
+ *
+ * @date 2017-04-21
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _DOWNLINK_H_
+#define _DOWNLINK_H_
+
+#include "settings.h"
+
+//! outcome of the downlink path
+typedef enum {
+    DOWNLINK_APPLIED = 0,   //!< verified, settings staged
+    DOWNLINK_NO_PAYLOAD,    //!< process_response() found no payload
+    DOWNLINK_BAD_KEY,       //!< the key could not be imported
+    DOWNLINK_BAD_SIGNATURE,
+    DOWNLINK_INVALID,       //!< verified, but process_payload() rejected a setting or there was none
+    DOWNLINK_OUTCOMES
+} downlink_outcome_t;
+
+extern const char *const downlink_outcome_names[DOWNLINK_OUTCOMES];
+
+/*!
+ * @brief Verify a downlink message and stage its settings, as the firmware does.
+ * @param message the message, 0 terminated (process_response() works in place)
+ * @param update where to stage the settings
+ * @param request where to store the request ID to acknowledge (0 if none), may be NULL
+ * @return the outcome
+ */
+downlink_outcome_t downlink_process(char *message, settings_update_t *update, uint32_t *request);
+
+#endif // _DOWNLINK_H_
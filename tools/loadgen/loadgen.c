@@ -0,0 +1,984 @@
+/*!
+ * @file
+ * @brief Fleet load generator: many virtual devices against an MQTT broker.
+ *
+ * Every virtual device has its own key, a UUID in the getDeviceUUID() format
+ * and its own sensor trace. It runs the firmware path: the payload of
+ * queueTelemetry() is signed when it is sampled (uc_ecc_sign_encoded()),
+ * queued in the device outbox (outbox.c, with the firmware's capacities and
+ * drop policies), and wrapped (protocol_message()) and published
+ * with QoS 0 to `mwc/ubirch/devices/<uuid>/` when the outbox is drained. After
+ * connecting, a device subscribes to `mwc/ubirch/devices/<uuid>/out`, and in
+ * session mode it announces a new session before draining the outbox.
+ *
+ * The devices are spread over worker threads, each with an epoll loop and a
+ * timer heap for its devices. By default the broker is the local stand-in
+ * (broker/broker.c) in a thread of this process, -H uses an external broker.
+ *
+ * With -m the telemetry is batch signed like with BATCH_WINDOW in the firmware:
+ * it is queued unsigned, and the messages drained together are signed once
+ * over their Merkle root (in windows of up to MERKLE_MAX_LEAVES) and carry
+ * their inclusion proofs.
+ *
+ * Load shapes: the sample interval with jitter, batch mode (the outbox is
+ * drained when it holds a number of messages) and reconnect storms (all
+ * connections are dropped periodically, the devices reconnect with a random
+ * backoff). With an interval of 0 the devices publish as fast as they can,
+ * -s runs that for an increasing number of threads to find where the
+ * generator saturates.
+ *
+ * @date 2017-04-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "broker.h"
+#include "crypto/crypto.h"
+#include "downlink.h"
+#include "mqtt.h"
+#include "outbox.h"
+#include "protocol.h"
+#include "sensor.h"
+#include "telemetry.h"
+
+#define MAX_THREADS 256
+#define EVENTS 256
+#define TIMERS_PER_LOOP 64      //!< timers handled before the sockets are polled again
+#define PAYLOAD_SIZE 256
+#define KEEPALIVE 0             //!< no keepalive, runs are short and the devices publish anyway
+#define DOWNLINK_SIZE 1024      //!< largest downlink message (MQTT_FRAME_SIZE of the firmware)
+
+// === CONFIGURATION ===
+
+static int device_count = 100;
+static int interval_ms = 1000;          //!< sample interval, 0 publishes as fast as possible
+static int jitter_ms = 0;               //!< uniform jitter of the sample interval, +/-
+static int batch = 1;                   //!< drain the outbox when it holds this many messages
+static bool merkle = false;             //!< batch sign the drained telemetry, one signature per window
+static int storm_s = 0;                 //!< period of the reconnect storms, 0 for none
+static int backoff_ms = 0;              //!< reconnect after a random delay of up to this
+static protocol_mode_t mode = PROTOCOL_FULL;
+static struct sockaddr_in broker_addr;
+
+// === SENSOR TRACE ===
+
+typedef struct {
+    double t_s;
+    float temperature;      //!< degree Celsius
+    float pressure;         //!< hPa
+    float humidity;         //!< %
+} trace_sample_t;
+
+static trace_sample_t *trace = NULL;
+static size_t trace_len = 0;
+static double trace_span_s = 0;
+
+// read "seconds,temperature,pressure,humidity" lines (the envsim format), the trace is repeated
+static bool trace_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    size_t cap = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        trace_sample_t s;
+        if (sscanf(line, "%lf,%f,%f,%f", &s.t_s, &s.temperature, &s.pressure, &s.humidity) != 4) continue;
+        if (trace_len == cap) {
+            cap = cap ? cap * 2 : 256;
+            trace = realloc(trace, cap * sizeof(trace_sample_t));
+        }
+        trace[trace_len++] = s;
+    }
+    fclose(f);
+    if (trace_len < 2) return false;
+    trace_span_s = trace[trace_len - 1].t_s - trace[0].t_s;
+    return trace_span_s > 0;
+}
+
+// step-hold replay of the trace, or a synthetic diurnal cycle without one
+static void trace_at(double t, trace_sample_t *out) {
+    if (!trace_len) {
+        const double day = 2 * M_PI * t / 86400.0;
+        out->temperature = (float) (18.0 + 6.0 * sin(day) + 0.5 * sin(day * 37.0));
+        out->pressure = (float) (1013.0 + 4.0 * sin(day / 3.0));
+        out->humidity = (float) (50.0 - 15.0 * sin(day));
+        return;
+    }
+
+    const double offset = trace[0].t_s + fmod(t, trace_span_s);
+    size_t lo = 0, hi = trace_len - 1;
+    while (lo < hi) {
+        const size_t mid = (lo + hi + 1) / 2;
+        if (trace[mid].t_s <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    *out = trace[lo];
+}
+
+// === DEVICES ===
+
+typedef enum {
+    DEVICE_OFFLINE = 0,
+    DEVICE_CONNECTING,      //!< TCP connect in progress
+    DEVICE_WAITING,         //!< CONNECT sent, waiting for CONNACK
+    DEVICE_ONLINE
+} device_state_t;
+
+typedef struct {
+    char uuid[37];
+    char topic[80];
+    uc_ed25519_key key;
+    protocol_identity_t identity;
+    double trace_offset_s;      //!< where in the trace the device starts
+    uint32_t seed;
+    int fd;
+    device_state_t state;
+    bool writing;               //!< socket full, waiting for EPOLLOUT
+    bool sampling;              //!< a sample timer is pending
+    int loop_counter;
+    int interval_ms;            //!< the sample interval, changed by config downlinks
+    uint64_t connect_us;        //!< start of the connection attempt
+    uint64_t published_us;      //!< when the last drain was written, 0 once a downlink answered it
+    outbox_t outbox;            //!< signed messages, batch signed ones are signed when the outbox is drained
+    uint8_t *in, *out;
+    size_t in_len, in_cap, out_len, out_cap;
+    unsigned in_flight;         //!< messages in the output buffer
+} device_t;
+
+static device_t *devices = NULL;
+
+// format the UUID like getDeviceUUID() does from the SIM UID registers
+static void device_uuid(char *uuid, const uint32_t uid[4]) {
+    sprintf(uuid, "%08X-%04X-%04X-%04X-%04X%08X", uid[0], uid[1] >> 16, uid[1] & 0xFFFF, uid[2] >> 16,
+            uid[2] & 0xFFFF, uid[3]);
+}
+
+static bool devices_create(void) {
+    devices = calloc((size_t) device_count, sizeof(device_t));
+    for (int i = 0; i < device_count; i++) {
+        device_t *d = &devices[i];
+        uint32_t uid[4];
+        if (wc_RNG_GenerateBlock(&uc_random, (byte *) uid, sizeof(uid)) != 0) return false;
+        device_uuid(d->uuid, uid);
+        snprintf(d->topic, sizeof(d->topic), PROTOCOL_TOPIC, d->uuid, "");
+
+        char imei[16];
+        snprintf(imei, sizeof(imei), "35%013d", i);
+        if (!uc_ecc_create_key(&d->key)) return false;
+        d->identity.auth = uc_sha512_encoded((const unsigned char *) imei, strlen(imei));
+        d->identity.key = uc_base64_encode(d->key.p, ED25519_PUB_KEY_SIZE);
+        d->seed = uid[3];
+        d->trace_offset_s = rand_r(&d->seed) % 86400;
+        d->interval_ms = interval_ms;
+        d->fd = -1;
+    }
+    return true;
+}
+
+// === WORKERS ===
+
+typedef enum {
+    TIMER_SAMPLE = 0,
+    TIMER_CONNECT
+} timer_kind_t;
+
+typedef struct {
+    uint64_t at_us;
+    int device;
+    timer_kind_t kind;
+} timer_entry_t;
+
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    int first, count, stride;   //!< devices first, first + stride, ...
+    timer_entry_t *timers;           //!< min heap
+    size_t timer_count, timer_cap;
+
+    // results
+    uint64_t samples, sent, lost, dropped, bytes;
+    uint64_t sign_ns;           //!< thread CPU time spent signing
+    uint64_t downlinks[DOWNLINK_OUTCOMES];
+    uint64_t downlink_ns;       //!< thread CPU time of the firmware downlink path
+    uint64_t acks;              //!< config acks sent (queueAck())
+    uint32_t *rtt_us;           //!< from the drain to the downlink
+    size_t rtt_count, rtt_cap;
+    uint64_t cpu_ns;            //!< thread CPU time of the run
+    uint64_t connects, failures, late_us, late_max_us;
+    uint32_t *connect_us;       //!< connection setup times
+    size_t connect_cap;
+} worker_t;
+
+static uint64_t run_start_us = 0, run_end_us = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+static uint64_t cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static void timer_push(worker_t *w, uint64_t at_us, int device, timer_kind_t kind) {
+    if (w->timer_count == w->timer_cap) {
+        w->timer_cap = w->timer_cap ? w->timer_cap * 2 : 64;
+        w->timers = realloc(w->timers, w->timer_cap * sizeof(timer_entry_t));
+    }
+    size_t i = w->timer_count++;
+    while (i && w->timers[(i - 1) / 2].at_us > at_us) {
+        w->timers[i] = w->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    w->timers[i] = (timer_entry_t) {at_us, device, kind};
+}
+
+static timer_entry_t timer_pop(worker_t *w) {
+    const timer_entry_t top = w->timers[0], last = w->timers[--w->timer_count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= w->timer_count) break;
+        if (child + 1 < w->timer_count && w->timers[child + 1].at_us < w->timers[child].at_us) child++;
+        if (w->timers[child].at_us >= last.at_us) break;
+        w->timers[i] = w->timers[child];
+        i = child;
+    }
+    if (w->timer_count) w->timers[i] = last;
+    return top;
+}
+
+static int device_jitter_ms(device_t *d, int range) {
+    return range > 0 ? (int) (rand_r(&d->seed) % (unsigned) (2 * range + 1)) - range : 0;
+}
+
+static void device_schedule_sample(worker_t *w, device_t *d, int index, uint64_t at_us) {
+    if (d->sampling) return;
+    d->sampling = true;
+    timer_push(w, at_us, index, TIMER_SAMPLE);
+}
+
+static uint8_t *device_reserve(device_t *d, size_t len) {
+    if (d->out_len + len > d->out_cap) {
+        d->out_cap = (d->out_len + len) * 2;
+        d->out = realloc(d->out, d->out_cap);
+    }
+    return d->out + d->out_len;
+}
+
+static void device_disconnect(worker_t *w, device_t *d, int index, uint64_t now);
+
+// write the output buffer, as much as the socket takes
+static void device_flush(worker_t *w, device_t *d, int index, uint64_t now) {
+    size_t sent = 0;
+    while (sent < d->out_len) {
+        const ssize_t n = send(d->fd, d->out + sent, d->out_len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                device_disconnect(w, d, index, now);
+                return;
+            }
+            break;
+        }
+        sent += (size_t) n;
+    }
+    w->bytes += sent;
+    memmove(d->out, d->out + sent, d->out_len - sent);
+    d->out_len -= sent;
+    if (!d->out_len && d->in_flight) {
+        w->sent += d->in_flight;
+        d->in_flight = 0;
+        d->published_us = now;
+    }
+
+    const bool writing = d->out_len > 0;
+    if (writing != d->writing) {
+        struct epoll_event ev = {.events = EPOLLIN | (writing ? EPOLLOUT : 0), .data.u32 = (uint32_t) index};
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, d->fd, &ev);
+        d->writing = writing;
+    }
+}
+
+// wrap a signed payload in the envelope and queue the PUBLISH
+static void device_publish(device_t *d, protocol_mode_t envelope, const char *payload, const char *signature,
+                           const char *proof) {
+    char *message = protocol_batch_message(envelope, &d->identity, signature, proof, payload);
+    const size_t len = strlen(message), max = MQTT_HEADER_MAX + 2 + strlen(d->topic) + len;
+    d->out_len += mqtt_publish(device_reserve(d, max), max, d->topic, message, len, 0, 0);
+    d->in_flight++;
+    free(message);
+}
+
+// queue a message, a full class drops by its policy
+static void device_queue(worker_t *w, device_t *d, outbox_class_t cls, const outbox_entry_t *entry) {
+    const uint32_t dropped = outbox_dropped(&d->outbox, cls);
+    outbox_push(&d->outbox, cls, entry);
+    w->dropped += outbox_dropped(&d->outbox, cls) - dropped;
+}
+
+// sign the unsigned telemetry of the outbox, one Merkle root per window (signWindow())
+static void device_sign_windows(worker_t *w, device_t *d) {
+    const uint64_t start = cpu_ns();
+    const uint8_t queued = outbox_count(&d->outbox, OUTBOX_TELEMETRY);
+    uint8_t i = 0;
+    while (i < queued && outbox_at(&d->outbox, OUTBOX_TELEMETRY, i)->signature) i++;
+    while (i < queued) {
+        const uint8_t first = i;
+        merkle_tree_t tree;
+        merkle_init(&tree);
+        for (; i < queued && i - first < MERKLE_MAX_LEAVES; i++) {
+            const char *payload = outbox_at(&d->outbox, OUTBOX_TELEMETRY, i)->payload;
+            merkle_add(&tree, (const unsigned char *) payload, strlen(payload));
+        }
+        char *signature = uc_ecc_sign_encoded(&d->key, merkle_build(&tree), MERKLE_HASH_SIZE);
+        for (uint8_t j = first; j < i; j++) {
+            outbox_entry_t *m = outbox_at(&d->outbox, OUTBOX_TELEMETRY, j);
+            unsigned char siblings[MERKLE_MAX_DEPTH][MERKLE_HASH_SIZE];
+            const size_t len = merkle_proof(&tree, (uint8_t) (j - first), siblings);
+            m->proof = protocol_proof((uint8_t) (j - first), tree.count,
+                                      (const unsigned char (*)[MERKLE_HASH_SIZE]) siblings, len);
+            m->signature = strdup(signature);
+        }
+        free(signature);
+    }
+    w->sign_ns += cpu_ns() - start;
+}
+
+// publish the outbox, after the session announcement if a new connection needs one
+static void device_drain(worker_t *w, device_t *d, int index, uint64_t now) {
+    if (merkle) device_sign_windows(w, d);
+    outbox_class_t cls;
+    outbox_entry_t *m;
+    while ((m = outbox_peek(&d->outbox, &cls)) != NULL) {
+        device_publish(d, mode, m->payload, m->signature, m->proof);
+        outbox_pop(&d->outbox, cls);
+    }
+    device_flush(w, d, index, now);
+}
+
+static void device_sample(worker_t *w, device_t *d, int index, uint64_t due, uint64_t now) {
+    d->sampling = false;
+    w->samples++;
+    const uint64_t late = now - due;
+    w->late_us += late;
+    if (late > w->late_max_us) w->late_max_us = late;
+
+    // the payload of queueTelemetry(), from the device's own position in the trace
+    trace_sample_t s;
+    trace_at(d->trace_offset_s + (now - run_start_us) / 1e6, &s);
+    const double altitude = 44330.0 * (1.0 - pow(s.pressure / 1013.25, 0.1903));
+    telemetry_t telemetry = {0};
+    telemetry.temperature = (int32_t) (s.temperature * telemetry_scale(TELEMETRY_TEMPERATURE));
+    telemetry.pressure = (int32_t) (s.pressure * telemetry_scale(TELEMETRY_PRESSURE));
+    telemetry.humidity = (int32_t) (s.humidity * telemetry_scale(TELEMETRY_HUMIDITY));
+    telemetry.altitude = (int32_t) (altitude * telemetry_scale(TELEMETRY_ALTITUDE));
+    telemetry_set_string(&telemetry, TELEMETRY_LATITUDE, "52.520008");
+    telemetry_set_string(&telemetry, TELEMETRY_LONGITUDE, "13.404954");
+    telemetry.battery = 100;
+    telemetry.loop = d->loop_counter++;
+    telemetry.present |= 1u << TELEMETRY_TEMPERATURE | 1u << TELEMETRY_PRESSURE | 1u << TELEMETRY_HUMIDITY |
+                         1u << TELEMETRY_ALTITUDE | 1u << TELEMETRY_BATTERY | 1u << TELEMETRY_LOOP |
+                         1u << TELEMETRY_ERROR;
+    char payload[TELEMETRY_JSON_SIZE];
+    telemetry_json(&telemetry, payload);
+
+    char *signature = NULL;
+    if (!merkle) {
+        const uint64_t start = cpu_ns();
+        signature = uc_ecc_sign_encoded(&d->key, (const unsigned char *) payload, strlen(payload));
+        w->sign_ns += cpu_ns() - start;
+    }
+
+    const outbox_entry_t entry = {strdup(payload), NULL, signature, NULL, 0, (uint32_t) (now / 1000u)};
+    device_queue(w, d, OUTBOX_TELEMETRY, &entry);
+
+    if (d->state == DEVICE_ONLINE && !d->writing && outbox_count(&d->outbox, OUTBOX_TELEMETRY) >= batch) {
+        device_drain(w, d, index, now);
+    }
+
+    if (interval_ms) {
+        const int next = d->interval_ms + device_jitter_ms(d, jitter_ms);
+        device_schedule_sample(w, d, index, due + (uint64_t) (next > 0 ? next : 0) * 1000u);
+    } else if (d->state == DEVICE_ONLINE && !d->writing) {
+        // flat out: the next sample as soon as the socket takes more
+        device_schedule_sample(w, d, index, now);
+    }
+}
+
+static void device_connect(worker_t *w, device_t *d, int index, uint64_t now) {
+    d->connect_us = now;
+    d->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    if (d->fd >= 0) setsockopt(d->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (d->fd < 0 || (connect(d->fd, (struct sockaddr *) &broker_addr, sizeof(broker_addr)) && errno != EINPROGRESS)) {
+        if (d->fd >= 0) close(d->fd);
+        d->fd = -1;
+        w->failures++;
+        timer_push(w, now + 1000u * (uint64_t) (backoff_ms > 0 ? 1 + rand_r(&d->seed) % backoff_ms : 100), index,
+                   TIMER_CONNECT);
+        return;
+    }
+    d->state = DEVICE_CONNECTING;
+    d->writing = true;
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.u32 = (uint32_t) index};
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, d->fd, &ev);
+}
+
+static void device_disconnect(worker_t *w, device_t *d, int index, uint64_t now) {
+    if (d->state == DEVICE_OFFLINE) return;
+    // a failed attempt is retried after a pause, a lost connection right away (plus the backoff)
+    const uint64_t pause_ms = d->state == DEVICE_ONLINE ? 0 : 100;
+    if (d->state != DEVICE_ONLINE) w->failures++;
+    close(d->fd);
+    d->fd = -1;
+    d->state = DEVICE_OFFLINE;
+    d->writing = false;
+    // whatever was still in the output buffer is lost, the outbox survives
+    w->lost += d->in_flight;
+    d->in_flight = 0;
+    d->out_len = d->in_len = 0;
+    timer_push(w, now + 1000u * (pause_ms + (backoff_ms > 0 ? rand_r(&d->seed) % (unsigned) backoff_ms : 0)), index,
+               TIMER_CONNECT);
+}
+
+static void device_online(worker_t *w, device_t *d, int index, uint64_t now) {
+    d->state = DEVICE_ONLINE;
+    w->connects++;
+    if (w->connects > w->connect_cap) {
+        w->connect_cap = w->connect_cap ? w->connect_cap * 2 : 256;
+        w->connect_us = realloc(w->connect_us, w->connect_cap * sizeof(uint32_t));
+    }
+    w->connect_us[w->connects - 1] = (uint32_t) (now - d->connect_us);
+
+    // a new connection is a new session, announced with the signed identity message (pubMqttIdentity())
+    if (mode == PROTOCOL_SESSION && protocol_new_session(&d->identity)) {
+        char *payload = protocol_identity_payload(&d->identity);
+        const uint64_t start = cpu_ns();
+        char *signature = uc_ecc_sign_encoded(&d->key, (const unsigned char *) payload, strlen(payload));
+        w->sign_ns += cpu_ns() - start;
+        device_publish(d, PROTOCOL_FULL, payload, signature, NULL);
+        free(payload);
+        free(signature);
+    }
+    device_drain(w, d, index, now);
+    if (!interval_ms) device_schedule_sample(w, d, index, now);
+}
+
+// a config message, through the firmware path of messageArrived() and processDownlink()
+static void device_downlink(worker_t *w, device_t *d, int index, const mqtt_publish_t *publish, uint64_t now) {
+    if (d->published_us) {
+        if (w->rtt_count == w->rtt_cap) {
+            w->rtt_cap = w->rtt_cap ? w->rtt_cap * 2 : 256;
+            w->rtt_us = realloc(w->rtt_us, w->rtt_cap * sizeof(uint32_t));
+        }
+        w->rtt_us[w->rtt_count++] = (uint32_t) (now - d->published_us);
+        d->published_us = 0;
+    }
+    if (publish->len > DOWNLINK_SIZE) {
+        w->downlinks[DOWNLINK_NO_PAYLOAD]++;
+        return;
+    }
+
+    const uint64_t start = cpu_ns();
+    char message[DOWNLINK_SIZE + 1];
+    memcpy(message, publish->payload, publish->len);
+    message[publish->len] = '\0';
+    settings_update_t update;
+    uint32_t request;
+    const downlink_outcome_t outcome = downlink_process(message, &update, &request);
+    w->downlink_ns += cpu_ns() - start;
+    w->downlinks[outcome]++;
+    // a rejected config is acknowledged with its status
+    const bool rejected = outcome == DOWNLINK_INVALID;
+    if (outcome != DOWNLINK_APPLIED && !rejected) return;
+
+    // the settings are per device here, the interval is the one the generator uses
+    if (interval_ms && !rejected && (update.mask & (1u << SETTING_INTERVAL))) {
+        d->interval_ms = update.values[SETTING_INTERVAL] * 1000;
+    }
+
+    // the signed ack of applyConfig(), its class is drained ahead of the telemetry
+    if (request) {
+        char fields[SETTINGS_COUNT * 20], payload[PAYLOAD_SIZE];
+        if (rejected) snprintf(fields, sizeof(fields), PROTOCOL_ACK_STATUS, E_JSON_FAILED);
+        else if (settings_format(&update, fields, sizeof(fields)) >= sizeof(fields)) fields[0] = '\0';
+        snprintf(payload, sizeof(payload), PROTOCOL_ACK, (unsigned long) request, fields,
+                 (unsigned long) ((now_us() - now) / 1000));
+        const uint64_t sign_start = cpu_ns();
+        char *signature = uc_ecc_sign_encoded(&d->key, (const unsigned char *) payload, strlen(payload));
+        w->sign_ns += cpu_ns() - sign_start;
+        const outbox_entry_t entry = {strdup(payload), NULL, signature, NULL, 0, (uint32_t) (now / 1000u)};
+        device_queue(w, d, OUTBOX_CONFIG_ACK, &entry);
+        w->acks++;
+        if (d->state == DEVICE_ONLINE && !d->writing) device_drain(w, d, index, now);
+    }
+}
+
+static void device_receive(worker_t *w, device_t *d, int index, uint64_t now) {
+    if (d->in_len + 4096 > d->in_cap) {
+        d->in_cap = d->in_len + 4096;
+        d->in = realloc(d->in, d->in_cap);
+    }
+    const ssize_t n = recv(d->fd, d->in + d->in_len, d->in_cap - d->in_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (n <= 0) {
+        device_disconnect(w, d, index, now);
+        return;
+    }
+    d->in_len += (size_t) n;
+
+    size_t used = 0;
+    mqtt_packet_t packet;
+    int status;
+    while ((status = mqtt_next(d->in + used, d->in_len - used, &packet)) == 1) {
+        used += packet.size;
+        if (packet.type == MQTT_CONNACK && d->state == DEVICE_WAITING) {
+            if (packet.len < 2 || packet.body[1] != 0) status = -1;
+            else device_online(w, d, index, now);
+        } else if (packet.type == MQTT_PUBLISH) {
+            mqtt_publish_t publish;
+            if (!mqtt_parse_publish(&packet, &publish)) {
+                status = -1;
+                break;
+            }
+            device_downlink(w, d, index, &publish, now);
+            if (publish.qos) d->out_len += mqtt_puback(device_reserve(d, 4), 4, publish.id);
+            if (d->out_len) device_flush(w, d, index, now);
+        }
+        if (status < 0 || d->state == DEVICE_OFFLINE) break;
+    }
+    if (status < 0) {
+        device_disconnect(w, d, index, now);
+        return;
+    }
+    memmove(d->in, d->in + used, d->in_len - used);
+    d->in_len -= used;
+}
+
+// the TCP connection is up: CONNECT and SUBSCRIBE, like the firmware's connect sequence
+static void device_connected(worker_t *w, device_t *d, int index, uint64_t now) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &error, &len) || error) {
+        device_disconnect(w, d, index, now);
+        return;
+    }
+    char subscription[80];
+    snprintf(subscription, sizeof(subscription), PROTOCOL_TOPIC, d->uuid, "out");
+    d->state = DEVICE_WAITING;
+    d->out_len += mqtt_connect(device_reserve(d, 256), 256, d->uuid, NULL, NULL, KEEPALIVE);
+    d->out_len += mqtt_subscribe(device_reserve(d, 128), 128, 1, subscription, 1);
+    d->writing = true;  // forces the epoll update in device_flush()
+    device_flush(w, d, index, now);
+}
+
+static void *worker_run(void *arg) {
+    worker_t *w = arg;
+    struct epoll_event events[EVENTS];
+    const uint64_t cpu_start = cpu_ns();
+
+    // connect all devices, with the backoff as the initial spread, and start sampling
+    for (int i = w->first; i < device_count; i += w->stride) {
+        device_t *d = &devices[i];
+        const uint64_t spread = backoff_ms > 0 ? rand_r(&d->seed) % (unsigned) backoff_ms : 0;
+        timer_push(w, run_start_us + spread * 1000u, i, TIMER_CONNECT);
+        if (interval_ms) {
+            device_schedule_sample(w, d, i, run_start_us + 1000u * (rand_r(&d->seed) % (unsigned) d->interval_ms));
+        }
+    }
+
+    for (;;) {
+        uint64_t now = now_us();
+        if (now >= run_end_us) break;
+
+        int handled = 0;
+        while (w->timer_count && w->timers[0].at_us <= now && handled++ < TIMERS_PER_LOOP) {
+            const timer_entry_t t = timer_pop(w);
+            device_t *d = &devices[t.device];
+            if (t.kind == TIMER_CONNECT) device_connect(w, d, t.device, now);
+            else device_sample(w, d, t.device, t.at_us, now);
+        }
+
+        int timeout = 10;
+        if (handled > TIMERS_PER_LOOP) timeout = 0;
+        else if (w->timer_count) {
+            const uint64_t wait = w->timers[0].at_us > now ? (w->timers[0].at_us - now + 999) / 1000 : 0;
+            if (wait < (uint64_t) timeout) timeout = (int) wait;
+        }
+        const int n = epoll_wait(w->epoll_fd, events, EVENTS, timeout);
+        now = now_us();
+        for (int i = 0; i < n; i++) {
+            const int index = (int) events[i].data.u32;
+            device_t *d = &devices[index];
+            if (d->state == DEVICE_CONNECTING) {
+                device_connected(w, d, index, now);
+                continue;
+            }
+            if (d->state == DEVICE_OFFLINE) continue;
+            if (events[i].events & EPOLLOUT) {
+                device_flush(w, d, index, now);
+                if (d->state == DEVICE_ONLINE && !d->writing) {
+                    if (outbox_count(&d->outbox, OUTBOX_TELEMETRY) >= batch) device_drain(w, d, index, now);
+                    if (!interval_ms) device_schedule_sample(w, d, index, now);
+                }
+            }
+            if (d->state != DEVICE_OFFLINE && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                device_receive(w, d, index, now);
+            }
+        }
+    }
+
+    w->cpu_ns = cpu_ns() - cpu_start;
+    return NULL;
+}
+
+// === RUN ===
+
+typedef struct {
+    double seconds;
+    uint64_t samples, sent, lost, dropped, bytes, connects, failures;
+    uint64_t downlinks[DOWNLINK_OUTCOMES], downlink_total, acks;
+    double downlink_us;         //!< firmware downlink path CPU per message
+    uint32_t rtt_p50_us, rtt_p99_us, rtt_max_us;
+    double sign_us;             //!< signing CPU per message
+    double late_ms, late_max_ms;
+    double busy[MAX_THREADS];   //!< thread CPU / wall time
+    uint32_t connect_p50_us, connect_p99_us, connect_max_us;
+    broker_stats_t broker;
+} result_t;
+
+static int compare_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void devices_reset(void) {
+    for (int i = 0; i < device_count; i++) {
+        device_t *d = &devices[i];
+        if (d->fd >= 0) close(d->fd);
+        outbox_clear(&d->outbox);
+        d->fd = -1;
+        d->state = DEVICE_OFFLINE;
+        d->writing = d->sampling = false;
+        d->out_len = d->in_len = 0;
+        d->in_flight = 0;
+        d->published_us = 0;
+        d->interval_ms = interval_ms;
+    }
+}
+
+static void run(int threads, int seconds, broker_t *broker, result_t *r) {
+    worker_t *workers = calloc((size_t) threads, sizeof(worker_t));
+    broker_stats_t before;
+    if (broker) broker_stats(broker, &before);
+
+    run_start_us = now_us() + 10000;
+    run_end_us = run_start_us + (uint64_t) seconds * 1000000u;
+    for (int i = 0; i < threads; i++) {
+        workers[i].first = i;
+        workers[i].stride = threads;
+        workers[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+
+    // reconnect storms: the broker drops everybody (an external broker: the devices drop their connections)
+    if (storm_s > 0) {
+        for (uint64_t at = run_start_us + (uint64_t) storm_s * 1000000u; at < run_end_us;
+             at += (uint64_t) storm_s * 1000000u) {
+            const uint64_t now = now_us();
+            if (at > now) usleep((useconds_t) (at - now));
+            if (broker) broker_drop_all(broker);
+            else for (int i = 0; i < device_count; i++) if (devices[i].fd >= 0) shutdown(devices[i].fd, SHUT_RDWR);
+        }
+    }
+
+    memset(r, 0, sizeof(result_t));
+    size_t connect_total = 0;
+    for (int i = 0; i < threads; i++) {
+        worker_t *w = &workers[i];
+        pthread_join(w->thread, NULL);
+        close(w->epoll_fd);
+        r->samples += w->samples;
+        r->sent += w->sent;
+        r->lost += w->lost;
+        r->dropped += w->dropped;
+        for (int o = 0; o < DOWNLINK_OUTCOMES; o++) {
+            r->downlinks[o] += w->downlinks[o];
+            r->downlink_total += w->downlinks[o];
+        }
+        r->downlink_us += w->downlink_ns / 1e3;
+        r->acks += w->acks;
+        r->bytes += w->bytes;
+        r->connects += w->connects;
+        r->failures += w->failures;
+        r->sign_us += w->sign_ns / 1e3;
+        r->late_ms += w->late_us / 1e3;
+        if (w->late_max_us / 1e3 > r->late_max_ms) r->late_max_ms = w->late_max_us / 1e3;
+        r->busy[i] = w->cpu_ns / 1e9 / seconds;
+        connect_total += w->connects;
+    }
+    r->seconds = seconds;
+    r->sign_us = r->sign_us / (r->samples + (mode == PROTOCOL_SESSION ? r->connects : 0) + 1e-9);
+    r->late_ms = r->samples ? r->late_ms / r->samples : 0;
+    r->downlink_us = r->downlink_total ? r->downlink_us / r->downlink_total : 0;
+
+    uint32_t *connect_us = malloc((connect_total + 1) * sizeof(uint32_t));
+    size_t k = 0;
+    for (int i = 0; i < threads; i++) {
+        memcpy(connect_us + k, workers[i].connect_us, workers[i].connects * sizeof(uint32_t));
+        k += workers[i].connects;
+        free(workers[i].connect_us);
+        free(workers[i].timers);
+    }
+    if (k) {
+        qsort(connect_us, k, sizeof(uint32_t), compare_u32);
+        r->connect_p50_us = connect_us[k / 2];
+        r->connect_p99_us = connect_us[k * 99 / 100];
+        r->connect_max_us = connect_us[k - 1];
+    }
+    free(connect_us);
+
+    size_t rtt_total = 0;
+    for (int i = 0; i < threads; i++) rtt_total += workers[i].rtt_count;
+    uint32_t *rtt_us = malloc((rtt_total + 1) * sizeof(uint32_t));
+    k = 0;
+    for (int i = 0; i < threads; i++) {
+        memcpy(rtt_us + k, workers[i].rtt_us, workers[i].rtt_count * sizeof(uint32_t));
+        k += workers[i].rtt_count;
+        free(workers[i].rtt_us);
+    }
+    if (k) {
+        qsort(rtt_us, k, sizeof(uint32_t), compare_u32);
+        r->rtt_p50_us = rtt_us[k / 2];
+        r->rtt_p99_us = rtt_us[k * 99 / 100];
+        r->rtt_max_us = rtt_us[k - 1];
+    }
+    free(rtt_us);
+    free(workers);
+
+    if (broker) {
+        // let the broker catch up with what was sent, then count what it received
+        usleep(200000);
+        broker_stats(broker, &r->broker);
+        uint64_t *after = (uint64_t *) &r->broker;
+        const uint64_t *start = (const uint64_t *) &before;
+        for (size_t i = 0; i < sizeof(broker_stats_t) / sizeof(uint64_t); i++) after[i] -= start[i];
+    }
+    devices_reset();
+}
+
+static void print_result(const result_t *r, int threads, bool in_process) {
+    printf("sent      : %llu messages, %.1f msgs/s, %.1f kB/s\n", (unsigned long long) r->sent,
+           r->sent / r->seconds, r->bytes / r->seconds / 1000);
+    if (in_process) printf("broker    : %llu received\n", (unsigned long long) r->broker.published);
+    printf("outbox    : %llu sampled, %llu dropped (full), %llu lost in flight\n", (unsigned long long) r->samples,
+           (unsigned long long) r->dropped, (unsigned long long) r->lost);
+    printf("connects  : %llu (%llu failed), setup p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           (unsigned long long) r->connects, (unsigned long long) r->failures, r->connect_p50_us / 1e3,
+           r->connect_p99_us / 1e3, r->connect_max_us / 1e3);
+    if (r->downlink_total) {
+        printf("downlinks :");
+        for (int o = 0; o < DOWNLINK_OUTCOMES; o++) {
+            if (r->downlinks[o]) printf(" %llu %s", (unsigned long long) r->downlinks[o], downlink_outcome_names[o]);
+        }
+        printf(", %.1f us CPU each, %llu acked\nround trip: p50 %.1f ms, p99 %.1f ms, max %.1f ms (publish to downlink)\n",
+               r->downlink_us, (unsigned long long) r->acks, r->rtt_p50_us / 1e3, r->rtt_p99_us / 1e3, r->rtt_max_us / 1e3);
+    }
+    printf("signing   : %.1f us CPU per message", r->sign_us);
+    if (interval_ms) printf(", %.2f s CPU per device-day", r->sign_us * (86400000.0 / interval_ms) / 1e6);
+    printf("\nschedule  : %.2f ms late on average, %.1f ms max\n", r->late_ms, r->late_max_ms);
+    printf("threads   :");
+    for (int i = 0; i < threads; i++) printf(" %.0f%%", r->busy[i] * 100);
+    printf(" busy\n");
+    if (interval_ms && r->late_max_ms > interval_ms) printf("the generator can't keep the sample schedule\n");
+}
+
+// === MAIN ===
+
+static bool parse_address(const char *arg, struct sockaddr_in *addr) {
+    char host[256];
+    int port = 1883;
+    if (sscanf(arg, "%255[^:]:%d", host, &port) < 1) return false;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM}, *info;
+    if (getaddrinfo(host, NULL, &hints, &info)) return false;
+    *addr = *(struct sockaddr_in *) info->ai_addr;
+    addr->sin_port = htons((uint16_t) port);
+    freeaddrinfo(info);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), seconds = 10, opt;
+    bool scaling = false;
+    const char *host = NULL, *capture_file = NULL;
+
+    while ((opt = getopt(argc, argv, "n:t:i:j:b:mr:w:d:H:C:f:Ss")) != -1) {
+        switch (opt) {
+            case 'n': device_count = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'i': interval_ms = atoi(optarg); break;
+            case 'j': jitter_ms = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'm': merkle = true; break;
+            case 'r': storm_s = atoi(optarg); break;
+            case 'w': backoff_ms = atoi(optarg); break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'H': host = optarg; break;
+            case 'C': capture_file = optarg; break;
+            case 'f':
+                if (!trace_load(optarg)) {
+                    fprintf(stderr, "loadgen: can't load trace %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'S': mode = PROTOCOL_SESSION; break;
+            case 's': scaling = true; break;
+            default:
+                fprintf(stderr, "usage: %s [options]\n"
+                                "  -n <devices>   virtual devices (default 100)\n"
+                                "  -t <threads>   worker threads (default: all cores)\n"
+                                "  -i <ms>        sample interval per device, 0 = as fast as possible (default 1000)\n"
+                                "  -j <ms>        interval jitter, +/- (default 0)\n"
+                                "  -b <count>     batch mode: drain the outbox at this many messages (default 1, up to the\n"
+                                "                 telemetry capacity of the firmware outbox)\n"
+                                "  -m             batch signing: one signature per drained window of telemetry\n"
+                                "  -r <seconds>   reconnect storm period (default none)\n"
+                                "  -w <ms>        random connect backoff, also spreads the first connect (default 0)\n"
+                                "  -d <seconds>   duration (default 10)\n"
+                                "  -H <host:port> external broker instead of the local stand-in\n"
+                                "  -C <file>      capture the traffic of the broker stand-in (see replay)\n"
+                                "  -f <file>      sensor trace, seconds,temperature,pressure,humidity\n"
+                                "  -S             session mode\n"
+                                "  -s             scaling: as fast as possible for 1, 2, 4 .. threads\n", argv[0]);
+                return 1;
+        }
+    }
+    if (device_count < 1 || threads < 1 || threads > MAX_THREADS || seconds < 1 || batch < 1 ||
+        batch > outbox_capacity(OUTBOX_TELEMETRY) || interval_ms < 0 || jitter_ms < 0 || backoff_ms < 0) {
+        fprintf(stderr, "loadgen: invalid arguments\n");
+        return 1;
+    }
+    if (capture_file && host) {
+        fprintf(stderr, "loadgen: -C captures on the broker stand-in, not with -H\n");
+        return 1;
+    }
+    if (scaling) interval_ms = 0;
+
+    // two descriptors per device with the local broker
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if ((rlim_t) device_count * (host ? 1 : 2) + 64 > limit.rlim_cur) {
+        fprintf(stderr, "loadgen: %d devices need more file descriptors than %llu\n", device_count,
+                (unsigned long long) limit.rlim_cur);
+        return 1;
+    }
+
+    broker_t *broker = NULL;
+    capture_t *capture = NULL;
+    if (host) {
+        if (!parse_address(host, &broker_addr)) {
+            fprintf(stderr, "loadgen: can't resolve %s\n", host);
+            return 1;
+        }
+    } else {
+        broker = broker_start(NULL, 0, false);
+        if (!broker) {
+            fprintf(stderr, "loadgen: can't start the broker stand-in\n");
+            return 1;
+        }
+        if (capture_file) {
+            capture = capture_open(capture_file);
+            if (!capture) {
+                fprintf(stderr, "loadgen: can't create %s\n", capture_file);
+                return 1;
+            }
+            broker_capture(broker, capture);
+        }
+        broker_addr.sin_family = AF_INET;
+        broker_addr.sin_port = htons(broker_port(broker));
+        broker_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    settings_init();
+    if (!uc_init() || !devices_create()) {
+        fprintf(stderr, "loadgen: can't create the device keys\n");
+        return 1;
+    }
+    printf("%d devices, interval %d +/- %d ms, batch %d, %s mode, broker %s\n", device_count, interval_ms,
+           jitter_ms, batch, mode == PROTOCOL_SESSION ? "session" : "full", host ? host : "stand-in");
+
+    result_t r;
+    if (!scaling) {
+        printf("%d threads, %d s%s\n", threads, seconds, storm_s ? ", reconnect storms" : "");
+        run(threads, seconds, broker, &r);
+        print_result(&r, threads, broker != NULL);
+    } else {
+        // where the generator stops scaling with the cores
+        printf("threads      msgs/s  speedup  efficiency  sign us/msg  busy\n");
+        double base = 0;
+        int saturated = 0;
+        for (int t = 1; t <= threads; t = t < threads && t * 2 > threads ? threads : t * 2) {
+            run(t, seconds, broker, &r);
+            const double rate = r.sent / r.seconds;
+            double busy = 0;
+            for (int i = 0; i < t; i++) busy += r.busy[i];
+            if (t == 1) base = rate;
+            printf("%7d  %10.1f  %7.2f  %9.0f%%  %11.1f  %3.0f%%\n", t, rate, rate / base, rate / base / t * 100,
+                   r.sign_us, busy / t * 100);
+            fflush(stdout);
+            if (!saturated && rate / base / t < 0.75) saturated = t;
+            if (t == threads) break;
+        }
+        if (saturated) printf("the generator saturates at %d threads (efficiency below 75%%)\n", saturated);
+        else printf("the generator scales to %d threads\n", threads);
+    }
+
+    if (broker) broker_stop(broker);
+    if (capture) {
+        const uint64_t records = capture_records(capture);
+        if (!capture_close(capture)) {
+            fprintf(stderr, "loadgen: writing %s failed\n", capture_file);
+            return 1;
+        }
+        printf("%llu messages captured to %s\n", (unsigned long long) records, capture_file);
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*!
+ * @file
+ * @brief Stress test of the log ring buffer with concurrent producers.
+ *
+ * Producer threads log records of varying size through log_printf() while
+ * a single consumer thread runs log_flush(), as the log thread does on the
+ * device. The output is written to a temporary file and checked afterwards:
+ * every line must be a record exactly as it was logged, the records of each
+ * producer must appear in order, and the records that were logged plus the
+ * records that were dropped (log_dropped()) must add up to the records that
+ * were produced. Exits with 1 on any mismatch.
+ *
+ * log_commit() takes the timestamp between reserving a record and committing
+ * it, so the uptime_ms() of this test yields there now and then: the consumer
+ * then finds reserved records on top of the stale bytes of consumed ones.
+ *
+ * @date 2017-04-29
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+#include "uptime.h"
+
+#define MAX_PRODUCERS 16
+
+// record: producer, sequence, fill length, then the fill, which starts at an offset that depends on the sequence
+#define RECORD_FORMAT "%02u %07u %03u %.*s\n"
+#define RECORD_PREFIX 15
+// log_printf() keeps at most LOG_MAX_RECORD - 1 characters
+#define MAX_FILL      (LOG_MAX_RECORD - 1 - RECORD_PREFIX - 1)
+
+static char fill[26 + MAX_FILL];
+
+static unsigned int producers = 4;
+static unsigned int records = 200000;
+static volatile int producing;
+
+// instead of compat/uptime.c
+uint32_t uptime_ms(void) {
+    static volatile uint32_t calls = 0;
+    const uint32_t n = __sync_add_and_fetch(&calls, 1);
+    if (n % 8 == 0) sched_yield();
+    // the timestamp bytes contain the committed and padding states, too
+    return n % 2 ? 0x01020102u : 0x02010201u;
+}
+
+void uptime_add_ms(uint32_t ms) {
+    (void) ms;
+}
+
+static unsigned int fill_len(unsigned int producer, unsigned int seq) {
+    // a cheap hash, so neighbouring records differ in size
+    const uint32_t h = (seq + 1) * 2654435761u ^ producer * 40503u;
+    return (h >> 8) % (MAX_FILL + 1);
+}
+
+static void *produce(void *arg) {
+    const unsigned int producer = (unsigned int) (uintptr_t) arg;
+    for (unsigned int seq = 0; seq < records; seq++) {
+        const unsigned int len = fill_len(producer, seq);
+        log_printf(LOG_LEVEL_ERROR, RECORD_FORMAT, producer, seq, len, (int) len, fill + seq % 26);
+        if (seq % 64 == 0) sched_yield();
+    }
+    __sync_fetch_and_sub(&producing, 1);
+    return NULL;
+}
+
+static void *consume(void *arg) {
+    (void) arg;
+    while (producing || log_pending()) {
+        log_flush();
+        sched_yield();
+    }
+    return NULL;
+}
+
+// check one output line, updates the expected sequence of its producer
+static bool check_line(const char *line, unsigned int *next) {
+    unsigned int producer, seq, len;
+    int n = 0;
+    if (sscanf(line, "%2u %7u %3u%n", &producer, &seq, &len, &n) != 3 || n != RECORD_PREFIX - 1) return false;
+    if (line[n++] != ' ') return false;
+    if (producer >= producers || seq >= records || seq < next[producer]) return false;
+    if (len != fill_len(producer, seq) || strlen(line + n) != len + 1) return false;
+    if (memcmp(line + n, fill + seq % 26, len) != 0 || line[n + len] != '\n') return false;
+    next[producer] = seq + 1;
+    return true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-p producers] [-n records per producer]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:")) != -1) {
+        switch (opt) {
+            case 'p':
+                producers = (unsigned int) atoi(optarg);
+                break;
+            case 'n':
+                records = (unsigned int) atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (producers < 1 || producers > MAX_PRODUCERS || records < 1 || records > 9999999) usage(argv[0]);
+
+    // the fill contains the committed and padding states, a stale body must not be taken for a record header
+    for (size_t i = 0; i < sizeof(fill); i++) fill[i] = (char) (i % 13 == 0 ? 1 + i % 2 : 'a' + i % 26);
+
+    char path[] = "/tmp/logstress-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0 || !freopen(path, "w", stdout)) {
+        perror(path);
+        return 1;
+    }
+    close(fd);
+
+    pthread_t consumer, threads[MAX_PRODUCERS];
+    producing = (int) producers;
+    pthread_create(&consumer, NULL, consume, NULL);
+    for (unsigned int i = 0; i < producers; i++) pthread_create(&threads[i], NULL, produce, (void *) (uintptr_t) i);
+    for (unsigned int i = 0; i < producers; i++) pthread_join(threads[i], NULL);
+    pthread_join(consumer, NULL);
+    fclose(stdout);
+
+    FILE *out = fopen(path, "r");
+    unlink(path);
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+
+    unsigned int next[MAX_PRODUCERS] = {0};
+    unsigned long logged = 0, corrupt = 0;
+    char line[LOG_MAX_RECORD * 2];
+    while (fgets(line, sizeof(line), out)) {
+        if (check_line(line, next)) logged++;
+        else if (corrupt++ < 5) fprintf(stderr, "corrupt record: %.*s\n", (int) strcspn(line, "\n"), line);
+    }
+    fclose(out);
+
+    const unsigned long produced = (unsigned long) producers * records, dropped = log_dropped();
+    fprintf(stderr, "%lu records from %u producers: %lu logged, %lu dropped, %lu corrupt\n",
+            produced, producers, logged, dropped, corrupt);
+    if (corrupt || logged + dropped != produced) {
+        fprintf(stderr, "FAILED\n");
+        return 1;
+    }
+    return 0;
+}
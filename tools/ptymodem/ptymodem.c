@@ -0,0 +1,427 @@
+/*!
+ * @file
+ * @brief Modem UART stand-in on a pseudo terminal, for the DMA receive ring.
+ *
+ * Runs the receive ring of the modem UART (rxring.c) against a pseudo
+ * terminal instead of the LPUART and eDMA of the board:
+ *
+ *   - an emulated modem writes bursts (a downlink frame and its AT framing)
+ *     to the master side at the line rate of the baud rate
+ *   - a DMA thread reads the slave side into the ring buffer, in place and
+ *     circular like the eDMA channel, and raises the half and full transfer
+ *     "interrupts" at the half and the end of the buffer and the idle line
+ *     "interrupt" after the configured idle characters without a byte
+ *   - a parser thread wakes up on these, takes whole chunks and checks every
+ *     byte against the modem's byte stream
+ *
+ * Reports the wake-ups against the interrupt per byte of the interrupt
+ * driven receive, the bytes per wake-up, the time from the end of a burst
+ * to the parser, overruns (with -c slowing the parser down) and corrupt
+ * bytes. With -D the ring reads a serial device or another pseudo terminal
+ * instead of the emulated modem, -v prints the chunks.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "rxring.h"
+
+#define BURSTS_SIZE 4096        //!< burst ends in flight between the modem and the parser (power of 2)
+#define SEED 0x2545f491u
+
+// === CONFIGURATION ===
+
+static int baud = 115200;
+static uint32_t ring_size = 2048;
+static int idle_chars = 4;
+static int burst_max = 600;     //!< bytes, a downlink frame and the AT framing around it
+static int gap_ms = 20;         //!< mean gap between bursts
+static int work_us = 0;         //!< parser time per chunk
+static bool verbose = false;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+static void sleep_until_us(uint64_t due) {
+    const struct timespec ts = {.tv_sec = (time_t) (due / 1000000u), .tv_nsec = (long) (due % 1000000u) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+// the byte stream of the modem, the parser runs the same generator to check it
+static uint8_t stream_next(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (uint8_t) x;
+}
+
+// 10 bit times per character (start, 8 data, stop)
+static uint64_t chars_us(uint64_t chars) {
+    return chars * 10 * 1000000u / (uint64_t) baud;
+}
+
+// === MODEM ===
+
+static int master_fd = -1;
+static int stop_modem = 0;
+
+//! the end of a burst, for the delivery time
+typedef struct {
+    uint64_t bytes;             //!< written up to the end of the burst
+    uint64_t us;
+} burst_t;
+
+static burst_t bursts[BURSTS_SIZE];
+static volatile uint32_t bursts_written = 0;
+
+static bool write_all(int fd, const uint8_t *data, size_t len) {
+    while (len) {
+        const ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+// bursts at the line rate, in slices of half the idle time so the line does not look idle within a burst
+static void *modem_thread(void *arg) {
+    (void) arg;
+    uint32_t state = SEED;
+    uint64_t written = 0;
+    const size_t slice = idle_chars > 1 ? (size_t) idle_chars / 2 : 1;
+    uint8_t *burst = malloc((size_t) burst_max);
+
+    while (!__atomic_load_n(&stop_modem, __ATOMIC_ACQUIRE)) {
+        const size_t len = 1 + (size_t) (rand() % burst_max);
+        for (size_t i = 0; i < len; i++) burst[i] = stream_next(&state);
+
+        uint64_t due = now_us();
+        for (size_t i = 0; i < len; i += slice) {
+            const size_t n = len - i < slice ? len - i : slice;
+            sleep_until_us(due);
+            if (!write_all(master_fd, burst + i, n)) {
+                free(burst);
+                return NULL;
+            }
+            due += chars_us(n);
+        }
+        sleep_until_us(due);
+        written += len;
+
+        const uint32_t index = bursts_written;
+        bursts[index & (BURSTS_SIZE - 1)] = (burst_t) {written, due};
+        __atomic_store_n(&bursts_written, index + 1, __ATOMIC_RELEASE);
+
+        // exponential gaps around the mean
+        const double u = (rand() + 1.0) / ((double) RAND_MAX + 2.0);
+        sleep_until_us(due + (uint64_t) (-gap_ms * 1000.0 * log(u)));
+    }
+    free(burst);
+    return NULL;
+}
+
+// === DMA ===
+
+static int line_fd = -1;
+static uint8_t *buffer = NULL;
+static rxring_t ring;
+static sem_t received;
+static int stop_dma = 0;
+
+static struct {
+    uint64_t idle, transfer;    //!< idle line and half / full transfer interrupts
+} irqs;
+
+static void dma_interrupt(uint32_t offset) {
+    // the remaining count of the major loop, reloaded to the size at its end
+    if (rxring_dma_update(&ring, ring_size - offset)) sem_post(&received);
+}
+
+// reads the line into the buffer like the eDMA channel: in place, circular, interrupts at half and full
+static void *dma_thread(void *arg) {
+    (void) arg;
+    const uint64_t idle_ns = chars_us((uint64_t) idle_chars) * 1000u;
+    uint32_t offset = 0;
+    bool pending = false;       //!< bytes since the last idle line
+
+    while (!__atomic_load_n(&stop_dma, __ATOMIC_ACQUIRE)) {
+        const uint64_t wait_ns = pending ? idle_ns : 100000000u;
+        const struct timespec timeout = {.tv_sec = (time_t) (wait_ns / 1000000000u),
+                                         .tv_nsec = (long) (wait_ns % 1000000000u)};
+        struct pollfd pfd = {.fd = line_fd, .events = POLLIN};
+        const int ready = ppoll(&pfd, 1, &timeout, NULL);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready == 0) {
+            if (pending) {
+                irqs.idle++;
+                dma_interrupt(offset);
+                pending = false;
+            }
+            continue;
+        }
+        if (ready < 0 || !(pfd.revents & POLLIN)) {
+            if (pfd.revents & (POLLHUP | POLLERR)) usleep(1000);
+            continue;
+        }
+
+        // at most up to the next half of the buffer, where the DMA raises an interrupt
+        const uint32_t boundary = offset < ring_size / 2 ? ring_size / 2 : ring_size;
+        const ssize_t n = read(line_fd, buffer + offset, boundary - offset);
+        if (n <= 0) continue;
+        offset += (uint32_t) n;
+        pending = true;
+        if (offset == boundary) {
+            offset &= ring_size - 1;
+            irqs.transfer++;
+            dma_interrupt(offset);
+        }
+    }
+    if (pending) dma_interrupt(offset);
+    return NULL;
+}
+
+// === PARSER ===
+
+static struct {
+    uint64_t wakeups, chunks, bytes, corrupt;
+    uint64_t delivery_us, delivery_max_us, delivered;
+} parser;
+
+static void print_chunk(const uint8_t *chunk, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t c = chunk[i];
+        if (c == '\r') fputs("\\r", stdout);
+        else if (c == '\n') fputs("\\n\n", stdout);
+        else if (c >= 0x20 && c < 0x7f) putchar(c);
+        else printf("\\x%02x", c);
+    }
+    printf(" [%zu]\n", len);
+}
+
+static void *parser_thread(void *arg) {
+    const bool check = arg != NULL;
+    uint32_t state = SEED, overruns = 0, burst = 0;
+
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100000000;
+        if (deadline.tv_nsec >= 1000000000) deadline.tv_sec++, deadline.tv_nsec -= 1000000000;
+        if (sem_timedwait(&received, &deadline)) {
+            if (__atomic_load_n(&stop_dma, __ATOMIC_ACQUIRE) && !rxring_available(&ring)) break;
+            continue;
+        }
+        parser.wakeups++;
+
+        for (;;) {
+            const uint8_t *chunk;
+            const size_t len = rxring_peek(&ring, &chunk);
+            // the bytes the DMA overwrote are skipped in the stream as well
+            for (; overruns != ring.overruns; overruns++) stream_next(&state);
+            if (!len) break;
+
+            uint32_t next = state;
+            uint64_t corrupt = 0;
+            if (check) for (size_t i = 0; i < len; i++) corrupt += chunk[i] != stream_next(&next);
+            if (verbose) print_chunk(chunk, len);
+            if (work_us) usleep((useconds_t) work_us);
+            if (!rxring_consume(&ring, len)) continue;
+            state = next;
+            parser.chunks++;
+            parser.bytes += len;
+            parser.corrupt += corrupt;
+        }
+
+        // bursts that are complete now
+        const uint64_t now = now_us(), seen = parser.bytes + ring.overruns;
+        while (burst != __atomic_load_n(&bursts_written, __ATOMIC_ACQUIRE) &&
+               bursts[burst & (BURSTS_SIZE - 1)].bytes <= seen) {
+            const uint64_t us = now - bursts[burst & (BURSTS_SIZE - 1)].us;
+            parser.delivery_us += us;
+            if (us > parser.delivery_max_us) parser.delivery_max_us = us;
+            parser.delivered++;
+            burst++;
+        }
+    }
+    return NULL;
+}
+
+// === MAIN ===
+
+static speed_t baud_speed(int rate) {
+    switch (rate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B0;
+    }
+}
+
+static bool make_raw(int fd, int rate) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio)) return false;
+    cfmakeraw(&tio);
+    if (rate && (cfsetispeed(&tio, baud_speed(rate)) || cfsetospeed(&tio, baud_speed(rate)))) return false;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int main(int argc, char **argv) {
+    int seconds = 5, opt;
+    const char *device = NULL;
+
+    while ((opt = getopt(argc, argv, "b:r:i:s:g:c:d:D:v")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            case 'r': ring_size = (uint32_t) atoi(optarg); break;
+            case 'i': idle_chars = atoi(optarg); break;
+            case 's': burst_max = atoi(optarg); break;
+            case 'g': gap_ms = atoi(optarg); break;
+            case 'c': work_us = atoi(optarg); break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'D': device = optarg; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [options]\n"
+                                "  -b <baud>      line rate (default 115200)\n"
+                                "  -r <bytes>     receive ring size, a power of 2 (default 2048)\n"
+                                "  -i <chars>     idle characters before the idle line interrupt (default 4)\n"
+                                "  -s <bytes>     largest burst of the emulated modem (default 600)\n"
+                                "  -g <ms>        mean gap between bursts (default 20)\n"
+                                "  -c <us>        parser time per chunk (default 0)\n"
+                                "  -d <seconds>   duration (default 5, 0 with -D: until interrupted)\n"
+                                "  -D <device>    read a serial device or pseudo terminal instead of the emulated modem\n"
+                                "  -v             print the chunks\n", argv[0]);
+                return 1;
+        }
+    }
+    if (baud <= 0 || ring_size < 16 || (ring_size & (ring_size - 1)) || idle_chars < 1 || idle_chars > 128 ||
+        burst_max < 1 || gap_ms < 0 || work_us < 0 || seconds < 0 || (!device && !seconds) ||
+        (device && !baud_speed(baud))) {
+        fprintf(stderr, "ptymodem: invalid arguments\n");
+        return 1;
+    }
+
+    char name[64];
+    if (device) {
+        line_fd = open(device, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (line_fd < 0 || !make_raw(line_fd, baud)) {
+            perror(device);
+            return 1;
+        }
+        snprintf(name, sizeof(name), "%s", device);
+    } else {
+        master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (master_fd < 0 || grantpt(master_fd) || unlockpt(master_fd) || ptsname_r(master_fd, name, sizeof(name))) {
+            perror("ptymodem: pseudo terminal");
+            return 1;
+        }
+        line_fd = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (line_fd < 0 || !make_raw(line_fd, 0)) {
+            perror(name);
+            return 1;
+        }
+    }
+    buffer = malloc(ring_size);
+    rxring_init(&ring, buffer, ring_size);
+    sem_init(&received, 0, 0);
+    printf("%s, %d baud, ring %u B, idle line after %d chars (%llu us)%s\n", name, baud, (unsigned) ring_size,
+           idle_chars, (unsigned long long) chars_us((uint64_t) idle_chars), device ? "" : ", emulated modem");
+    fflush(stdout);
+
+    struct sigaction action = {.sa_handler = stop};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    pthread_t modem, dma, reader;
+    const uint64_t start = now_us();
+    pthread_create(&dma, NULL, dma_thread, NULL);
+    pthread_create(&reader, NULL, parser_thread, device ? NULL : (void *) 1);
+    if (!device) pthread_create(&modem, NULL, modem_thread, NULL);
+
+    const uint64_t end = seconds ? start + (uint64_t) seconds * 1000000u : UINT64_MAX;
+    while (running && now_us() < end) usleep(10000);
+    if (!device) {
+        __atomic_store_n(&stop_modem, 1, __ATOMIC_RELEASE);
+        pthread_join(modem, NULL);
+        // the last burst reaches the parser after the idle time
+        usleep((useconds_t) (chars_us((uint64_t) idle_chars) + 50000));
+    }
+    __atomic_store_n(&stop_dma, 1, __ATOMIC_RELEASE);
+    pthread_join(dma, NULL);
+    sem_post(&received);
+    pthread_join(reader, NULL);
+    const double elapsed = (now_us() - start) / 1e6;
+
+    printf("received : %llu B in %.1f s, %.1f kB/s", (unsigned long long) parser.bytes, elapsed,
+           parser.bytes / elapsed / 1e3);
+    if (!device) printf(", %llu bursts", (unsigned long long) bursts_written);
+    printf("\n");
+    printf("wake-ups : %llu (%llu idle line, %llu half/full), %.1f B per wake-up, %llu chunks; "
+           "%llu interrupts per byte before\n", (unsigned long long) parser.wakeups, (unsigned long long) irqs.idle,
+           (unsigned long long) irqs.transfer, parser.wakeups ? (double) parser.bytes / parser.wakeups : 0,
+           (unsigned long long) parser.chunks, (unsigned long long) parser.bytes);
+    if (parser.delivered) {
+        printf("delivery : burst end to parser %.2f ms avg, %.2f ms max\n",
+               (double) parser.delivery_us / parser.delivered / 1e3, parser.delivery_max_us / 1e3);
+    }
+    printf("errors   : %llu bytes overrun, %llu corrupt\n", (unsigned long long) ring.overruns,
+           (unsigned long long) parser.corrupt);
+
+    close(line_fd);
+    if (master_fd >= 0) close(master_fd);
+    sem_destroy(&received);
+    free(buffer);
+    return parser.corrupt ? 1 : 0;
+}
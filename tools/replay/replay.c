@@ -0,0 +1,555 @@
+/*!
+ * @file
+ * @brief Replay a capture of MQTT traffic through the firmware and backend paths.
+ *
+ * Maps a capture (capture/capture.h, written by mqtt-broker, loadgen and
+ * responder with -C) and feeds its records, without copying them, through
+ *
+ *   - downlink: the firmware downlink path, process_response(), the
+ *     signature check and process_payload(), for the `.../out` records
+ *   - verify: the device message verification of the responder, full and
+ *     session mode and batch signed windows, for the device records
+ *   - publish: an MQTT connection, every record republished on its topic to
+ *     the broker stand-in or an external broker (-H)
+ *
+ * either as fast as possible or with the original timing of the capture (-T),
+ * scaled with -x. Reports the throughput and the outcomes per path, so a
+ * change of one of the paths can be measured and checked against recorded
+ * traffic instead of a live run.
+ *
+ * @date 2017-04-28
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "broker.h"
+#include "capture.h"
+#include "crypto/crypto.h"
+#include "downlink.h"
+#include "jsmn/jsmn.h"
+#include "mqtt.h"
+#include "protocol.h"
+#include "sensor.h"
+
+#define MAX_TOKENS 128
+#define DEVICES_SIZE 65536      //!< device table (power of 2)
+
+//! the paths a record can be fed through
+enum {
+    PATH_DOWNLINK = 1,
+    PATH_VERIFY = 2,
+    PATH_PUBLISH = 4
+};
+
+//! outcomes of the verify path
+typedef enum {
+    VERIFY_OK = 0,
+    VERIFY_REJECTED,        //!< bad signature
+    VERIFY_UNKNOWN,         //!< session not announced
+    VERIFY_MALFORMED,
+    VERIFY_OUTCOMES
+} verify_outcome_t;
+
+static const char *const verify_outcome_names[VERIFY_OUTCOMES] = {
+        "verified", "bad signature", "unknown session", "malformed"
+};
+
+static struct {
+    uint64_t records, bytes;
+    uint64_t skipped;                       //!< records no selected path takes
+    uint64_t downlink, downlink_us, downlink_outcomes[DOWNLINK_OUTCOMES];
+    uint64_t verify, verify_us, verify_outcomes[VERIFY_OUTCOMES];
+    uint64_t published;
+    uint64_t late_us, late_max_us;          //!< behind the original timing
+} stats;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+// === VERIFY ===
+
+//! the state the backend keeps per device
+typedef struct {
+    char uuid[37];
+    char key[PROTOCOL_KEY_LENGTH + 1];      //!< the last key the device sent
+    bool valid;                             //!< key imported
+    uc_ed25519_key pub;
+    char sid[PROTOCOL_SID_LENGTH + 1];      //!< the announced session
+    bool root_valid;                        //!< the last batch signed window verified with the key
+    unsigned char root[MERKLE_HASH_SIZE];
+    unsigned char root_signature[ED25519_SIG_SIZE];
+} device_t;
+
+static device_t *devices = NULL;
+
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t) s[i]) * 16777619u;
+    return h;
+}
+
+static device_t *device_find(const char *uuid, size_t len) {
+    if (len == 0 || len >= sizeof(devices[0].uuid)) return NULL;
+    for (uint32_t i = 0, h = hash(uuid, len); i < DEVICES_SIZE; i++) {
+        device_t *d = &devices[(h + i) & (DEVICES_SIZE - 1)];
+        if (!d->uuid[0]) {
+            memcpy(d->uuid, uuid, len);
+            return d;
+        }
+        if (strlen(d->uuid) == len && strncmp(d->uuid, uuid, len) == 0) return d;
+    }
+    return NULL;
+}
+
+// forget all devices, every loop starts with the backend state of the capture start
+static void devices_reset(void) {
+    for (size_t i = 0; i < DEVICES_SIZE; i++) if (devices[i].valid) wc_ed25519_free(&devices[i].pub);
+    memset(devices, 0, DEVICES_SIZE * sizeof(device_t));
+}
+
+static bool token_is(const char *json, const jsmntok_t *token, const char *s) {
+    const size_t n = strlen(s);
+    return token->type == JSMN_STRING && (size_t) (token->end - token->start) == n &&
+           strncmp(json + token->start, s, n) == 0;
+}
+
+// a non-negative integer that fits 32 bit
+static bool token_uint(const char *json, const jsmntok_t *token, uint32_t *value) {
+    const int len = token->end - token->start;
+    if (token->type != JSMN_PRIMITIVE || len <= 0 || len > 10) return false;
+    uint64_t v = 0;
+    for (int i = 0; i < len; i++) {
+        const char c = json[token->start + i];
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (uint64_t) (c - '0');
+    }
+    if (v > UINT32_MAX) return false;
+    *value = (uint32_t) v;
+    return true;
+}
+
+// verify a device message as the responder does: full mode with the key it carries, session mode with
+// the announced key, a batch signed message against the root of its inclusion proof (once per window)
+static verify_outcome_t device_verify(device_t *d, const char *json, size_t len) {
+    jsmntok_t tokens[MAX_TOKENS], key = {0}, sid = {0}, signature = {0}, payload = {0};
+    jsmntok_t index = {0}, count = {0}, proof = {0};
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    const int n = jsmn_parse(&parser, json, len, tokens, MAX_TOKENS);
+    if (n < 1 || tokens[0].type != JSMN_OBJECT) return VERIFY_MALFORMED;
+    for (int i = 1; i + 1 < n;) {
+        const jsmntok_t *name = &tokens[i], *value = &tokens[i + 1];
+        if (token_is(json, name, P_KEY) && value->type == JSMN_STRING) key = *value;
+        else if (token_is(json, name, "sid") && value->type == JSMN_STRING) sid = *value;
+        else if (token_is(json, name, P_SIGNATURE) && value->type == JSMN_STRING) signature = *value;
+        else if (token_is(json, name, P_PAYLOAD) && value->type == JSMN_OBJECT) payload = *value;
+        else if (token_is(json, name, "i")) index = *value;
+        else if (token_is(json, name, "n")) count = *value;
+        else if (token_is(json, name, "m") && value->type == JSMN_ARRAY) proof = *value;
+        i += 2;
+        while (i < n && tokens[i].start < value->end) i++;
+    }
+    if (!signature.end || !payload.end || (!key.end && !sid.end)) return VERIFY_MALFORMED;
+
+    if (key.end) {
+        const size_t key_len = (size_t) (key.end - key.start);
+        if (key_len != PROTOCOL_KEY_LENGTH) return VERIFY_MALFORMED;
+        if (strncmp(d->key, json + key.start, key_len) != 0) {
+            unsigned char raw[ED25519_PUB_KEY_SIZE + 1];
+            size_t raw_len = ED25519_PUB_KEY_SIZE;
+            if (d->valid) wc_ed25519_free(&d->pub);
+            memcpy(d->key, json + key.start, key_len);
+            d->root_valid = false;
+            d->valid = uc_base64_decode(d->key, key_len, raw, &raw_len) && raw_len == ED25519_PUB_KEY_SIZE &&
+                       uc_import_ecc_pub_key(&d->pub, raw, raw_len);
+        }
+    } else if ((size_t) (sid.end - sid.start) != PROTOCOL_SID_LENGTH ||
+               strncmp(d->sid, json + sid.start, PROTOCOL_SID_LENGTH) != 0) {
+        return VERIFY_UNKNOWN;
+    }
+    if (!d->valid) return VERIFY_MALFORMED;
+
+    unsigned char raw_signature[ED25519_SIG_SIZE + 1];
+    size_t signature_len = ED25519_SIG_SIZE;
+    if (!uc_base64_decode(json + signature.start, (size_t) (signature.end - signature.start), raw_signature,
+                          &signature_len) || signature_len != ED25519_SIG_SIZE) {
+        return VERIFY_MALFORMED;
+    }
+    const unsigned char *signed_data = (const unsigned char *) json + payload.start;
+    size_t signed_len = (size_t) (payload.end - payload.start);
+    unsigned char root[MERKLE_HASH_SIZE];
+    if (index.end || count.end || proof.end) {
+        uint32_t i, n;
+        if (!token_uint(json, &index, &i) || !token_uint(json, &count, &n) || !proof.end ||
+            !protocol_batch_root(json + payload.start, signed_len, i, n, json + proof.start,
+                                 (size_t) (proof.end - proof.start), root)) {
+            return VERIFY_MALFORMED;
+        }
+        signed_data = root;
+        signed_len = MERKLE_HASH_SIZE;
+    }
+    const bool known_root = signed_data == root && d->root_valid && memcmp(d->root, root, MERKLE_HASH_SIZE) == 0 &&
+                            memcmp(d->root_signature, raw_signature, ED25519_SIG_SIZE) == 0;
+    if (!known_root) {
+        if (!uc_ecc_verify(&d->pub, signed_data, signed_len, raw_signature, signature_len)) return VERIFY_REJECTED;
+        if (signed_data == root) {
+            memcpy(d->root, root, MERKLE_HASH_SIZE);
+            memcpy(d->root_signature, raw_signature, ED25519_SIG_SIZE);
+            d->root_valid = true;
+        }
+    }
+
+    // an identity message announces the session of the following messages
+    const char *end = json + payload.end;
+    const char *announced = memmem(json + payload.start, (size_t) (payload.end - payload.start), "\"sid\":\"", 7);
+    if (key.end && announced && announced + 7 + PROTOCOL_SID_LENGTH <= end &&
+        memmem(json + payload.start, (size_t) (payload.end - payload.start), "\"y\":\"i\"", 7)) {
+        memcpy(d->sid, announced + 7, PROTOCOL_SID_LENGTH);
+    }
+    return VERIFY_OK;
+}
+
+static void replay_verify(const capture_record_t *r) {
+    const size_t prefix = strlen(PROTOCOL_TOPIC_PREFIX);
+    if (r->topic_len <= prefix + 1 || strncmp(r->topic, PROTOCOL_TOPIC_PREFIX, prefix) != 0) {
+        stats.skipped++;
+        return;
+    }
+    const uint64_t start = now_us();
+    device_t *d = device_find(r->topic + prefix, r->topic_len - prefix - 1);
+    const verify_outcome_t outcome = d ? device_verify(d, (const char *) r->payload, r->len) : VERIFY_MALFORMED;
+    stats.verify_us += now_us() - start;
+    stats.verify_outcomes[outcome]++;
+    stats.verify++;
+}
+
+// === DOWNLINK ===
+
+static char *message = NULL;
+static size_t message_cap = 0;
+
+static void replay_downlink(const capture_record_t *r) {
+    // process_response() works in place on a 0 terminated message, as on the device
+    if (r->len + 1 > message_cap) {
+        message_cap = r->len + 1;
+        message = realloc(message, message_cap);
+    }
+    memcpy(message, r->payload, r->len);
+    message[r->len] = '\0';
+
+    const uint64_t start = now_us();
+    settings_update_t update;
+    uint32_t request;
+    const downlink_outcome_t outcome = downlink_process(message, &update, &request);
+    stats.downlink_us += now_us() - start;
+    stats.downlink_outcomes[outcome]++;
+    stats.downlink++;
+}
+
+// === PUBLISH ===
+
+static int broker_fd = -1;
+static uint8_t *out = NULL;
+static size_t out_len = 0, out_cap = 0;
+
+static bool send_all(const uint8_t *data, size_t len) {
+    while (len) {
+        const ssize_t n = send(broker_fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+// publishes are collected and sent in chunks, unless the original timing is kept
+static bool flush_out(void) {
+    const bool sent = send_all(out, out_len);
+    out_len = 0;
+    return sent;
+}
+
+static bool replay_publish(const capture_record_t *r, bool timed) {
+    const size_t need = MQTT_HEADER_MAX + 2 + r->topic_len + r->len;
+    if (out_len + need > out_cap) {
+        if (out_len && !flush_out()) return false;
+        if (need > out_cap) out = realloc(out, out_cap = need < 65536 ? 65536 : need);
+    }
+    // mqtt_publish() takes a 0 terminated topic
+    char topic[256];
+    if (r->topic_len >= sizeof(topic)) {
+        stats.skipped++;
+        return true;
+    }
+    memcpy(topic, r->topic, r->topic_len);
+    topic[r->topic_len] = '\0';
+
+    const size_t len = mqtt_publish(out + out_len, out_cap - out_len, topic, r->payload, r->len, 0, 0);
+    if (!len) {
+        stats.skipped++;
+        return true;
+    }
+    out_len += len;
+    const bool sent = !timed || flush_out();
+    if (sent) stats.published++;
+    return sent;
+}
+
+static bool parse_address(const char *arg, struct sockaddr_in *addr) {
+    char host[256];
+    int port = 1883;
+    if (sscanf(arg, "%255[^:]:%d", host, &port) < 1) return false;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM}, *info;
+    if (getaddrinfo(host, NULL, &hints, &info)) return false;
+    *addr = *(struct sockaddr_in *) info->ai_addr;
+    addr->sin_port = htons((uint16_t) port);
+    freeaddrinfo(info);
+    return true;
+}
+
+static bool broker_connect(const struct sockaddr_in *addr) {
+    broker_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    if (broker_fd < 0 || connect(broker_fd, (const struct sockaddr *) addr, sizeof(*addr))) return false;
+    setsockopt(broker_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t packet[64];
+    const size_t len = mqtt_connect(packet, sizeof(packet), "capture-replay", NULL, NULL, 0);
+    if (!send_all(packet, len)) return false;
+
+    // wait for the CONNACK, nothing else is subscribed
+    uint8_t connack[4];
+    size_t got = 0;
+    while (got < sizeof(connack)) {
+        const ssize_t n = recv(broker_fd, connack + got, sizeof(connack) - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        got += (size_t) n;
+    }
+    return connack[0] >> 4 == MQTT_CONNACK && connack[3] == 0;
+}
+
+// === MAIN ===
+
+static bool parse_paths(const char *arg, int *paths) {
+    *paths = 0;
+    char *copy = strdup(arg), *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (strcmp(name, "downlink") == 0) *paths |= PATH_DOWNLINK;
+        else if (strcmp(name, "verify") == 0) *paths |= PATH_VERIFY;
+        else if (strcmp(name, "publish") == 0) *paths |= PATH_PUBLISH;
+        else *paths = -1;
+        if (*paths < 0) break;
+    }
+    free(copy);
+    return *paths > 0;
+}
+
+// wait until the original time of a record, scaled
+static void wait_until(uint64_t start_us, uint64_t offset_us, double speed) {
+    const uint64_t due = start_us + (uint64_t) (offset_us / speed);
+    const uint64_t now = now_us();
+    if (now >= due) {
+        stats.late_us += now - due;
+        if (now - due > stats.late_max_us) stats.late_max_us = now - due;
+        return;
+    }
+    const struct timespec delay = {.tv_sec = (time_t) ((due - now) / 1000000u),
+                                   .tv_nsec = (long) ((due - now) % 1000000u) * 1000};
+    nanosleep(&delay, NULL);
+}
+
+static void print_outcomes(const char *path, uint64_t count, uint64_t us, const uint64_t *outcomes,
+                           const char *const *names, int n) {
+    printf("%-9s: %llu records, %.1f us/record,", path, (unsigned long long) count, count ? (double) us / count : 0);
+    for (int i = 0; i < n; i++) {
+        if (outcomes[i]) printf(" %llu %s", (unsigned long long) outcomes[i], names[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int paths = PATH_DOWNLINK | PATH_VERIFY, loops = 1, opt;
+    bool timed = false;
+    double speed = 1;
+    const char *host = NULL;
+
+    while ((opt = getopt(argc, argv, "p:Tx:l:H:")) != -1) {
+        switch (opt) {
+            case 'p':
+                if (!parse_paths(optarg, &paths)) {
+                    fprintf(stderr, "replay: unknown path in %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'T': timed = true; break;
+            case 'x': speed = atof(optarg); break;
+            case 'l': loops = atoi(optarg); break;
+            case 'H': host = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [options] <capture>\n"
+                                "  -p <paths>     downlink, verify and/or publish, comma separated\n"
+                                "                 (default downlink,verify)\n"
+                                "  -T             keep the original timing of the capture\n"
+                                "  -x <factor>    speed up the original timing (default 1)\n"
+                                "  -l <loops>     replay the capture this many times (default 1)\n"
+                                "  -H <host:port> publish to an external broker instead of the stand-in\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc || loops < 1 || speed <= 0) {
+        fprintf(stderr, "replay: invalid arguments, see %s -h\n", argv[0]);
+        return 1;
+    }
+
+    capture_reader_t reader;
+    if (!capture_map(argv[optind], &reader)) {
+        fprintf(stderr, "replay: %s is not a capture\n", argv[optind]);
+        return 1;
+    }
+    uint64_t counts[CAPTURE_DIRECTIONS] = {0}, first_us = 0, last_us = 0;
+    capture_record_t r;
+    while (capture_next(&reader, &r)) {
+        if (!counts[0] && !counts[1]) first_us = r.t_us;
+        last_us = r.t_us;
+        counts[r.direction]++;
+    }
+    if (reader.truncated) fprintf(stderr, "replay: %s is truncated, replaying the complete records\n", argv[optind]);
+    const uint64_t span_us = last_us - first_us;
+    printf("capture  : %llu uplink, %llu downlink records, %.1f MB, %.1f s\n", (unsigned long long) counts[0],
+           (unsigned long long) counts[1], reader.size / 1e6, span_us / 1e6);
+
+    settings_init();
+    if (!uc_init()) {
+        fprintf(stderr, "replay: can't initialize the crypto unit\n");
+        return 1;
+    }
+    devices = calloc(DEVICES_SIZE, sizeof(device_t));
+
+    broker_t *broker = NULL;
+    if (paths & PATH_PUBLISH) {
+        struct sockaddr_in addr;
+        if (host) {
+            if (!parse_address(host, &addr)) {
+                fprintf(stderr, "replay: can't resolve %s\n", host);
+                return 1;
+            }
+        } else {
+            broker = broker_start(NULL, 0, false);
+            if (!broker) {
+                fprintf(stderr, "replay: can't start the broker stand-in\n");
+                return 1;
+            }
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(broker_port(broker));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        if (!broker_connect(&addr)) {
+            fprintf(stderr, "replay: can't connect to the broker\n");
+            return 1;
+        }
+    }
+
+    const uint64_t start = now_us();
+    bool ok = true;
+    for (int loop = 0; loop < loops && ok; loop++) {
+        devices_reset();
+        capture_rewind(&reader);
+        while (ok && capture_next(&reader, &r)) {
+            if (timed) wait_until(start, (span_us + 1) * (uint64_t) loop + r.t_us - first_us, speed);
+            stats.records++;
+            stats.bytes += r.len;
+            const bool downlink = r.direction == CAPTURE_DOWNLINK;
+            if (downlink && paths & PATH_DOWNLINK) replay_downlink(&r);
+            else if (!downlink && paths & PATH_VERIFY) replay_verify(&r);
+            else if (!(paths & PATH_PUBLISH)) stats.skipped++;
+            if (paths & PATH_PUBLISH) ok = replay_publish(&r, timed);
+        }
+    }
+    if (ok && out_len) ok = flush_out();
+    if (!ok) fprintf(stderr, "replay: the broker closed the connection\n");
+
+    // the stand-in has seen every publish once it counted them all
+    uint64_t received = 0;
+    if (broker) {
+        broker_stats_t b;
+        for (int i = 0; i < 5000; i++) {
+            broker_stats(broker, &b);
+            if (b.published >= stats.published) break;
+            usleep(1000);
+        }
+        received = b.published;
+    }
+    const double seconds = (now_us() - start) / 1e6;
+
+    printf("replay   : %llu records in %.3f s%s, %.0f records/s, %.1f MB/s",
+           (unsigned long long) stats.records, seconds, timed ? " (original timing)" : "",
+           stats.records / seconds, stats.bytes / seconds / 1e6);
+    if (stats.skipped) printf(", %llu skipped", (unsigned long long) stats.skipped);
+    printf("\n");
+    if (timed && stats.records) {
+        printf("timing   : %.1f us late on average, %.1f ms max\n", (double) stats.late_us / stats.records,
+               stats.late_max_us / 1e3);
+    }
+    if (paths & PATH_DOWNLINK) {
+        print_outcomes("downlink", stats.downlink, stats.downlink_us, stats.downlink_outcomes, downlink_outcome_names,
+                       DOWNLINK_OUTCOMES);
+    }
+    if (paths & PATH_VERIFY) {
+        print_outcomes("verify", stats.verify, stats.verify_us, stats.verify_outcomes, verify_outcome_names,
+                       VERIFY_OUTCOMES);
+    }
+    if (paths & PATH_PUBLISH) {
+        printf("publish  : %llu records", (unsigned long long) stats.published);
+        if (broker) printf(", %llu received by the stand-in", (unsigned long long) received);
+        printf("\n");
+    }
+
+    if (broker_fd >= 0) {
+        uint8_t disconnect[2];
+        send_all(disconnect, mqtt_empty(disconnect, sizeof(disconnect), MQTT_DISCONNECT));
+        close(broker_fd);
+    }
+    if (broker) broker_stop(broker);
+    devices_reset();
+    free(devices);
+    free(message);
+    free(out);
+    capture_unmap(&reader);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,691 @@
+/*!
+ * @file
+ * @brief Signing backend stand-in: answers device messages with signed config messages.
+ *
+ * Subscribes to the device topics (`mwc/ubirch/devices/+/`), verifies the
+ * device messages with the firmware crypto unit and answers on the device's
+ * `.../out` topic with a config message in the backend format
+ * (`{"v","k","s","p"}`, the key PKCS#8 encoded, the payload signed with the
+ * responder's key). On demand a fraction of the answers is forged (payload
+ * changed after signing), signed with another key than the one sent, or
+ * malformed, to test the downlink path of the devices.
+ *
+ * Every answer is timed from the arrival of the device message to the
+ * publish, and can be recorded (-o). With -x every answer is run through the
+ * firmware downlink path first (process_response(), the signature check and
+ * process_payload()) and the outcome is checked against the intended kind.
+ *
+ * Each config payload carries a request ID ("r"), the devices acknowledge an
+ * applied config with a signed ack message (`{"y":"k","r":..,"ms":..}`). The
+ * acks are matched with the last request to the device and reported as the
+ * round trip from the answer to the ack, next to the receive-to-apply time
+ * the device measured.
+ *
+ * Batch signed messages are verified against the Merkle root of their
+ * inclusion proof, the signature once per window.
+ *
+ * By default the responder runs the broker stand-in (broker/broker.c) on
+ * the given port, so devices and the load generator can connect to it, -H
+ * uses an external broker instead.
+ *
+ * @date 2017-04-21
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "broker.h"
+#include "crypto/crypto.h"
+#include "downlink.h"
+#include "jsmn/jsmn.h"
+#include "mqtt.h"
+#include "protocol.h"
+#include "sensor.h"
+
+#define MAX_TOKENS 128
+#define DEVICES_SIZE 65536      //!< device table (power of 2)
+#define MESSAGE_SIZE 1024
+
+// === CONFIGURATION ===
+
+static int every = 1;                   //!< answer every n-th message of a device
+static double forged_rate = 0;          //!< payload changed after signing
+static double wrong_key_rate = 0;       //!< signed with another key than the one in the message
+static double malformed_rate = 0;
+static bool check = false;              //!< run the answers through the firmware downlink path
+static bool request_acks = true;        //!< add a request ID to the config payload
+static bool verbose = false;
+static char config[256] = "{\"i\":60}";
+static FILE *record = NULL;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signal) {
+    (void) signal;
+    running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + (uint64_t) ts.tv_nsec / 1000u;
+}
+
+// === ANSWERS ===
+
+//! the kinds of answers
+typedef enum {
+    ANSWER_VALID = 0,
+    ANSWER_FORGED,          //!< the payload was changed after signing
+    ANSWER_WRONG_KEY,       //!< signed with another key
+    ANSWER_MALFORMED,       //!< truncated, wrong version, undecodable signature or no payload object
+    ANSWER_KINDS
+} answer_kind_t;
+
+static const char *const kind_names[ANSWER_KINDS] = {"valid", "forged", "wrong key", "malformed"};
+
+static uc_ed25519_key backend_key, other_key;
+static char *backend_key_encoded = NULL;
+
+static struct {
+    uint64_t received, verified, rejected, unknown, malformed;
+    uint64_t answers[ANSWER_KINDS];
+    uint64_t outcomes[ANSWER_KINDS][DOWNLINK_OUTCOMES];
+    uint64_t unexpected;
+    uint64_t sign_us, check_us;
+    uint32_t *latency_us;
+    size_t latency_count, latency_cap;
+    uint64_t acks, acks_rejected, acks_unmatched, apply_ms, apply_max_ms;
+    uint32_t *ack_us;                   //!< from the answer to the ack
+    size_t ack_count, ack_cap;
+} stats;
+
+static uint32_t request_id = 0;
+
+static void sample_add(uint32_t **samples, size_t *count, size_t *cap, uint32_t value) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *samples = realloc(*samples, *cap * sizeof(uint32_t));
+    }
+    (*samples)[(*count)++] = value;
+}
+
+// create an answer of the given kind (malloc(), 0 terminated), with the request ID if not 0
+static char *answer_create(answer_kind_t kind, unsigned variant, uint32_t request) {
+    char payload[sizeof(config) + 16];
+    if (request) snprintf(payload, sizeof(payload), "{\"r\":%lu,%s", (unsigned long) request, config + 1);
+    else strcpy(payload, config);
+
+    const uint64_t start = now_us();
+    char *signature = uc_ecc_sign_encoded(kind == ANSWER_WRONG_KEY ? &other_key : &backend_key,
+                                          (const unsigned char *) payload, strlen(payload));
+    stats.sign_us += now_us() - start;
+    if (!signature) return NULL;
+
+    if (kind == ANSWER_FORGED) {
+        // change the first digit, the value stays in range and the payload parses
+        char *digit = strpbrk(payload, "0123456789");
+        if (digit) *digit = *digit == '1' ? '2' : '1';
+    }
+
+    const char *version = PROTOCOL_VERSION_FULL;
+    char *message = malloc(MESSAGE_SIZE);
+    if (kind == ANSWER_MALFORMED && variant % 4 == 1) version = "1.0.0";
+    if (kind == ANSWER_MALFORMED && variant % 4 == 2) memset(signature, '!', strlen(signature));
+    if (kind == ANSWER_MALFORMED && variant % 4 == 3) {
+        snprintf(message, MESSAGE_SIZE, "{\"v\":\"%s\",\"k\":\"%s\",\"s\":\"%s\",\"p\":\"%s\"}", version,
+                 backend_key_encoded, signature, "i=60");
+    } else {
+        snprintf(message, MESSAGE_SIZE, "{\"v\":\"%s\",\"k\":\"%s\",\"s\":\"%s\",\"p\":%s}", version,
+                 backend_key_encoded, signature, payload);
+    }
+    if (kind == ANSWER_MALFORMED && variant % 4 == 0) message[strlen(message) / 2] = '\0';
+    free(signature);
+    return message;
+}
+
+// === DEVICES ===
+
+typedef struct {
+    char uuid[37];
+    uint32_t messages;
+    char key[PROTOCOL_KEY_LENGTH + 1];      //!< the last key the device sent
+    bool valid;                             //!< key imported
+    uc_ed25519_key pub;
+    char sid[PROTOCOL_SID_LENGTH + 1];      //!< the announced session
+    bool root_valid;                        //!< the last batch signed window verified with the key
+    unsigned char root[MERKLE_HASH_SIZE];
+    unsigned char root_signature[ED25519_SIG_SIZE];
+    uint32_t request;                       //!< the last request ID sent, 0 once acknowledged
+    uint64_t request_us;                    //!< when it was sent
+} device_t;
+
+static device_t *devices = NULL;
+
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t) s[i]) * 16777619u;
+    return h;
+}
+
+static device_t *device_find(const char *uuid, size_t len) {
+    if (len == 0 || len >= sizeof(devices[0].uuid)) return NULL;
+    for (uint32_t i = 0, h = hash(uuid, len); i < DEVICES_SIZE; i++) {
+        device_t *d = &devices[(h + i) & (DEVICES_SIZE - 1)];
+        if (!d->uuid[0]) {
+            memcpy(d->uuid, uuid, len);
+            return d;
+        }
+        if (strlen(d->uuid) == len && strncmp(d->uuid, uuid, len) == 0) return d;
+    }
+    return NULL;
+}
+
+static bool token_is(const char *json, const jsmntok_t *token, const char *s) {
+    const size_t n = strlen(s);
+    return token->type == JSMN_STRING && (size_t) (token->end - token->start) == n &&
+           strncmp(json + token->start, s, n) == 0;
+}
+
+// a non-negative integer that fits 32 bit
+static bool token_uint(const char *json, const jsmntok_t *token, uint32_t *value) {
+    const int len = token->end - token->start;
+    if (token->type != JSMN_PRIMITIVE || len <= 0 || len > 10) return false;
+    uint64_t v = 0;
+    for (int i = 0; i < len; i++) {
+        const char c = json[token->start + i];
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (uint64_t) (c - '0');
+    }
+    if (v > UINT32_MAX) return false;
+    *value = (uint32_t) v;
+    return true;
+}
+
+// verify a device message, full mode with the key it carries, session mode with the announced key,
+// a batch signed message against the root of its inclusion proof (once per window)
+static bool device_verify(device_t *d, const char *json, size_t len) {
+    jsmntok_t tokens[MAX_TOKENS], key = {0}, sid = {0}, signature = {0}, payload = {0};
+    jsmntok_t index = {0}, count = {0}, proof = {0};
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    const int n = jsmn_parse(&parser, json, len, tokens, MAX_TOKENS);
+    if (n < 1 || tokens[0].type != JSMN_OBJECT) {
+        stats.malformed++;
+        return false;
+    }
+    for (int i = 1; i + 1 < n;) {
+        const jsmntok_t *name = &tokens[i], *value = &tokens[i + 1];
+        if (token_is(json, name, P_KEY) && value->type == JSMN_STRING) key = *value;
+        else if (token_is(json, name, "sid") && value->type == JSMN_STRING) sid = *value;
+        else if (token_is(json, name, P_SIGNATURE) && value->type == JSMN_STRING) signature = *value;
+        else if (token_is(json, name, P_PAYLOAD) && value->type == JSMN_OBJECT) payload = *value;
+        else if (token_is(json, name, "i")) index = *value;
+        else if (token_is(json, name, "n")) count = *value;
+        else if (token_is(json, name, "m") && value->type == JSMN_ARRAY) proof = *value;
+        i += 2;
+        while (i < n && tokens[i].start < value->end) i++;
+    }
+    if (!signature.end || !payload.end || (!key.end && !sid.end)) {
+        stats.malformed++;
+        return false;
+    }
+
+    if (key.end) {
+        const size_t key_len = (size_t) (key.end - key.start);
+        if (key_len != PROTOCOL_KEY_LENGTH) {
+            stats.malformed++;
+            return false;
+        }
+        if (strncmp(d->key, json + key.start, key_len) != 0) {
+            unsigned char raw[ED25519_PUB_KEY_SIZE + 1];
+            size_t raw_len = ED25519_PUB_KEY_SIZE;
+            if (d->valid) wc_ed25519_free(&d->pub);
+            memcpy(d->key, json + key.start, key_len);
+            d->root_valid = false;
+            d->valid = uc_base64_decode(d->key, key_len, raw, &raw_len) && raw_len == ED25519_PUB_KEY_SIZE &&
+                       uc_import_ecc_pub_key(&d->pub, raw, raw_len);
+        }
+    } else if ((size_t) (sid.end - sid.start) != PROTOCOL_SID_LENGTH ||
+               strncmp(d->sid, json + sid.start, PROTOCOL_SID_LENGTH) != 0) {
+        stats.unknown++;
+        return false;
+    }
+    if (!d->valid) {
+        stats.malformed++;
+        return false;
+    }
+
+    unsigned char raw_signature[ED25519_SIG_SIZE + 1];
+    size_t signature_len = ED25519_SIG_SIZE;
+    if (!uc_base64_decode(json + signature.start, (size_t) (signature.end - signature.start), raw_signature,
+                          &signature_len) || signature_len != ED25519_SIG_SIZE) {
+        stats.malformed++;
+        return false;
+    }
+    const unsigned char *signed_data = (const unsigned char *) json + payload.start;
+    size_t signed_len = (size_t) (payload.end - payload.start);
+    unsigned char root[MERKLE_HASH_SIZE];
+    if (index.end || count.end || proof.end) {
+        uint32_t i, n;
+        if (!token_uint(json, &index, &i) || !token_uint(json, &count, &n) || !proof.end ||
+            !protocol_batch_root(json + payload.start, signed_len, i, n, json + proof.start,
+                                 (size_t) (proof.end - proof.start), root)) {
+            stats.malformed++;
+            return false;
+        }
+        signed_data = root;
+        signed_len = MERKLE_HASH_SIZE;
+    }
+    const bool known_root = signed_data == root && d->root_valid && memcmp(d->root, root, MERKLE_HASH_SIZE) == 0 &&
+                            memcmp(d->root_signature, raw_signature, ED25519_SIG_SIZE) == 0;
+    if (!known_root) {
+        if (!uc_ecc_verify(&d->pub, signed_data, signed_len, raw_signature, signature_len)) {
+            stats.rejected++;
+            return false;
+        }
+        if (signed_data == root) {
+            memcpy(d->root, root, MERKLE_HASH_SIZE);
+            memcpy(d->root_signature, raw_signature, ED25519_SIG_SIZE);
+            d->root_valid = true;
+        }
+    }
+
+    // an identity message announces the session of the following messages
+    const char *announced = strstr(json + payload.start, "\"sid\":\"");
+    if (key.end && announced && announced < json + payload.end && strstr(json + payload.start, "\"y\":\"i\"")) {
+        memcpy(d->sid, announced + 7, PROTOCOL_SID_LENGTH);
+    }
+    stats.verified++;
+    return true;
+}
+
+// === MQTT ===
+
+static int broker_fd = -1;
+static uint16_t packet_id = 0;
+static uint64_t start_us = 0;
+
+static bool send_all(const uint8_t *data, size_t len) {
+    while (len) {
+        const ssize_t n = send(broker_fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t) n;
+    }
+    return true;
+}
+
+static bool answer(device_t *d, uint64_t received_us) {
+    const double r = rand() / (double) RAND_MAX;
+    answer_kind_t kind = ANSWER_VALID;
+    if (r < malformed_rate) kind = ANSWER_MALFORMED;
+    else if (r < malformed_rate + forged_rate) kind = ANSWER_FORGED;
+    else if (r < malformed_rate + forged_rate + wrong_key_rate) kind = ANSWER_WRONG_KEY;
+
+    const uint32_t request = request_acks ? ++request_id : 0;
+    char *message = answer_create(kind, (unsigned) stats.answers[kind], request);
+    if (!message) return false;
+    if (check) {
+        const uint64_t start = now_us();
+        char *copy = strdup(message);
+        settings_update_t update;
+        const downlink_outcome_t outcome = downlink_process(copy, &update, NULL);
+        free(copy);
+        stats.check_us += now_us() - start;
+        stats.outcomes[kind][outcome]++;
+        if ((kind == ANSWER_VALID) != (outcome == DOWNLINK_APPLIED)) stats.unexpected++;
+    }
+
+    char topic[80];
+    snprintf(topic, sizeof(topic), PROTOCOL_TOPIC, d->uuid, "out");
+    uint8_t packet[MQTT_HEADER_MAX + 2 + sizeof(topic) + 2 + MESSAGE_SIZE];
+    if (++packet_id == 0) packet_id = 1;
+    const size_t len = mqtt_publish(packet, sizeof(packet), topic, message, strlen(message), 1, packet_id);
+    const bool sent = len && send_all(packet, len);
+
+    const uint64_t now = now_us();
+    if (sent) {
+        stats.answers[kind]++;
+        sample_add(&stats.latency_us, &stats.latency_count, &stats.latency_cap, (uint32_t) (now - received_us));
+        // only a valid answer is applied and acknowledged
+        if (kind == ANSWER_VALID) {
+            d->request = request;
+            d->request_us = now;
+        }
+        if (record) {
+            fprintf(record, "%.3f,%s,%s,%u\n", (now - start_us) / 1e3, d->uuid, kind_names[kind],
+                    (unsigned) (now - received_us));
+        }
+        if (verbose) printf("%s %s\n", topic, message);
+    }
+    free(message);
+    return sent;
+}
+
+// the value of a numeric member of a verified message, 0 if there is none
+static unsigned long member_value(const char *json, size_t len, const char *member) {
+    const char *found = memmem(json, len, member, strlen(member));
+    return found ? strtoul(found + strlen(member), NULL, 10) : 0;
+}
+
+static void handle_ack(device_t *d, const char *json, size_t len, uint64_t received_us) {
+    const unsigned long request = member_value(json, len, "\"r\":");
+    if (!request || request != d->request) {
+        stats.acks_unmatched++;
+        return;
+    }
+    // a rejected config is acknowledged with its error status
+    if (memmem(json, len, "\"e\":", 4)) {
+        stats.acks_rejected++;
+        d->request = 0;
+        return;
+    }
+    const unsigned long apply_ms = member_value(json, len, "\"ms\":");
+    stats.acks++;
+    stats.apply_ms += apply_ms;
+    if (apply_ms > stats.apply_max_ms) stats.apply_max_ms = apply_ms;
+    sample_add(&stats.ack_us, &stats.ack_count, &stats.ack_cap, (uint32_t) (received_us - d->request_us));
+    if (record) {
+        fprintf(record, "%.3f,%s,ack,%u\n", (received_us - start_us) / 1e3, d->uuid,
+                (unsigned) (received_us - d->request_us));
+    }
+    d->request = 0;
+}
+
+static void handle_publish(const mqtt_publish_t *publish, uint64_t received_us) {
+    stats.received++;
+    const size_t prefix = strlen(PROTOCOL_TOPIC_PREFIX);
+    if (publish->topic_len <= prefix + 1 || strncmp(publish->topic, PROTOCOL_TOPIC_PREFIX, prefix) != 0) return;
+
+    device_t *d = device_find(publish->topic + prefix, publish->topic_len - prefix - 1);
+    if (!d || !device_verify(d, (const char *) publish->payload, publish->len)) return;
+
+    // identity messages and acks are not answered
+    const char *json = (const char *) publish->payload;
+    if (memmem(json, publish->len, "\"y\":\"i\"", 7)) return;
+    if (memmem(json, publish->len, "\"y\":\"k\"", 7)) {
+        handle_ack(d, json, publish->len, received_us);
+        return;
+    }
+    if (d->messages++ % (uint32_t) every == 0) answer(d, received_us);
+}
+
+static bool broker_connect(const struct sockaddr_in *addr) {
+    broker_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    if (broker_fd < 0 || connect(broker_fd, (const struct sockaddr *) addr, sizeof(*addr))) return false;
+    setsockopt(broker_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    uint8_t packet[256];
+    size_t len = mqtt_connect(packet, sizeof(packet), "backend-responder", NULL, NULL, 0);
+    len += mqtt_subscribe(packet + len, sizeof(packet) - len, 1, PROTOCOL_TOPIC_PREFIX "+/", 0);
+    return send_all(packet, len);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(void) {
+    printf("device messages : %llu, %llu verified, %llu bad signature, %llu unknown session, %llu malformed\n",
+           (unsigned long long) stats.received, (unsigned long long) stats.verified,
+           (unsigned long long) stats.rejected, (unsigned long long) stats.unknown,
+           (unsigned long long) stats.malformed);
+    uint64_t total = 0;
+    printf("answers         :");
+    for (int k = 0; k < ANSWER_KINDS; k++) {
+        printf(" %llu %s%s", (unsigned long long) stats.answers[k], kind_names[k], k + 1 < ANSWER_KINDS ? "," : "");
+        total += stats.answers[k];
+    }
+    printf("\n");
+    if (!total) return;
+
+    qsort(stats.latency_us, stats.latency_count, sizeof(uint32_t), compare_u32);
+    printf("answer latency  : p50 %u us, p99 %u us, max %u us (signing %.1f us)\n",
+           stats.latency_us[stats.latency_count / 2], stats.latency_us[stats.latency_count * 99 / 100],
+           stats.latency_us[stats.latency_count - 1], (double) stats.sign_us / total);
+    if (request_acks) {
+        printf("acks            : %llu of %llu valid answers, %llu rejected, %llu unmatched",
+               (unsigned long long) stats.acks, (unsigned long long) stats.answers[ANSWER_VALID],
+               (unsigned long long) stats.acks_rejected, (unsigned long long) stats.acks_unmatched);
+        if (stats.ack_count) {
+            qsort(stats.ack_us, stats.ack_count, sizeof(uint32_t), compare_u32);
+            printf(", round trip p50 %.1f ms, p99 %.1f ms, max %.1f ms, apply %.1f ms avg, %llu ms max",
+                   stats.ack_us[stats.ack_count / 2] / 1e3, stats.ack_us[stats.ack_count * 99 / 100] / 1e3,
+                   stats.ack_us[stats.ack_count - 1] / 1e3, (double) stats.apply_ms / stats.acks,
+                   (unsigned long long) stats.apply_max_ms);
+        }
+        printf("\n");
+    }
+    if (!check) return;
+
+    printf("firmware path   : %.1f us per downlink, %llu unexpected outcomes\n", (double) stats.check_us / total,
+           (unsigned long long) stats.unexpected);
+    for (int k = 0; k < ANSWER_KINDS; k++) {
+        if (!stats.answers[k]) continue;
+        printf("  %-10s   :", kind_names[k]);
+        for (int o = 0; o < DOWNLINK_OUTCOMES; o++) {
+            if (stats.outcomes[k][o]) printf(" %llu %s", (unsigned long long) stats.outcomes[k][o], downlink_outcome_names[o]);
+        }
+        printf("\n");
+    }
+}
+
+// === MAIN ===
+
+// "i=60,th=2500" to the config payload {"i":60,"th":2500}
+static bool parse_config(const char *arg) {
+    size_t len = 0;
+    config[len++] = '{';
+    char *copy = strdup(arg), *save = NULL;
+    for (char *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (!value) break;
+        *value++ = '\0';
+        len += (size_t) snprintf(config + len, sizeof(config) - len, "%s\"%s\":%s", len > 1 ? "," : "", item, value);
+        if (len >= sizeof(config) - 2) break;
+    }
+    free(copy);
+    if (len <= 1 || len >= sizeof(config) - 2) return false;
+    config[len++] = '}';
+    config[len] = '\0';
+    return true;
+}
+
+static bool parse_address(const char *arg, struct sockaddr_in *addr) {
+    char host[256];
+    int port = 1883;
+    if (sscanf(arg, "%255[^:]:%d", host, &port) < 1) return false;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM}, *info;
+    if (getaddrinfo(host, NULL, &hints, &info)) return false;
+    *addr = *(struct sockaddr_in *) info->ai_addr;
+    addr->sin_port = htons((uint16_t) port);
+    freeaddrinfo(info);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int port = 1883, seconds = 0, opt;
+    const char *host = NULL, *capture_file = NULL;
+
+    while ((opt = getopt(argc, argv, "H:p:c:e:F:W:M:d:o:C:Nxv")) != -1) {
+        switch (opt) {
+            case 'H': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c':
+                if (!parse_config(optarg)) {
+                    fprintf(stderr, "responder: invalid config %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e': every = atoi(optarg); break;
+            case 'F': forged_rate = atof(optarg); break;
+            case 'W': wrong_key_rate = atof(optarg); break;
+            case 'M': malformed_rate = atof(optarg); break;
+            case 'd': seconds = atoi(optarg); break;
+            case 'o':
+                record = fopen(optarg, "w");
+                if (!record) {
+                    perror(optarg);
+                    return 1;
+                }
+                fprintf(record, "ms,uuid,kind,latency_us\n");
+                break;
+            case 'C': capture_file = optarg; break;
+            case 'N': request_acks = false; break;
+            case 'x': check = true; break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "usage: %s [options]\n"
+                                "  -H <host:port> external broker (default: the broker stand-in on -p)\n"
+                                "  -p <port>      port of the broker stand-in (default 1883, all interfaces)\n"
+                                "  -c <settings>  config to send, key=value[,key=value] (default i=60)\n"
+                                "  -e <n>         answer every n-th message of a device (default 1)\n"
+                                "  -F <rate>      fraction of forged answers (payload changed after signing)\n"
+                                "  -W <rate>      fraction of answers signed with another key\n"
+                                "  -M <rate>      fraction of malformed answers\n"
+                                "  -d <seconds>   run time (default: until interrupted)\n"
+                                "  -o <file>      record every answer and ack (ms, uuid, kind, latency)\n"
+                                "  -C <file>      capture the traffic of the broker stand-in (see replay)\n"
+                                "  -N             no request IDs, the devices don't send acks\n"
+                                "  -x             check every answer with the firmware downlink path\n"
+                                "  -v             print the answers\n", argv[0]);
+                return 1;
+        }
+    }
+    if (every < 1 || forged_rate + wrong_key_rate + malformed_rate > 1) {
+        fprintf(stderr, "responder: invalid arguments\n");
+        return 1;
+    }
+    if (capture_file && host) {
+        fprintf(stderr, "responder: -C captures on the broker stand-in, not with -H\n");
+        return 1;
+    }
+
+    settings_init();
+    if (!uc_init() || !uc_ecc_create_key(&backend_key) || !uc_ecc_create_key(&other_key)) {
+        fprintf(stderr, "responder: can't create the backend key\n");
+        return 1;
+    }
+    backend_key_encoded = uc_ecc_export_pub_encoded(&backend_key);
+    devices = calloc(DEVICES_SIZE, sizeof(device_t));
+
+    struct sockaddr_in addr;
+    broker_t *broker = NULL;
+    capture_t *capture = NULL;
+    if (host) {
+        if (!parse_address(host, &addr)) {
+            fprintf(stderr, "responder: can't resolve %s\n", host);
+            return 1;
+        }
+    } else {
+        broker = broker_start("0.0.0.0", (uint16_t) port, false);
+        if (!broker) {
+            fprintf(stderr, "responder: can't listen on port %d\n", port);
+            return 1;
+        }
+        if (capture_file) {
+            capture = capture_open(capture_file);
+            if (!capture) {
+                fprintf(stderr, "responder: can't create %s\n", capture_file);
+                return 1;
+            }
+            broker_capture(broker, capture);
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(broker_port(broker));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    if (!broker_connect(&addr)) {
+        fprintf(stderr, "responder: can't connect to the broker\n");
+        return 1;
+    }
+    printf("responder: broker %s:%u, config %s, backend key %s\n", host ? host : "0.0.0.0", ntohs(addr.sin_port),
+           config, backend_key_encoded);
+    fflush(stdout);
+
+    struct sigaction action = {.sa_handler = stop};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    start_us = now_us();
+    const uint64_t end_us = seconds > 0 ? start_us + (uint64_t) seconds * 1000000u : UINT64_MAX;
+    size_t in_len = 0, in_cap = 65536;
+    uint8_t *in = malloc(in_cap);
+    while (running && now_us() < end_us) {
+        struct pollfd pfd = {.fd = broker_fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) <= 0) continue;
+        if (in_cap - in_len < 4096) in = realloc(in, in_cap *= 2);
+        const ssize_t n = recv(broker_fd, in + in_len, in_cap - in_len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            fprintf(stderr, "responder: the broker closed the connection\n");
+            break;
+        }
+        in_len += (size_t) n;
+        const uint64_t received_us = now_us();
+
+        size_t used = 0;
+        mqtt_packet_t packet;
+        int status;
+        while ((status = mqtt_next(in + used, in_len - used, &packet)) == 1) {
+            used += packet.size;
+            mqtt_publish_t publish;
+            if (packet.type == MQTT_PUBLISH && mqtt_parse_publish(&packet, &publish)) {
+                handle_publish(&publish, received_us);
+            }
+        }
+        if (status < 0) {
+            fprintf(stderr, "responder: malformed MQTT stream\n");
+            break;
+        }
+        memmove(in, in + used, in_len - used);
+        in_len -= used;
+    }
+
+    report();
+    close(broker_fd);
+    if (broker) broker_stop(broker);
+    if (capture) {
+        const uint64_t records = capture_records(capture);
+        if (!capture_close(capture)) fprintf(stderr, "responder: writing %s failed\n", capture_file);
+        else printf("responder: %llu messages captured to %s\n", (unsigned long long) records, capture_file);
+    }
+    if (record) fclose(record);
+    free(in);
+    return 0;
+}
@@ -0,0 +1,561 @@
+/*!
+ * @file
+ * @brief Virtual-time simulator of the sensor firmware.
+ *
+ * Runs the firmware scheduling logic (main loop schedule, sensor scheduler,
+ * alert detection, settings, outbox) against a virtual clock, a replayable sensor trace and a
+ * modem model with attach latency, failures and per-state current draw.
+ * The MCU power states are modelled with the idle policy of power.c.
+ * A month of operation takes a few seconds and reports message counts,
+ * bytes, radio-on time and the estimated charge, so reporting and power
+ * policies can be compared before rollout.
+ *
+ * usage: envsim [options], see usage()
+ *
+ * @date 2017-04-12
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "alert.h"
+#include "bme280.h"
+#include "outbox.h"
+#include "power.h"
+#include "report.h"
+#include "protocol.h"
+#include "schedule.h"
+#include "sensors.h"
+#include "settings.h"
+#include "stats.h"
+#include "telemetry.h"
+
+// send topic "mwc/ubirch/devices/<uuid>/", PUBLISH header, TCP/IP headers of the segment and its ack
+#define TOPIC_LENGTH 56
+#define MQTT_PUBLISH_HEADER 5
+#define TCP_OVERHEAD 80
+// MQTT PINGREQ/PINGRESP including TCP/IP headers, sent every keep alive interval
+#define MQTT_PING_BYTES 164
+#define MQTT_CONNECT_BYTES 600
+
+#define DAY_MS (24ULL * 3600 * 1000)
+#define NEVER UINT64_MAX
+
+// === MODEM MODEL ===
+
+typedef enum {
+    MODEM_OFF = 0,
+    MODEM_ATTACHING,
+    MODEM_IDLE,
+    MODEM_TX,
+    MODEM_STATES
+} modem_state_t;
+
+static const char *const modem_names[MODEM_STATES] = {"off", "attaching", "idle", "tx"};
+
+typedef struct {
+    uint32_t attach_ms;         //!< mean time from power-up to MQTT connected
+    uint32_t attach_jitter_ms;  //!< uniform jitter added to the attach time
+    double fail_rate;           //!< probability that an attach fails
+    uint32_t retry_ms;          //!< retry delay after a failed attach (the MQTT thread waits a loop period)
+    int64_t linger_ms;          //!< power down after this idle time, -1 stays connected (firmware default)
+    uint32_t uplink_bps;        //!< GPRS uplink throughput
+    double current_ma[MODEM_STATES];
+} modem_model_t;
+
+static modem_model_t modem = {
+    21000, 8000, 0.05, LOOP_PERIOD, -1, 20000,
+    // rough Quectel M66 figures: powered down, attach/registration, GPRS idle (DRX), GPRS transfer
+    {0.01, 110.0, 15.0, 220.0}
+};
+
+// === MCU MODEL ===
+
+// rough K82F figures: run, sleep (WFI) and deep sleep (VLPS)
+static double mcu_current_ma[POWER_STATES] = {20.0, 8.0, 0.05};
+
+// run time per activity: sensor sample, signing a message, idle wake-up (log thread, heartbeat LED)
+#define RUN_SAMPLE_MS 3
+#define RUN_SIGN_MS 60
+#define RUN_TICK_MS 1
+
+static bool tickless = true;        //!< tickless deep sleep (power.c), otherwise the idle thread uses WFI
+static bool ring = false;           //!< the modem RI line wakes the MQTT thread, it polls only every RING_WAIT
+static uint32_t poll_ms = POLL_WAIT;    //!< without it, the connected MQTT thread polls for a yield slice this often
+static uint32_t run_pending = 0;     //!< run time caused by the events at the current time
+
+// === SENSOR TRACE ===
+
+typedef struct {
+    double t_s;
+    float temperature;      //!< degree Celsius
+    float pressure;         //!< hPa
+    float humidity;         //!< %
+} trace_sample_t;
+
+static trace_sample_t *trace = NULL;
+static size_t trace_len = 0;
+static double trace_span_s = 0;
+
+// read "seconds,temperature,pressure,humidity" lines, the trace is repeated
+static bool trace_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    size_t cap = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        trace_sample_t s;
+        if (sscanf(line, "%lf,%f,%f,%f", &s.t_s, &s.temperature, &s.pressure, &s.humidity) != 4) continue;
+        if (trace_len == cap) {
+            cap = cap ? cap * 2 : 256;
+            trace = (trace_sample_t *) realloc(trace, cap * sizeof(trace_sample_t));
+        }
+        trace[trace_len++] = s;
+    }
+    fclose(f);
+    if (trace_len < 2) return false;
+    trace_span_s = trace[trace_len - 1].t_s - trace[0].t_s;
+    return trace_span_s > 0;
+}
+
+// step-hold replay of the trace, or a synthetic diurnal cycle without one
+static void trace_at(uint64_t now_ms, trace_sample_t *out) {
+    const double t = now_ms / 1000.0;
+    if (!trace_len) {
+        const double day = 2 * M_PI * t / 86400.0;
+        out->temperature = (float) (18.0 + 6.0 * sin(day) + 0.5 * sin(day * 37.0));
+        out->pressure = (float) (1013.0 + 4.0 * sin(day / 3.0));
+        out->humidity = (float) (50.0 - 15.0 * sin(day));
+        return;
+    }
+
+    const double offset = trace[0].t_s + fmod(t, trace_span_s);
+    size_t lo = 0, hi = trace_len - 1;
+    while (lo < hi) {
+        const size_t mid = (lo + hi + 1) / 2;
+        if (trace[mid].t_s <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    *out = trace[lo];
+}
+
+// === SIMULATION STATE ===
+
+static uint64_t now = 0;
+
+static struct {
+    uint32_t telemetry;
+    uint32_t heartbeats;
+    uint32_t skipped;
+    uint32_t alerts;
+    uint32_t dropped;
+    uint32_t attaches;
+    uint32_t attach_failures;
+    uint32_t pings;
+    uint32_t polls;
+    uint64_t keepalive_late_ms;     //!< longest time a packet went out after the keep alive was due
+    uint64_t payload_bytes;
+    uint64_t link_bytes;
+    uint64_t state_ms[MODEM_STATES];
+    uint64_t mcu_ms[POWER_STATES];  //!< the firmware stats only cover the time since the last stats message
+    uint32_t wakeups;
+    double sensor_uah;
+} sim;
+
+static modem_state_t modem_state = MODEM_OFF;
+static uint64_t modem_since = 0;
+static uint64_t attach_done = NEVER;
+static uint64_t retry_at = 0;
+static uint64_t last_activity = 0;
+static uint64_t next_ping = NEVER;     //!< the keep alive is due, the client pings in the next yield
+static uint64_t next_poll = NEVER;
+static uint64_t poll_until = 0;
+static bool attach_fails = false;
+
+static alert_state_t alert_state;
+static outbox_t outbox;
+static int bme_id = -1;
+static uint32_t rng = 2463534242u;
+
+static uint32_t xorshift(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static double uniform(void) {
+    return xorshift() / 4294967296.0;
+}
+
+static void modem_enter(modem_state_t state) {
+    // a transfer may still run, the next state starts after it
+    if (now > modem_since) {
+        sim.state_ms[modem_state] += now - modem_since;
+        modem_since = now;
+    }
+    modem_state = state;
+}
+
+// === FIRMWARE LOGIC ===
+
+static const sensor_channel_t trace_channels[] = {{"t", 100.0f}, {"p", 1.0f}, {"h", 100.0f}, {"a", 100.0f}};
+
+static int trace_sample(void *ctx, float *values) {
+    (void) ctx;
+    trace_sample_t s;
+    trace_at(now, &s);
+    values[0] = s.temperature;
+    values[1] = s.pressure;
+    values[2] = s.humidity;
+    values[3] = 44330.0f * (1.0f - (float) pow(s.pressure * 100.0f / 101325.0f, 1 / 5.255));
+    return true;
+}
+
+static const sensor_driver_t trace_driver = {"trace", trace_channels, 4, BME280_PERIOD, NULL, trace_sample, NULL};
+
+static void queue(outbox_class_t cls, const char *payload) {
+    run_pending += RUN_SIGN_MS;
+    outbox_entry_t entry = {strdup(payload), NULL, NULL, NULL, 0, (uint32_t) now};
+    outbox_push(&outbox, cls, &entry);
+}
+
+static void sampled(int id, const float *values, uint32_t now_ms) {
+    if (!values || id != bme_id) return;
+    run_pending += RUN_SAMPLE_MS;
+
+    sim.sensor_uah += bme280_current_estimate((bme280_profile_id_t) settings_get(SETTING_BME_PROFILE),
+                                                BME280_PERIOD) / 1000.0 * BME280_PERIOD / 3600000.0;
+
+    const int temp = (int) (values[0] * 100);
+    const alert_event_t event = alert_check(&alert_state, temp, settings_get(SETTING_THRESHOLD),
+                                            settings_get(SETTING_HYSTERESIS),
+                                            (uint32_t) settings_get(SETTING_ALERT_INTERVAL) * 1000, now_ms);
+    if (event == ALERT_NONE) return;
+
+    char payload[160];
+    snprintf(payload, sizeof(payload), PROTOCOL_ALERT, event, temp, (int) settings_get(SETTING_THRESHOLD),
+             "52.520008", "13.404954", 0);
+    queue(OUTBOX_ALERT, payload);
+    sim.alerts++;
+}
+
+static report_state_t last_report;
+
+// the scheduled report: telemetry, a heartbeat or nothing (see queueReport() in main.cpp)
+static void queue_report(int loop_counter) {
+    const char *keys[REPORT_MAX_CHANNELS];
+    int32_t values[REPORT_MAX_CHANNELS];
+    const size_t count = sensors_values(keys, values, REPORT_MAX_CHANNELS);
+    const report_action_t action = report_check(&last_report, keys, values, count, (uint32_t) (now + 1));
+
+    char payload[TELEMETRY_JSON_SIZE];
+    if (action == REPORT_TELEMETRY) {
+        telemetry_t telemetry = {0};
+        telemetry_set_sensors(&telemetry, keys, values, count);
+        telemetry_set_string(&telemetry, TELEMETRY_LATITUDE, "52.520008");
+        telemetry_set_string(&telemetry, TELEMETRY_LONGITUDE, "13.404954");
+        telemetry.battery = 100;
+        telemetry.loop = loop_counter;
+        telemetry.present |= 1u << TELEMETRY_BATTERY | 1u << TELEMETRY_LOOP | 1u << TELEMETRY_ERROR;
+        telemetry_json(&telemetry, payload);
+        queue(OUTBOX_TELEMETRY, payload);
+        sim.telemetry++;
+    } else if (action == REPORT_HEARTBEAT) {
+        snprintf(payload, sizeof(payload), PROTOCOL_HEARTBEAT, loop_counter);
+        queue(OUTBOX_TELEMETRY, payload);
+        sim.heartbeats++;
+    } else {
+        sim.skipped++;
+    }
+    report_sent(&last_report, action, keys, values, count, (uint32_t) (now + 1));
+}
+
+// size of a message on the link: envelope (see protocol.c), PUBLISH header and topic, TCP/IP
+static size_t message_bytes(const char *payload) {
+    const size_t envelope = strlen("{\"v\":\"" PROTOCOL_VERSION_FULL "\",\"a\":\"\",\"k\":\"\",\"s\":\"\",\"p\":}") +
+                            PROTOCOL_AUTH_LENGTH + PROTOCOL_KEY_LENGTH + PROTOCOL_SIGNATURE_LENGTH;
+    return envelope + strlen(payload) + MQTT_PUBLISH_HEADER + TOPIC_LENGTH + TCP_OVERHEAD;
+}
+
+static void transmit(uint64_t bytes) {
+    const uint64_t tx_ms = bytes * 8 * 1000 / modem.uplink_bps;
+    // the clock does not advance: close the idle time so far, the transfer takes the time after it
+    modem_enter(modem_state);
+    sim.state_ms[MODEM_TX] += tx_ms;
+    modem_since += tx_ms;
+    sim.link_bytes += bytes;
+    last_activity = now;
+    if (next_ping != NEVER && now > next_ping && now - next_ping > sim.keepalive_late_ms)
+        sim.keepalive_late_ms = now - next_ping;
+    // the client only pings if nothing was sent for a keep alive interval
+    next_ping = now + MAX_INTERVAL * 1000ULL;
+}
+
+static void drain(void) {
+    outbox_class_t cls;
+    outbox_entry_t *entry;
+    while ((entry = outbox_peek(&outbox, &cls)) != NULL) {
+        sim.payload_bytes += strlen(entry->payload);
+        transmit(message_bytes(entry->payload));
+        outbox_pop(&outbox, cls);
+    }
+}
+
+// the MQTT thread: connect when there is something to send, then publish everything
+static void flush(void) {
+    if (!outbox_pending(&outbox)) return;
+    if (modem_state == MODEM_IDLE) {
+        drain();
+    } else if (modem_state == MODEM_OFF && retry_at <= now) {
+        modem_enter(MODEM_ATTACHING);
+        sim.attaches++;
+        attach_fails = uniform() < modem.fail_rate;
+        attach_done = now + modem.attach_ms + (uint64_t) (uniform() * modem.attach_jitter_ms);
+    }
+}
+
+static void attached(void) {
+    attach_done = NEVER;
+    if (attach_fails) {
+        sim.attach_failures++;
+        modem_enter(MODEM_OFF);
+        retry_at = now + modem.retry_ms;
+        return;
+    }
+    modem_enter(MODEM_IDLE);
+    sim.link_bytes += MQTT_CONNECT_BYTES;
+    next_ping = now + MAX_INTERVAL * 1000ULL;
+    next_poll = now;
+    drain();
+}
+
+// the connected MQTT thread: a yield slice with the UART clocked, the client pings from within it if the keep alive is
+// due during the slice, then sleep until the next poll (or ring) or until the keep alive is due, as mqtt_thread() does
+static void poll(void) {
+    if (next_ping <= now + YIELD_SLICE) {
+        transmit(MQTT_PING_BYTES);
+        sim.pings++;
+    }
+    run_pending += RUN_TICK_MS;
+    poll_until = now + YIELD_SLICE;
+    const uint32_t keepalive_ms = next_ping > poll_until ? (uint32_t) (next_ping - poll_until) : 0;
+    next_poll = poll_until + schedule_mqtt_wait(ring ? RING_WAIT : poll_ms, keepalive_ms);
+    sim.polls++;
+}
+
+// the idle time until the next event, spent as the power policy decides
+static void idle(uint64_t next) {
+    const uint32_t run = run_pending < next - now ? run_pending : (uint32_t) (next - now);
+    const uint32_t idle_ms = (uint32_t) (next - now) - run;
+    run_pending = 0;
+    if (!idle_ms) return;
+
+    // the MQTT thread keeps the UART clocked while attaching and while polling the connection
+    const bool locked = !tickless || modem_state == MODEM_ATTACHING ||
+                        (modem_state >= MODEM_IDLE && now < poll_until);
+    if (locked) power_lock_deepsleep();
+    const power_state_t state = power_select(idle_ms);
+    power_account(state, idle_ms);
+    sim.mcu_ms[state] += idle_ms;
+    if (state == POWER_DEEPSLEEP) sim.wakeups++;
+    if (locked) power_unlock_deepsleep();
+}
+
+// === MAIN ===
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [options]\n"
+                    "  -d <days>       simulated time (default 30)\n"
+                    "  -t <trace.csv>  sensor trace (seconds,temperature,pressure,humidity), repeated\n"
+                    "  -s <key=value>  setting as sent by the server, e.g. -s i=600 -s th=2500 (repeatable)\n"
+                    "  -a <ms>         modem attach time (default %u)\n"
+                    "  -j <ms>         attach time jitter (default %u)\n"
+                    "  -f <rate>       attach failure rate (default %.2f)\n"
+                    "  -r <ms>         retry delay after a failed attach (default %u)\n"
+                    "  -l <ms>         power the modem down after being idle, -1 stays connected (default)\n"
+                    "  -I <mA,...>     modem current off,attaching,idle,tx\n"
+                    "  -M <mA,...>     MCU current run,sleep,deep sleep\n"
+                    "  -W              idle with WFI only, without tickless deep sleep\n"
+                    "  -R              the modem RI line wakes the MQTT thread, it polls only every %u ms\n"
+                    "  -p <ms>         without it, poll the modem for %u ms this often, 0 polls continuously (default %u)\n"
+                    "  -b <mAh>        battery capacity for the lifetime estimate (default 2600)\n"
+                    "  -S <seed>       random seed\n",
+            name, modem.attach_ms, modem.attach_jitter_ms, modem.fail_rate, modem.retry_ms, RING_WAIT, YIELD_SLICE,
+            poll_ms);
+}
+
+int main(int argc, char *argv[]) {
+    double days = 30, battery_mah = 2600;
+
+    settings_init();
+    settings_update_t update;
+    memset(&update, 0, sizeof(update));
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:t:s:a:j:f:r:l:I:M:WRp:b:S:h")) != -1) {
+        switch (opt) {
+            case 'd': days = atof(optarg); break;
+            case 't':
+                if (!trace_load(optarg)) {
+                    fprintf(stderr, "can't load trace %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's': {
+                const char *eq = strchr(optarg, '=');
+                if (!eq || settings_stage(&update, optarg, (size_t) (eq - optarg), eq + 1, strlen(eq + 1))) {
+                    fprintf(stderr, "invalid setting %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'a': modem.attach_ms = (uint32_t) atol(optarg); break;
+            case 'j': modem.attach_jitter_ms = (uint32_t) atol(optarg); break;
+            case 'f': modem.fail_rate = atof(optarg); break;
+            case 'r': modem.retry_ms = (uint32_t) atol(optarg); break;
+            case 'l': modem.linger_ms = atoll(optarg); break;
+            case 'I':
+                sscanf(optarg, "%lf,%lf,%lf,%lf", &modem.current_ma[MODEM_OFF], &modem.current_ma[MODEM_ATTACHING],
+                       &modem.current_ma[MODEM_IDLE], &modem.current_ma[MODEM_TX]);
+                break;
+            case 'M':
+                sscanf(optarg, "%lf,%lf,%lf", &mcu_current_ma[POWER_RUN], &mcu_current_ma[POWER_SLEEP],
+                       &mcu_current_ma[POWER_DEEPSLEEP]);
+                break;
+            case 'W': tickless = false; break;
+            case 'R': ring = true; break;
+            case 'p': poll_ms = (uint32_t) atol(optarg); break;
+            case 'b': battery_mah = atof(optarg); break;
+            case 'S': rng = (uint32_t) atol(optarg) | 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    settings_commit(&update);
+
+    alert_init(&alert_state);
+    report_init(&last_report);
+    sensors_init(NULL, NULL, sampled);
+    bme_id = sensors_register(&trace_driver);
+
+    const clock_t started = clock();
+    const uint64_t end = (uint64_t) (days * DAY_MS);
+    uint64_t next_sensor = 0, next_loop = 0, next_tick = 0;
+    int loop_counter = 0;
+
+    // the uptime passed to the firmware modules is 32 bit, it starts at 1 like after boot
+    while (now < end) {
+        if (now == next_sensor) next_sensor = now + sensors_run((uint32_t) (now + 1));
+
+        if (now == next_loop) {
+            const uint32_t due = schedule_loop((uint32_t) loop_counter, settings_get(SETTING_INTERVAL));
+            if (due & SCHEDULE_REPORT) queue_report(loop_counter);
+            if (due & SCHEDULE_STATS) {
+                uint32_t dropped = 0;
+                for (int c = 0; c < OUTBOX_CLASSES; c++) dropped += outbox_dropped(&outbox, (outbox_class_t) c);
+                stats_set(STAT_DROPPED, dropped);
+                power_update_stats((uint32_t) (now + 1));
+                char *payload = stats_payload();
+                queue(OUTBOX_STATS, payload);
+                free(payload);
+            }
+            loop_counter++;
+            next_loop = now + LOOP_PERIOD;
+        }
+
+        if (now == next_tick) {
+            run_pending += RUN_TICK_MS;
+            next_tick = now + LOG_IDLE_PERIOD;
+        }
+        if (now == attach_done) attached();
+        if (now == next_poll && modem_state == MODEM_IDLE) poll();
+        if (modem.linger_ms >= 0 && modem_state == MODEM_IDLE && now >= last_activity + (uint64_t) modem.linger_ms) {
+            modem_enter(MODEM_OFF);
+            next_ping = NEVER;
+            next_poll = NEVER;
+        }
+        flush();
+
+        // advance to the next event
+        uint64_t next = next_sensor < next_loop ? next_sensor : next_loop;
+        if (next_tick < next) next = next_tick;
+        if (attach_done < next) next = attach_done;
+        if (next_poll < next) next = next_poll;
+        if (poll_until > now && poll_until < next) next = poll_until;
+        if (retry_at > now && retry_at < next && outbox_pending(&outbox)) next = retry_at;
+        if (modem.linger_ms >= 0 && modem_state == MODEM_IDLE && last_activity + (uint64_t) modem.linger_ms < next)
+            next = last_activity + (uint64_t) modem.linger_ms;
+        if (next <= now) next = now + 1;
+        idle(next);
+        now = next;
+    }
+    if (now > end) now = end;
+    modem_enter(modem_state);
+    // a transfer that runs past the end
+    if (modem_since > now) sim.state_ms[MODEM_TX] -= modem_since - now;
+    for (int c = 0; c < OUTBOX_CLASSES; c++) sim.dropped += outbox_dropped(&outbox, (outbox_class_t) c);
+
+    // charge per component
+    const double hours = now / 3600000.0;
+    double modem_mah = 0;
+    uint64_t radio_ms = 0;
+    for (int s = 0; s < MODEM_STATES; s++) {
+        modem_mah += modem.current_ma[s] * sim.state_ms[s] / 3600000.0;
+        if (s != MODEM_OFF) radio_ms += sim.state_ms[s];
+    }
+    uint64_t *const mcu_ms = sim.mcu_ms;
+    mcu_ms[POWER_RUN] = now - mcu_ms[POWER_SLEEP] - mcu_ms[POWER_DEEPSLEEP];
+    double mcu_mah = 0;
+    for (int s = 0; s < POWER_STATES; s++) mcu_mah += mcu_current_ma[s] * mcu_ms[s] / 3600000.0;
+    const double sensor_mah = sim.sensor_uah / 1000.0;
+    const double total_mah = modem_mah + mcu_mah + sensor_mah;
+
+    printf("simulated        %.1f days in %.2f s\n", hours / 24, (double) (clock() - started) / CLOCKS_PER_SEC);
+    printf("messages         %u telemetry, %u heartbeats, %u alerts, %u dropped (%u reports skipped)\n",
+           sim.telemetry, sim.heartbeats, sim.alerts, sim.dropped, sim.skipped);
+    printf("bytes            %llu payload, %llu on the link (%u pings)\n", (unsigned long long) sim.payload_bytes,
+           (unsigned long long) sim.link_bytes, sim.pings);
+    printf("polls            %u\n", sim.polls);
+    printf("keep alive       %llu ms late at most (interval %u s)\n", (unsigned long long) sim.keepalive_late_ms,
+           MAX_INTERVAL);
+    printf("attaches         %u (%u failed)\n", sim.attaches, sim.attach_failures);
+    printf("radio on         %.1f h (%.1f %%)\n", radio_ms / 3600000.0, 100.0 * radio_ms / (double) now);
+    for (int s = 0; s < MODEM_STATES; s++)
+        printf("  %-14s %.1f h\n", modem_names[s], sim.state_ms[s] / 3600000.0);
+    printf("mcu              run %.1f h, sleep %.1f h, deep sleep %.1f h, %u wake-ups\n", mcu_ms[POWER_RUN] / 3600000.0,
+           mcu_ms[POWER_SLEEP] / 3600000.0, mcu_ms[POWER_DEEPSLEEP] / 3600000.0, sim.wakeups);
+    printf("charge           %.1f mAh (modem %.1f, mcu %.1f, sensor %.3f)\n", total_mah, modem_mah, mcu_mah,
+           sensor_mah);
+    printf("average current  %.2f mA, %.0f days on %.0f mAh\n", total_mah / hours, battery_mah / (total_mah / hours) / 24,
+           battery_mah);
+
+    // a ping later than the keep alive interval, the broker may take the connection for dead
+    if (sim.keepalive_late_ms) {
+        fprintf(stderr, "keep alive missed by %llu ms\n", (unsigned long long) sim.keepalive_late_ms);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*!
+ * @file
+ * @brief Telemetry payload decoder and serializer check.
+ *
+ * Decodes binary telemetry payloads (telemetry_encode(), one hex encoded
+ * payload per line on stdin) and prints them as the JSON the firmware sends,
+ * or with -u in physical units (the integer divided by the scale of the
+ * field).
+ *
+ * -c checks the serializers with random payloads: the JSON writer against
+ * the printf template it replaced, and the binary encoding decoded again.
+ * It also reports the sizes and times of printf, the JSON writer and the
+ * binary encoder.
+ *
+ * @date 2017-04-26
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "telemetry.h"
+
+#define CHECK_ROUNDS 100000
+
+// the printf template of queueTelemetry() before the schema, the JSON writer must match it
+static const char *const payload_template = "{\"t\":%ld,\"p\":%ld,\"h\":%ld,\"a\":%ld,\"la\":\"%s\",\"lo\":\"%s\","
+                                            "\"ba\":%d,\"lp\":%d,\"e\":%d}";
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// === DECODE ===
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void print_units(const telemetry_t *t) {
+    printf("{");
+    const char *separator = "";
+#define PRINT_FIELD_INT(member, scale) printf("%.*f", (scale) >= 100 ? 2 : (scale) >= 10 ? 1 : 0, \
+                                              (double) (member) / (scale))
+#define PRINT_FIELD_STRING(member, scale) printf("\"%s\"", (member))
+#define TELEMETRY_PRINT(id, member, key, type, scale) \
+    if (t->present & (1u << id)) { \
+        printf("%s\"" key "\":", separator); \
+        PRINT_##type(t->member, scale); \
+        separator = ","; \
+    }
+    TELEMETRY_SCHEMA(TELEMETRY_PRINT)
+#undef TELEMETRY_PRINT
+    printf("}\n");
+}
+
+static int decode(bool units) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int invalid = 0;
+    while ((n = getline(&line, &cap, stdin)) > 0) {
+        while (n && (line[n - 1] == '\n' || line[n - 1] == '\r')) n--;
+        if (!n) continue;
+
+        uint8_t binary[TELEMETRY_BINARY_SIZE];
+        size_t len = 0;
+        bool valid = n % 2 == 0 && (size_t) n / 2 <= sizeof(binary);
+        for (ssize_t i = 0; valid && i < n; i += 2) {
+            const int high = hex_value(line[i]), low = hex_value(line[i + 1]);
+            valid = high >= 0 && low >= 0;
+            binary[len++] = (uint8_t) (high << 4 | low);
+        }
+
+        telemetry_t telemetry;
+        if (!valid || !telemetry_decode(binary, len, &telemetry)) {
+            fprintf(stderr, "invalid payload: %.*s\n", (int) n, line);
+            invalid++;
+            continue;
+        }
+        if (units) {
+            print_units(&telemetry);
+        } else {
+            char json[TELEMETRY_JSON_SIZE];
+            telemetry_json(&telemetry, json);
+            printf("%s\n", json);
+        }
+    }
+    free(line);
+    return invalid ? 1 : 0;
+}
+
+// === CHECK ===
+
+static int32_t random_int(void) {
+    // mostly sensor sized values, sometimes the extremes
+    switch (rand() % 8) {
+        case 0: return INT32_MIN;
+        case 1: return INT32_MAX;
+        case 2: return (int32_t) ((uint32_t) rand() << 16 ^ (uint32_t) rand());
+        default: return rand() % 200001 - 100000;
+    }
+}
+
+static void random_telemetry(telemetry_t *t) {
+    memset(t, 0, sizeof(telemetry_t));
+    t->temperature = random_int();
+    t->pressure = random_int();
+    t->humidity = random_int();
+    t->altitude = random_int();
+    snprintf(t->latitude, sizeof(t->latitude), "%d.%06d", rand() % 181 - 90, rand() % 1000000);
+    snprintf(t->longitude, sizeof(t->longitude), "%d.%06d", rand() % 361 - 180, rand() % 1000000);
+    t->battery = rand() % 101;
+    t->loop = random_int();
+    t->error = rand() % 256;
+    t->present = (1u << TELEMETRY_FIELDS) - 1;
+}
+
+static size_t print_template(const telemetry_t *t, char *out, size_t max) {
+    return (size_t) snprintf(out, max, payload_template, (long) t->temperature, (long) t->pressure,
+                             (long) t->humidity, (long) t->altitude, t->latitude, t->longitude, (int) t->battery,
+                             (int) t->loop, (int) t->error);
+}
+
+static int check(void) {
+    static telemetry_t payloads[1024];
+    unsigned long differ = 0, roundtrip = 0, json_max = 0, binary_max = 0, json_total = 0, binary_total = 0;
+
+    for (int round = 0; round < CHECK_ROUNDS; round++) {
+        telemetry_t *t = &payloads[round % 1024];
+        random_telemetry(t);
+        char expected[512], json[TELEMETRY_JSON_SIZE];
+        print_template(t, expected, sizeof(expected));
+        const size_t json_len = telemetry_json(t, json);
+        if (strcmp(expected, json) != 0 && !differ++) fprintf(stderr, "differs:\n  %s\n  %s\n", expected, json);
+
+        // some fields missing, the binary encoding must give back the same payload
+        t->present &= (uint16_t) rand();
+        uint8_t binary[TELEMETRY_BINARY_SIZE];
+        const size_t binary_len = telemetry_encode(t, binary);
+        telemetry_t decoded;
+        char original[TELEMETRY_JSON_SIZE], again[TELEMETRY_JSON_SIZE];
+        telemetry_json(t, original);
+        if (!telemetry_decode(binary, binary_len, &decoded) || (telemetry_json(&decoded, again), strcmp(original, again))) {
+            if (!roundtrip++) fprintf(stderr, "binary round trip differs: %s\n", original);
+        }
+        // truncated encodings must be rejected
+        if (binary_len > 2 && telemetry_decode(binary, binary_len - 1, &decoded) && !roundtrip++) {
+            fprintf(stderr, "truncated binary accepted: %s\n", original);
+        }
+
+        if (json_len > json_max) json_max = json_len;
+        if (binary_len > binary_max) binary_max = binary_len;
+        json_total += json_len;
+        binary_total += binary_len;
+    }
+    printf("%d payloads: %lu differ from the template, %lu binary round trips failed\n", CHECK_ROUNDS, differ,
+           roundtrip);
+    printf("size      : JSON %.1f avg, %lu max (buffer %zu), binary %.1f avg, %lu max (buffer %zu)\n",
+           (double) json_total / CHECK_ROUNDS, json_max, (size_t) TELEMETRY_JSON_SIZE, (double) binary_total / CHECK_ROUNDS,
+           binary_max, (size_t) TELEMETRY_BINARY_SIZE);
+
+    // all fields, as sent
+    for (int i = 0; i < 1024; i++) random_telemetry(&payloads[i]);
+    char out[512];
+    volatile size_t sink = 0;
+    double start = now_s();
+    for (int round = 0; round < CHECK_ROUNDS; round++) sink += print_template(&payloads[round % 1024], out, sizeof(out));
+    const double printf_ns = (now_s() - start) / CHECK_ROUNDS * 1e9;
+    start = now_s();
+    for (int round = 0; round < CHECK_ROUNDS; round++) sink += telemetry_json(&payloads[round % 1024], out);
+    const double json_ns = (now_s() - start) / CHECK_ROUNDS * 1e9;
+    start = now_s();
+    for (int round = 0; round < CHECK_ROUNDS; round++) sink += telemetry_encode(&payloads[round % 1024], (uint8_t *) out);
+    const double binary_ns = (now_s() - start) / CHECK_ROUNDS * 1e9;
+    (void) sink;
+    printf("time      : printf %.0f ns, JSON writer %.0f ns, binary %.0f ns per payload\n", printf_ns, json_ns,
+           binary_ns);
+
+    return differ || roundtrip ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    bool units = false, run_check = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "uc")) != -1) {
+        switch (opt) {
+            case 'u': units = true; break;
+            case 'c': run_check = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-u] [-c] < payloads\n"
+                                "  -u   print the values in physical units\n"
+                                "  -c   check the serializers with random payloads (no input)\n", argv[0]);
+                return 1;
+        }
+    }
+    srand(1);
+    return run_check ? check() : decode(units);
+}
@@ -0,0 +1,377 @@
+/*!
+ * @file
+ * @brief TLS handshake benchmark: full versus resumed, per cipher profile.
+ *
+ * Runs a TLS broker stand-in on the loopback interface (it answers the MQTT
+ * CONNECT with a CONNACK) and connects to it repeatedly with the cipher
+ * profiles of tls_network.h, once with a full handshake and once resuming the
+ * previous session. Reports the handshake bytes in both directions, the round
+ * trips, the client CPU time and the time this would take over a GPRS link
+ * with the given round trip time and data rate.
+ *
+ * The firmware uses wolfSSL, the benchmark uses OpenSSL on both ends, and
+ * says so in its output. The byte counts and round trips are defined by the
+ * TLS 1.2 protocol and the certificate, the CPU time is a host figure to
+ * compare profiles only, not the firmware's.
+ *
+ * @date 2017-04-18
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#define PSK_IDENTITY "device"
+
+static const unsigned char psk_key[32] = {
+        0x75, 0x62, 0x69, 0x72, 0x63, 0x68, 0x2d, 0x65, 0x6e, 0x76, 0x2d, 0x73, 0x65, 0x6e, 0x73, 0x6f,
+        0x72, 0x2d, 0x74, 0x6c, 0x73, 0x2d, 0x62, 0x65, 0x6e, 0x63, 0x68, 0x2d, 0x70, 0x73, 0x6b, 0x21
+};
+
+// MQTT 3.1.1 CONNECT (client "bench", clean session, keep alive 1800), CONNACK and DISCONNECT
+static const unsigned char mqtt_connect[] = {0x10, 0x11, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x07, 0x08,
+                                             0x00, 0x05, 'b', 'e', 'n', 'c', 'h'};
+static const unsigned char mqtt_connack[] = {0x20, 0x02, 0x00, 0x00};
+static const unsigned char mqtt_disconnect[] = {0xe0, 0x00};
+
+//! cipher profiles, see tls_network.h
+typedef struct {
+    const char *name;
+    const char *ciphers;
+    bool certificate;
+} profile_t;
+
+static const profile_t profiles[] = {
+        {"psk",   "PSK-CHACHA20-POLY1305",         false},
+        {"ecdhe", "ECDHE-ECDSA-CHACHA20-POLY1305", true},
+};
+#define PROFILES (sizeof(profiles) / sizeof(profiles[0]))
+
+//! what the client saw of a handshake
+typedef struct {
+    uint64_t sent;
+    uint64_t received;
+    uint32_t round_trips;
+    bool writing;           //!< the last transfer was a write, the next read waits for the peer
+} traffic_t;
+
+static int iterations = 50;
+static double rtt_ms = 600;
+static double link_bps = 20000;
+static bool tickets = true;
+
+static EVP_PKEY *server_key = NULL;
+static X509 *server_cert = NULL;
+
+static void fail(const char *what) {
+    fprintf(stderr, "%s failed\n", what);
+    ERR_print_errors_fp(stderr);
+    exit(1);
+}
+
+static double elapsed_us(const struct timespec *start, clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+// === CREDENTIALS ===
+
+static void create_certificate(void) {
+    server_key = EVP_EC_gen("P-256");
+    server_cert = X509_new();
+    if (!server_key || !server_cert) fail("key generation");
+
+    X509_set_version(server_cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(server_cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(server_cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(server_cert), 365L * 24 * 3600);
+    X509_set_pubkey(server_cert, server_key);
+    X509_NAME *name = X509_get_subject_name(server_cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "localhost", -1, -1, 0);
+    X509_set_issuer_name(server_cert, name);
+    if (!X509_sign(server_cert, server_key, EVP_sha256())) fail("certificate signing");
+}
+
+static unsigned int psk_client(SSL *ssl, const char *hint, char *identity, unsigned int identity_max,
+                               unsigned char *key, unsigned int key_max) {
+    (void) ssl;
+    (void) hint;
+    if (strlen(PSK_IDENTITY) >= identity_max || sizeof(psk_key) > key_max) return 0;
+    strcpy(identity, PSK_IDENTITY);
+    memcpy(key, psk_key, sizeof(psk_key));
+    return sizeof(psk_key);
+}
+
+static unsigned int psk_server(SSL *ssl, const char *identity, unsigned char *key, unsigned int key_max) {
+    (void) ssl;
+    if (strcmp(identity, PSK_IDENTITY) != 0 || sizeof(psk_key) > key_max) return 0;
+    memcpy(key, psk_key, sizeof(psk_key));
+    return sizeof(psk_key);
+}
+
+static SSL_CTX *create_context(const profile_t *profile, bool server) {
+    SSL_CTX *ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+    if (!ctx) fail("SSL_CTX_new");
+
+    // the firmware speaks TLS 1.2 with a single cipher suite and P-256
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    if (!SSL_CTX_set_cipher_list(ctx, profile->ciphers)) fail("SSL_CTX_set_cipher_list");
+    SSL_CTX_set1_groups_list(ctx, "P-256");
+
+    if (server) {
+        if (profile->certificate) {
+            SSL_CTX_use_certificate(ctx, server_cert);
+            SSL_CTX_use_PrivateKey(ctx, server_key);
+        } else {
+            SSL_CTX_set_psk_server_callback(ctx, psk_server);
+        }
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "tlsbench", 8);
+        if (!tickets) SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    } else {
+        if (profile->certificate) {
+            X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), server_cert);
+            SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+        } else {
+            SSL_CTX_set_psk_client_callback(ctx, psk_client);
+        }
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+    return ctx;
+}
+
+// === BROKER STAND-IN ===
+
+typedef struct {
+    int listener;
+    SSL_CTX *ctx;
+} broker_t;
+
+static bool read_exactly(SSL *ssl, unsigned char *buffer, size_t len) {
+    size_t received = 0;
+    while (received < len) {
+        const int n = SSL_read(ssl, buffer + received, (int) (len - received));
+        if (n <= 0) return false;
+        received += (size_t) n;
+    }
+    return true;
+}
+
+// accepts connections until the listener is closed, answers CONNECT with CONNACK
+static void *broker_thread(void *arg) {
+    broker_t *broker = arg;
+    int fd;
+    while ((fd = accept(broker->listener, NULL, NULL)) >= 0) {
+        SSL *ssl = SSL_new(broker->ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            unsigned char packet[sizeof(mqtt_connect)];
+            if (read_exactly(ssl, packet, sizeof(packet)) && packet[0] == 0x10)
+                SSL_write(ssl, mqtt_connack, sizeof(mqtt_connack));
+            read_exactly(ssl, packet, sizeof(mqtt_disconnect));
+        }
+        // the device does not send a close notify, the session stays resumable anyway
+        SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+// === CLIENT ===
+
+static long count_traffic(BIO *bio, int oper, const char *argp, size_t len, int argi, long argl, int ret,
+                          size_t *processed) {
+    (void) argp;
+    (void) len;
+    (void) argi;
+    (void) argl;
+    traffic_t *traffic = (traffic_t *) BIO_get_callback_arg(bio);
+    if (!traffic || ret <= 0 || !processed) return ret;
+
+    if (oper == (BIO_CB_WRITE | BIO_CB_RETURN)) {
+        traffic->sent += *processed;
+        traffic->writing = true;
+    } else if (oper == (BIO_CB_READ | BIO_CB_RETURN)) {
+        traffic->received += *processed;
+        if (traffic->writing) traffic->round_trips++;
+        traffic->writing = false;
+    }
+    return ret;
+}
+
+static int connect_broker(uint16_t port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) fail("connect");
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+//! results of one profile and handshake kind
+typedef struct {
+    traffic_t traffic;      //!< of the last handshake
+    double cpu_us;
+    double wall_us;
+    int resumed;
+} result_t;
+
+/*!
+ * Connect, handshake (resuming the session if given), do the MQTT connect and disconnect.
+ * @return the session of the connection
+ */
+static SSL_SESSION *connect_once(SSL_CTX *ctx, uint16_t port, SSL_SESSION *session, result_t *result) {
+    const int fd = connect_broker(port);
+    SSL *ssl = SSL_new(ctx);
+    BIO *bio = BIO_new_socket(fd, BIO_NOCLOSE);
+    traffic_t traffic = {0};
+    BIO_set_callback_arg(bio, (char *) &traffic);
+    BIO_set_callback_ex(bio, count_traffic);
+    SSL_set_bio(ssl, bio, bio);
+    if (session) SSL_set_session(ssl, session);
+
+    struct timespec cpu_start, wall_start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    if (SSL_connect(ssl) != 1) fail("handshake");
+    result->cpu_us += elapsed_us(&cpu_start, CLOCK_THREAD_CPUTIME_ID);
+    result->wall_us += elapsed_us(&wall_start, CLOCK_MONOTONIC);
+    result->resumed += SSL_session_reused(ssl);
+    result->traffic = traffic;
+
+    unsigned char connack[sizeof(mqtt_connack)];
+    SSL_write(ssl, mqtt_connect, sizeof(mqtt_connect));
+    if (!read_exactly(ssl, connack, sizeof(connack)) || connack[0] != 0x20) fail("MQTT connect");
+    SSL_write(ssl, mqtt_disconnect, sizeof(mqtt_disconnect));
+
+    // like the firmware, no close notify; OpenSSL would drop the session otherwise
+    SSL_SESSION *next = SSL_get1_session(ssl);
+    SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(ssl);
+    close(fd);
+    return next;
+}
+
+static void print_result(const profile_t *profile, const char *kind, const result_t *result) {
+    const traffic_t *t = &result->traffic;
+    const double link_ms = t->round_trips * rtt_ms + (t->sent + t->received) * 8 * 1000.0 / link_bps;
+    printf("%-6s %-8s %9llu %9llu %6u %8.0f %8.0f %8.0f %5d/%d\n", profile->name, kind,
+           (unsigned long long) t->sent, (unsigned long long) t->received, t->round_trips,
+           result->cpu_us / iterations, result->wall_us / iterations, link_ms, result->resumed, iterations);
+}
+
+static void run(const profile_t *profile) {
+    broker_t broker = {socket(AF_INET, SOCK_STREAM, 0), create_context(profile, true)};
+    struct sockaddr_in address = {0};
+    socklen_t address_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(broker.listener, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(broker.listener, 4) != 0 ||
+        getsockname(broker.listener, (struct sockaddr *) &address, &address_len) != 0)
+        fail("listen");
+    const uint16_t port = ntohs(address.sin_port);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, broker_thread, &broker);
+
+    SSL_CTX *ctx = create_context(profile, false);
+    result_t full = {0}, resumed = {0};
+    for (int i = 0; i < iterations; i++) {
+        // a full handshake, then a reconnect resuming its session
+        SSL_SESSION *session = connect_once(ctx, port, NULL, &full);
+        SSL_SESSION *next = connect_once(ctx, port, session, &resumed);
+        SSL_SESSION_free(session);
+        SSL_SESSION_free(next);
+    }
+    print_result(profile, "full", &full);
+    print_result(profile, "resumed", &resumed);
+
+    shutdown(broker.listener, SHUT_RDWR);
+    close(broker.listener);
+    pthread_join(thread, NULL);
+    SSL_CTX_free(ctx);
+    SSL_CTX_free(broker.ctx);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [options]\n"
+                    "  -p <profile>  psk or ecdhe (default both)\n"
+                    "  -n <count>    handshakes per kind (default %d)\n"
+                    "  -r <ms>       round trip time of the modeled link (default %.0f)\n"
+                    "  -b <bps>      data rate of the modeled link (default %.0f)\n"
+                    "  -T            no session tickets, resume from the broker session cache\n",
+            name, iterations, rtt_ms, link_bps);
+}
+
+int main(int argc, char *argv[]) {
+    const char *only = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:r:b:Th")) != -1) {
+        switch (opt) {
+            case 'p': only = optarg; break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'r': rtt_ms = atof(optarg); break;
+            case 'b': link_bps = atof(optarg); break;
+            case 'T': tickets = false; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (iterations < 1) iterations = 1;
+
+    create_certificate();
+    printf("TLS 1.2, %d handshakes each, link %.0f ms round trip at %.0f bps, resumption with %s\n", iterations,
+           rtt_ms, link_bps, tickets ? "session tickets" : "session IDs");
+    printf("%s on both ends, not the firmware's wolfSSL: bytes and round trips follow from TLS 1.2,\n"
+           "the CPU and wall times are host figures to compare the profiles, not the device's\n\n",
+           OpenSSL_version(OPENSSL_VERSION));
+    printf("%-6s %-8s %9s %9s %6s %8s %8s %8s %7s\n", "", "", "sent", "received", "trips", "cpu us", "wall us",
+           "link ms", "resumed");
+    for (size_t p = 0; p < PROFILES; p++) {
+        if (only && strcmp(only, profiles[p].name) != 0) continue;
+        run(&profiles[p]);
+    }
+
+    X509_free(server_cert);
+    EVP_PKEY_free(server_key);
+    return 0;
+}
@@ -0,0 +1,671 @@
+/*!
+ * @file
+ * @brief Bulk verifier for signed device messages.
+ *
+ * Reads device messages, one per line as published by the firmware
+ * (`{"v","a","k","s","p"}`, or `{"v","sid","s","p"}` in session mode), and
+ * verifies the payload signatures on all cores. The verification is the
+ * firmware crypto unit (crypto/crypto.c): uc_base64_decode(),
+ * uc_import_ecc_pub_key() and uc_ecc_verify().
+ *
+ * The messages are split into ranges, one per worker. A worker takes small
+ * batches from the front of its own range; when it runs dry it steals the back
+ * half of the largest remaining range of another worker. Each worker keeps its
+ * own cache of imported device keys, so the hot path takes no shared locks.
+ *
+ * Session IDs are bound to keys by the identity messages (`"y":"i"`), they are
+ * collected while loading, before the messages are verified in parallel. An
+ * identity message only binds its session ID if its signature is valid. A
+ * session ID that is bound to another key as well can not be attributed to a
+ * device, its messages are reported as a session conflict.
+ *
+ * Batch signed messages (`"i"`, `"n"`, `"m"`) are checked against the Merkle
+ * root their inclusion proof gives (protocol_batch_root()). The messages of a
+ * window share the signature, each worker remembers the roots it verified, so
+ * a window costs one signature check per worker that sees it.
+ *
+ * With -g the tool creates test messages with the firmware signing path, with
+ * -b batch signed in windows of that many messages per device.
+ *
+ * @date 2017-04-19
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "crypto/crypto.h"
+#include "jsmn/jsmn.h"
+#include "log.h"
+#include "protocol.h"
+#include "sensor.h"
+
+#define MAX_THREADS 256
+#define MAX_TOKENS 128          //!< envelope and payload
+#define BATCH 16                //!< messages a worker takes from its range at once
+#define CACHE_SIZE 4096         //!< keys cached per worker (power of 2)
+#define CACHE_PROBES 8
+#define SESSIONS_SIZE 65536     //!< session ID table (power of 2)
+#define ROOTS_SIZE 1024         //!< verified Merkle roots remembered per worker (power of 2)
+
+//! verification results
+typedef enum {
+    VERIFY_OK = 0,
+    VERIFY_BAD_SIGNATURE,       //!< the signature does not match
+    VERIFY_UNKNOWN_SESSION,     //!< no valid identity message for the session ID
+    VERIFY_SESSION_CONFLICT,    //!< the session ID was bound to more than one key
+    VERIFY_MALFORMED,           //!< not a device message, or undecodable key or signature
+    VERIFY_RESULTS
+} verify_result_t;
+
+static const char *const result_names[VERIFY_RESULTS] = {"valid", "bad signature", "unknown session",
+                                                         "session conflict", "malformed"};
+
+//! a message, a line of the input
+typedef struct {
+    const char *json;
+    size_t len;
+} message_t;
+
+static message_t *messages = NULL;
+static size_t message_count = 0;
+static uint8_t *results = NULL;
+
+// === INPUT ===
+
+static char *read_all(FILE *f, size_t *len) {
+    size_t size = 1 << 20;
+    char *data = malloc(size);
+    *len = 0;
+    size_t n;
+    while (data && (n = fread(data + *len, 1, size - *len, f)) > 0) {
+        *len += n;
+        if (*len == size) data = realloc(data, size *= 2);
+    }
+    return data;
+}
+
+static void split_lines(char *data, size_t len) {
+    size_t capacity = 1024;
+    messages = malloc(capacity * sizeof(message_t));
+    for (char *line = data, *end = data + len; line < end;) {
+        char *nl = memchr(line, '\n', (size_t) (end - line));
+        if (!nl) nl = end;
+        size_t n = (size_t) (nl - line);
+        if (n && line[n - 1] == '\r') n--;
+        if (n) {
+            if (message_count == capacity) messages = realloc(messages, (capacity *= 2) * sizeof(message_t));
+            messages[message_count].json = line;
+            messages[message_count].len = n;
+            message_count++;
+        }
+        line = nl + 1;
+    }
+}
+
+// === ENVELOPE ===
+
+//! the members of a message envelope, as offsets into the message
+typedef struct {
+    jsmntok_t version, auth, key, sid, signature, payload;
+    jsmntok_t index, count, proof;      //!< inclusion proof of a batch signed message
+} envelope_t;
+
+static bool token_is(const char *json, const jsmntok_t *token, const char *s) {
+    const size_t n = strlen(s);
+    return token->type == JSMN_STRING && (size_t) (token->end - token->start) == n &&
+           strncmp(json + token->start, s, n) == 0;
+}
+
+// parse the top level members, the payload is kept as its raw JSON (that is what is signed)
+static bool parse_envelope(const message_t *m, envelope_t *e, jsmntok_t *tokens) {
+    memset(e, 0, sizeof(envelope_t));
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    const int n = jsmn_parse(&parser, m->json, m->len, tokens, MAX_TOKENS);
+    if (n < 1 || tokens[0].type != JSMN_OBJECT) return false;
+
+    int i = 1;
+    while (i + 1 < n) {
+        const jsmntok_t *key = &tokens[i], *value = &tokens[i + 1];
+        if (token_is(m->json, key, P_VERSION) && value->type == JSMN_STRING) e->version = *value;
+        else if (token_is(m->json, key, "a") && value->type == JSMN_STRING) e->auth = *value;
+        else if (token_is(m->json, key, P_KEY) && value->type == JSMN_STRING) e->key = *value;
+        else if (token_is(m->json, key, "sid") && value->type == JSMN_STRING) e->sid = *value;
+        else if (token_is(m->json, key, P_SIGNATURE) && value->type == JSMN_STRING) e->signature = *value;
+        else if (token_is(m->json, key, P_PAYLOAD) && value->type == JSMN_OBJECT) e->payload = *value;
+        else if (token_is(m->json, key, "i") && value->type == JSMN_PRIMITIVE) e->index = *value;
+        else if (token_is(m->json, key, "n") && value->type == JSMN_PRIMITIVE) e->count = *value;
+        else if (token_is(m->json, key, "m") && value->type == JSMN_ARRAY) e->proof = *value;
+
+        // skip the value and everything nested in it
+        i += 2;
+        while (i < n && tokens[i].start < value->end) i++;
+    }
+    // a proof needs all of its members
+    if ((e->index.end || e->count.end || e->proof.end) && !(e->index.end && e->count.end && e->proof.end))
+        return false;
+    return e->signature.end && e->payload.end && (e->key.end || e->sid.end);
+}
+
+// a non-negative integer that fits 32 bit
+static bool token_uint(const char *json, const jsmntok_t *token, uint32_t *value) {
+    const int len = token->end - token->start;
+    if (len <= 0 || len > 10) return false;
+    uint64_t v = 0;
+    for (int i = 0; i < len; i++) {
+        const char c = json[token->start + i];
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (uint64_t) (c - '0');
+    }
+    if (v > UINT32_MAX) return false;
+    *value = (uint32_t) v;
+    return true;
+}
+
+// === SESSIONS ===
+
+//! session ID to key binding, from the identity messages
+typedef struct {
+    char sid[PROTOCOL_SID_LENGTH + 1];
+    const char *key;
+    size_t key_len;
+    bool conflict;              //!< also announced with another key
+} session_t;
+
+static session_t *sessions = NULL;
+static uint32_t identities_bound = 0, identities_rejected = 0, session_conflicts = 0;
+
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t) s[i]) * 16777619u;
+    return h;
+}
+
+static session_t *session_slot(const char *sid, size_t len) {
+    if (len != PROTOCOL_SID_LENGTH) return NULL;
+    for (uint32_t i = 0, h = hash(sid, len); i < SESSIONS_SIZE; i++) {
+        session_t *s = &sessions[(h + i) & (SESSIONS_SIZE - 1)];
+        if (!s->key || strncmp(s->sid, sid, len) == 0) return s;
+    }
+    return NULL;
+}
+
+// the signature of a message that carries its key, the payload signed directly
+static bool signed_by_key(const message_t *m, const envelope_t *e) {
+    unsigned char raw[ED25519_PUB_KEY_SIZE + 1], signature[ED25519_SIG_SIZE + 1];
+    size_t raw_len = ED25519_PUB_KEY_SIZE, signature_len = ED25519_SIG_SIZE;
+    if (!uc_base64_decode(m->json + e->key.start, (size_t) (e->key.end - e->key.start), raw, &raw_len) ||
+        raw_len != ED25519_PUB_KEY_SIZE ||
+        !uc_base64_decode(m->json + e->signature.start, (size_t) (e->signature.end - e->signature.start),
+                          signature, &signature_len) || signature_len != ED25519_SIG_SIZE)
+        return false;
+
+    uc_ed25519_key key;
+    if (!uc_import_ecc_pub_key(&key, raw, raw_len)) return false;
+    const bool valid = uc_ecc_verify(&key, (const unsigned char *) m->json + e->payload.start,
+                                     (size_t) (e->payload.end - e->payload.start), signature, signature_len);
+    wc_ed25519_free(&key);
+    return valid;
+}
+
+// bind the session IDs announced in valid identity messages, in input order
+static void collect_sessions(void) {
+    sessions = calloc(SESSIONS_SIZE, sizeof(session_t));
+    jsmntok_t tokens[MAX_TOKENS];
+    for (size_t i = 0; i < message_count; i++) {
+        const message_t *m = &messages[i];
+        if (!strstr(m->json, "\"y\":\"i\"")) continue;
+
+        // identity messages are signed on their own, with the key they carry
+        envelope_t e;
+        if (!parse_envelope(m, &e, tokens) || !e.key.end || e.proof.end) continue;
+        const char *sid = strstr(m->json + e.payload.start, "\"sid\":\"");
+        if (!sid || sid >= m->json + e.payload.end) continue;
+        sid += 7;
+
+        session_t *s = session_slot(sid, PROTOCOL_SID_LENGTH);
+        if (!s) continue;
+        if (!signed_by_key(m, &e)) {
+            identities_rejected++;
+            continue;
+        }
+
+        const char *key = m->json + e.key.start;
+        const size_t key_len = (size_t) (e.key.end - e.key.start);
+        if (s->key && (s->key_len != key_len || strncmp(s->key, key, key_len) != 0)) {
+            // keep the first binding, the messages of the session are not attributable any more
+            if (!s->conflict) session_conflicts++;
+            s->conflict = true;
+            continue;
+        }
+        memcpy(s->sid, sid, PROTOCOL_SID_LENGTH);
+        s->key = key;
+        s->key_len = key_len;
+        identities_bound++;
+    }
+}
+
+// === WORKERS ===
+
+//! a cached device key, by its Base64 encoding
+typedef struct {
+    char encoded[PROTOCOL_KEY_LENGTH + 1];
+    bool valid;
+    uc_ed25519_key key;
+} cached_key_t;
+
+//! a Merkle root whose signature was verified, with the key it was verified with (Base64)
+typedef struct {
+    char key[PROTOCOL_KEY_LENGTH];
+    unsigned char root[MERKLE_HASH_SIZE];
+    unsigned char signature[ED25519_SIG_SIZE];
+} verified_root_t;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    pthread_mutex_t lock;       //!< protects next and end
+    size_t next, end;           //!< the remaining range
+    cached_key_t *cache;
+    verified_root_t *roots;
+    uint64_t counts[VERIFY_RESULTS];
+    uint64_t signature_checks;  //!< Ed25519 verifications
+    uint32_t steals;
+    uint32_t key_imports;
+} worker_t;
+
+static worker_t workers[MAX_THREADS];
+static int worker_count = 1;
+
+static uc_ed25519_key *cached_key(worker_t *w, const char *encoded, size_t len) {
+    if (len != PROTOCOL_KEY_LENGTH) return NULL;
+
+    const uint32_t h = hash(encoded, len);
+    cached_key_t *slot = NULL;
+    for (uint32_t i = 0; i < CACHE_PROBES; i++) {
+        cached_key_t *c = &w->cache[(h + i) & (CACHE_SIZE - 1)];
+        if (c->encoded[0] && strncmp(c->encoded, encoded, len) == 0) return c->valid ? &c->key : NULL;
+        if (!c->encoded[0]) {
+            slot = c;
+            break;
+        }
+    }
+    // evict the home slot if the probe sequence is full
+    if (!slot) {
+        slot = &w->cache[h & (CACHE_SIZE - 1)];
+        if (slot->valid) wc_ed25519_free(&slot->key);
+    }
+
+    unsigned char raw[ED25519_PUB_KEY_SIZE + 1];
+    size_t raw_len = ED25519_PUB_KEY_SIZE;
+    memcpy(slot->encoded, encoded, len);
+    slot->encoded[len] = '\0';
+    slot->valid = uc_base64_decode(encoded, len, raw, &raw_len) && raw_len == ED25519_PUB_KEY_SIZE &&
+                  uc_import_ecc_pub_key(&slot->key, raw, raw_len);
+    w->key_imports++;
+    return slot->valid ? &slot->key : NULL;
+}
+
+static verify_result_t verify(worker_t *w, const message_t *m) {
+    jsmntok_t tokens[MAX_TOKENS];
+    envelope_t e;
+    if (!parse_envelope(m, &e, tokens)) return VERIFY_MALFORMED;
+
+    const char *key = m->json + e.key.start;
+    size_t key_len = (size_t) (e.key.end - e.key.start);
+    if (!e.key.end) {
+        const session_t *s = session_slot(m->json + e.sid.start, (size_t) (e.sid.end - e.sid.start));
+        if (!s || !s->key) return VERIFY_UNKNOWN_SESSION;
+        if (s->conflict) return VERIFY_SESSION_CONFLICT;
+        key = s->key;
+        key_len = s->key_len;
+    }
+    uc_ed25519_key *pub = cached_key(w, key, key_len);
+    if (!pub) return VERIFY_MALFORMED;
+
+    unsigned char signature[ED25519_SIG_SIZE + 1];
+    size_t signature_len = ED25519_SIG_SIZE;
+    if (!uc_base64_decode(m->json + e.signature.start, (size_t) (e.signature.end - e.signature.start),
+                          signature, &signature_len) || signature_len != ED25519_SIG_SIZE)
+        return VERIFY_MALFORMED;
+
+    const char *payload = m->json + e.payload.start;
+    const size_t payload_len = (size_t) (e.payload.end - e.payload.start);
+    if (!e.proof.end) {
+        w->signature_checks++;
+        return uc_ecc_verify(pub, (const unsigned char *) payload, payload_len, signature, signature_len)
+               ? VERIFY_OK : VERIFY_BAD_SIGNATURE;
+    }
+
+    // batch signed: the signature covers the root the proof leads to
+    uint32_t index, count;
+    unsigned char root[MERKLE_HASH_SIZE];
+    if (!token_uint(m->json, &e.index, &index) || !token_uint(m->json, &e.count, &count) ||
+        !protocol_batch_root(payload, payload_len, index, count, m->json + e.proof.start,
+                             (size_t) (e.proof.end - e.proof.start), root))
+        return VERIFY_MALFORMED;
+
+    verified_root_t *known = &w->roots[hash((const char *) root, MERKLE_HASH_SIZE) & (ROOTS_SIZE - 1)];
+    if (memcmp(known->key, key, PROTOCOL_KEY_LENGTH) == 0 && memcmp(known->root, root, MERKLE_HASH_SIZE) == 0 &&
+        memcmp(known->signature, signature, ED25519_SIG_SIZE) == 0)
+        return VERIFY_OK;
+
+    w->signature_checks++;
+    if (!uc_ecc_verify(pub, root, MERKLE_HASH_SIZE, signature, signature_len)) return VERIFY_BAD_SIGNATURE;
+    memcpy(known->key, key, PROTOCOL_KEY_LENGTH);
+    memcpy(known->root, root, MERKLE_HASH_SIZE);
+    memcpy(known->signature, signature, ED25519_SIG_SIZE);
+    return VERIFY_OK;
+}
+
+// take a batch from the front of the own range
+static bool take(worker_t *w, size_t *from, size_t *to) {
+    pthread_mutex_lock(&w->lock);
+    *from = w->next;
+    *to = w->next + BATCH < w->end ? w->next + BATCH : w->end;
+    w->next = *to;
+    pthread_mutex_unlock(&w->lock);
+    return *from < *to;
+}
+
+// steal the back half of the largest remaining range
+static bool steal(worker_t *w) {
+    for (;;) {
+        worker_t *victim = NULL;
+        size_t largest = 0;
+        for (int i = 0; i < worker_count; i++) {
+            const size_t remaining = workers[i].end - workers[i].next;
+            if (&workers[i] != w && remaining > largest) {
+                largest = remaining;
+                victim = &workers[i];
+            }
+        }
+        if (!victim) return false;
+
+        pthread_mutex_lock(&victim->lock);
+        const size_t remaining = victim->end - victim->next;
+        size_t from = 0, to = 0;
+        if (remaining > 0) {
+            from = victim->end - (remaining + 1) / 2;
+            to = victim->end;
+            victim->end = from;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        // the victim may have finished meanwhile, look again
+        if (from == to) continue;
+
+        pthread_mutex_lock(&w->lock);
+        w->next = from;
+        w->end = to;
+        pthread_mutex_unlock(&w->lock);
+        w->steals++;
+        return true;
+    }
+}
+
+static void *worker_thread(void *arg) {
+    worker_t *w = arg;
+    size_t from, to;
+    do {
+        while (take(w, &from, &to)) {
+            for (size_t i = from; i < to; i++) {
+                const verify_result_t r = verify(w, &messages[i]);
+                results[i] = (uint8_t) r;
+                w->counts[r]++;
+            }
+        }
+    } while (steal(w));
+    return NULL;
+}
+
+// verify all messages with the given number of threads, returns the time in seconds
+static double run(int threads) {
+    worker_count = threads;
+    for (int i = 0; i < threads; i++) {
+        worker_t *w = &workers[i];
+        memset(w->counts, 0, sizeof(w->counts));
+        w->id = i;
+        w->steals = w->key_imports = 0;
+        w->signature_checks = 0;
+        w->next = message_count * (size_t) i / (size_t) threads;
+        w->end = message_count * (size_t) (i + 1) / (size_t) threads;
+        w->cache = calloc(CACHE_SIZE, sizeof(cached_key_t));
+        w->roots = calloc(ROOTS_SIZE, sizeof(verified_root_t));
+        pthread_mutex_init(&w->lock, NULL);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < threads; i++) pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+    for (int i = 0; i < threads; i++) pthread_join(workers[i].thread, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < threads; i++) {
+        for (int c = 0; c < CACHE_SIZE; c++) if (workers[i].cache[c].valid) wc_ed25519_free(&workers[i].cache[c].key);
+        free(workers[i].cache);
+        free(workers[i].roots);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// === GENERATOR ===
+
+static const char *const generated_template = "{\"t\":%d,\"p\":%d,\"h\":%d,\"a\":%d,\"la\":\"%s\",\"lo\":\"%s\","
+                                              "\"ba\":%d,\"lp\":%d,\"e\":0}";
+
+// a forged message has a payload that was changed after signing
+static void forge(char *payload, double forged) {
+    if (rand() < forged * RAND_MAX) payload[5] = payload[5] == '9' ? '0' : (char) (payload[5] + 1);
+}
+
+// print signed messages of a number of devices, some with a forged payload, batch signed if window > 1
+static void generate(size_t count, int devices, protocol_mode_t mode, double forged, int window) {
+    uc_ed25519_key *keys = calloc((size_t) devices, sizeof(uc_ed25519_key));
+    protocol_identity_t *identities = calloc((size_t) devices, sizeof(protocol_identity_t));
+
+    for (int d = 0; d < devices; d++) {
+        char imei[16];
+        snprintf(imei, sizeof(imei), "35%013d", d);
+        uc_ecc_create_key(&keys[d]);
+        identities[d].auth = uc_sha512_encoded((const unsigned char *) imei, strlen(imei));
+        identities[d].key = uc_base64_encode(keys[d].p, ED25519_PUB_KEY_SIZE);
+        if (mode == PROTOCOL_SESSION) {
+            // the identity message binds the session ID, it always carries the key
+            protocol_new_session(&identities[d]);
+            char *payload = protocol_identity_payload(&identities[d]);
+            char *signature = uc_ecc_sign_encoded(&keys[d], (const unsigned char *) payload, strlen(payload));
+            char *message = protocol_message(PROTOCOL_FULL, &identities[d], signature, payload);
+            puts(message);
+            free(message);
+            free(signature);
+            free(payload);
+        }
+    }
+
+    // messages go round the devices, a block holds a window of messages of every device
+    const size_t block = (size_t) devices * (size_t) window;
+    char (*payloads)[256] = malloc(block * sizeof(*payloads));
+    char **signatures = calloc((size_t) devices, sizeof(char *));
+    merkle_tree_t *trees = malloc((size_t) devices * sizeof(merkle_tree_t));
+
+    for (size_t base = 0; base < count; base += block) {
+        const size_t n = count - base < block ? count - base : block;
+        for (size_t j = 0; j < n; j++) {
+            const size_t i = base + j;
+            snprintf(payloads[j], sizeof(payloads[j]), generated_template, 2000 + rand() % 500, 1000 + rand() % 30,
+                     4000 + rand() % 2000, 3400 + rand() % 100, "52.520008", "13.404954", 100, (int) (i / devices));
+        }
+
+        if (window > 1) {
+            // the window of a device: its messages in this block, the root is signed once
+            for (int d = 0; d < devices; d++) merkle_init(&trees[d]);
+            for (size_t j = 0; j < n; j++) {
+                merkle_add(&trees[j % (size_t) devices], (const unsigned char *) payloads[j], strlen(payloads[j]));
+            }
+            for (int d = 0; d < devices && (size_t) d < n; d++) {
+                const unsigned char *root = merkle_build(&trees[d]);
+                signatures[d] = uc_ecc_sign_encoded(&keys[d], root, MERKLE_HASH_SIZE);
+            }
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            const int d = (int) (j % (size_t) devices);
+            char *message;
+            if (window > 1) {
+                unsigned char hashes[MERKLE_MAX_DEPTH][MERKLE_HASH_SIZE];
+                const uint8_t index = (uint8_t) (j / (size_t) devices);
+                const size_t len = merkle_proof(&trees[d], index, hashes);
+                char *proof = protocol_proof(index, trees[d].count, (const unsigned char (*)[MERKLE_HASH_SIZE]) hashes, len);
+                forge(payloads[j], forged);
+                message = protocol_batch_message(mode, &identities[d], signatures[d], proof, payloads[j]);
+                free(proof);
+            } else {
+                char *signature = uc_ecc_sign_encoded(&keys[d], (const unsigned char *) payloads[j],
+                                                      strlen(payloads[j]));
+                forge(payloads[j], forged);
+                message = protocol_message(mode, &identities[d], signature, payloads[j]);
+                free(signature);
+            }
+            puts(message);
+            free(message);
+        }
+        for (int d = 0; d < devices; d++) {
+            free(signatures[d]);
+            signatures[d] = NULL;
+        }
+    }
+    free(trees);
+    free(signatures);
+    free(payloads);
+}
+
+// === MAIN ===
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [options] [file]\n"
+                    "  -t <threads>   worker threads (default: all cores)\n"
+                    "  -s             scaling report from 1 to the number of threads\n"
+                    "  -v             list the messages that failed verification and the crypto log\n"
+                    "  -g <count>     generate signed test messages instead (to stdout)\n"
+                    "  -d <devices>   devices of the generated messages (default 100)\n"
+                    "  -S             generate session mode messages\n"
+                    "  -F <rate>      fraction of generated messages with a forged payload (default 0)\n"
+                    "  -b <window>    batch sign the generated messages, one Merkle root per window (max %d)\n",
+            name, MERKLE_MAX_LEAVES);
+}
+
+int main(int argc, char *argv[]) {
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    bool scaling = false, verbose = false;
+    size_t generate_count = 0;
+    int devices = 100;
+    protocol_mode_t mode = PROTOCOL_FULL;
+    double forged = 0;
+    int window = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:svg:d:SF:b:h")) != -1) {
+        switch (opt) {
+            case 't': threads = atoi(optarg); break;
+            case 's': scaling = true; break;
+            case 'v': verbose = true; break;
+            case 'g': generate_count = (size_t) atol(optarg); break;
+            case 'd': devices = atoi(optarg); break;
+            case 'S': mode = PROTOCOL_SESSION; break;
+            case 'F': forged = atof(optarg); break;
+            case 'b': window = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (!uc_init()) return 1;
+
+    if (generate_count) {
+        if (window < 1) window = 1;
+        if (window > MERKLE_MAX_LEAVES) window = MERKLE_MAX_LEAVES;
+        generate(generate_count, devices > 0 ? devices : 1, mode, forged, window);
+        return 0;
+    }
+
+    FILE *in = optind < argc ? fopen(argv[optind], "rb") : stdin;
+    if (!in) {
+        perror(argv[optind]);
+        return 1;
+    }
+    size_t len;
+    char *data = read_all(in, &len);
+    if (in != stdin) fclose(in);
+    split_lines(data, len);
+    if (!message_count) {
+        fprintf(stderr, "no messages\n");
+        return 1;
+    }
+    results = calloc(message_count, 1);
+    collect_sessions();
+
+    if (scaling) {
+        printf("%-8s %10s %8s %10s %7s\n", "threads", "msgs/s", "speedup", "efficiency", "steals");
+        double base = 0;
+        for (int t = 1; t <= threads; t = t < threads && t * 2 > threads ? threads : t * 2) {
+            const double seconds = run(t);
+            const double rate = message_count / seconds;
+            if (t == 1) base = rate;
+            uint32_t steals = 0;
+            for (int i = 0; i < t; i++) steals += workers[i].steals;
+            printf("%-8d %10.0f %8.2f %9.0f%% %7u\n", t, rate, rate / base, 100 * rate / base / t, steals);
+        }
+    } else {
+        const double seconds = run(threads);
+        printf("%zu messages in %.3f s on %d threads, %.0f msgs/s\n", message_count, seconds, threads,
+               message_count / seconds);
+    }
+
+    uint64_t counts[VERIFY_RESULTS] = {0};
+    uint64_t signature_checks = 0;
+    uint32_t imports = 0;
+    for (int i = 0; i < worker_count; i++) {
+        for (int r = 0; r < VERIFY_RESULTS; r++) counts[r] += workers[i].counts[r];
+        signature_checks += workers[i].signature_checks;
+        imports += workers[i].key_imports;
+    }
+    for (int r = 0; r < VERIFY_RESULTS; r++) printf("%-16s %llu\n", result_names[r], (unsigned long long) counts[r]);
+    printf("%-16s %llu\n", "signature checks", (unsigned long long) signature_checks);
+    printf("%-16s %u\n", "key imports", imports);
+    if (identities_bound || identities_rejected)
+        printf("%-16s %u bound, %u with a bad signature, %u conflicting\n", "sessions", identities_bound,
+               identities_rejected, session_conflicts);
+
+    if (verbose) {
+        for (size_t i = 0; i < message_count; i++)
+            if (results[i] != VERIFY_OK) fprintf(stderr, "%zu: %s\n", i + 1, result_names[results[i]]);
+        // the crypto unit logs decoding errors
+        log_flush();
+    }
+    return counts[VERIFY_OK] == message_count ? 0 : 2;
+}
@@ -0,0 +1,45 @@
+/*!
+ * @file
+ * @brief Monotonic uptime clock.
+ *
+ * @date 2017-03-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#include "mbed.h"
+#include "uptime.h"
+
+static uint32_t last_ticks = 0;
+static uint64_t elapsed_us = 0;
+
+uint32_t uptime_ms(void) {
+    core_util_critical_section_enter();
+    const uint32_t ticks = us_ticker_read();
+    elapsed_us += (uint32_t) (ticks - last_ticks);
+    last_ticks = ticks;
+    const uint32_t ms = (uint32_t) (elapsed_us / 1000);
+    core_util_critical_section_exit();
+
+    return ms;
+}
+
+void uptime_add_ms(uint32_t ms) {
+    core_util_critical_section_enter();
+    elapsed_us += (uint64_t) ms * 1000;
+    core_util_critical_section_exit();
+}
@@ -0,0 +1,47 @@
+/*!
+ * @file
+ * @brief Monotonic uptime clock.
+ *
+ * The us ticker wraps after ~71 minutes, this clock accumulates the ticker
+ * deltas into a millisecond counter that keeps running as long as it is
+ * read at least once per wrap period (the sensor thread reads it every sample).
+ *
+ * @date 2017-03-20
+ *
+ * @copyright &copys; 2017 ubirch GmbH (https://ubirch.com)
+ *
+ * ```
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * ```
+ */
+
+#ifndef _UPTIME_H_
+#define _UPTIME_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! @brief Milliseconds since boot, wraps after ~49 days
+uint32_t uptime_ms(void);
+
+//! @brief Add time that passed while the us ticker was stopped (deep sleep)
+void uptime_add_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _UPTIME_H_